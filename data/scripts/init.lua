@@ -227,6 +227,9 @@ function createComponent(name, parent)
 		fpslimit = createProperty(-1),
 		frames = 0,
 		noRenderSignal = false,
+		trackDamage = false,
+		renderedFrames = 0,
+		skippedFrames = 0,
 		clip = createProperty(false),
 		clip_size = createProperty { 0, 0, 0, 0 },
         draw = function (comp) drawAll(comp.components); end,
@@ -288,11 +291,51 @@ panel = createComponent("panel")
 popups = createComponent("popups", panel)
 
 
+-- returns property read once per frame at start of update
+-- or nil if property can't be added to snapshot
+local function snapshotProperty(ref, typeName, default)
+    local slot = addSnapshotProp(ref, typeName, default or 0)
+    if not slot then
+        return nil
+    end
+    if 'int' == typeName then
+        return {
+            __property = 1;
+            __ref = ref;
+            __type = typeName;
+            get = function() return getSnapshoti(slot); end;
+            set = function(self, value) setSnapshoti(slot, value); end;
+        }
+    elseif 'float' == typeName then
+        return {
+            __property = 1;
+            __ref = ref;
+            __type = typeName;
+            get = function() return getSnapshotf(slot); end;
+            set = function(self, value) setSnapshotf(slot, value); end;
+        }
+    else
+        return {
+            __property = 1;
+            __ref = ref;
+            __type = typeName;
+            get = function() return getSnapshotd(slot); end;
+            set = function(self, value) setSnapshotd(slot, value); end;
+        }
+    end
+end
+
 -- returns simulator double property
-function globalPropertyd(name, default)
+-- if snapshot is true property is read once per frame
+function globalPropertyd(name, default, snapshot)
     local ref = findProp(name, "double")
+    if snapshot and ref then
+        return snapshotProperty(ref, 'double', default)
+    end
     return {
         __property = 1;
+        __ref = ref;
+        __type = "double";
         get = function() return getPropd(ref, default); end;
         set = function(self, value) setPropd(ref, value); end;
     }
@@ -306,17 +349,25 @@ function createGlobalPropertyd(name, default, notPublishInDRE)
 end
 
 -- create new global functional double property
-function createFuncPropertyd(name, getter, setter)
-    local ref = createFuncProp(name, 'double', getter, setter)
+-- if cache is true getter is called once per frame, if cache is number
+-- getter result is reused for cache seconds
+function createFuncPropertyd(name, getter, setter, cache)
+    local ref = createFuncProp(name, 'double', getter, setter, 0, cache)
     return globalPropertyd(name)
 end
 
 
 -- returns simulator float property
-function globalPropertyf(name, default)
+-- if snapshot is true property is read once per frame
+function globalPropertyf(name, default, snapshot)
     local ref = findProp(name, "float")
+    if snapshot and ref then
+        return snapshotProperty(ref, 'float', default)
+    end
     return {
         __property = 1;
+        __ref = ref;
+        __type = "float";
         get = function() return getPropf(ref, default); end;
         set = function(self, value) setPropf(ref, value); end;
     }
@@ -330,17 +381,24 @@ function createGlobalPropertyf(name, default, notPublishInDRE)
 end
 
 -- create new global functional float property
-function createFuncPropertyf(name, getter, setter)
-    local ref = createFuncProp(name, 'float', getter, setter)
+-- cache has same meaning as in createFuncPropertyd
+function createFuncPropertyf(name, getter, setter, cache)
+    local ref = createFuncProp(name, 'float', getter, setter, 0, cache)
     return globalPropertyf(name)
 end
 
 
 -- returns simulator int property
-function globalPropertyi(name, default)
+-- if snapshot is true property is read once per frame
+function globalPropertyi(name, default, snapshot)
     local ref = findProp(name, "int")
+    if snapshot and ref then
+        return snapshotProperty(ref, 'int', default)
+    end
     return {
         __property = 1;
+        __ref = ref;
+        __type = "int";
         get = function(doNotCall) return getPropi(ref, default); end;
         set = function(self, value) setPropi(ref, value); end;
     }
@@ -354,8 +412,9 @@ function createGlobalPropertyi(name, default, notPublishInDRE)
 end
 
 -- create new global functional int property
-function createFuncPropertyi(name, getter, setter)
-    local ref = createFuncProp(name, 'int', getter, setter)
+-- cache has same meaning as in createFuncPropertyd
+function createFuncPropertyi(name, getter, setter, cache)
+    local ref = createFuncProp(name, 'int', getter, setter, 0, cache)
     return globalPropertyi(name)
 end
 
@@ -364,6 +423,8 @@ function globalPropertys(name, default)
     local ref = findProp(name, "string")
     return {
         __property = 1;
+        __ref = ref;
+        __type = "string";
         get = function(doNotCall) return getProps(ref, default); end;
         set = function(self, value) setProps(ref, value); end;
     }
@@ -377,16 +438,99 @@ function createGlobalPropertys(name, maxLen, default, notPublishInDRE)
 end
 
 -- create new global functional string property
-function createFuncPropertys(name, getter, setter, maxSize)
-    local ref = createFuncProp(name, 'string', getter, setter, maxSize)
+-- cache has same meaning as in createFuncPropertyd
+function createFuncPropertys(name, getter, setter, maxSize, cache)
+    local ref = createFuncProp(name, 'string', getter, setter, maxSize, cache)
     return globalPropertys(name)
 end
 
 
+-- returns array property object using specified range accessors
+-- get() returns table of all elements, getRange reads count elements 
+-- starting at zero-based offset into new table or into optional table 
+-- or FFI array buf.  FFI pointers need explicit count, FFI arrays are
+-- never accessed past their size
+local function arrayProperty(ref, getRange, setRange)
+    return {
+        __property = 1;
+        get = function() return getRange(ref, 0); end;
+        set = function(self, value) setRange(ref, 0, value); end;
+        size = function(self) return getPropArraySize(ref); end;
+        getRange = function(self, offset, count, buf) 
+            return getRange(ref, offset, count, buf)
+        end;
+        setRange = function(self, offset, values, count) 
+            setRange(ref, offset, values, count)
+        end;
+    }
+end
+
+-- returns simulator float array property
+function globalPropertyfa(name)
+    local ref = findProp(name, "floatarray")
+    return arrayProperty(ref, 
+            function(...) return getPropfa(...); end,
+            function(...) setPropfa(...); end)
+end
+
+-- create new float array property of size elements
+-- default is optional table of initial values
+function createGlobalPropertyfa(name, size, default, notPublishInDRE)
+	if notPublishInDRE == nil then notPublishInDRE = 0 end
+    local ref = createProp(name, 'floatarray', size, default, notPublishInDRE)
+    return globalPropertyfa(name)
+end
+
+-- returns simulator int array property
+function globalPropertyia(name)
+    local ref = findProp(name, "intarray")
+    return arrayProperty(ref, 
+            function(...) return getPropia(...); end,
+            function(...) setPropia(...); end)
+end
+
+-- create new int array property of size elements
+-- default is optional table of initial values
+function createGlobalPropertyia(name, size, default, notPublishInDRE)
+	if notPublishInDRE == nil then notPublishInDRE = 0 end
+    local ref = createProp(name, 'intarray', size, default, notPublishInDRE)
+    return globalPropertyia(name)
+end
+
+
+-- create property computed from other properties
+-- inputs is table of global or computed properties, compute is function 
+-- called with values of inputs only when some of them changed.
+-- If publish is name of property, value is computed every frame and 
+-- written to that double property, otherwise it is computed on read.
+function computedProperty(name, inputs, compute, publish)
+    local id = createComputedProp(name, inputs, compute, publish)
+    if not id then
+        return nil
+    end
+    return {
+        __property = 1;
+        __computed = id;
+        get = function() return getComputedProp(id); end;
+        set = function(self, value) end;
+    }
+end
+
+
+-- properties read by component being rendered with damage tracking
+-- or nil if there is no such component
+local currentDeps = nil
+
+-- true if component being rendered reads values which can't be tracked
+local currentVolatile = false
+
 -- returns value of property
 -- traverse recursive properties
 function get(property, doNotCall)
     if isProperty(property) then
+        if currentDeps then
+            currentDeps[property] = true
+        end
         if property.get then
             return property:get(doNotCall)
         else
@@ -398,6 +542,7 @@ function get(property, doNotCall)
         end
     else
         if (not doNotCall) and ("function" == type(property)) then
+            currentVolatile = true
             return property()
         else
             return property
@@ -475,6 +620,163 @@ function renderToTarget(v)
 	restoreRenderTarget()
 end
 
+-- placeholder of nil values in dependencies table
+local NIL_VALUE = { }
+
+-- copy value of property to compare it later
+local function copyValue(value)
+    if nil == value then
+        return NIL_VALUE
+    elseif 'table' == type(value) then
+        local copy = { }
+        for k, v in pairs(value) do
+            copy[k] = v
+        end
+        return copy
+    else
+        return value
+    end
+end
+
+-- returns true if value of property equals to copy made by copyValue
+local function sameValue(value, copy)
+    if nil == value then
+        return copy == NIL_VALUE
+    elseif 'table' == type(value) then
+        if 'table' ~= type(copy) then
+            return false
+        end
+        for k, v in pairs(value) do
+            if copy[k] ~= v then
+                return false
+            end
+        end
+        for k, _ in pairs(copy) do
+            if nil == value[k] then
+                return false
+            end
+        end
+        return true
+    else
+        return value == copy
+    end
+end
+
+-- returns true if any property read by component during last rendering
+-- changed its value
+local function dependenciesChanged(v)
+    if v.volatile or (not v.dependencies) then
+        return true
+    end
+    local parentDeps = currentDeps
+    currentDeps = nil
+    local changed = false
+    for property, copy in pairs(v.dependencies) do
+        if not sameValue(get(property), copy) then
+            changed = true
+            break
+        end
+    end
+    currentDeps = parentDeps
+    return changed
+end
+
+-- properties returning version of texture content by texture ID, used
+-- as dependencies of tracked components
+local textureDependencies = { }
+
+-- make textures drawn by component dependencies of component
+local function trackTextures(ids)
+    for _, id in ipairs(ids) do
+        local dependency = textureDependencies[id]
+        if not dependency then
+            dependency = {
+                __property = 1;
+                get = function() return getTextureVersion(id); end;
+                set = function(self, value) end;
+            }
+            textureDependencies[id] = dependency
+        end
+        currentDeps[dependency] = true
+    end
+end
+
+-- draw to component render target and remember values of all properties
+-- and textures read by component
+local function renderTrackedTarget(v)
+    local parentDeps, parentVolatile = currentDeps, currentVolatile
+    currentDeps, currentVolatile = { }, false
+
+    local mark = beginTextureTracking()
+    renderToTarget(v)
+    trackTextures(endTextureTracking(mark))
+
+    local deps, volatile = currentDeps, currentVolatile
+    currentDeps = nil
+    local values = { }
+    for property, _ in pairs(deps) do
+        values[property] = copyValue(get(property))
+    end
+    v.dependencies = values
+    v.volatile = volatile
+    currentDeps, currentVolatile = parentDeps, parentVolatile
+end
+
+-- frame rate period property, found on first use
+local frameRatePeriod = nil
+
+-- returns true if fps limit of component allows to render it this frame
+local function fpsLimitAllows(v)
+    local limit = get(v.fpslimit)
+    if limit == -1 then
+        return true
+    end
+    if not frameRatePeriod then
+        frameRatePeriod = globalPropertyf("sim/operation/misc/frame_rate_period")
+    end
+    -- read directly so it doesn't become dependency of component
+    local cur_fps = 1.0 / frameRatePeriod.get()
+    return (limit >= cur_fps) or (v.frames > cur_fps / limit)
+end
+
+-- update render target of component if needed
+local function updateRenderTarget(v)
+    local allowed = fpsLimitAllows(v)
+    local render = allowed
+    if render and v.trackDamage then
+        render = dependenciesChanged(v)
+    end
+
+    if render then
+        if v.trackDamage then
+            renderTrackedTarget(v)
+        else
+            renderToTarget(v)
+        end
+        v.frames = 0
+        v.renderedFrames = v.renderedFrames + 1
+    else
+        v.frames = v.frames + 1
+        v.skippedFrames = v.skippedFrames + 1
+    end
+
+    -- component is part of enclosing tracked component even if skipped.
+    -- Component skipped by fps limit is updated only when enclosing
+    -- component is rendered again, so enclosing one can't be skipped
+    if currentDeps then
+        if not allowed then
+            currentVolatile = true
+        elseif v.dependencies then
+            for property, _ in pairs(v.dependencies) do
+                currentDeps[property] = true
+            end
+            if v.volatile then
+                currentVolatile = true
+            end
+        end
+    end
+end
+
 -- draw component
 function drawComponent(v)
     if v and toboolean(get(v.visible)) then
@@ -482,19 +784,7 @@ function drawComponent(v)
         local renderTargetExist = toboolean(get(v.mask))
         if renderTargetExist then
 			if not v.noRenderSignal then
-				local cur_fps = 1.0 / get(globalPropertyf("sim/operation/misc/frame_rate_period"))
-				local limit = get(v.fpslimit)
-				if limit == -1 or limit >= cur_fps then
-					renderToTarget(v)
-					v.frames = 0
-				else 
-					if v.frames > cur_fps / limit then
-						renderToTarget(v)
-						v.frames = 0
-					else 
-						v.frames = v.frames + 1
-					end
-				end
+				updateRenderTarget(v)
 			end
 			local pos = get(v.position)
 			setTranslation(pos[1], pos[2], pos[3], pos[4], v.size[1], v.size[2])
@@ -694,7 +984,7 @@ function loadComponent(name, fileName)
         f()
         finishComponentsCreation()
 		
-		if get(t.fpslimit) ~= -1 then
+		if get(t.fpslimit) ~= -1 or t.trackDamage then
 			set(t.mask, true)
 		end
 		
@@ -774,12 +1064,17 @@ cursor = {
 
 -- Draw panel on screen
 function drawPanelLayer()
+    -- drop tracking state left by errors in previous frame
+    currentDeps, currentVolatile = nil, false
+    resetTextureTracking()
     drawComponent(panel)
 end
 
 
 -- draw popup panels
 function drawPopupsLayer()
+    currentDeps, currentVolatile = nil, false
+    resetTextureTracking()
     drawComponent(popups)
 
     if cursor.shape then
@@ -1589,3 +1884,241 @@ BLEND_EQUATION_REVERSE_SUBTRACT = 0x800B
 
 -- Default blend equation value		
 BLEND_EQUATION_ADD = 0x8006
+
+
+-- Classic C functions replaced by FFI wrappers, e.g. to compare them.
+-- Empty if FFI isn't available
+classicFunctions = { }
+
+-- Bind hot functions through LuaJIT FFI so calling code can be compiled.
+-- Keep in sync with SaslFfiApi in libavionics/ffiapi.h
+local function bindFfiApi()
+    if not (jit and getFfiApi) then
+        return
+    end
+    local ok, ffi = pcall(require, 'ffi')
+    if not ok then
+        return
+    end
+
+    ffi.cdef[[
+        typedef struct SaslFfiApi {
+            int (*get_propi)(void *avionics, void *prop, int dflt, 
+                    int *blocked);
+            int (*set_propi)(void *avionics, void *prop, int value);
+            float (*get_propf)(void *avionics, void *prop, float dflt, 
+                    int *blocked);
+            int (*set_propf)(void *avionics, void *prop, float value);
+            double (*get_propd)(void *avionics, void *prop, double dflt, 
+                    int *blocked);
+            int (*set_propd)(void *avionics, void *prop, double value);
+            void (*draw_texture)(void *avionics, void *tex, double x, double y,
+                    double width, double height, float r, float g, float b, 
+                    float a, int is_upside_down);
+            void (*draw_rectangle)(void *avionics, double x, double y,
+                    double width, double height,
+                    double r, double g, double b, double a);
+            void (*draw_line)(void *avionics, double x1, double y1,
+                    double x2, double y2, double r, double g, double b, 
+                    double a);
+            void (*draw_text)(void *avionics, void *font, double x, double y,
+                    const char *str, float r, float g, float b, float a);
+            int (*get_propia)(void *avionics, void *prop, int *values, 
+                    int offset, int count);
+            void (*set_propia)(void *avionics, void *prop, 
+                    const int *values, int offset, int count);
+            int (*get_propfa)(void *avionics, void *prop, float *values, 
+                    int offset, int count);
+            void (*set_propfa)(void *avionics, void *prop, 
+                    const float *values, int offset, int count);
+            int (*get_snapshoti)(void *avionics, int slot);
+            float (*get_snapshotf)(void *avionics, int slot);
+            double (*get_snapshotd)(void *avionics, int slot);
+            void (*draw_sprites)(void *avionics, void *tex, 
+                    const double *sprites, int count);
+        } SaslFfiApi;
+    ]]
+
+    local ptr, avionics = getFfiApi()
+    local api = ffi.cast('SaslFfiApi*', ptr)
+
+    for _, name in ipairs({ 'getPropi', 'setPropi', 'getPropf', 'setPropf',
+            'getPropd', 'setPropd', 'getPropia', 'setPropia', 'getPropfa',
+            'setPropfa', 'getSnapshoti', 'getSnapshotf', 'getSnapshotd',
+            'drawSprites', 'drawTexture', 'drawRectangle', 'drawLine',
+            'drawText' }) do
+        classicFunctions[name] = _G[name]
+    end
+
+    -- Functional properties call Lua which isn't allowed inside FFI calls.
+    -- C side refuses to call them and such properties are accessed by
+    -- classic functions from then on.  Classic functions also handle
+    -- invalid arguments.
+    local classicRefs = {}
+    local blocked = ffi.new('int[1]')
+    local function propFunctions(classicGet, classicSet, ffiGet, ffiSet)
+        local get = function(ref, default)
+            if ('userdata' ~= type(ref)) or classicRefs[ref] then
+                return classicGet(ref, default)
+            end
+            local v = ffiGet(avionics, ref, tonumber(default) or 0, blocked)
+            if 0 ~= blocked[0] then
+                classicRefs[ref] = true
+                return classicGet(ref, default)
+            end
+            return v
+        end
+        local set = function(ref, value)
+            if ('userdata' ~= type(ref)) or classicRefs[ref] then
+                classicSet(ref, value)
+            elseif 0 ~= ffiSet(avionics, ref, tonumber(value) or 0) then
+                classicRefs[ref] = true
+                classicSet(ref, value)
+            end
+        end
+        return get, set
+    end
+
+    getPropi, setPropi = propFunctions(getPropi, setPropi, 
+            api.get_propi, api.set_propi)
+    getPropf, setPropf = propFunctions(getPropf, setPropf, 
+            api.get_propf, api.set_propf)
+    getPropd, setPropd = propFunctions(getPropd, setPropd, 
+            api.get_propd, api.set_propd)
+
+    -- FFI arrays are filled directly, tables are handled by C wrappers.
+    -- Pointers don't carry length, so count is required for them, arrays
+    -- are never accessed past their size.  Element type is checked by
+    -- conversion of FFI call arguments.
+    local function rangeFunctions(getRange, setRange, ffiGet, ffiSet, 
+            elemType)
+        local ptrType = ffi.typeof(elemType .. ' *')
+        local elemSize = ffi.sizeof(elemType)
+        local function bufferCount(buf, count)
+            if ffi.istype(ptrType, buf) then
+                if not count then
+                    error('count is required for FFI pointer', 3)
+                end
+                return count
+            end
+            local size = math.floor((ffi.sizeof(buf) or 0) / elemSize)
+            if (not count) or (count > size) then
+                count = size
+            end
+            return count
+        end
+        local get = function(ref, offset, count, buf)
+            if 'cdata' == type(buf) then
+                count = bufferCount(buf, count)
+                if 0 >= count then
+                    return 0
+                end
+                return ffiGet(avionics, ref, buf, offset or 0, count)
+            end
+            return getRange(ref, offset, count, buf)
+        end
+        local set = function(ref, offset, values, count)
+            if 'cdata' == type(values) then
+                count = bufferCount(values, count)
+                if 0 < count then
+                    ffiSet(avionics, ref, values, offset or 0, count)
+                end
+            else
+                setRange(ref, offset, values, count)
+            end
+        end
+        return get, set
+    end
+    getSnapshoti = function(slot)
+        return api.get_snapshoti(avionics, slot)
+    end
+    getSnapshotf = function(slot)
+        return api.get_snapshotf(avionics, slot)
+    end
+    getSnapshotd = function(slot)
+        return api.get_snapshotd(avionics, slot)
+    end
+
+    getPropia, setPropia = rangeFunctions(getPropia, setPropia, 
+            api.get_propia, api.set_propia, 'int')
+    getPropfa, setPropfa = rangeFunctions(getPropfa, setPropfa, 
+            api.get_propfa, api.set_propfa, 'float')
+
+    -- FFI buffer of sprites is passed directly, tables are handled by C
+    -- wrapper.  Count is required for pointers and limited by size of
+    -- arrays, like in range functions
+    local spriteStride = 10
+    local doublePtr = ffi.typeof('double *')
+    local spriteSize = spriteStride * ffi.sizeof('double')
+    local cDrawSprites = drawSprites
+    drawSprites = function(tex, sprites, count)
+        if 'cdata' ~= type(sprites) then
+            return cDrawSprites(tex, sprites, count)
+        end
+        if 'userdata' ~= type(tex) then
+            return
+        end
+        count = tonumber(count)
+        if ffi.istype(doublePtr, sprites) then
+            if not count then
+                error('count is required for FFI pointer', 2)
+            end
+        else
+            local size = math.floor((ffi.sizeof(sprites) or 0) / spriteSize)
+            if (not count) or (count > size) then
+                count = size
+            end
+        end
+        if 0 < count then
+            api.draw_sprites(avionics, tex, sprites, count)
+        end
+    end
+
+    -- negative color means background color, like in C wrappers.
+    -- Invalid texture or font is silently ignored, like in C wrappers
+    drawTexture = function(tex, x, y, width, height, r, g, b, a, upsideDown)
+        if 'userdata' ~= type(tex) then
+            return
+        end
+        if not b then
+            r, g, b = -1, 0, 0
+        end
+        if upsideDown and upsideDown ~= 0 then
+            upsideDown = 1
+        else
+            upsideDown = 0
+        end
+        api.draw_texture(avionics, tex, tonumber(x) or 0, tonumber(y) or 0,
+                tonumber(width) or 0, tonumber(height) or 0, 
+                tonumber(r) or 0, tonumber(g) or 0, tonumber(b) or 0, 
+                tonumber(a) or -1, upsideDown)
+    end
+    drawRectangle = function(x, y, width, height, r, g, b, a)
+        api.draw_rectangle(avionics, tonumber(x) or 0, tonumber(y) or 0, 
+                tonumber(width) or 0, tonumber(height) or 0,
+                tonumber(r) or 0, tonumber(g) or 0, tonumber(b) or 0, 
+                tonumber(a) or 0)
+    end
+    drawLine = function(x1, y1, x2, y2, r, g, b, a)
+        api.draw_line(avionics, tonumber(x1) or 0, tonumber(y1) or 0, 
+                tonumber(x2) or 0, tonumber(y2) or 0,
+                tonumber(r) or 0, tonumber(g) or 0, tonumber(b) or 0, 
+                tonumber(a) or 0)
+    end
+    drawText = function(font, x, y, str, r, g, b, a)
+        if ('userdata' ~= type(font)) or (nil == str) then
+            return
+        end
+        if 'string' ~= type(str) then
+            str = tostring(str)
+        end
+        if not b then
+            r, g, b = -1, 0, 0
+        end
+        api.draw_text(avionics, font, tonumber(x) or 0, tonumber(y) or 0, 
+                str, tonumber(r) or 0, tonumber(g) or 0, tonumber(b) or 0, 
+                tonumber(a) or -1)
+    end
+end
+
+bindFfiApi()
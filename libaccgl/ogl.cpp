@@ -3,6 +3,8 @@
 #include <list>
 #include <map>
 #include <vector>
+#include <algorithm>
+#include <math.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <assert.h>
@@ -155,9 +157,38 @@ typedef void(*BlendColor)(GLfloat R, GLfloat G, GLfloat B, GLfloat A);
 static BlendColor glBlendColor = NULL;
 #endif
 
-// rectangle, for now used to define clip areas only
-struct Rect {
-	double x, y, width, height;
+// stencil bits of clip areas, value is depth of stencil clipping
+#define CLIP_STENCIL_BITS 0x7F
+
+// stencil bit set by mask form
+#define MASK_STENCIL_BIT 0x80
+
+// state of masking
+enum MaskMode {
+	// masking disabled
+	MASK_NONE,
+
+	// mask form is drawn to stencil buffer
+	MASK_FORM,
+
+	// drawing is limited by mask form
+	MASK_UNDER
+};
+
+// clip area in window coordinates
+struct ClipArea {
+	// scissor rectangle: bounding box of area intersected with parent area
+	GLint x, y;
+	GLsizei width, height;
+
+	// depth of stencil clipping or 0 if area clipped by scissor only
+	int stencilRef;
+
+	// true if area itself is not axis aligned and drawn to stencil buffer
+	bool stencil;
+
+	// transformed corners of area
+	GLfloat quad[8];
 };
 
 // graphics context
@@ -246,6 +277,28 @@ struct OglCanvas
 
 	// texture assigned to current fbo
 	int currentFboTex;
+
+	// stack of nested clip areas
+	std::vector<ClipArea> clipStack;
+
+	// size of clip stack when render targets was set
+	std::vector<std::size_t> clipBase;
+
+	// masking state when render targets was set
+	std::vector<MaskMode> maskBase;
+
+	// true if scissor test is enabled
+	bool scissorEnabled;
+
+	// scissor rectangle applied to OpenGL state
+	GLint scissor[4];
+
+	// stencil clipping depth applied to OpenGL state
+	// or -1 if stencil state must be applied again
+	int stencilRef;
+
+	// state of masking
+	MaskMode masking;
 };
 
 
@@ -294,6 +347,13 @@ static void drawBegin(struct SaslGraphicsCallbacks *canvas)
 
 	c->transform.clear();
 	c->transform.push_back(Matrix::identity());
+
+	c->clipStack.clear();
+	c->clipBase.clear();
+	c->maskBase.clear();
+	c->scissorEnabled = false;
+	c->stencilRef = 0;
+	c->masking = MASK_NONE;
 }
 
 
@@ -545,7 +605,10 @@ static void drawTexturedTriangle(struct SaslGraphicsCallbacks *canvas,
 	addVertex(c, x3, y3, r3, g3, b3, a3, u3, v3);
 }
 
-// enable masking before drawing its form
+static void applyClipArea(OglCanvas *c);
+
+// enable masking before drawing its form.  mask uses its own stencil
+// bit, so clip areas stay valid
 static void drawMask(struct SaslGraphicsCallbacks* canvas) {
 	OglCanvas* c = (OglCanvas*)canvas;
 	assert(canvas);
@@ -553,12 +616,13 @@ static void drawMask(struct SaslGraphicsCallbacks* canvas) {
 	dumpBuffers(c);
 
 	glPushAttrib(GL_STENCIL_BUFFER_BIT);
+	glStencilMask(MASK_STENCIL_BIT);
+	glClearStencil(0);
 	glClear(GL_STENCIL_BUFFER_BIT);
-	glEnable(GL_STENCIL_TEST);
 
-	glStencilMask(1);
-	glStencilFunc(GL_ALWAYS, 1, 1);
-	glStencilOp(GL_KEEP, GL_KEEP, GL_REPLACE);
+	c->masking = MASK_FORM;
+	c->stencilRef = -1;
+	applyClipArea(c);
 	glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
 }
 
@@ -571,8 +635,9 @@ static void drawUnderMask(struct SaslGraphicsCallbacks* canvas) {
 
 	glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
 
-	glStencilFunc(GL_EQUAL, 1, 1);
-	glStencilOp(GL_KEEP, GL_KEEP, GL_KEEP);
+	c->masking = MASK_UNDER;
+	c->stencilRef = -1;
+	applyClipArea(c);
 }
 
 // disable masking
@@ -582,41 +647,199 @@ static void drawMaskEnd(struct SaslGraphicsCallbacks* canvas) {
 
 	dumpBuffers(c);
 
-	glDisable(GL_STENCIL_TEST);
 	glPopAttrib();
 
+	// clip areas may be changed while masking
+	c->masking = MASK_NONE;
+	c->stencilRef = -1;
+	applyClipArea(c);
+}
+
+// returns current clip area or NULL if clipping disabled
+static const ClipArea* getClipArea(OglCanvas *c)
+{
+	std::size_t base = c->clipBase.empty() ? 0 : c->clipBase.back();
+	if (c->clipStack.size() > base)
+		return &c->clipStack.back();
+	else
+		return NULL;
+}
+
+
+// make OpenGL scissor and stencil state match top of clip stack.
+// buffers are flushed only if state really changed
+static void applyClipArea(OglCanvas *c)
+{
+	const ClipArea *area = getClipArea(c);
+
+	if (area) {
+		if ((!c->scissorEnabled) || (c->scissor[0] != area->x) ||
+			(c->scissor[1] != area->y) || (c->scissor[2] != area->width) ||
+			(c->scissor[3] != area->height))
+		{
+			dumpBuffers(c);
+			if (!c->scissorEnabled)
+				glEnable(GL_SCISSOR_TEST);
+			glScissor(area->x, area->y, area->width, area->height);
+			c->scissorEnabled = true;
+			c->scissor[0] = area->x;
+			c->scissor[1] = area->y;
+			c->scissor[2] = area->width;
+			c->scissor[3] = area->height;
+		}
+	} else if (c->scissorEnabled) {
+		dumpBuffers(c);
+		glDisable(GL_SCISSOR_TEST);
+		c->scissorEnabled = false;
+	}
+
+	int ref = area ? area->stencilRef : 0;
+	if (ref != c->stencilRef) {
+		dumpBuffers(c);
+		if (MASK_FORM == c->masking) {
+			glEnable(GL_STENCIL_TEST);
+			glStencilMask(MASK_STENCIL_BIT);
+			glStencilFunc(GL_ALWAYS, MASK_STENCIL_BIT, MASK_STENCIL_BIT);
+			glStencilOp(GL_KEEP, GL_KEEP, GL_REPLACE);
+		} else if (MASK_UNDER == c->masking) {
+			glEnable(GL_STENCIL_TEST);
+			glStencilFunc(GL_EQUAL, MASK_STENCIL_BIT | ref, 
+				MASK_STENCIL_BIT | (ref ? CLIP_STENCIL_BITS : 0));
+			glStencilOp(GL_KEEP, GL_KEEP, GL_KEEP);
+		} else if (ref) {
+			glEnable(GL_STENCIL_TEST);
+			glStencilFunc(GL_EQUAL, ref, CLIP_STENCIL_BITS);
+			glStencilOp(GL_KEEP, GL_KEEP, GL_KEEP);
+		} else
+			glDisable(GL_STENCIL_TEST);
+		c->stencilRef = ref;
+	}
 }
 
-// enable clipping to rectangle
+
+// draw clip area to stencil buffer
+// \param ref stencil value of pixels to update
+// \param op GL_INCR to add area or GL_DECR to remove it
+static void drawStencilClip(OglCanvas *c, const ClipArea &area, int ref,
+	GLenum op)
+{
+	dumpBuffers(c);
+
+	glEnable(GL_STENCIL_TEST);
+	glStencilMask(CLIP_STENCIL_BITS);
+	glStencilFunc(GL_EQUAL, ref, CLIP_STENCIL_BITS);
+	glStencilOp(GL_KEEP, GL_KEEP, op);
+	glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+
+	// corners are already transformed
+	c->transform.push_back(Matrix::identity());
+	disableTexture(c);
+	setMode(c, GL_TRIANGLES);
+	const GLfloat *q = area.quad;
+	addVertex(c, q[0], q[1], 1, 1, 1, 1, 0, 0);
+	addVertex(c, q[2], q[3], 1, 1, 1, 1, 0, 0);
+	addVertex(c, q[4], q[5], 1, 1, 1, 1, 0, 0);
+	addVertex(c, q[0], q[1], 1, 1, 1, 1, 0, 0);
+	addVertex(c, q[4], q[5], 1, 1, 1, 1, 0, 0);
+	addVertex(c, q[6], q[7], 1, 1, 1, 1, 0, 0);
+	dumpBuffers(c);
+	c->transform.pop_back();
+
+	// mask form is never visible
+	if (MASK_FORM != c->masking)
+		glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+	c->stencilRef = -1;
+}
+
+
+// push clip area to clip stack.  area is specified by two corners
+// and intersected with current clip area.  if current transform is not
+// axis aligned area is clipped by stencil buffer
 static void setClipArea(struct SaslGraphicsCallbacks *canvas,
-	double x, double y, double width, double height)
+	double x1, double y1, double x2, double y2)
 {
 	OglCanvas *c = (OglCanvas*)canvas;
 	assert(canvas);
 
-	dumpBuffers(c);
-
-	Rect r = { x, y, width, height };
-	glEnable(GL_SCISSOR_TEST);
+	ClipArea area;
+	const Matrix &m = c->transform.back();
+	Vector p[4] = { m * Vector(x1, y1), m * Vector(x2, y1),
+		m * Vector(x2, y2), m * Vector(x1, y2) };
+
+	float minX = p[0].getX(), maxX = minX;
+	float minY = p[0].getY(), maxY = minY;
+	for (int i = 0; i < 4; i++) {
+		area.quad[i * 2] = p[i].getX();
+		area.quad[i * 2 + 1] = p[i].getY();
+		minX = std::min(minX, p[i].getX());
+		maxX = std::max(maxX, p[i].getX());
+		minY = std::min(minY, p[i].getY());
+		maxY = std::max(maxY, p[i].getY());
+	}
 
-	Vector rv1 = c->transform.back() * Vector(r.x, r.y);
-	float x1 = rv1.getX();
-	float y1 = rv1.getY();
-	Vector rv2 = c->transform.back() * Vector(r.width, r.height);
-	float x2 = rv2.getX();
-	float y2 = rv2.getY();
+	// edges are parallel to axes if transform has no rotation or 
+	// rotated by multiple of 90 degrees
+	const float eps = 0.01f;
+	bool aligned = ((fabs(p[0].getX() - p[3].getX()) < eps) &&
+		(fabs(p[0].getY() - p[1].getY()) < eps)) ||
+		((fabs(p[0].getX() - p[1].getX()) < eps) &&
+		(fabs(p[0].getY() - p[3].getY()) < eps));
+
+	GLint ax1 = (GLint)floor(minX + 0.5f);
+	GLint ay1 = (GLint)floor(minY + 0.5f);
+	GLint ax2 = (GLint)floor(maxX + 0.5f);
+	GLint ay2 = (GLint)floor(maxY + 0.5f);
+
+	const ClipArea *parent = getClipArea(c);
+	if (parent) {
+		ax1 = std::max(ax1, parent->x);
+		ay1 = std::max(ay1, parent->y);
+		ax2 = std::min(ax2, parent->x + parent->width);
+		ay2 = std::min(ay2, parent->y + parent->height);
+	}
 
-	glScissor(x1, y1, x2 - x1, y2 - y1);
+	area.x = ax1;
+	area.y = ay1;
+	area.width = std::max(0, ax2 - ax1);
+	area.height = std::max(0, ay2 - ay1);
+	area.stencil = !aligned;
+	area.stencilRef = parent ? parent->stencilRef : 0;
+
+	c->clipStack.push_back(area);
+	applyClipArea(c);
+
+	if (area.stencil) {
+		if (!area.stencilRef) {
+			// stencil buffer content is unknown at first use,
+			// mask bit is kept
+			glClearStencil(0);
+			glStencilMask(CLIP_STENCIL_BITS);
+			glClear(GL_STENCIL_BUFFER_BIT);
+		}
+		drawStencilClip(c, area, area.stencilRef, GL_INCR);
+		c->clipStack.back().stencilRef++;
+		applyClipArea(c);
+	}
 }
 
 
-// disable clipping
+// pop clip area from clip stack
 static void resetClipArea(struct SaslGraphicsCallbacks *canvas)
 {
 	OglCanvas *c = (OglCanvas*)canvas;
 	assert(canvas);
-	dumpBuffers(c);
-	glDisable(GL_SCISSOR_TEST);
+
+	const ClipArea *area = getClipArea(c);
+	if (!area) {
+		printf("invalid clip area reset!\n");
+		return;
+	}
+
+	if (area->stencil)
+		drawStencilClip(c, *area, area->stencilRef, GL_DECR);
+
+	c->clipStack.pop_back();
+	applyClipArea(c);
 }
 
 
@@ -817,6 +1040,15 @@ static int setRenderTarget(struct SaslGraphicsCallbacks *canvas,
 		glPushMatrix();
 		glPushAttrib(GL_ALL_ATTRIB_BITS);
 
+		// clip areas of panel are not applied to render target
+		c->clipBase.push_back(c->clipStack.size());
+		c->maskBase.push_back(c->masking);
+		glDisable(GL_SCISSOR_TEST);
+		glDisable(GL_STENCIL_TEST);
+		c->scissorEnabled = false;
+		c->stencilRef = 0;
+		c->masking = MASK_NONE;
+
 		GLint w, h;
 		glBindTexture(GL_TEXTURE_2D, textureId);
 		glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &w);
@@ -844,6 +1076,26 @@ static int setRenderTarget(struct SaslGraphicsCallbacks *canvas,
 
 		// restore x-plane state
 		glPopAttrib();
+
+		// unbalanced clip areas of render target are dropped and
+		// scissor state of parent is restored by glPopAttrib
+		if (!c->clipBase.empty()) {
+			c->clipStack.resize(c->clipBase.back());
+			c->clipBase.pop_back();
+		}
+		if (!c->maskBase.empty()) {
+			c->masking = c->maskBase.back();
+			c->maskBase.pop_back();
+		}
+		const ClipArea *area = getClipArea(c);
+		c->scissorEnabled = (NULL != area);
+		c->stencilRef = area ? area->stencilRef : 0;
+		if (area) {
+			c->scissor[0] = area->x;
+			c->scissor[1] = area->y;
+			c->scissor[2] = area->width;
+			c->scissor[3] = area->height;
+		}
 		glMatrixMode(GL_MODELVIEW);
 		glPopMatrix();
 		glMatrixMode(GL_PROJECTION);
@@ -1117,6 +1369,9 @@ struct SaslGraphicsCallbacks* saslgl_init_graphics()
 	c->currentTexture = 0;
 	c->defaultFbo = 0;
 	c->currentFboTex = 0;
+	c->scissorEnabled = false;
+	c->stencilRef = 0;
+	c->masking = MASK_NONE;
 
 	return (struct SaslGraphicsCallbacks*)c;
 }
@@ -7,6 +7,7 @@
 #include "utils.h"
 #include "graphstub.h"
 #include "sound.h"
+#include "ffiapi.h"
 
 
 using namespace xa;
@@ -18,8 +19,9 @@ Avionics::Avionics(const std::string &path,
         sasl_lua_destroyer_callback luaDestroyer): path(path), 
     lua(luaCreator, luaDestroyer), clickEmulator(timer),
     fontManager(textureManager), properties(lua), server(log, properties), 
-    commands(lua)
+    commands(lua), computed(lua, properties)
 {
+    lua.storeAvionics(this);
     log.exportToLua(lua);
     panelWidth = popupWidth = 1024;
     panelHeight = popupHeight = 768;
@@ -30,11 +32,14 @@ Avionics::Avionics(const std::string &path,
     bgR = bgG = bgB = 1.0f;
     bgA = 0.0f;
 
-    lua.storeAvionics(this);
     exportGraphToLua(lua);
     exportTextureToLua(lua);
     exportFontToLua(lua);
     exportPropsToLua(lua);
+    exportCommandsToLua(lua);
+    exportComputedToLua(lua);
+    exportFfiToLua(lua);
+    exportPropsServerToLua(lua);
 	exportFrameCounterToLua(lua);
     sound.exportSoundToLua(lua);
 
@@ -48,8 +53,7 @@ static int luaGetFrameCounter(lua_State* L) {
 }
 
 void exportFrameCounterToLua(Luna& lua) {
-	lua_State* L = lua.getLua();
-	LUA_REGISTER(L, "getFrameCounter", luaGetFrameCounter);
+	lua.registerFunction("getFrameCounter", luaGetFrameCounter);
 }
 
 Avionics::~Avionics()
@@ -76,6 +80,7 @@ int Avionics::initLua()
 
 void Avionics::setFrameCounter(const int& counter) {
 	frameCounter = counter;
+	properties.setFrameCounter(counter);
 }
 
 int Avionics::getFrameCounter() const {
@@ -156,6 +161,9 @@ void Avionics::update(const int& counter)
 	setFrameCounter(counter);
     if (properties.update())
         log.error("Error updating properties");
+    properties.updateSnapshot();
+    properties.checkWatches();
+    computed.update();
 
     if (server.isRunning())
         if (server.update())
@@ -180,6 +188,9 @@ void Avionics::update(const int& counter)
     } else
         lua_pop(L, 1);
 
+    if (properties.flush())
+        log.error("Error writing properties");
+
     long currentTime = timer.getTime();
     if (currentTime - lastGcTime > 3000) {
 //        lua_gc(L, LUA_GCCOLLECT, 0);
@@ -220,6 +231,11 @@ void Avionics::draw(int stage)
     }
     
     graphics->draw_end(graphics);
+
+    // values set by components while drawing are written now, not after
+    // next update
+    if (properties.flush())
+        log.error("Error writing properties");
 }
 
 void Avionics::addSearchPath(const std::string &path)
@@ -378,9 +394,10 @@ void Avionics::setShowClickable(bool show)
 }
 
 
-int Avionics::startPropsServer(int port, const std::string &secret)
+int Avionics::startPropsServer(int port, const std::string &secret,
+        bool threaded)
 {
-    return server.start(secret.c_str(), port);
+    return server.start(secret.c_str(), port, threaded);
 }
 
 
@@ -390,6 +407,13 @@ void Avionics::stopPropsServer()
 }
 
 
+int Avionics::setPropsMulticast(const char *group, int port, 
+        int keyframeInterval)
+{
+    return server.setMulticast(group, port, keyframeInterval);
+}
+
+
 void Avionics::setCommandsCallbacks(SaslCommandCallbacks *callbacks, 
         void *data)
 {
@@ -12,6 +12,7 @@
 #include "properties.h"
 #include "propsserv.h"
 #include "commands.h"
+#include "computed.h"
 #include "log.h"
 #include "sound.h"
 
@@ -71,6 +72,9 @@ class Avionics
         /// Commands API
         Commands commands;
 
+        /// Properties computed from other properties
+        ComputedProps computed;
+
         /// Graphics functions
         SaslGraphicsCallbacks *graphics;
 
@@ -177,14 +181,28 @@ class Avionics
         void update(const int& counter);
 
         /// Start props server
-        int startPropsServer(int port, const std::string &secret);
+        /// \param threaded serve connections by separate thread if true
+        int startPropsServer(int port, const std::string &secret, 
+                bool threaded = false);
 
         /// Stop ptops server
         void stopPropsServer();
 
+        /// Publish networked properties to multicast group
+        /// \param keyframeInterval number of frames between frames with
+        ///                         all values
+        int setPropsMulticast(const char *group, int port, 
+                int keyframeInterval);
+
+        /// Returns props server
+        PropsServer& getPropsServer() { return server; }
+
         /// Returns commands API
         Commands& getCommands() { return commands; };
 
+        /// Returns computed properties
+        ComputedProps& getComputed() { return computed; };
+
         /// Set commands callbacks
         void setCommandsCallbacks(SaslCommandCallbacks *callbacks,
                 void *data);
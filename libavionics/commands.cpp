@@ -130,15 +130,18 @@ Commands::Commands(Luna &lua): lua(lua)
 {
     memset(&callbacks, 0, sizeof(callbacks));
     data = NULL;
-    
-    lua_State *L = lua.getLua();
-    LUA_REGISTER(L, "findCommand", luaFindCommand);
-    LUA_REGISTER(L, "commandBegin", luaCommandBegin);
-    LUA_REGISTER(L, "commandEnd", luaCommandEnd);
-    LUA_REGISTER(L, "commandOnce", luaCommandOnce);
-    LUA_REGISTER(L, "createCommand", luaCreateCommand);
-    LUA_REGISTER(L, "registerCommandHandler", luaRegisterCommandHandler);
-    LUA_REGISTER(L, "unregisterCommandHandler", luaUnregisterCommandHandler);
+}
+
+
+void xa::exportCommandsToLua(Luna &lua)
+{
+    lua.registerFunction("findCommand", luaFindCommand);
+    lua.registerFunction("commandBegin", luaCommandBegin);
+    lua.registerFunction("commandEnd", luaCommandEnd);
+    lua.registerFunction("commandOnce", luaCommandOnce);
+    lua.registerFunction("createCommand", luaCreateCommand);
+    lua.registerFunction("registerCommandHandler", luaRegisterCommandHandler);
+    lua.registerFunction("unregisterCommandHandler", luaUnregisterCommandHandler);
 }
 
 
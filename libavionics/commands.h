@@ -82,6 +82,10 @@ class Commands
 };
 
 
+/// Register commands functions in Lua
+void exportCommandsToLua(Luna &lua);
+
+
 };
 
 #endif
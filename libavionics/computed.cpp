@@ -0,0 +1,301 @@
+#include "computed.h"
+
+#include "avionics.h"
+
+
+using namespace xa;
+
+
+
+ComputedProps::ComputedProps(Luna &lua, Properties &properties):
+    lua(lua), properties(properties)
+{
+    frameEvals = 0;
+    lastFrameEvals = 0;
+}
+
+
+ComputedProps::~ComputedProps()
+{
+    for (std::vector<Node>::iterator i = nodes.begin(); i != nodes.end(); i++)
+        if (LUA_NOREF != (*i).function)
+            lua.unRef((*i).function);
+}
+
+
+int ComputedProps::addNode(const std::string &name,
+        const std::vector<Input> &inputs, int function,
+        sasl_compute_callback callback, void *ref, SaslPropRef output,
+        bool eager)
+{
+    if ((LUA_NOREF == function) && (! callback))
+        return -1;
+
+    int id = nodes.size();
+    for (std::vector<Input>::const_iterator i = inputs.begin();
+            i != inputs.end(); i++)
+        if ((! (*i).prop) && ((0 > (*i).node) || ((*i).node >= id)))
+            return -1;
+
+    Node node;
+    node.name = name;
+    node.function = function;
+    node.callback = callback;
+    node.ref = ref;
+    node.output = output;
+    node.value = 0;
+    node.dirty = true;
+    node.eager = eager || output;
+    node.evals = 0;
+    node.time = 0;
+
+    for (std::vector<Input>::const_iterator i = inputs.begin();
+            i != inputs.end(); i++)
+    {
+        Input input = *i;
+        if (input.prop) {
+            size_t source = 0;
+            while ((source < sources.size()) &&
+                    (sources[source].prop != input.prop))
+                source++;
+            if (source == sources.size()) {
+                Source s;
+                s.prop = input.prop;
+                s.value = properties.getPropd(input.prop);
+                s.slot = properties.addSnapshotProp(input.prop, PROP_DOUBLE,
+                        s.value);
+                sources.push_back(s);
+            }
+            sources[source].nodes.push_back(id);
+            input.node = source;
+        }
+        node.inputs.push_back(input);
+    }
+
+    for (std::vector<Input>::iterator i = node.inputs.begin();
+            i != node.inputs.end(); i++)
+        if (! (*i).prop)
+            nodes[(*i).node].dependents.push_back(id);
+
+    nodes.push_back(node);
+    return id;
+}
+
+
+void ComputedProps::markDirty(int id)
+{
+    Node &node = nodes[id];
+    if (node.dirty)
+        return;
+
+    node.dirty = true;
+    for (std::vector<int>::iterator i = node.dependents.begin();
+            i != node.dependents.end(); i++)
+        markDirty(*i);
+}
+
+
+void ComputedProps::evaluate(int id)
+{
+    double startTime = timer.getSeconds();
+
+    size_t base = args.size();
+    for (std::vector<Input>::iterator i = nodes[id].inputs.begin();
+            i != nodes[id].inputs.end(); i++)
+    {
+        const Input &input = *i;
+        args.push_back(input.prop ? sources[input.node].value :
+                nodes[input.node].value);
+    }
+    int count = args.size() - base;
+
+    // Lua function may create new nodes, so don't keep reference to node
+    // while calling it
+    double value = nodes[id].value;
+    if (LUA_NOREF != nodes[id].function) {
+        lua_State *L = lua.getLua();
+        lua.getRef(nodes[id].function);
+        for (int i = 0; i < count; i++)
+            lua_pushnumber(L, args[base + i]);
+        args.resize(base);
+        if (LUA_PCALL(L, count, 1, 0)) {
+            findAvionics(L)->getLog().error(
+                    "Error evaluating computed property %s: %s",
+                    nodes[id].name.c_str(), lua_tostring(L, -1));
+        } else
+            value = lua_tonumber(L, -1);
+        lua_pop(L, 1);
+    } else {
+        value = nodes[id].callback(count ? &args[base] : NULL, count,
+                nodes[id].ref);
+        args.resize(base);
+    }
+
+    Node &node = nodes[id];
+    node.value = value;
+    node.dirty = false;
+    node.evals++;
+    frameEvals++;
+    node.time += timer.getSeconds() - startTime;
+
+    if (node.output)
+        properties.setProp(node.output, node.value);
+}
+
+
+double ComputedProps::getValue(int id)
+{
+    if ((0 > id) || (id >= (int)nodes.size()))
+        return 0;
+
+    if (nodes[id].dirty) {
+        // nodes may be added by Lua functions, so access them by index
+        size_t count = nodes[id].inputs.size();
+        for (size_t i = 0; i < count; i++) {
+            const Input &input = nodes[id].inputs[i];
+            if (! input.prop)
+                getValue(input.node);
+        }
+        evaluate(id);
+    }
+
+    return nodes[id].value;
+}
+
+
+void ComputedProps::update()
+{
+    lastFrameEvals = frameEvals;
+    frameEvals = 0;
+
+    for (std::vector<Source>::iterator i = sources.begin();
+            i != sources.end(); i++)
+    {
+        Source &source = *i;
+        double value = 0 <= source.slot ? 
+            properties.getSnapshotd(source.slot) :
+            properties.getPropd(source.prop, source.value);
+        if (value == source.value)
+            continue;
+        source.value = value;
+        for (std::vector<int>::iterator j = source.nodes.begin();
+                j != source.nodes.end(); j++)
+            markDirty(*j);
+    }
+
+    // inputs of node are always created before node
+    for (size_t i = 0; i < nodes.size(); i++)
+        if (nodes[i].eager && nodes[i].dirty)
+            getValue(i);
+}
+
+
+void ComputedProps::pushStats(lua_State *L)
+{
+    // names of nodes may repeat
+    lua_createtable(L, 0, nodes.size());
+    for (size_t i = 0; i < nodes.size(); i++) {
+        const Node &node = nodes[i];
+        lua_createtable(L, 0, 3);
+        lua_pushstring(L, node.name.c_str());
+        lua_setfield(L, -2, "name");
+        lua_pushnumber(L, node.evals);
+        lua_setfield(L, -2, "evals");
+        lua_pushnumber(L, node.time);
+        lua_setfield(L, -2, "time");
+        lua_rawseti(L, -2, i);
+    }
+    lua_pushnumber(L, lastFrameEvals);
+    lua_setfield(L, -2, "__frameEvals");
+}
+
+
+/// Create computed property.
+/// Arguments are name, table of input property objects, function and
+/// optional name of published property and eager flag.
+/// Inputs are global property objects or computed property objects.
+/// Returns ID of computed property or nil
+static int luaCreateComputedProp(lua_State *L)
+{
+    if ((! lua_isstring(L, 1)) || (! lua_istable(L, 2)) ||
+            (! lua_isfunction(L, 3)))
+    {
+        lua_pushnil(L);
+        return 1;
+    }
+
+    Avionics *avionics = getAvionics(L);
+
+    std::vector<ComputedProps::Input> inputs;
+    int count = lua_objlen(L, 2);
+    for (int i = 1; i <= count; i++) {
+        lua_rawgeti(L, 2, i);
+        ComputedProps::Input input;
+        input.prop = NULL;
+        input.node = -1;
+        if (lua_istable(L, -1)) {
+            lua_getfield(L, -1, "__ref");
+            input.prop = (SaslPropRef)lua_touserdata(L, -1);
+            lua_getfield(L, -2, "__computed");
+            if (lua_isnumber(L, -1))
+                input.node = (int)lua_tonumber(L, -1);
+            lua_pop(L, 2);
+        }
+        lua_pop(L, 1);
+        if ((! input.prop) && (-1 == input.node)) {
+            avionics->getLog().error("Invalid input %i of computed "
+                    "property %s", i, lua_tostring(L, 1));
+            lua_pushnil(L);
+            return 1;
+        }
+        inputs.push_back(input);
+    }
+
+    SaslPropRef output = NULL;
+    if (lua_isstring(L, 4)) {
+        output = avionics->getProps().createProp(lua_tostring(L, 4),
+                PROP_DOUBLE);
+        if (! output) {
+            lua_pushnil(L);
+            return 1;
+        }
+    }
+
+    lua_pushvalue(L, 3);
+    int function = avionics->getLuna().addRef();
+    int id = avionics->getComputed().addNode(lua_tostring(L, 1), inputs,
+            function, NULL, NULL, output, lua_toboolean(L, 5));
+    if (-1 == id) {
+        avionics->getLuna().unRef(function);
+        lua_pushnil(L);
+    } else
+        lua_pushnumber(L, id);
+    return 1;
+}
+
+
+/// Returns value of computed property
+static int luaGetComputedProp(lua_State *L)
+{
+    lua_pushnumber(L, getAvionics(L)->getComputed().getValue(
+                (int)lua_tonumber(L, 1)));
+    return 1;
+}
+
+
+/// Returns table of names, evaluation counts and times of computed 
+/// properties indexed by ID
+static int luaGetComputedStats(lua_State *L)
+{
+    getAvionics(L)->getComputed().pushStats(L);
+    return 1;
+}
+
+
+void xa::exportComputedToLua(Luna &lua)
+{
+    lua.registerFunction("createComputedProp", luaCreateComputedProp);
+    lua.registerFunction("getComputedProp", luaGetComputedProp);
+    lua.registerFunction("getComputedStats", luaGetComputedStats);
+}
+
@@ -0,0 +1,162 @@
+#ifndef __COMPUTED_H__
+#define __COMPUTED_H__
+
+
+#include <string>
+#include <vector>
+#include "luna.h"
+#include "libavcallbacks.h"
+#include "rttimer.h"
+
+
+namespace xa {
+
+
+class Properties;
+
+
+/// Properties computed from other properties.
+/// Nodes may use only nodes created before them as inputs, so order of
+/// creation is topological order of graph.  Node is evaluated only if
+/// some of its inputs changed since last evaluation.
+class ComputedProps
+{
+    public:
+        /// Input of computed property
+        struct Input {
+            /// property reference or NULL if input is computed property
+            SaslPropRef prop;
+
+            /// ID of input computed property
+            int node;
+        };
+
+    private:
+        /// Simulator property used as input by some nodes.  Read from
+        /// properties snapshot, so property shared with scripts is read 
+        /// once per frame
+        struct Source {
+            /// property reference
+            SaslPropRef prop;
+
+            /// slot of property in double snapshot or -1
+            int slot;
+
+            /// value read at start of frame
+            double value;
+
+            /// nodes using this property
+            std::vector<int> nodes;
+        };
+
+        /// Computed property
+        struct Node {
+            /// name of node for statistics
+            std::string name;
+
+            /// indexes of sources or nodes used as inputs
+            std::vector<Input> inputs;
+
+            /// nodes using this node as input
+            std::vector<int> dependents;
+
+            /// Lua reference to function or LUA_NOREF
+            int function;
+
+            /// C function used if there is no Lua function
+            sasl_compute_callback callback;
+
+            /// reference passed to C function
+            void *ref;
+
+            /// property to publish value to or NULL
+            SaslPropRef output;
+
+            /// last computed value
+            double value;
+
+            /// true if some input changed since last evaluation
+            bool dirty;
+
+            /// true if node is evaluated every frame
+            bool eager;
+
+            /// number of evaluations
+            int evals;
+
+            /// total evaluation time in seconds
+            double time;
+        };
+
+    private:
+        /// Reference to Lua
+        Luna &lua;
+
+        /// Properties used as inputs and outputs
+        Properties &properties;
+
+        /// Input properties
+        std::vector<Source> sources;
+
+        /// Computed properties
+        std::vector<Node> nodes;
+
+        /// Stack of function arguments
+        std::vector<double> args;
+
+        /// Timer used to measure evaluation time
+        RtTimer timer;
+
+        /// Number of evaluations since start of frame
+        int frameEvals;
+
+        /// Number of evaluations during last frame
+        int lastFrameEvals;
+
+    public:
+        ComputedProps(Luna &lua, Properties &properties);
+
+        ~ComputedProps();
+
+    public:
+        /// Add computed property.
+        /// \param name name of node
+        /// \param inputs input properties, input nodes must already exist
+        /// \param function Lua reference to function or LUA_NOREF
+        /// \param callback C function used if function is LUA_NOREF
+        /// \param ref reference passed to callback
+        /// \param output property to write computed value or NULL
+        /// \param eager evaluate node every frame if true, on read if false.
+        ///     Nodes with output are always evaluated every frame.
+        /// Returns ID of computed property or -1 on error
+        int addNode(const std::string &name, const std::vector<Input> &inputs,
+                int function, sasl_compute_callback callback, void *ref,
+                SaslPropRef output, bool eager);
+
+        /// Returns value of computed property evaluating it if needed
+        double getValue(int node);
+
+        /// Read input properties, mark nodes with changed inputs and
+        /// evaluate eager nodes.  Called once per frame
+        void update();
+
+        /// Push table of node statistics indexed by node ID to Lua stack
+        void pushStats(lua_State *L);
+
+    private:
+        /// Mark node and all dependent nodes for evaluation
+        void markDirty(int node);
+
+        /// Evaluate node.  Inputs must be evaluated already
+        void evaluate(int node);
+};
+
+
+/// Register computed properties functions in Lua
+void exportComputedToLua(Luna &lua);
+
+};
+
+
+#endif
+
@@ -0,0 +1,202 @@
+#include "ffiapi.h"
+
+#include "avionics.h"
+#include "graph.h"
+#include "font.h"
+
+
+using namespace xa;
+
+
+static int ffiGetPropi(void *avionics, void *prop, int dflt, int *blocked)
+{
+    Properties &props = ((Avionics*)avionics)->getProps();
+    props.blockLua();
+    int v = props.getPropi(prop, dflt);
+    *blocked = props.unblockLua();
+    return v;
+}
+
+
+static int ffiSetPropi(void *avionics, void *prop, int value)
+{
+    Properties &props = ((Avionics*)avionics)->getProps();
+    props.blockLua();
+    props.setProp(prop, value);
+    return props.unblockLua();
+}
+
+
+static float ffiGetPropf(void *avionics, void *prop, float dflt, int *blocked)
+{
+    Properties &props = ((Avionics*)avionics)->getProps();
+    props.blockLua();
+    float v = props.getPropf(prop, dflt);
+    *blocked = props.unblockLua();
+    return v;
+}
+
+
+static int ffiSetPropf(void *avionics, void *prop, float value)
+{
+    Properties &props = ((Avionics*)avionics)->getProps();
+    props.blockLua();
+    props.setProp(prop, value);
+    return props.unblockLua();
+}
+
+
+static double ffiGetPropd(void *avionics, void *prop, double dflt,
+        int *blocked)
+{
+    Properties &props = ((Avionics*)avionics)->getProps();
+    props.blockLua();
+    double v = props.getPropd(prop, dflt);
+    *blocked = props.unblockLua();
+    return v;
+}
+
+
+static int ffiSetPropd(void *avionics, void *prop, double value)
+{
+    Properties &props = ((Avionics*)avionics)->getProps();
+    props.blockLua();
+    props.setProp(prop, value);
+    return props.unblockLua();
+}
+
+
+static int ffiGetPropia(void *avionics, void *prop, int *values, 
+        int offset, int count)
+{
+    return ((Avionics*)avionics)->getProps().getPropArray(prop, PROP_INT, 
+            values, offset, count);
+}
+
+
+static void ffiSetPropia(void *avionics, void *prop, const int *values, 
+        int offset, int count)
+{
+    ((Avionics*)avionics)->getProps().setPropArray(prop, PROP_INT, values, 
+            offset, count);
+}
+
+
+static int ffiGetPropfa(void *avionics, void *prop, float *values, 
+        int offset, int count)
+{
+    return ((Avionics*)avionics)->getProps().getPropArray(prop, PROP_FLOAT, 
+            values, offset, count);
+}
+
+
+static void ffiSetPropfa(void *avionics, void *prop, const float *values, 
+        int offset, int count)
+{
+    ((Avionics*)avionics)->getProps().setPropArray(prop, PROP_FLOAT, values, 
+            offset, count);
+}
+
+
+static int ffiGetSnapshoti(void *avionics, int slot)
+{
+    return ((Avionics*)avionics)->getProps().getSnapshoti(slot);
+}
+
+
+static float ffiGetSnapshotf(void *avionics, int slot)
+{
+    return ((Avionics*)avionics)->getProps().getSnapshotf(slot);
+}
+
+
+static double ffiGetSnapshotd(void *avionics, int slot)
+{
+    return ((Avionics*)avionics)->getProps().getSnapshotd(slot);
+}
+
+
+/// Replace negative color components by background color
+static void rgbaFromArgs(Avionics *avionics, float &r, float &g,
+        float &b, float &a)
+{
+    float bgR, bgG, bgB, bgA;
+    avionics->getBackgroundColor(bgR, bgG, bgB, bgA);
+    if (0 > r) {
+        r = bgR;
+        g = bgG;
+        b = bgB;
+    }
+    if (0 > a)
+        a = bgA;
+}
+
+
+static void ffiDrawTexture(void *avionics, void *tex, double x, double y,
+        double width, double height, float r, float g, float b, float a,
+        int is_upside_down)
+{
+    if (! tex)
+        return;
+    Avionics *av = (Avionics*)avionics;
+    rgbaFromArgs(av, r, g, b, a);
+    drawTexture(av, (TexturePart*)tex, x, y, width, height, r, g, b, a,
+            is_upside_down);
+}
+
+
+static void ffiDrawRectangle(void *avionics, double x, double y,
+        double width, double height, double r, double g, double b, double a)
+{
+    drawRectangle((Avionics*)avionics, x, y, width, height, r, g, b, a);
+}
+
+
+static void ffiDrawLine(void *avionics, double x1, double y1,
+        double x2, double y2, double r, double g, double b, double a)
+{
+    drawLine((Avionics*)avionics, x1, y1, x2, y2, r, g, b, a);
+}
+
+
+static void ffiDrawText(void *avionics, void *font, double x, double y,
+        const char *str, float r, float g, float b, float a)
+{
+    if ((! font) || (! str))
+        return;
+    Avionics *av = (Avionics*)avionics;
+    rgbaFromArgs(av, r, g, b, a);
+    drawFont((Font*)font, av->getGraphics(), x, y, str, r, g, b, a);
+}
+
+
+static void ffiDrawSprites(void *avionics, void *tex, const double *sprites,
+        int count)
+{
+    if ((! tex) || (! sprites) || (0 >= count))
+        return;
+    drawSprites((Avionics*)avionics, (TexturePart*)tex, sprites, count);
+}
+
+
+static SaslFfiApi ffiApi = { ffiGetPropi, ffiSetPropi, ffiGetPropf,
+        ffiSetPropf, ffiGetPropd, ffiSetPropd, ffiDrawTexture,
+        ffiDrawRectangle, ffiDrawLine, ffiDrawText, ffiGetPropia, 
+        ffiSetPropia, ffiGetPropfa, ffiSetPropfa, ffiGetSnapshoti, 
+        ffiGetSnapshotf, ffiGetSnapshotd, ffiDrawSprites };
+
+
+/// Returns table of FFI functions and avionics pointer
+static int luaGetFfiApi(lua_State *L)
+{
+    lua_pushlightuserdata(L, &ffiApi);
+    lua_pushlightuserdata(L, getAvionics(L));
+    return 2;
+}
+
+
+void xa::exportFfiToLua(Luna &lua)
+{
+    lua.registerFunction("getFfiApi", luaGetFfiApi);
+}
+
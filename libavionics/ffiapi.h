@@ -0,0 +1,75 @@
+#ifndef __FFI_API_H__
+#define __FFI_API_H__
+
+
+#include "luna.h"
+
+
+/// \file C ABI for hot functions called from Lua via LuaJIT FFI.
+/// Plugin symbols are not exported, so functions are passed to Lua as
+/// table of pointers.  Keep in sync with ffi.cdef in init.lua.
+
+extern "C" {
+
+/// Table of FFI callable functions.  First argument of every function
+/// is avionics pointer returned by getFfiApi together with this table.
+struct SaslFfiApi
+{
+    /// Functional properties can't call Lua from FFI calls.  Getters set
+    /// blocked and setters return non-zero if property must be accessed
+    /// by classic Lua functions instead
+    int (*get_propi)(void *avionics, void *prop, int dflt, int *blocked);
+    int (*set_propi)(void *avionics, void *prop, int value);
+    float (*get_propf)(void *avionics, void *prop, float dflt, int *blocked);
+    int (*set_propf)(void *avionics, void *prop, float value);
+    double (*get_propd)(void *avionics, void *prop, double dflt,
+            int *blocked);
+    int (*set_propd)(void *avionics, void *prop, double value);
+
+    /// Negative r or a means background color and alpha
+    void (*draw_texture)(void *avionics, void *tex, double x, double y,
+            double width, double height, float r, float g, float b, float a,
+            int is_upside_down);
+    void (*draw_rectangle)(void *avionics, double x, double y,
+            double width, double height,
+            double r, double g, double b, double a);
+    void (*draw_line)(void *avionics, double x1, double y1,
+            double x2, double y2, double r, double g, double b, double a);
+
+    /// Negative r or a means background color and alpha
+    void (*draw_text)(void *avionics, void *font, double x, double y,
+            const char *str, float r, float g, float b, float a);
+
+    /// Array functions return number of values read
+    int (*get_propia)(void *avionics, void *prop, int *values, int offset,
+            int count);
+    void (*set_propia)(void *avionics, void *prop, const int *values, 
+            int offset, int count);
+    int (*get_propfa)(void *avionics, void *prop, float *values, int offset,
+            int count);
+    void (*set_propfa)(void *avionics, void *prop, const float *values, 
+            int offset, int count);
+
+    /// Values of properties read at start of frame
+    int (*get_snapshoti)(void *avionics, int slot);
+    float (*get_snapshotf)(void *avionics, int slot);
+    double (*get_snapshotd)(void *avionics, int slot);
+
+    /// Buffer must hold count sprites of SPRITE_STRIDE doubles
+    void (*draw_sprites)(void *avionics, void *tex, const double *sprites,
+            int count);
+};
+
+}
+
+
+namespace xa {
+
+/// Register getFfiApi function in Lua
+void exportFfiToLua(Luna &lua);
+
+};
+
+
+#endif
+
@@ -370,8 +370,6 @@ static int luaLoadFont(lua_State *L)
 
 void xa::exportFontToLua(Luna &lua)
 {
-    lua_State *L = lua.getLua();
-
-    LUA_REGISTER(L, "getGLFont", luaLoadFont);
+    lua.registerFunction("getGLFont", luaLoadFont);
 }
 
@@ -82,7 +82,7 @@ static int luaDrawFrame(lua_State *L)
 }
 
 /// Draw non-filled rectangle
-static void drawRectangle(Avionics *avionics, double x, double y, 
+void xa::drawRectangle(Avionics *avionics, double x, double y, 
         double width, double height,
         double r, double g, double b, double a)
 {
@@ -220,7 +220,7 @@ static int luaDrawCircle(lua_State *L)
 }
 
 /// Draw line
-static void drawLine(Avionics *avionics, double x1, double y1, 
+void xa::drawLine(Avionics *avionics, double x1, double y1, 
         double x2, double y2, double r, double g, double b, double a)
 {
     SaslGraphicsCallbacks *graphics = avionics->getGraphics();
@@ -239,12 +239,20 @@ static int luaDrawLine(lua_State *L)
 }
 
 
-static void drawTexture(Avionics *avionics, TexturePart *tex,
+/// Remember texture drawn by component rendered with damage tracking
+static void trackTexture(Avionics *avionics, TexturePart *tex)
+{
+    avionics->getTextureManager()->trackDrawn(tex->getTexture()->getId());
+}
+
+
+void xa::drawTexture(Avionics *avionics, TexturePart *tex,
         double x, double y, double width, double height,
         float r, float g, float b, float a, bool is_upside_down)
 {
     SaslGraphicsCallbacks *graphics = avionics->getGraphics();
     assert(graphics);
+    trackTexture(avionics, tex);
 
 	if (is_upside_down) {
 		graphics->draw_textured_triangle(graphics, tex->getTexture()->getId(),
@@ -318,6 +326,7 @@ static void drawRenderTarget(Avionics *avionics, int id,
 
 	SaslGraphicsCallbacks *graphics = avionics->getGraphics();
 	assert(graphics);
+	avionics->getTextureManager()->trackDrawn(id);
 
 	graphics->draw_textured_triangle(graphics, id,
 		x, y + height, 0, 1, r, g, b, a,
@@ -355,6 +364,7 @@ static void drawTextureCoords(Avionics *avionics, TexturePart *tex,
 {
 	SaslGraphicsCallbacks *graphics = avionics->getGraphics();
 	assert(graphics);
+	trackTexture(avionics, tex);
 
 	graphics->draw_textured_triangle(graphics, tex->getTexture()->getId(),
 		x1, y1, tex->getX1(), tex->getY1(), r, g, b, a,
@@ -395,6 +405,7 @@ static void drawTexturePart(Avionics *avionics, TexturePart *tex,
 {
     SaslGraphicsCallbacks *graphics = avionics->getGraphics();
     assert(graphics);
+    trackTexture(avionics, tex);
 
 	double pw, ph, tx1, ty1, tx2, ty2;
 	pw = tex->getX2() - tex->getX1();
@@ -464,6 +475,7 @@ static void drawRotatedTexture(Avionics *avionics, TexturePart *tex,
 {
     SaslGraphicsCallbacks *graphics = avionics->getGraphics();
     assert(graphics);
+    trackTexture(avionics, tex);
 
     graphics->push_transform(graphics);
 
@@ -513,6 +525,7 @@ static void drawRotatedTextureCenter(Avionics *avionics, TexturePart *tex,
 {
 	SaslGraphicsCallbacks *graphics = avionics->getGraphics();
 	assert(graphics);
+	trackTexture(avionics, tex);
 
 	graphics->push_transform(graphics);
 
@@ -564,6 +577,7 @@ static void drawRotatedTexturePart(Avionics *avionics, TexturePart *tex,
 {
     SaslGraphicsCallbacks *graphics = avionics->getGraphics();
     assert(graphics);
+    trackTexture(avionics, tex);
 
     graphics->push_transform(graphics);
     double centerX = x + width / 2.0;
@@ -661,6 +675,7 @@ static void drawIntricatelyTexturedRectangle(Avionics *avionics,
 {
     SaslGraphicsCallbacks *graphics = avionics->getGraphics();
     assert(graphics);
+    trackTexture(avionics, tex);
 
     double tx1 = tx;
     double ty1 = ty;
@@ -712,6 +727,96 @@ static int luaDrawIntricatelyTexturedRectangle(lua_State *L)
     return 0;
 }
 
+
+void xa::drawSprites(Avionics *avionics, TexturePart *tex,
+        const double *buf, int count)
+{
+    SaslGraphicsCallbacks *graphics = avionics->getGraphics();
+    assert(graphics);
+    trackTexture(avionics, tex);
+
+    int texId = tex->getTexture()->getId();
+    double px = tex->getX1();
+    double py = tex->getY1();
+    double pw = tex->getX2() - px;
+    double ph = tex->getY2() - py;
+
+    for (int i = 0; i < count; i++, buf += SPRITE_STRIDE) {
+        double x = buf[0];
+        double y = buf[1];
+        double w = buf[2];
+        double h = buf[3];
+        double tx1 = px + pw * buf[4];
+        double ty1 = py + ph * buf[5];
+        double tx2 = px + pw * buf[6];
+        double ty2 = py + ph * buf[7];
+
+        unsigned int rgba = (unsigned int)buf[8];
+        float r = ((rgba >> 24) & 0xff) / 255.0f;
+        float g = ((rgba >> 16) & 0xff) / 255.0f;
+        float b = ((rgba >> 8) & 0xff) / 255.0f;
+        float a = (rgba & 0xff) / 255.0f;
+
+        // corners: top left, top right, bottom right, bottom left
+        double cx[4] = { x, x + w, x + w, x };
+        double cy[4] = { y + h, y + h, y, y };
+
+        if (buf[9]) {
+            double angle = buf[9] * 3.14159265358979 / 180.0;
+            double cs = cos(angle);
+            double sn = sin(angle);
+            double ox = x + w / 2.0;
+            double oy = y + h / 2.0;
+            for (int j = 0; j < 4; j++) {
+                double dx = cx[j] - ox;
+                double dy = cy[j] - oy;
+                cx[j] = ox + dx * cs + dy * sn;
+                cy[j] = oy - dx * sn + dy * cs;
+            }
+        }
+
+        graphics->draw_textured_triangle(graphics, texId,
+                cx[0], cy[0], tx1, ty1, r, g, b, a,
+                cx[1], cy[1], tx2, ty1, r, g, b, a,
+                cx[2], cy[2], tx2, ty2, r, g, b, a);
+        graphics->draw_textured_triangle(graphics, texId,
+                cx[0], cy[0], tx1, ty1, r, g, b, a,
+                cx[2], cy[2], tx2, ty2, r, g, b, a,
+                cx[3], cy[3], tx1, ty2, r, g, b, a);
+    }
+}
+
+
+/// Lua wrapper for drawSprites
+/// Buffer is flat Lua table with SPRITE_STRIDE numbers per sprite.
+/// LuaJIT FFI arrays of doubles are handled by FFI binding in init.lua,
+/// size of cdata can't be checked here.
+static int luaDrawSprites(lua_State *L)
+{
+    if ((! lua_islightuserdata(L, 1) || lua_isnil(L, 1)))
+        return 0;
+
+    TexturePart *tex = (TexturePart*)lua_touserdata(L, 1);
+    int count = (int)lua_tonumber(L, 3);
+    if ((0 >= count) || (! tex) || (! lua_istable(L, 2)))
+        return 0;
+
+    Avionics *avionics = getAvionics(L);
+
+    double sprite[SPRITE_STRIDE];
+    int idx = 1;
+    for (int i = 0; i < count; i++) {
+        for (int j = 0; j < SPRITE_STRIDE; j++, idx++) {
+            lua_rawgeti(L, 2, idx);
+            sprite[j] = lua_tonumber(L, -1);
+            lua_pop(L, 1);
+        }
+        drawSprites(avionics, tex, sprite, 1);
+    }
+
+    return 0;
+}
+
 /// Lua wrapper for drawMask
 static int luaDrawMask(lua_State* L) {
 	Avionics *avionics = getAvionics(L);
@@ -831,33 +936,32 @@ static int luaSetBlendColor(lua_State *L) {
 
 void xa::exportGraphToLua(Luna &lua)
 {
-    lua_State *L = lua.getLua();
-
-    LUA_REGISTER(L, "setTranslation", luaSetupMatrix);
-    LUA_REGISTER(L, "saveGraphicsContext", luaSaveContext);
-    LUA_REGISTER(L, "restoreGraphicsContext", luaRestoreContext);
-    LUA_REGISTER(L, "drawFrame", luaDrawFrame);
-    LUA_REGISTER(L, "drawTexture", luaDrawTexture);
-	LUA_REGISTER(L, "drawRenderTarget", luaDrawRenderTarget);
-	LUA_REGISTER(L, "drawTextureCoords", luaDrawTextureCoords);
-    LUA_REGISTER(L, "drawRotatedTexture", luaDrawRotatedTexture);
-	LUA_REGISTER(L, "drawRotatedTextureCenter", luaDrawRotatedTextureCenter);
-    LUA_REGISTER(L, "drawTexturePart", luaDrawTexturePart);
-    LUA_REGISTER(L, "drawRotatedTexturePart", luaDrawRotatedTexturePart);
-    LUA_REGISTER(L, "drawRectangle", luaDrawRectangle);
-    LUA_REGISTER(L, "drawTriangle", luaDrawTriangle);
-	LUA_REGISTER(L, "drawCircle", luaDrawCircle);
-    LUA_REGISTER(L, "drawLine", luaDrawLine);
-    LUA_REGISTER(L, "drawText", luaDrawFont);
-    LUA_REGISTER(L, "drawTexturedRect", luaDrawIntricatelyTexturedRectangle);
-	LUA_REGISTER(L, "drawMask", luaDrawMask);
-	LUA_REGISTER(L, "drawUnderMask", luaDrawUnderMask);
-	LUA_REGISTER(L, "drawMaskEnd", luaDrawMaskEnd);
-	LUA_REGISTER(L, "setClipArea", luaSetClipArea);
-	LUA_REGISTER(L, "resetClipArea", luaResetClipArea);
-	LUA_REGISTER(L, "setBlendFunc", luaSetBlendFunc);
-	LUA_REGISTER(L, "setBlendEquation", luaSetBlendEquation);
-	LUA_REGISTER(L, "resetBlending", luaResetBlending);
-	LUA_REGISTER(L, "setBlendColor", luaSetBlendColor);
+    lua.registerFunction("setTranslation", luaSetupMatrix);
+    lua.registerFunction("saveGraphicsContext", luaSaveContext);
+    lua.registerFunction("restoreGraphicsContext", luaRestoreContext);
+    lua.registerFunction("drawFrame", luaDrawFrame);
+    lua.registerFunction("drawTexture", luaDrawTexture);
+	lua.registerFunction("drawRenderTarget", luaDrawRenderTarget);
+	lua.registerFunction("drawTextureCoords", luaDrawTextureCoords);
+    lua.registerFunction("drawRotatedTexture", luaDrawRotatedTexture);
+	lua.registerFunction("drawRotatedTextureCenter", luaDrawRotatedTextureCenter);
+    lua.registerFunction("drawTexturePart", luaDrawTexturePart);
+    lua.registerFunction("drawRotatedTexturePart", luaDrawRotatedTexturePart);
+    lua.registerFunction("drawRectangle", luaDrawRectangle);
+    lua.registerFunction("drawTriangle", luaDrawTriangle);
+	lua.registerFunction("drawCircle", luaDrawCircle);
+    lua.registerFunction("drawLine", luaDrawLine);
+    lua.registerFunction("drawText", luaDrawFont);
+    lua.registerFunction("drawTexturedRect", luaDrawIntricatelyTexturedRectangle);
+    lua.registerFunction("drawSprites", luaDrawSprites);
+	lua.registerFunction("drawMask", luaDrawMask);
+	lua.registerFunction("drawUnderMask", luaDrawUnderMask);
+	lua.registerFunction("drawMaskEnd", luaDrawMaskEnd);
+	lua.registerFunction("setClipArea", luaSetClipArea);
+	lua.registerFunction("resetClipArea", luaResetClipArea);
+	lua.registerFunction("setBlendFunc", luaSetBlendFunc);
+	lua.registerFunction("setBlendEquation", luaSetBlendEquation);
+	lua.registerFunction("resetBlending", luaResetBlending);
+	lua.registerFunction("setBlendColor", luaSetBlendColor);
 }
 
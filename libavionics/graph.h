@@ -14,6 +14,31 @@ namespace xa {
 /// Register functions in Lua
 void exportGraphToLua(Luna &lua);
 
+/// Draw filled rectangle
+void drawRectangle(Avionics *avionics, double x, double y, 
+        double width, double height,
+        double r, double g, double b, double a);
+
+/// Draw line
+void drawLine(Avionics *avionics, double x1, double y1, 
+        double x2, double y2, double r, double g, double b, double a);
+
+/// Draw texture stretched to rectangle
+void drawTexture(Avionics *avionics, TexturePart *tex,
+        double x, double y, double width, double height,
+        float r, float g, float b, float a, bool is_upside_down);
+
+
+/// Number of values describing single sprite in drawSprites buffer:
+/// x, y, width, height, u1, v1, u2, v2, rgba, rotation
+#define SPRITE_STRIDE 10
+
+/// Draw sprites packed into array of count * SPRITE_STRIDE doubles.
+/// Texture coordinates are relative to texture part, color is
+/// packed as 0xRRGGBBAA and rotation is in degrees around sprite center.
+void drawSprites(Avionics *avionics, TexturePart *tex,
+        const double *buf, int count);
+
 
 };
 
@@ -56,17 +56,33 @@ typedef int (*sasl_get_prop_string_callback)(SaslPropRef prop,
 /// Returns zero on cuccess or non-zero on error
 typedef int (*sasl_set_prop_string_callback)(SaslPropRef prop, const char *value);
 
+/// Copy count elements of array property starting at offset to values.
+/// type is type of elements in values, PROP_INT or PROP_FLOAT.
+/// If values is NULL returns number of elements available in property,
+/// otherwise returns number of elements copied
+typedef int (*sasl_get_prop_array_callback)(SaslPropRef prop, int type,
+        void *values, int offset, int count, int *err);
+
+/// Set count elements of array property starting at offset.
+/// type is type of elements in values, PROP_INT or PROP_FLOAT.
+/// Returns zero on cuccess or non-zero on error
+typedef int (*sasl_set_prop_array_callback)(SaslPropRef prop, int type,
+        const void *values, int offset, int count);
+
 
 
 #define PROP_INT 1
 #define PROP_FLOAT 2
 #define PROP_DOUBLE 3
 #define PROP_STRING 4
+#define PROP_INT_ARRAY 5
+#define PROP_FLOAT_ARRAY 6
 
 
 /// Create new property and returns reference to it.
 /// If property already exists just returns reference to it.
-/// maxSize is maximum size for string properties, ignored for other types
+/// maxSize is maximum size for string properties or number of elements 
+/// of array properties, ignored for other types
 /// notPublish must be true, if there is no need to register property in DRE
 typedef SaslPropRef (*sasl_create_prop_callback)(SaslProps props, const char *name, 
             int type, int maxSize, bool notPublish);
@@ -98,6 +114,20 @@ typedef int (*sasl_update_props_callback)(SaslProps props);
 /// Destroy properties.
 typedef void (*sasl_props_done)(SaslProps props);
 
+/// Write property values deferred during frame.
+typedef int (*sasl_flush_props_callback)(SaslProps props);
+
+/// Disable deferred writes of property if immediate is not zero
+typedef void (*sasl_set_prop_immediate_callback)(SaslPropRef prop, 
+        int immediate);
+
+/// Receives single named statistics value
+typedef void (*sasl_stat_callback)(void *ref, const char *name, double value);
+
+/// Report statistics of properties backend calling report for each value
+typedef void (*sasl_props_stats_callback)(SaslProps props, 
+        sasl_stat_callback report, void *ref);
+
 /// All callbacks for handy setup
 struct SaslPropsCallbacks {
     sasl_get_prop_ref_callback get_prop_ref;
@@ -114,9 +144,19 @@ struct SaslPropsCallbacks {
     sasl_set_prop_string_callback set_prop_string;
     sasl_update_props_callback update_props;
     sasl_props_done props_done;
+    sasl_props_stats_callback props_stats;
+    sasl_get_prop_array_callback get_prop_array;
+    sasl_set_prop_array_callback set_prop_array;
+    sasl_flush_props_callback flush_props;
+    sasl_set_prop_immediate_callback set_prop_immediate;
 };
 
 
+/// Computes value of computed property from values of its inputs
+typedef double (*sasl_compute_callback)(const double *inputs, int count, 
+        void *ref);
+
+
 //
 // Commands API
 //
@@ -216,11 +256,12 @@ typedef void (*sasl_draw_under_mask)(struct SaslGraphicsCallbacks *canvas);
 // disable masking
 typedef void (*sasl_draw_mask_end)(struct SaslGraphicsCallbacks *canvas);		
 		
-// enable clipping to rectangle
+// enable clipping to rectangle.  clip areas are nested: each call 
+// intersects area with previous one until reset_clip_area called
 typedef void (*sasl_set_clip_area)(struct SaslGraphicsCallbacks *canvas, 
         double x1, double y1, double x2, double y2);
 
-// disable clipping.
+// restore clip area active before last set_clip_area call
 typedef void (*sasl_reset_clip_area)(struct SaslGraphicsCallbacks *canvas);
 
 // push affine translation state
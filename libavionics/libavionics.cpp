@@ -6,6 +6,7 @@
 #include <stdlib.h>
 #include "avionics.h"
 #include "propsclient.h"
+#include "propsreplay.h"
 
 
 using namespace xa;
@@ -279,6 +280,34 @@ int sasl_set_prop_double(SASL sasl, SaslPropRef ref, double value)
     return -1;
 }
 
+int sasl_create_computed_prop(SASL sasl, const char *name, 
+        SaslPropRef *inputs, int count, sasl_compute_callback callback, 
+        void *ref, SaslPropRef output)
+{
+    TRY
+        std::vector<ComputedProps::Input> in;
+        for (int i = 0; i < count; i++) {
+            ComputedProps::Input input;
+            input.prop = inputs[i];
+            input.node = -1;
+            if (! input.prop)
+                return -1;
+            in.push_back(input);
+        }
+        return sasl->avionics->getComputed().addNode(name ? name : "", in,
+                LUA_NOREF, callback, ref, output, false);
+    CATCH("creating computed property")
+    return -1;
+}
+
+double sasl_get_computed_prop(SASL sasl, int id)
+{
+    TRY
+        return sasl->avionics->getComputed().getValue(id);
+    CATCH("getting computed property value")
+    return 0.0;
+}
+
 
 int sasl_set_background_color(SASL sasl, float r, float g, float b, float a)
 {
@@ -308,6 +337,16 @@ int sasl_start_netprop_server(SASL sasl, int port, const char *secret)
 }
 
 
+int sasl_start_netprop_server_threaded(SASL sasl, int port, 
+        const char *secret)
+{
+    TRY
+        return sasl->avionics->startPropsServer(port, secret, true);
+    CATCH("starting network server")
+    return -1;
+}
+
+
 void sasl_stop_netprop_server(SASL sasl)
 {
     TRY
@@ -316,6 +355,17 @@ void sasl_stop_netprop_server(SASL sasl)
 }
 
 
+int sasl_set_netprop_multicast(SASL sasl, const char *group, int port,
+        int keyframeInterval)
+{
+    TRY
+        return sasl->avionics->setPropsMulticast(group, port, 
+                keyframeInterval);
+    CATCH("setting multicast group")
+    return -1;
+}
+
+
 void sasl_set_commands(SASL sasl, struct SaslCommandCallbacks *callbacks, void *data)
 {
     TRY
@@ -333,6 +383,108 @@ int sasl_connect_to_server(SASL sasl, const char *host, int port,
 }
 
 
+int sasl_connect_to_server_push(SASL sasl, const char *host, int port, 
+        const char *secret, int rate, float deadband)
+{
+    TRY
+        return connectToServer(sasl, sasl->avionics->getLog(), host, port, 
+                secret, rate, deadband);
+    CATCH("connecting to remote properties server")
+    return -1;
+}
+
+
+int sasl_connect_to_server_multicast(SASL sasl, const char *host, int port,
+        const char *secret)
+{
+    TRY
+        return connectToServerMulticast(sasl, sasl->avionics->getLog(), host,
+                port, secret);
+    CATCH("connecting to remote properties server")
+    return -1;
+}
+
+
+int sasl_connect_to_server_shared(SASL sasl, const char *host, int port,
+        const char *secret)
+{
+    TRY
+        return connectToServerShared(sasl, sasl->avionics->getLog(), host,
+                port, secret);
+    CATCH("connecting to local properties server")
+    return -1;
+}
+
+
+int sasl_set_netprop_rate(SASL sasl, SaslPropRef ref, int rate, 
+        float deadband)
+{
+    TRY
+        return setNetPropRate(sasl->avionics->getProps(), ref, rate, 
+                deadband);
+    CATCH("setting networked property rate")
+    return -1;
+}
+
+
+int sasl_set_netprop_encoding(SASL sasl, SaslPropRef ref, int encoding,
+        float epsilon, float scale, float offset)
+{
+    TRY
+        return setNetPropEncoding(sasl->avionics->getProps(), ref, encoding,
+                epsilon, scale, offset);
+    CATCH("setting networked property encoding")
+    return -1;
+}
+
+
+int sasl_set_netprop_smoothing(SASL sasl, SaslPropRef ref, int enable,
+        float delay, float snap)
+{
+    TRY
+        return setNetPropSmoothing(sasl->avionics->getProps(), ref, 
+                enable, delay, snap);
+    CATCH("setting networked property smoothing")
+    return -1;
+}
+
+
+
+int sasl_start_props_recording(SASL sasl, const char *fileName)
+{
+    TRY
+        return sasl->avionics->getProps().startRecording(fileName);
+    CATCH("starting properties recording")
+    return -1;
+}
+
+
+void sasl_stop_props_recording(SASL sasl)
+{
+    TRY
+        sasl->avionics->getProps().stopRecording();
+    CATCH("stopping properties recording")
+}
+
+
+int sasl_replay_props(SASL sasl, const char *fileName)
+{
+    TRY
+        return replayProps(sasl, sasl->avionics->getLog(), fileName);
+    CATCH("replaying properties")
+    return -1;
+}
+
+
+int sasl_props_replay_finished(SASL sasl)
+{
+    TRY
+        return isReplayFinished(sasl->avionics->getProps());
+    CATCH("checking properties replay")
+    return 1;
+}
+
+
 
 void sasl_set_sound_engine(SASL sasl, struct SaslSoundCallbacks *callbacks)
 {
@@ -214,6 +214,28 @@ double sasl_get_prop_double(SASL sasl, SaslPropRef ref, int *err);
 int sasl_set_prop_double(SASL sasl, SaslPropRef ref, double value);
 
 
+/// Create property computed from other properties.  Callback is called
+/// only when some of inputs changed.
+/// Returns ID of computed property or -1 on error
+/// \param sasl SASL handler.
+/// \param name name of computed property used in statistics.
+/// \param inputs references to input properties.
+/// \param count number of inputs.
+/// \param callback function computing value from values of inputs.
+/// \param ref reference passed to callback.
+/// \param output property to publish value to or NULL.  Nodes with
+///            output are evaluated every frame, others on read.
+int sasl_create_computed_prop(SASL sasl, const char *name, 
+        SaslPropRef *inputs, int count, sasl_compute_callback callback, 
+        void *ref, SaslPropRef output);
+
+
+/// Returns value of computed property
+/// \param sasl SASL handler.
+/// \param id ID of computed property.
+double sasl_get_computed_prop(SASL sasl, int id);
+
+
 /// Set color of texture background
 /// \param sasl SASL handler.
 /// \param r color red component
@@ -245,11 +267,34 @@ void sasl_set_commands(SASL sasl, struct SaslCommandCallbacks *callbacks, void *
 int sasl_start_netprop_server(SASL sasl, int port, const char *secret);
 
 
+/// Run networked properties server which serves connections by separate
+/// thread.  Properties are still read and written by thread calling
+/// sasl_update, network thread receives snapshot of values every frame.
+/// Returns zero on success.
+/// \param sasl SASL handler.
+/// \param port port to listen
+/// \param secret secret word for clients authentication
+int sasl_start_netprop_server_threaded(SASL sasl, int port, 
+        const char *secret);
+
+
 /// Stop networked properties server
 /// \param sasl SASL handler.
 void sasl_stop_netprop_server(SASL sasl);
 
 
+/// Publish values of networked properties to UDP multicast group once
+/// per frame.  Must be called before threaded server is started.
+/// Returns zero on success.
+/// \param sasl SASL handler.
+/// \param group address of multicast group or NULL to stop publishing
+/// \param port UDP port of group
+/// \param keyframeInterval number of frames between frames carrying all
+///     values, other frames carry changed values only
+int sasl_set_netprop_multicast(SASL sasl, const char *group, int port,
+        int keyframeInterval);
+
+
 /// Connect local properties to remote server.
 /// Returns zero on success.
 /// \param sasl SASL handler.
@@ -260,6 +305,118 @@ int sasl_connect_to_server(SASL sasl, const char *host, int port,
         const char *secret);
 
 
+/// Connect local properties to remote server which pushes changed
+/// values without waiting for requests.
+/// Returns zero on success.
+/// \param sasl SASL handler.
+/// \param host address of host to connect
+/// \param port port to listen
+/// \param secret secret word for clients authentication
+/// \param rate max number of updates of property per second
+/// \param deadband min change of numeric property to send it
+int sasl_connect_to_server_push(SASL sasl, const char *host, int port, 
+        const char *secret, int rate, float deadband);
+
+
+/// Connect local properties to remote server which publishes values to
+/// multicast group.  Values are received from group, changes of
+/// properties are sent to server by TCP connection.
+/// Returns zero on success.
+/// \param sasl SASL handler.
+/// \param host address of host to connect
+/// \param port port to listen
+/// \param secret secret word for clients authentication
+int sasl_connect_to_server_multicast(SASL sasl, const char *host, int port,
+        const char *secret);
+
+
+/// Connect local properties to server running on the same host.
+/// Values are read from memory shared with server without system calls,
+/// connection is used for subscriptions only.  String values are
+/// truncated to 256 bytes.
+/// Returns zero on success.
+/// \param sasl SASL handler.
+/// \param host address of host to connect, usually 127.0.0.1
+/// \param port port to listen
+/// \param secret secret word for clients authentication
+int sasl_connect_to_server_shared(SASL sasl, const char *host, int port,
+        const char *secret);
+
+
+/// Change push rate and deadband of networked property.
+/// Returns zero on success or non-zero if values are not pushed.
+/// \param sasl SASL handler.
+/// \param ref reference to property.
+/// \param rate max number of updates of property per second
+/// \param deadband min change of numeric property to send it
+int sasl_set_netprop_rate(SASL sasl, SaslPropRef ref, int rate, 
+        float deadband);
+
+
+/// Networked property value is sent as is
+#define NETPROP_RAW 0
+
+/// Networked property value is sent as 16 bit fixed point number
+#define NETPROP_FIXED16 1
+
+/// Networked property value is sent as difference to last sent value
+#define NETPROP_DELTA 2
+
+/// Change encoding of networked property values.  Server starts sending
+/// values in new encoding after it acknowledges change.
+/// Returns zero on success or non-zero if server doesn't support encodings.
+/// \param sasl SASL handler.
+/// \param ref reference to property.
+/// \param encoding NETPROP_RAW, NETPROP_FIXED16 or NETPROP_DELTA.
+///     Fixed point encoding is available for float and double properties,
+///     delta encoding for numeric properties.
+/// \param epsilon min change of numeric property to send it
+/// \param scale step of fixed point value
+/// \param offset fixed point value is offset + code * scale
+int sasl_set_netprop_encoding(SASL sasl, SaslPropRef ref, int encoding,
+        float epsilon, float scale, float offset);
+
+
+/// Smooth values of float or double networked property.  Returned values
+/// are interpolated between received ones for current time, so changes
+/// don't come in steps at network update rate.
+/// Returns zero on success or non-zero if property can't be smoothed.
+/// \param sasl SASL handler.
+/// \param ref reference to property.
+/// \param enable non-zero to enable smoothing
+/// \param delay delay of returned values in seconds, about one or two
+///     update intervals.  Zero to extrapolate from last received values
+/// \param snap max change of value which is smoothed, larger changes
+///     are returned immediately.  Zero to smooth any change
+int sasl_set_netprop_smoothing(SASL sasl, SaslPropRef ref, int enable,
+        float delay, float snap);
+
+
+/// Start recording every property read and write to binary log.
+/// Returns zero on success.
+/// \param sasl SASL handler.
+/// \param fileName path to log file
+int sasl_start_props_recording(SASL sasl, const char *fileName);
+
+
+/// Stop recording properties.
+/// \param sasl SASL handler.
+void sasl_stop_props_recording(SASL sasl);
+
+
+/// Replace properties by values recorded with sasl_start_props_recording.
+/// Every sasl_update call replays next recorded frame, so panel can be
+/// run without simulator.  Returns zero on success.
+/// \param sasl SASL handler.
+/// \param fileName path to log file
+int sasl_replay_props(SASL sasl, const char *fileName);
+
+
+/// Returns non-zero if all recorded frames were replayed.
+/// \param sasl SASL handler.
+int sasl_props_replay_finished(SASL sasl);
+
+
 // Sound API
 
 /// Setup sound engine
@@ -6,6 +6,7 @@
 #include <stdarg.h>
 #include "avionics.h"
 #include "libavconsts.h"
+#include "netthread.h"
 
 
 using namespace xa;
@@ -30,6 +31,7 @@ static void defaultLogger(int level, const char *message)
 Log::Log()
 {
     setLogger(NULL, NULL);
+    queue = NULL;
 }
 
 
@@ -45,7 +47,13 @@ void Log::log(int level, const char *message, va_list args)
     va_end(cp);
     char *buf = (char*)alloca(msgLen + 1);
     vsnprintf(buf, msgLen + 1, message, args);
-    callback(level, buf);
+    if (queue) {
+        LogMessage msg;
+        msg.level = level;
+        msg.text = buf;
+        queue->push(msg);
+    } else
+        callback(level, buf);
 }
 
 
@@ -104,6 +112,20 @@ sasl_log_callback Log::getLogger(void **refPtr)
 }
 
 
+void Log::setQueue(LogQueue *logQueue)
+{
+    queue = logQueue;
+}
+
+
+void Log::flush(LogQueue &logQueue)
+{
+    LogMessage msg;
+    while (logQueue.pop(msg))
+        callback(msg.level, msg.text.c_str());
+}
+
+
 static std::string getArgs(lua_State *L)
 {
     std::string str;
@@ -169,11 +191,10 @@ static int luaError(lua_State *L)
 
 void Log::exportToLua(Luna &lua)
 {
-    lua_State *L = lua.getLua();
-    LUA_REGISTER(L, "logDebug", luaDebug);
-    LUA_REGISTER(L, "logInfo", luaInfo);
-    LUA_REGISTER(L, "logWarning", luaWarning);
-    LUA_REGISTER(L, "logError", luaError);
-    LUA_REGISTER(L, "print", luaInfo);
+    lua.registerFunction("logDebug", luaDebug);
+    lua.registerFunction("logInfo", luaInfo);
+    lua.registerFunction("logWarning", luaWarning);
+    lua.registerFunction("logError", luaError);
+    lua.registerFunction("print", luaInfo);
 }
 
@@ -1,11 +1,14 @@
 #ifndef __LOG_H__
 #define __LOG_H__
 
-#include "luna.h"
+#include <stdarg.h>
 #include "libavcallbacks.h"
 
 namespace xa {
 
+class Luna;
+class LogQueue;
+
 // logger
 class Log
 {
@@ -16,6 +19,9 @@ class Log
         /// Data for logger function
         void *ref;
 
+        /// Queue for messages logged by other thread or NULL
+        LogQueue *queue;
+
     public:
         /// Create default logger
         Log();
@@ -43,6 +49,13 @@ class Log
         /// get logger function
         sasl_log_callback getLogger(void **ref);
 
+        /// Pass messages to queue instead of logger function.
+        /// Used by threads which can't call logger directly
+        void setQueue(LogQueue *queue);
+
+        /// Pass queued messages to logger function
+        void flush(LogQueue &queue);
+
         /// register logger functions in Lua
         void exportToLua(Luna &lua);
 };
@@ -12,14 +12,20 @@
 #include <sys/socket.h>
 #include <sys/ioctl.h>
 #include <sys/select.h>
+#include <poll.h>
+#ifdef LIN
+#include <sys/epoll.h>
+#endif
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <netdb.h>
 #else
 #include <winsock2.h>
+#include <ws2tcpip.h>
 #endif
 #include <errno.h>
 #include <cstdio>
+#include <algorithm>
 
 
 // MSG_NOSIGNAL does not exist on OS X and is never sent anyway
@@ -32,24 +38,24 @@ using namespace xa;
 
 NetBuf::NetBuf() 
 {
-    allocated = 2048;
-    data = (unsigned char*)malloc(allocated);
-    filled = 0;
+    data = NULL;
+    allocated = start = filled = 0;
 }
 
 NetBuf::NetBuf(const NetBuf &nb)
 {
-    allocated = nb.allocated;
-    filled = nb.filled;
-    data = (unsigned char*)malloc(allocated);
-    memcpy(data, nb.data, nb.filled);
+    allocated = filled = nb.filled;
+    start = 0;
+    data = filled ? (unsigned char*)malloc(allocated) : NULL;
+    if (data)
+        memcpy(data, nb.data + nb.start, nb.filled);
+    else
+        allocated = filled = 0;
 }
 
 NetBuf& NetBuf::operator=(const NetBuf& nb) {
-	allocated = nb.allocated;
-	filled = nb.filled;
-	data = (unsigned char*)malloc(allocated);
-	memcpy(data, nb.data, nb.filled);
+	NetBuf copy(nb);
+	swap(copy);
 	return *this;
 }
 
@@ -60,17 +66,38 @@ NetBuf::~NetBuf()
 }
 
 
+void NetBuf::swap(NetBuf &nb)
+{
+    std::swap(data, nb.data);
+    std::swap(allocated, nb.allocated);
+    std::swap(start, nb.start);
+    std::swap(filled, nb.filled);
+}
+
+
 void NetBuf::ensureHasSpace(size_t size) 
 {
-    if (size + filled <= allocated)
+    if (start + filled + size <= allocated)
+        return;
+
+    // moving no more than removed bytes keeps removal cost constant
+    if (start >= filled) {
+        if (filled)
+            memmove(data, data + start, filled);
+        start = 0;
+        if (filled + size <= allocated)
+            return;
+    }
+
+    size_t newSize = ((start + filled + size) / 1024 + 1) * 1024;
+    if (2048 > newSize)
+        newSize = 2048;
+    unsigned char* dataR = (unsigned char*)realloc(data, newSize);
+    if (dataR) {
+        data = dataR;
+    } else {
         return;
-    size_t newSize = ((filled + size) / 1024 + 1) * 1024;
-	unsigned char* dataR = (unsigned char*)realloc(data, newSize);
-	if (dataR) {
-		data = dataR;
-	} else {
-		return;
-	}
+    }
     allocated = newSize;
 }
 
@@ -78,7 +105,7 @@ void NetBuf::ensureHasSpace(size_t size)
 void NetBuf::add(const unsigned char *s, size_t size) 
 {
     ensureHasSpace(size);
-    memcpy(data + filled, s, size);
+    memcpy(data + start + filled, s, size);
     filled += size;
 }
 
@@ -117,11 +144,37 @@ void NetBuf::addDouble(double v)
 
 
 
+void NetBuf::addVarint(unsigned v)
+{
+    unsigned char buf[5];
+    int len = 0;
+    while (0x80 <= v) {
+        buf[len++] = (unsigned char)(v | 0x80);
+        v >>= 7;
+    }
+    buf[len++] = (unsigned char)v;
+    add(buf, len);
+}
+
+
+void NetBuf::addVarint64(uint64_t v)
+{
+    unsigned char buf[10];
+    int len = 0;
+    while (0x80 <= v) {
+        buf[len++] = (unsigned char)(v | 0x80);
+        v >>= 7;
+    }
+    buf[len++] = (unsigned char)v;
+    add(buf, len);
+}
+
+
 void NetBuf::remove(size_t size) {
     if (size >= filled)
-        filled = 0;
+        start = filled = 0;
     else {
-        memmove(data, data + size, filled - size);
+        start += size;
         filled -= size;
     }
 }
@@ -155,6 +208,83 @@ double xa::netToDouble(const unsigned char *data)
     return *((double*)data);
 }
 
+int xa::netToVarint(const unsigned char *data, size_t size, unsigned &value)
+{
+    value = 0;
+    for (size_t i = 0; (i < size) && (i < 5); i++) {
+        value |= (unsigned)(data[i] & 0x7f) << (7 * i);
+        if (! (data[i] & 0x80))
+            return i + 1;
+    }
+    return 0;
+}
+
+NetReader::NetReader(const unsigned char *data, size_t size): 
+    data(data), size(size)
+{
+    pos = 0;
+    invalid = false;
+}
+
+
+bool NetReader::getUint8(int &value)
+{
+    if (pos + 1 > size)
+        return false;
+    value = data[pos++];
+    return true;
+}
+
+
+bool NetReader::getUint16(int &value)
+{
+    if (pos + 2 > size)
+        return false;
+    value = netToInt16(data + pos);
+    pos += 2;
+    return true;
+}
+
+
+bool NetReader::getVarint(unsigned &value)
+{
+    int len = netToVarint(data + pos, size - pos, value);
+    if (! len) {
+        if (5 <= size - pos)
+            invalid = true;
+        return false;
+    }
+    pos += len;
+    return true;
+}
+
+
+bool NetReader::getVarint64(uint64_t &value)
+{
+    value = 0;
+    for (size_t i = 0; (pos + i < size) && (i < 10); i++) {
+        value |= (uint64_t)(data[pos + i] & 0x7f) << (7 * i);
+        if (! (data[pos + i] & 0x80)) {
+            pos += i + 1;
+            return true;
+        }
+    }
+    if (10 <= size - pos)
+        invalid = true;
+    return false;
+}
+
+
+const unsigned char* NetReader::getBytes(size_t count)
+{
+    if (pos + count > size)
+        return NULL;
+    const unsigned char *res = data + pos;
+    pos += count;
+    return res;
+}
+
+
 int xa::getPropTypeSize(int type)
 {
     switch (type) {
@@ -197,10 +327,286 @@ static void closeSocket(int sock)
 }
 
 
+#if defined(LIN)
+struct xa::PollSet
+{
+    /// epoll descriptor
+    int epollFd;
+
+    /// buffer for events returned by epoll
+    std::vector<struct epoll_event> events;
+};
+#else
+struct xa::PollSet
+{
+    /// descriptors passed to poll()
+    std::vector<struct pollfd> fds;
+};
+#endif
+
+
+/// Wait for events on array of sockets
+static int pollSockets(struct pollfd *fds, size_t count, int timeout)
+{
+#ifdef WINDOWS
+    return WSAPoll(fds, count, timeout);
+#else
+    return ::poll(fds, count, timeout);
+#endif
+}
+
+
+/// Returns readiness flags of single socket without waiting
+static int pollSocket(int sock, bool wantSend)
+{
+    struct pollfd fd;
+    fd.fd = sock;
+    fd.events = POLLIN | (wantSend ? POLLOUT : 0);
+    fd.revents = 0;
+
+    int res = pollSockets(&fd, 1, 0);
+    if (0 > res) {
+        if (EINTR != errno)
+            perror("error polling socket");
+        return 0;
+    }
+
+    int flags = 0;
+    if (fd.revents & POLLIN)
+        flags |= NET_CAN_RECEIVE;
+    if (fd.revents & POLLOUT)
+        flags |= NET_CAN_SEND;
+    if (fd.revents & (POLLERR | POLLHUP))
+        flags |= NET_FAILED;
+    return flags;
+}
+
+
+NetPoller::NetPoller(Log &log): log(log)
+{
+    wakeSock = -1;
+    pollSet = new PollSet;
+#if defined(LIN)
+    pollSet->epollFd = epoll_create(16);
+    if (0 > pollSet->epollFd)
+        log.error("can't create epoll descriptor");
+#endif
+}
+
+
+NetPoller::~NetPoller()
+{
+    if (0 <= wakeSock)
+        closeSocket(wakeSock);
+#if defined(LIN)
+    if (0 <= pollSet->epollFd)
+        close(pollSet->epollFd);
+#endif
+    delete pollSet;
+}
+
+
+int NetPoller::add(int sock)
+{
+    for (std::vector<int>::iterator i = socks.begin(); i != socks.end(); ++i)
+        if (*i == sock)
+            return 0;
+
+#if defined(LIN)
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.fd = sock;
+    if (epoll_ctl(pollSet->epollFd, EPOLL_CTL_ADD, sock, &ev)) {
+        log.error("can't add socket to epoll");
+        return -1;
+    }
+#else
+    struct pollfd fd;
+    fd.fd = sock;
+    fd.events = POLLIN;
+    fd.revents = 0;
+    pollSet->fds.push_back(fd);
+#endif
+
+    socks.push_back(sock);
+    if ((int)ready.size() <= sock) {
+        ready.resize(sock + 1, 0);
+        sendWanted.resize(sock + 1, 0);
+    }
+    sendWanted[sock] = 0;
+    return 0;
+}
+
+
+void NetPoller::setWantSend(int sock, bool want)
+{
+    if ((0 > sock) || (sock >= (int)sendWanted.size()) || 
+            ((0 != sendWanted[sock]) == want))
+        return;
+
+    for (size_t i = 0; i < socks.size(); i++) {
+        if (socks[i] != sock)
+            continue;
+#if defined(LIN)
+        struct epoll_event ev;
+        memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLIN | (want ? (uint32_t)EPOLLOUT : 0);
+        ev.data.fd = sock;
+        if (epoll_ctl(pollSet->epollFd, EPOLL_CTL_MOD, sock, &ev)) {
+            log.error("can't modify socket in epoll");
+            return;
+        }
+#else
+        pollSet->fds[i].events = POLLIN | (want ? POLLOUT : 0);
+#endif
+        sendWanted[sock] = want;
+        return;
+    }
+}
+
+
+void NetPoller::remove(int sock)
+{
+    for (size_t i = 0; i < socks.size(); i++) {
+        if (socks[i] != sock)
+            continue;
+#if defined(LIN)
+        struct epoll_event ev;
+        memset(&ev, 0, sizeof(ev));
+        epoll_ctl(pollSet->epollFd, EPOLL_CTL_DEL, sock, &ev);
+#else
+        pollSet->fds.erase(pollSet->fds.begin() + i);
+#endif
+        socks.erase(socks.begin() + i);
+        ready[sock] = 0;
+        sendWanted[sock] = 0;
+        return;
+    }
+}
+
+
+int NetPoller::enableWakeup()
+{
+    if (0 <= wakeSock)
+        return 0;
+
+    int sock = socket(AF_INET, SOCK_DGRAM, 0);
+    if (0 > sock) {
+        log.error("can't create wakeup socket");
+        return -1;
+    }
+
+    struct sockaddr_in addr;
+#ifdef WINDOWS
+    int len = sizeof(addr);
+#else
+    socklen_t len = sizeof(addr);
+#endif
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    // socket sends datagrams to itself
+    if (bind(sock, (struct sockaddr*)&addr, sizeof(addr)) ||
+            getsockname(sock, (struct sockaddr*)&addr, &len) ||
+            connect(sock, (struct sockaddr*)&addr, sizeof(addr)) ||
+            makeNonBlock(sock) || add(sock))
+    {
+        log.error("can't setup wakeup socket");
+        closeSocket(sock);
+        return -1;
+    }
+
+    wakeSock = sock;
+    return 0;
+}
+
+
+void NetPoller::wakeup()
+{
+    if (0 <= wakeSock)
+        ::send(wakeSock, "w", 1, 0);
+}
+
+
+/// Read all wakeup datagrams
+static void drainSocket(int sock)
+{
+    char buf[64];
+    while (0 < recv(sock, buf, sizeof(buf), 0))
+        ;
+}
+
+
+int NetPoller::poll(int timeout)
+{
+    for (std::vector<int>::iterator i = readySocks.begin(); 
+            i != readySocks.end(); ++i)
+        ready[*i] = 0;
+    readySocks.clear();
+
+    if (socks.empty())
+        return 0;
+
+#if defined(LIN)
+    std::vector<struct epoll_event> &events = pollSet->events;
+    events.resize(socks.size());
+    int res = epoll_wait(pollSet->epollFd, &events[0], events.size(), 
+            timeout);
+    if (0 > res)
+        return (EINTR == errno) ? 0 : -1;
+
+    for (int i = 0; i < res; i++) {
+        if (events[i].data.fd == wakeSock) {
+            drainSocket(wakeSock);
+            continue;
+        }
+        int flags = 0;
+        if (events[i].events & EPOLLIN)
+            flags |= NET_CAN_RECEIVE;
+        if (events[i].events & EPOLLOUT)
+            flags |= NET_CAN_SEND;
+        if (events[i].events & (EPOLLERR | EPOLLHUP))
+            flags |= NET_FAILED;
+        ready[events[i].data.fd] = flags;
+        readySocks.push_back(events[i].data.fd);
+    }
+#else
+    std::vector<struct pollfd> &fds = pollSet->fds;
+    int res = pollSockets(&fds[0], fds.size(), timeout);
+    if (0 > res)
+        return (EINTR == errno) ? 0 : -1;
+
+    for (size_t i = 0; (i < fds.size()) && res; i++) {
+        if (! fds[i].revents)
+            continue;
+        if (fds[i].fd == wakeSock) {
+            drainSocket(wakeSock);
+            continue;
+        }
+        int flags = 0;
+        if (fds[i].revents & POLLIN)
+            flags |= NET_CAN_RECEIVE;
+        if (fds[i].revents & POLLOUT)
+            flags |= NET_CAN_SEND;
+        if (fds[i].revents & (POLLERR | POLLHUP))
+            flags |= NET_FAILED;
+        ready[fds[i].fd] = flags;
+        readySocks.push_back(fds[i].fd);
+    }
+#endif
+
+    return readySocks.size();
+}
+
+
+
 AsyncCon::AsyncCon(Log &log): log(log)
 {
     sock = 0;
     receiver = NULL;
+    poller = NULL;
 }
 
 
@@ -215,6 +621,8 @@ int AsyncCon::setSocket(int socket)
     if (socket) {
         if (makeNonBlock(socket))
             return -1;
+        if (poller && poller->add(socket))
+            return -1;
     }
     sock = socket;
     return 0;
@@ -343,7 +751,9 @@ int AsyncCon::recvMore()
     size_t received = ::recv(sock, recvBuffer.getFreeSpace(), 2048,
             MSG_NOSIGNAL | MSG_DONTWAIT);
 #endif
-    if (0 >= (int)received) {
+    if (0 == (int)received)
+        return -1;
+    if (0 > (int)received) {
         if (EAGAIN != errno)
             return -1;
         else
@@ -361,18 +771,26 @@ int AsyncCon::recvMore()
 
 int AsyncCon::update()
 {
-    if (sendBuffer.getFilled() && canSend(sock))
+    int events = poller ? poller->getEvents(sock) : 
+        pollSocket(sock, 0 != sendBuffer.getFilled());
+
+    // data queued after last poll is sent without waiting for next poll,
+    // send doesn't block if socket is full
+    if (sendBuffer.getFilled() && (poller || (events & NET_CAN_SEND)))
         if (sendMore()) {
             log.error("error sending data");
             return -1;
         }
 
-    if (canReceive(sock))
+    if (events & (NET_CAN_RECEIVE | NET_FAILED))
         if (recvMore()) {
             log.error("error receiving data");
             return -1;
         }
 
+    if (poller)
+        poller->setWantSend(sock, 0 != sendBuffer.getFilled());
+
     return 0;
 }
 
@@ -411,10 +829,22 @@ void AsyncCon::setCallback(NetReceiver *callback)
 }
 
 
+void AsyncCon::setPoller(NetPoller *netPoller)
+{
+    if (poller && sock)
+        poller->remove(sock);
+    poller = netPoller;
+    if (poller && sock)
+        poller->add(sock);
+}
+
+
 void AsyncCon::close()
 {
     if (sock) {
         log.debug("closing connection");
+        if (poller)
+            poller->remove(sock);
         closeSocket(sock);
         sock = 0;
     }
@@ -457,6 +887,8 @@ int xa::establishConnection(const char *host, int port)
 TcpServer::TcpServer(Log &log): log(log)
 {
     sock = 0;
+    acceptor = NULL;
+    poller = NULL;
 }
 
 
@@ -473,6 +905,16 @@ void TcpServer::setCallback(ConnectionAcceptor *callback)
 }
 
 
+void TcpServer::setPoller(NetPoller *netPoller)
+{
+    if (poller && sock)
+        poller->remove(sock);
+    poller = netPoller;
+    if (poller && sock)
+        poller->add(sock);
+}
+
+
 static int createSocket(int port)
 {
     struct sockaddr_in serv_addr;
@@ -515,6 +957,11 @@ int TcpServer::start(int port)
         return -1;
     }
 
+    if (poller && poller->add(sock)) {
+        stop();
+        return -1;
+    }
+
     return 0;
 }
 
@@ -522,6 +969,8 @@ int TcpServer::start(int port)
 void TcpServer::stop()
 {
     if (sock) {
+        if (poller)
+            poller->remove(sock);
         closeSocket(sock);
         sock = 0;
     }
@@ -538,7 +987,9 @@ int TcpServer::update()
     socklen_t addrlen = sizeof(clntAddr);
 #endif
 
-    if (canReceive(sock)) {
+    bool incoming = poller ? 
+        0 != (poller->getEvents(sock) & NET_CAN_RECEIVE) : canReceive(sock);
+    if (incoming) {
         int clntSock = accept(sock, (struct sockaddr*)&clntAddr, &addrlen);
         log.debug("accept %i", clntSock);
         if (-1 == clntSock)
@@ -558,3 +1009,135 @@ bool TcpServer::isRunning()
     return sock;
 }
 
+
+
+UdpSocket::UdpSocket()
+{
+    sock = -1;
+    memset(addr, 0, sizeof(addr));
+}
+
+
+UdpSocket::~UdpSocket()
+{
+    close();
+}
+
+
+/// Fill address of host or group.  Returns non-zero on error
+static int makeAddress(const char *host, int port, struct sockaddr_in &addr)
+{
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons((u_short)port);
+    addr.sin_addr.s_addr = inet_addr(host);
+    return INADDR_NONE == addr.sin_addr.s_addr ? -1 : 0;
+}
+
+
+int UdpSocket::openSender(const char *group, int port, int ttl)
+{
+    close();
+
+    struct sockaddr_in *groupAddr = (struct sockaddr_in*)addr;
+    if (makeAddress(group, port, *groupAddr))
+        return -1;
+
+    sock = socket(AF_INET, SOCK_DGRAM, 0);
+    if (0 > sock)
+        return -1;
+
+    unsigned char mttl = (unsigned char)ttl;
+    unsigned char loop = 1;
+    if (setsockopt(sock, IPPROTO_IP, IP_MULTICAST_TTL, (char*)&mttl, 
+                sizeof(mttl)) || 
+            setsockopt(sock, IPPROTO_IP, IP_MULTICAST_LOOP, (char*)&loop, 
+                sizeof(loop)))
+    {
+        close();
+        return -1;
+    }
+
+    return 0;
+}
+
+
+int UdpSocket::openReceiver(const char *group, int port)
+{
+    close();
+
+    struct sockaddr_in *groupAddr = (struct sockaddr_in*)addr;
+    if (makeAddress(group, port, *groupAddr))
+        return -1;
+
+    sock = socket(AF_INET, SOCK_DGRAM, 0);
+    if (0 > sock)
+        return -1;
+
+    // several receivers may run on the same host
+    int one = 1;
+    setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, (char*)&one, sizeof(one));
+#ifdef SO_REUSEPORT
+    setsockopt(sock, SOL_SOCKET, SO_REUSEPORT, (char*)&one, sizeof(one));
+#endif
+
+    struct sockaddr_in local;
+    memset(&local, 0, sizeof(local));
+    local.sin_family = AF_INET;
+    local.sin_addr.s_addr = htonl(INADDR_ANY);
+    local.sin_port = htons((u_short)port);
+
+    struct ip_mreq mreq;
+    mreq.imr_multiaddr = groupAddr->sin_addr;
+    mreq.imr_interface.s_addr = htonl(INADDR_ANY);
+
+    if (bind(sock, (struct sockaddr*)&local, sizeof(local)) || 
+            setsockopt(sock, IPPROTO_IP, IP_ADD_MEMBERSHIP, (char*)&mreq, 
+                sizeof(mreq)) || makeNonBlock(sock))
+    {
+        close();
+        return -1;
+    }
+
+    return 0;
+}
+
+
+void UdpSocket::close()
+{
+    if (0 > sock)
+        return;
+#ifdef WINDOWS
+    closesocket(sock);
+#else
+    ::close(sock);
+#endif
+    sock = -1;
+}
+
+
+int UdpSocket::send(const unsigned char *data, size_t size)
+{
+    if (0 > sock)
+        return -1;
+    int sent = sendto(sock, (const char*)data, size, 0, 
+            (struct sockaddr*)addr, sizeof(struct sockaddr_in));
+    return (int)size == sent ? 0 : -1;
+}
+
+
+int UdpSocket::receive(unsigned char *data, size_t size)
+{
+    if (0 > sock)
+        return -1;
+    int received = recvfrom(sock, (char*)data, size, 0, NULL, NULL);
+    if (0 > received) {
+#ifdef WINDOWS
+        return WSAEWOULDBLOCK == WSAGetLastError() ? 0 : -1;
+#else
+        return ((EAGAIN == errno) || (EWOULDBLOCK == errno)) ? 0 : -1;
+#endif
+    }
+    return received;
+}
+
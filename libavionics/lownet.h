@@ -8,25 +8,31 @@
 
 #include <stdlib.h>
 #include <stdint.h>
+#include <vector>
 
 
 namespace xa {
 
-/// Buffer for data
+/// Buffer for data.
+/// Removed data only moves read offset, buffer is compacted lazily
+/// when more space is needed.
 class NetBuf
 {
     private:
-        /// Pointer to data buffer
+        /// Pointer to data buffer or NULL if nothing allocated yet
         unsigned char *data;
 
         /// size of allocated buffer
         size_t allocated;
 
+        /// Offset of first byte of data
+        size_t start;
+
         /// How much data located in buffer
         size_t filled;
 
     public:
-        /// Create new empty buffer
+        /// Create new empty buffer.  Memory is allocated on first append
         NetBuf();
         
         /// Copy buffer
@@ -39,7 +45,10 @@ class NetBuf
         ~NetBuf();
 
     public:
-        /// Make sure buffer size is at least size bytes.
+        /// Exchange contents of buffers without copying data
+        void swap(NetBuf &netBuf);
+
+        /// Make sure buffer has space for size more bytes.
         /// Allocates more memory if needed
         void ensureHasSpace(size_t size);
 
@@ -61,17 +70,24 @@ class NetBuf
         /// Append double value to buffer.
         void addDouble(double v);
 
+        /// Append variable length unsigned integer to buffer.
+        /// Every byte stores 7 bits, high bit is set if more bytes follow
+        void addVarint(unsigned v);
+
+        /// Append 64 bit variable length unsigned integer to buffer.
+        void addVarint64(uint64_t v);
+
         /// Remove data from start of buffer
         void remove(size_t size);
 
         /// Returns pointer to data buffer
-        unsigned char* getData() { return data; };
+        unsigned char* getData() { return data + start; };
 
         /// Returns how much bytes stored in buffer
         size_t getFilled() { return filled; };
         
         /// Returns pointer to free space at data buffer
-        unsigned char* getFreeSpace() { return data + filled; };
+        unsigned char* getFreeSpace() { return data + start + filled; };
 
         /// Mark more space as filled
         void increaseFilled(size_t size);
@@ -93,6 +109,55 @@ double netToDouble(const unsigned char *data);
 /// Returns size of marshaled properties
 int getPropTypeSize(int type);
 
+/// Read variable length unsigned integer.
+/// Returns number of bytes used or 0 if data is incomplete
+int netToVarint(const unsigned char *data, size_t size, unsigned &value);
+
+
+/// Reads fields of message from received data.
+/// Every read fails if message is not received completely yet
+class NetReader
+{
+    private:
+        /// Received data
+        const unsigned char *data;
+
+        /// Size of received data
+        size_t size;
+
+        /// Position of next field
+        size_t pos;
+
+        /// True if message can't be parsed
+        bool invalid;
+
+    public:
+        /// Start reading data
+        NetReader(const unsigned char *data, size_t size);
+
+    public:
+        /// Read single byte
+        bool getUint8(int &value);
+
+        /// Read 2 bytes integer in network order
+        bool getUint16(int &value);
+
+        /// Read variable length integer
+        bool getVarint(unsigned &value);
+
+        /// Read 64 bit variable length integer
+        bool getVarint64(uint64_t &value);
+
+        /// Returns pointer to size bytes of data or NULL
+        const unsigned char* getBytes(size_t size);
+
+        /// Returns number of bytes read
+        size_t getPos() const { return pos; }
+
+        /// Returns true if data contains malformed field
+        bool isInvalid() const { return invalid; }
+};
+
 
 /// Receiver of network data
 class NetReceiver
@@ -106,6 +171,88 @@ class NetReceiver
 };
 
 
+/// Socket has data to receive or connection to accept
+#define NET_CAN_RECEIVE 1
+
+/// Socket can send data
+#define NET_CAN_SEND 2
+
+/// Socket failed or was closed by peer
+#define NET_FAILED 4
+
+
+/// System specific set of polled sockets
+struct PollSet;
+
+
+/// Checks readiness of many sockets with single system call.
+/// Uses epoll on Linux and poll() on other systems.
+class NetPoller
+{
+    private:
+        /// Logger object
+        Log &log;
+
+        /// System specific polling state
+        PollSet *pollSet;
+
+        /// Registered sockets
+        std::vector<int> socks;
+
+        /// Readiness of sockets indexed by socket
+        std::vector<int> ready;
+
+        /// Sockets reported by last poll
+        std::vector<int> readySocks;
+
+        /// Non-zero if socket is checked for sending, indexed by socket
+        std::vector<int> sendWanted;
+
+        /// Socket interrupting poll or -1
+        int wakeSock;
+
+    public:
+        /// Create empty poller
+        NetPoller(Log &log);
+
+        /// Destroy poller
+        ~NetPoller();
+
+    private:
+        NetPoller(const NetPoller&);
+        NetPoller& operator=(const NetPoller&);
+
+    public:
+        /// Start watching socket.  Returns non-zero on error
+        int add(int sock);
+
+        /// Stop watching socket
+        void remove(int sock);
+
+        /// Check if socket can send data.  Sockets are checked for
+        /// receiving only by default, so idle sockets don't wake poll
+        void setWantSend(int sock, bool want);
+
+        /// Allow other threads to interrupt poll.
+        /// Returns non-zero on error
+        int enableWakeup();
+
+        /// Make current or next poll return immediately.
+        /// Can be called from any thread
+        void wakeup();
+
+        /// Check all sockets at once.
+        /// \param timeout max time to wait in milliseconds, 0 to not wait
+        /// Returns number of ready sockets or -1 on error
+        int poll(int timeout);
+
+        /// Returns readiness flags of socket found by last poll
+        int getEvents(int sock) const {
+            return (0 <= sock) && (sock < (int)ready.size()) ? ready[sock] : 0;
+        }
+};
+
+
 /// Low-level async net routinues
 class AsyncCon
 {
@@ -125,6 +272,9 @@ class AsyncCon
         /// Data receiver callback
         NetReceiver *receiver;
 
+        /// Poller checking socket state or NULL
+        NetPoller *poller;
+
     public:
         /// Create async net struture
         AsyncCon(Log &log);
@@ -158,6 +308,10 @@ class AsyncCon
         /// Set data receiver callback
         void setCallback(NetReceiver *receiver);
 
+        /// Use shared poller instead of polling socket in update.
+        /// Poller must be polled before update is called
+        void setPoller(NetPoller *poller);
+
         /// Close connection
         void close();
 
@@ -198,6 +352,9 @@ class TcpServer
         /// Connection acceptor callback
         ConnectionAcceptor *acceptor;
 
+        /// Poller checking socket state or NULL
+        NetPoller *poller;
+
     public:
         /// create server object
         TcpServer(Log &log);
@@ -209,6 +366,9 @@ class TcpServer
         /// Set acceptor callback
         void setCallback(ConnectionAcceptor *acceptor);
 
+        /// Use shared poller for checking incoming connections
+        void setPoller(NetPoller *poller);
+
         /// open server socket
         int start(int port);
 
@@ -222,6 +382,53 @@ class TcpServer
         bool isRunning();
 };
 
+
+/// UDP socket sending or receiving datagrams of multicast group
+class UdpSocket
+{
+    private:
+        /// socket descriptor or -1 if closed
+        int sock;
+
+        /// address of multicast group, struct sockaddr_in
+        unsigned char addr[16];
+
+    public:
+        /// create closed socket
+        UdpSocket();
+
+        /// close socket
+        ~UdpSocket();
+
+    private:
+        UdpSocket(const UdpSocket&);
+        UdpSocket& operator=(const UdpSocket&);
+
+    public:
+        /// Open socket sending datagrams to group.
+        /// Datagrams are looped back to receivers on the same host.
+        /// \param ttl max number of routers datagram passes
+        /// Returns non-zero on error
+        int openSender(const char *group, int port, int ttl);
+
+        /// Open non-blocking socket receiving datagrams of group.
+        /// Returns non-zero on error
+        int openReceiver(const char *group, int port);
+
+        /// Close socket
+        void close();
+
+        /// Returns true if socket is open
+        bool isOpen() const { return 0 <= sock; }
+
+        /// Send datagram to group.  Returns non-zero on error
+        int send(const unsigned char *data, size_t size);
+
+        /// Receive datagram.  Returns size of datagram, 0 if there is
+        /// no datagram or -1 on error
+        int receive(unsigned char *data, size_t size);
+};
+
 };
 
 #endif
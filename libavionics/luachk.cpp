@@ -32,6 +32,28 @@ lua_safe_register(lua_State *L, const char *name, lua_CFunction f)
 	lua_setglobal(L, name);
 }
 
+// same as lua_safe_callback but function is stored in second upvalue.
+// first upvalue is left for data of function
+int
+lua_safe_closure_callback(lua_State *L)
+{
+	lua_safe_lock();
+	lua_CFunction f = (lua_CFunction )lua_touserdata(L, lua_upvalueindex(2));
+	int r =  f(L);
+	lua_safe_unlock();
+	return r;
+}
+
+void
+lua_safe_register_closure(lua_State *L, const char *name, lua_CFunction f,
+		void *data)
+{
+	lua_pushlightuserdata(L, data);
+	lua_pushlightuserdata(L, (void *)f);
+	lua_pushcclosure(L, &lua_safe_closure_callback, 2);
+	lua_setglobal(L, name);
+}
+
 int 
 lua_safe_pcall(lua_State *L, int a, int b, int c) 
 {
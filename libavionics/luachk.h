@@ -9,12 +9,25 @@ extern "C" {
 
 int  lua_safe_pcall(lua_State *, int, int, int);
 void lua_safe_register(lua_State *L, const char *name, lua_CFunction f);
+void lua_safe_register_closure(lua_State *L, const char *name, 
+        lua_CFunction f, void *data);
+
+/// Register global C function with data pointer as first upvalue
+static inline void lua_register_closure(lua_State *L, const char *name, 
+        lua_CFunction f, void *data)
+{
+    lua_pushlightuserdata(L, data);
+    lua_pushcclosure(L, f, 1);
+    lua_setglobal(L, name);
+}
 
 #if defined(PROTECT_LUA)
 #	define LUA_PCALL     lua_safe_pcall
 #	define LUA_REGISTER  lua_safe_register
+#	define LUA_REGISTER_CLOSURE  lua_safe_register_closure
 #else
 #	define LUA_PCALL     lua_pcall
 #	define LUA_REGISTER  lua_register
+#	define LUA_REGISTER_CLOSURE  lua_register_closure
 #endif // PROTECT_LUA
 #endif //__LUACHK_H__
@@ -313,6 +313,7 @@ Luna::Luna(sasl_lua_creator_callback luaCreator,
                 sasl_lua_destroyer_callback luaDestroyer)
 {
     this->luaDestroyer = luaDestroyer;
+    avionics = NULL;
 
     if (luaCreator)
         lua = luaCreator();
@@ -427,15 +428,22 @@ void Luna::unRef(int ref)
 {
     lua_getfield(lua, LUA_REGISTRYINDEX, "xavionics");
     luaL_unref(lua, -1, ref);
+    lua_pop(lua, 1);
 }
 
 void Luna::storeAvionics(Avionics *avionics)
 {
+    this->avionics = avionics;
     lua_pushlightuserdata(lua, avionics);
     lua_setfield(lua, LUA_REGISTRYINDEX, "avionics");
 }
 
-Avionics* xa::getAvionics(lua_State *lua)
+void Luna::registerFunction(const char *name, lua_CFunction f)
+{
+    LUA_REGISTER_CLOSURE(lua, name, f, avionics);
+}
+
+Avionics* xa::findAvionics(lua_State *lua)
 {
     lua_getfield(lua, LUA_REGISTRYINDEX, "avionics");
     Avionics *v = (Avionics*)lua_touserdata(lua, -1);
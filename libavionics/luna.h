@@ -14,6 +14,13 @@ extern "C" {
 
 #include "luachk.h"
 
+
+/// Lua type code of LuaJIT FFI cdata objects (not exported by lua.h)
+#ifndef LUA_TCDATA
+#define LUA_TCDATA 10
+#endif
+
+
 namespace xa {
 
 
@@ -30,6 +37,9 @@ class Luna
         // lua destroyer callback
         sasl_lua_destroyer_callback luaDestroyer;
 
+        /// Avionics passed to registered functions
+        Avionics *avionics;
+
     public:
         /// Create LUA instance
         Luna(sasl_lua_creator_callback luaCreator,
@@ -91,10 +101,24 @@ class Luna
 
         /// Store data in registry table
         void storeAvionics(Avionics *avionics);
+
+        /// Register global C function.  Avionics stored by 
+        /// storeAvionics is passed to function as first upvalue.
+        /// \param name name of function in Lua
+        /// \param f function to register
+        void registerFunction(const char *name, lua_CFunction f);
 };
 
 
-Avionics* getAvionics(lua_State *lua);
+/// Returns avionics of function registered by Luna::registerFunction
+inline Avionics* getAvionics(lua_State *lua)
+{
+    return (Avionics*)lua_touserdata(lua, lua_upvalueindex(1));
+}
+
+/// Returns avionics stored in registry table.  Slower than getAvionics
+/// but can be called from any context, e.g. from C callbacks.
+Avionics* findAvionics(lua_State *lua);
 
 };
 
@@ -0,0 +1,94 @@
+#include "netthread.h"
+
+#ifdef WINDOWS
+#include <windows.h>
+#endif
+
+
+using namespace xa;
+
+
+void xa::memoryBarrier()
+{
+#ifdef WINDOWS
+    MemoryBarrier();
+#else
+    __sync_synchronize();
+#endif
+}
+
+
+/// Function and argument passed to new thread
+struct ThreadStart
+{
+    void (*function)(void *arg);
+    void *arg;
+};
+
+
+#ifdef WINDOWS
+static DWORD WINAPI threadProc(LPVOID param)
+#else
+static void* threadProc(void *param)
+#endif
+{
+    ThreadStart start = *(ThreadStart*)param;
+    delete (ThreadStart*)param;
+    start.function(start.arg);
+    return 0;
+}
+
+
+NetThread::NetThread()
+{
+    running = false;
+}
+
+
+NetThread::~NetThread()
+{
+    join();
+}
+
+
+int NetThread::start(void (*function)(void *arg), void *arg)
+{
+    if (running)
+        return -1;
+
+    ThreadStart *start = new ThreadStart;
+    start->function = function;
+    start->arg = arg;
+
+#ifdef WINDOWS
+    handle = CreateThread(NULL, 0, threadProc, start, 0, NULL);
+    if (! handle) {
+        delete start;
+        return -1;
+    }
+#else
+    if (pthread_create(&thread, NULL, threadProc, start)) {
+        delete start;
+        return -1;
+    }
+#endif
+
+    running = true;
+    return 0;
+}
+
+
+void NetThread::join()
+{
+    if (! running)
+        return;
+
+#ifdef WINDOWS
+    WaitForSingleObject(handle, INFINITE);
+    CloseHandle(handle);
+#else
+    pthread_join(thread, NULL);
+#endif
+    running = false;
+}
+
@@ -0,0 +1,138 @@
+#ifndef __NET_THREAD_H__
+#define __NET_THREAD_H__
+
+
+#include <stdlib.h>
+#include <string>
+#include <vector>
+#ifndef WINDOWS
+#include <pthread.h>
+#endif
+
+
+namespace xa {
+
+
+/// Full memory barrier.  Memory operations are not reordered across it
+void memoryBarrier();
+
+
+/// Lock free queue with single producer and single consumer thread.
+/// Capacity is fixed, elements are copied to preallocated slots.
+template <class T>
+class SpscQueue
+{
+    private:
+        /// Slots of elements.  One slot always stays empty
+        std::vector<T> items;
+
+        /// Index of first element, changed by consumer only
+        volatile size_t head;
+
+        /// Index after last element, changed by producer only
+        volatile size_t tail;
+
+    public:
+        /// Create empty queue
+        /// \param capacity max number of elements in queue
+        SpscQueue(size_t capacity): items(capacity + 1) {
+            head = tail = 0;
+        }
+
+    private:
+        SpscQueue(const SpscQueue&);
+        SpscQueue& operator=(const SpscQueue&);
+
+    public:
+        /// Append element.  Called by producer thread only.
+        /// Returns false if queue is full
+        bool push(const T &value) {
+            size_t next = (tail + 1) % items.size();
+            if (next == head)
+                return false;
+            memoryBarrier();
+            items[tail] = value;
+            // element must be written before consumer can see it
+            memoryBarrier();
+            tail = next;
+            return true;
+        }
+
+        /// Remove first element.  Called by consumer thread only.
+        /// Returns false if queue is empty
+        bool pop(T &value) {
+            if (head == tail)
+                return false;
+            memoryBarrier();
+            value = items[head];
+            // element must be read before producer can reuse slot
+            memoryBarrier();
+            head = (head + 1) % items.size();
+            return true;
+        }
+
+        /// Remove all elements.  Called only when no thread uses queue
+        void clear() { head = tail = 0; }
+};
+
+
+/// Message logged by network thread
+struct LogMessage
+{
+    /// level of message
+    int level;
+
+    /// text of message
+    std::string text;
+};
+
+
+/// Messages passed from network thread to thread owning logger
+class LogQueue: public SpscQueue<LogMessage>
+{
+    public:
+        LogQueue(size_t capacity): SpscQueue<LogMessage>(capacity) { }
+};
+
+
+/// System thread running single function
+class NetThread
+{
+    private:
+#ifdef WINDOWS
+        /// thread handle
+        void *handle;
+#else
+        /// thread handle
+        pthread_t thread;
+#endif
+
+        /// true if thread was started and not joined yet
+        bool running;
+
+    public:
+        NetThread();
+
+        /// Waits for thread termination
+        ~NetThread();
+
+    private:
+        NetThread(const NetThread&);
+        NetThread& operator=(const NetThread&);
+
+    public:
+        /// Run function in new thread.  Returns non-zero on error
+        int start(void (*function)(void *arg), void *arg);
+
+        /// Wait for thread termination
+        void join();
+
+        /// Returns true if thread is started
+        bool isRunning() const { return running; }
+};
+
+};
+
+
+#endif
+
@@ -2,6 +2,7 @@
 
 #include "avionics.h"
 #include <string.h>
+#include <math.h>
 
 
 using namespace xa;
@@ -19,11 +20,78 @@ static int getPropType(const std::string &propType)
         return PROP_DOUBLE;
     else if ("string" == propType)
         return PROP_STRING;
+    else if ("intarray" == propType)
+        return PROP_INT_ARRAY;
+    else if ("floatarray" == propType)
+        return PROP_FLOAT_ARRAY;
     else
         return -1;
 }
 
 
+/// Set range of array property from Lua table at index idx.
+/// count defaults to table size.  FFI arrays are passed by FFI binding in
+/// init.lua which knows their size and type, they are rejected here
+template <typename T>
+static int setArrayFromLua(lua_State *L, SaslPropRef prop, int type, 
+        int offset, int idx, int count)
+{
+    Properties &props = getAvionics(L)->getProps();
+
+    if (! lua_istable(L, idx))
+        return -1;
+    if (0 >= count)
+        count = lua_objlen(L, idx);
+    if (! count)
+        return 0;
+
+    T *values = (T*)props.getArrayBuffer(count);
+    for (int i = 0; i < count; i++) {
+        lua_rawgeti(L, idx, i + 1);
+        values[i] = (T)lua_tonumber(L, -1);
+        lua_pop(L, 1);
+    }
+    return props.setPropArray(prop, type, values, offset, count);
+}
+
+
+/// Read range of array property.
+/// Arguments are property, offset, count and optional table to fill.
+/// If count is nil all elements after offset are read.
+/// Returns table of values.  FFI arrays are filled by FFI binding in
+/// init.lua, size of their memory is not known here
+template <typename T>
+static int getArrayToLua(lua_State *L, int type)
+{
+    Properties &props = getAvionics(L)->getProps();
+    SaslPropRef prop = (SaslPropRef)lua_touserdata(L, 1);
+    int offset = (int)lua_tonumber(L, 2);
+    
+    int count;
+    if (lua_isnoneornil(L, 3))
+        count = props.getPropArray(prop, type, NULL, offset, 0);
+    else
+        count = (int)lua_tonumber(L, 3);
+
+    int read = 0;
+    T *values = NULL;
+    if (0 < count) {
+        values = (T*)props.getArrayBuffer(count);
+        read = props.getPropArray(prop, type, values, offset, count);
+    }
+
+    if (lua_istable(L, 4))
+        lua_pushvalue(L, 4);
+    else
+        lua_createtable(L, read, 0);
+    for (int i = 0; i < read; i++) {
+        lua_pushnumber(L, values[i]);
+        lua_rawseti(L, -2, i + 1);
+    }
+    return 1;
+}
+
+
 /// Lua wrapper for getProp
 static int luaGetProp(lua_State *L)
 {
@@ -65,7 +133,9 @@ static int luaCreateProp(lua_State *L)
     int type = getPropType(lua_tostring(L, 2));
     int maxLen = 0;
     int valArg = 3;
-    if (PROP_STRING == type) {
+    if ((PROP_STRING == type) || (PROP_INT_ARRAY == type) || 
+            (PROP_FLOAT_ARRAY == type)) 
+    {
         maxLen = lua_tonumber(L, 3);
         valArg++;
 		if (lua_gettop(L) == 5) {
@@ -103,6 +173,12 @@ static int luaCreateProp(lua_State *L)
                             getAvionics(L)->getProps().setProp(prop, value);
                         break;
                     }
+                case PROP_INT_ARRAY:
+                    setArrayFromLua<int>(L, prop, PROP_INT, 0, valArg, 0);
+                    break;
+                case PROP_FLOAT_ARRAY:
+                    setArrayFromLua<float>(L, prop, PROP_FLOAT, 0, valArg, 0);
+                    break;
             }
         }
         lua_pushlightuserdata(L, prop);
@@ -126,13 +202,18 @@ static int luaCreateFuncProp(lua_State *L)
     std::string propName = lua_tostring(L, 1);
     int type = getPropType(lua_tostring(L, 2));
     int maxSize = lua_tonumber(L, 5);
+    double cacheAge = -1;
+    if (lua_isnumber(L, 6))
+        cacheAge = lua_tonumber(L, 6);
+    else if (lua_toboolean(L, 6))
+        cacheAge = 0;
     lua_pushvalue(L, 3);
     int getter = lua.addRef();
     lua_pushvalue(L, 4);
     int setter = lua.addRef();
    
     SaslPropRef p = getAvionics(L)->getProps().registerFuncProp(propName, type, 
-            maxSize, getter, setter);
+            maxSize, getter, setter, cacheAge);
     if (p)
         lua_pushlightuserdata(L, p);
     else
@@ -253,24 +334,249 @@ static int luaSetProps(lua_State *L)
     return 0;
 }
 
+/// Lua wrapper for getPropArray with int values
+static int luaGetPropia(lua_State *L)
+{
+    return getArrayToLua<int>(L, PROP_INT);
+}
 
 
-void xa::exportPropsToLua(Luna &lua)
+/// Lua wrapper for setPropArray with int values
+/// Arguments are property, offset, table and count
+static int luaSetPropia(lua_State *L)
 {
-    lua_State *L = lua.getLua();
+    SaslPropRef prop = (SaslPropRef)lua_touserdata(L, 1);
+    setArrayFromLua<int>(L, prop, PROP_INT, (int)lua_tonumber(L, 2), 3,
+            (int)lua_tonumber(L, 4));
+    return 0;
+}
 
-    LUA_REGISTER(L, "findProp", luaGetProp);
-    LUA_REGISTER(L, "createProp", luaCreateProp);
-    LUA_REGISTER(L, "createFuncProp", luaCreateFuncProp);
-    LUA_REGISTER(L, "freeProp", luaFreeProp);
-    LUA_REGISTER(L, "getPropi", luaGetPropi);
-    LUA_REGISTER(L, "setPropi", luaSetPropi);
-    LUA_REGISTER(L, "getPropf", luaGetPropf);
-    LUA_REGISTER(L, "setPropf", luaSetPropf);
-    LUA_REGISTER(L, "getPropd", luaGetPropd);
-    LUA_REGISTER(L, "setPropd", luaSetPropd);
-    LUA_REGISTER(L, "getProps", luaGetProps);
-    LUA_REGISTER(L, "setProps", luaSetProps);
+
+/// Lua wrapper for getPropArray with float values
+static int luaGetPropfa(lua_State *L)
+{
+    return getArrayToLua<float>(L, PROP_FLOAT);
+}
+
+
+/// Lua wrapper for setPropArray with float values
+/// Arguments are property, offset, table and count
+static int luaSetPropfa(lua_State *L)
+{
+    SaslPropRef prop = (SaslPropRef)lua_touserdata(L, 1);
+    setArrayFromLua<float>(L, prop, PROP_FLOAT, (int)lua_tonumber(L, 2), 3,
+            (int)lua_tonumber(L, 4));
+    return 0;
+}
+
+
+/// Returns number of elements of array property
+static int luaGetPropArraySize(lua_State *L)
+{
+    SaslPropRef prop = (SaslPropRef)lua_touserdata(L, 1);
+    lua_pushnumber(L, getAvionics(L)->getProps().getPropArray(prop, 
+                PROP_FLOAT, NULL, 0, 0));
+    return 1;
+}
+
+/// Lua wrapper for addSnapshotProp
+/// Arguments are property, type name and default value.
+/// Returns slot of property or nil
+static int luaAddSnapshotProp(lua_State *L)
+{
+    SaslPropRef prop = (SaslPropRef)lua_touserdata(L, 1);
+    int type = lua_isstring(L, 2) ? getPropType(lua_tostring(L, 2)) : -1;
+    int slot = getAvionics(L)->getProps().addSnapshotProp(prop, type, 
+            lua_tonumber(L, 3));
+    if (-1 == slot)
+        lua_pushnil(L);
+    else
+        lua_pushnumber(L, slot);
+    return 1;
+}
+
+
+/// Lua wrapper for getSnapshoti
+static int luaGetSnapshoti(lua_State *L)
+{
+    lua_pushnumber(L, getAvionics(L)->getProps().getSnapshoti(
+                (int)lua_tonumber(L, 1)));
+    return 1;
+}
+
+
+/// Lua wrapper for setSnapshoti
+static int luaSetSnapshoti(lua_State *L)
+{
+    getAvionics(L)->getProps().setSnapshoti((int)lua_tonumber(L, 1), 
+            (int)lua_tonumber(L, 2));
+    return 0;
+}
+
+
+/// Lua wrapper for getSnapshotf
+static int luaGetSnapshotf(lua_State *L)
+{
+    lua_pushnumber(L, getAvionics(L)->getProps().getSnapshotf(
+                (int)lua_tonumber(L, 1)));
+    return 1;
+}
+
+
+/// Lua wrapper for setSnapshotf
+static int luaSetSnapshotf(lua_State *L)
+{
+    getAvionics(L)->getProps().setSnapshotf((int)lua_tonumber(L, 1), 
+            (float)lua_tonumber(L, 2));
+    return 0;
+}
+
+
+/// Lua wrapper for getSnapshotd
+static int luaGetSnapshotd(lua_State *L)
+{
+    lua_pushnumber(L, getAvionics(L)->getProps().getSnapshotd(
+                (int)lua_tonumber(L, 1)));
+    return 1;
+}
+
+
+/// Lua wrapper for setSnapshotd
+static int luaSetSnapshotd(lua_State *L)
+{
+    getAvionics(L)->getProps().setSnapshotd((int)lua_tonumber(L, 1), 
+            lua_tonumber(L, 2));
+    return 0;
+}
+
+/// Lua wrapper for setPropImmediate
+/// Arguments are property and optional flag, true by default
+static int luaSetPropImmediate(lua_State *L)
+{
+    SaslPropRef prop = (SaslPropRef)lua_touserdata(L, 1);
+    bool immediate = lua_isnoneornil(L, 2) || lua_toboolean(L, 2);
+    getAvionics(L)->getProps().setPropImmediate(prop, immediate);
+    return 0;
+}
+
+/// Call function when property changes.
+/// Arguments are property object or reference, callback and optional
+/// min change of numeric value.  Type of property object is taken from
+/// its __type field, references are watched as doubles.
+/// Callback is called with new and old values.  Returns watch ID
+static int luaOnPropertyChanged(lua_State *L)
+{
+    SaslPropRef prop = NULL;
+    int type = PROP_DOUBLE;
+    if (lua_istable(L, 1)) {
+        lua_getfield(L, 1, "__ref");
+        prop = (SaslPropRef)lua_touserdata(L, -1);
+        lua_getfield(L, 1, "__type");
+        if (lua_isstring(L, -1))
+            type = getPropType(lua_tostring(L, -1));
+        lua_pop(L, 2);
+    } else
+        prop = (SaslPropRef)lua_touserdata(L, 1);
+
+    if ((! prop) || (! lua_isfunction(L, 2)) || 
+            ((PROP_INT != type) && (PROP_FLOAT != type) && 
+             (PROP_DOUBLE != type) && (PROP_STRING != type)))
+    {
+        lua_pushnil(L);
+        return 1;
+    }
+
+    Luna &lua = getAvionics(L)->getLuna();
+    lua_pushvalue(L, 2);
+    int callback = lua.addRef();
+    lua_pushnumber(L, getAvionics(L)->getProps().addWatch(prop, type, 
+                callback, lua_tonumber(L, 3)));
+    return 1;
+}
+
+
+/// Remove watch created by onPropertyChanged
+static int luaRemovePropertyWatch(lua_State *L)
+{
+    if (lua_isnumber(L, 1))
+        getAvionics(L)->getProps().removeWatch((int)lua_tonumber(L, 1));
+    return 0;
+}
+
+
+/// Start recording property reads and writes.
+/// Argument is name of log file.  Returns true on success
+static int luaStartPropsRecording(lua_State *L)
+{
+    Avionics *avionics = getAvionics(L);
+    const char *fileName = lua_tostring(L, 1);
+    int err = fileName ? 
+        avionics->getProps().startRecording(fileName) : -1;
+    if (err)
+        avionics->getLog().error("Can't record properties to %s", 
+                fileName ? fileName : "(nil)");
+    lua_pushboolean(L, ! err);
+    return 1;
+}
+
+
+/// Stop recording properties
+static int luaStopPropsRecording(lua_State *L)
+{
+    getAvionics(L)->getProps().stopRecording();
+    return 0;
+}
+
+
+void xa::addStatToTable(void *ref, const char *name, double value)
+{
+    lua_State *L = (lua_State*)ref;
+    lua_pushnumber(L, value);
+    lua_setfield(L, -2, name);
+}
+
+
+/// Returns table of properties backend statistics
+static int luaGetPropsStats(lua_State *L)
+{
+    lua_newtable(L);
+    getAvionics(L)->getProps().reportStats(addStatToTable, L);
+    return 1;
+}
+
+
+void xa::exportPropsToLua(Luna &lua)
+{
+    lua.registerFunction("findProp", luaGetProp);
+    lua.registerFunction("createProp", luaCreateProp);
+    lua.registerFunction("createFuncProp", luaCreateFuncProp);
+    lua.registerFunction("freeProp", luaFreeProp);
+    lua.registerFunction("getPropi", luaGetPropi);
+    lua.registerFunction("setPropi", luaSetPropi);
+    lua.registerFunction("getPropf", luaGetPropf);
+    lua.registerFunction("setPropf", luaSetPropf);
+    lua.registerFunction("getPropd", luaGetPropd);
+    lua.registerFunction("setPropd", luaSetPropd);
+    lua.registerFunction("getProps", luaGetProps);
+    lua.registerFunction("setProps", luaSetProps);
+    lua.registerFunction("getPropia", luaGetPropia);
+    lua.registerFunction("setPropia", luaSetPropia);
+    lua.registerFunction("getPropfa", luaGetPropfa);
+    lua.registerFunction("setPropfa", luaSetPropfa);
+    lua.registerFunction("getPropArraySize", luaGetPropArraySize);
+    lua.registerFunction("addSnapshotProp", luaAddSnapshotProp);
+    lua.registerFunction("getSnapshoti", luaGetSnapshoti);
+    lua.registerFunction("setSnapshoti", luaSetSnapshoti);
+    lua.registerFunction("getSnapshotf", luaGetSnapshotf);
+    lua.registerFunction("setSnapshotf", luaSetSnapshotf);
+    lua.registerFunction("getSnapshotd", luaGetSnapshotd);
+    lua.registerFunction("setSnapshotd", luaSetSnapshotd);
+    lua.registerFunction("setPropImmediate", luaSetPropImmediate);
+    lua.registerFunction("onPropertyChanged", luaOnPropertyChanged);
+    lua.registerFunction("removePropertyWatch", luaRemovePropertyWatch);
+    lua.registerFunction("getPropsStats", luaGetPropsStats);
+    lua.registerFunction("startPropsRecording", luaStartPropsRecording);
+    lua.registerFunction("stopPropsRecording", luaStopPropsRecording);
 }
 
 
@@ -278,6 +584,13 @@ Properties::Properties(Luna &lua): lua(lua)
 {
     propsCallbacks = NULL;
     props = NULL;
+    snapshotTime = 0;
+    frameCounter = 0;
+    watchesCount = 0;
+    watchesFired = 0;
+    watchesTime = 0;
+    luaBlocked = false;
+    blockedCall = false;
 }
 
 
@@ -293,6 +606,11 @@ Properties::~Properties()
         lua.unRef(h.getter);
         lua.unRef(h.setter);
     }
+
+    for (std::vector<PropWatch>::iterator i = watches.begin(); 
+            i != watches.end(); i++)
+        if ((*i).prop)
+            lua.unRef((*i).callback);
 }
 
 
@@ -303,6 +621,27 @@ void Properties::setProps(struct SaslPropsCallbacks *callbacks, SaslProps p)
 
     propsCallbacks = callbacks;
     props = p;
+    handles.clear();
+}
+
+
+void Properties::addHandle(SaslPropRef prop, const std::string &name, 
+        int type)
+{
+    if (! prop)
+        return;
+
+    HandleInfo &handle = handles[prop];
+    // backend may reuse freed reference for another property
+    if ((! handle.refs) || (handle.name != name) || (handle.type != type)) {
+        handle.name = name;
+        handle.type = type;
+        handle.refs = 0;
+    }
+    handle.refs++;
+
+    if (recorder.isOpen())
+        recorder.addProp(prop, name, type);
 }
 
 
@@ -311,7 +650,9 @@ SaslPropRef Properties::getProp(const std::string &name, int type)
     if (! (propsCallbacks && props))
         return NULL;
 
-    return propsCallbacks->get_prop_ref(props, name.c_str(), type);
+    SaslPropRef prop = propsCallbacks->get_prop_ref(props, name.c_str(), type);
+    addHandle(prop, name, type);
+    return prop;
 }
 
 
@@ -320,7 +661,10 @@ SaslPropRef Properties::createProp(const std::string &name, int type, int maxSiz
     if (! (propsCallbacks && props))
         return NULL;
 
-    return propsCallbacks->create_prop(props, name.c_str(), type, maxSize, notPublish);
+    SaslPropRef prop = propsCallbacks->create_prop(props, name.c_str(), type, 
+            maxSize, notPublish);
+    addHandle(prop, name, type);
+    return prop;
 }
 
 
@@ -329,6 +673,15 @@ void Properties::freeProp(SaslPropRef prop)
     if ((! prop) || (! propsCallbacks))
         return;
 
+    // released handle may be reused for another property
+    std::map<SaslPropRef, HandleInfo>::iterator i = handles.find(prop);
+    if ((i != handles.end()) && (0 >= --(*i).second.refs)) {
+        handles.erase(i);
+        intSnapshot.remove(prop);
+        floatSnapshot.remove(prop);
+        doubleSnapshot.remove(prop);
+    }
+
     propsCallbacks->free_prop_ref(prop);
 }
 
@@ -352,6 +705,8 @@ int Properties::getPropi(SaslPropRef prop, int dflt, int *err)
     int res = propsCallbacks->get_prop_int(prop, err);
     if (*err)
         res = dflt;
+    else if (recorder.isOpen())
+        recorder.recordInt(RECORD_READ, prop, res);
     return res;
 }
 
@@ -364,6 +719,8 @@ int Properties::setProp(SaslPropRef prop, int value)
     if (! (propsCallbacks && props))
         return 0;
 
+    if (recorder.isOpen())
+        recorder.recordInt(RECORD_WRITE, prop, value);
     return propsCallbacks->set_prop_int(prop, value);
 }
 
@@ -388,6 +745,8 @@ float Properties::getPropf(SaslPropRef prop, float dflt, int *err)
     float res = propsCallbacks->get_prop_float(prop, err);
     if (*err)
         res = dflt;
+    else if (recorder.isOpen())
+        recorder.recordFloat(RECORD_READ, prop, res);
     return res;
 }
 
@@ -400,10 +759,12 @@ int Properties::setProp(SaslPropRef prop, float value)
     if (! (propsCallbacks && props))
             return 0;
 
+    if (recorder.isOpen())
+        recorder.recordFloat(RECORD_WRITE, prop, value);
     return propsCallbacks->set_prop_float(prop, value);
 }
 
-float Properties::getPropd(SaslPropRef prop, double dflt, int *err)
+double Properties::getPropd(SaslPropRef prop, double dflt, int *err)
 {
     int localErr;
     if (! err)
@@ -423,6 +784,8 @@ float Properties::getPropd(SaslPropRef prop, double dflt, int *err)
     double res = propsCallbacks->get_prop_double(prop, err);
     if (*err)
         res = dflt;
+    else if (recorder.isOpen())
+        recorder.recordDouble(RECORD_READ, prop, res);
     return res;
 }
 
@@ -435,6 +798,8 @@ int Properties::setProp(SaslPropRef prop, double value)
     if (! (propsCallbacks && props))
         return 0;
 
+    if (recorder.isOpen())
+        recorder.recordDouble(RECORD_WRITE, prop, value);
     return propsCallbacks->set_prop_double(prop, value);
 }
 
@@ -464,6 +829,8 @@ std::string Properties::getProps(SaslPropRef prop, const std::string &dflt,
     propsCallbacks->get_prop_string(prop, buf, sz, err);
     if (*err)
         return dflt;
+    if (recorder.isOpen())
+        recorder.recordString(RECORD_READ, prop, buf);
     return buf;
 }
 
@@ -473,6 +840,8 @@ int Properties::setProp(SaslPropRef prop, const std::string &value)
     if ((! prop) || (! (propsCallbacks && props)))
         return 0;
     
+    if (recorder.isOpen())
+        recorder.recordString(RECORD_WRITE, prop, value);
     return propsCallbacks->set_prop_string(prop, value.c_str());
 }
 
@@ -482,6 +851,9 @@ int Properties::update()
     if (! (propsCallbacks && props))
         return 0;
 
+    if (recorder.isOpen())
+        recorder.frame();
+
     int err = 0;
     if (propsCallbacks->update_props)
         err = propsCallbacks->update_props(props);
@@ -490,49 +862,377 @@ int Properties::update()
 }
 
 
+int Properties::flush()
+{
+    if (! (propsCallbacks && props && propsCallbacks->flush_props))
+        return 0;
+
+    return propsCallbacks->flush_props(props);
+}
+
+
+void Properties::setPropImmediate(SaslPropRef prop, bool immediate)
+{
+    if (prop && propsCallbacks && propsCallbacks->set_prop_immediate)
+        propsCallbacks->set_prop_immediate(prop, immediate);
+}
+
+
+int Properties::getPropArray(SaslPropRef prop, int type, void *values, 
+        int offset, int count, int *err)
+{
+    int localErr;
+    if (! err)
+        err = &localErr;
+    *err = 0;
+
+    if (! (prop && propsCallbacks && props && 
+                propsCallbacks->get_prop_array)) 
+    {
+        *err = -1;
+        return 0;
+    }
+
+    int res = propsCallbacks->get_prop_array(prop, type, values, offset, 
+            count, err);
+    if (*err)
+        return 0;
+    if (recorder.isOpen()) {
+        if (values)
+            recorder.recordArray(RECORD_READ, prop, type, values, offset, res);
+        else
+            recorder.recordSize(prop, offset + res);
+    }
+    return res;
+}
+
+
+int Properties::setPropArray(SaslPropRef prop, int type, const void *values,
+        int offset, int count)
+{
+    if (! (prop && propsCallbacks && props && 
+                propsCallbacks->set_prop_array))
+        return 0;
+
+    if (recorder.isOpen())
+        recorder.recordArray(RECORD_WRITE, prop, type, values, offset, count);
+    return propsCallbacks->set_prop_array(prop, type, values, offset, count);
+}
+
+
+void* Properties::getArrayBuffer(int count)
+{
+    if ((int)arrayBuf.size() < count)
+        arrayBuf.resize(count);
+    return &arrayBuf[0];
+}
+
+
+int Properties::addSnapshotProp(SaslPropRef prop, int type, double dflt)
+{
+    if (! prop)
+        return -1;
+
+    int slot;
+    switch (type) {
+        case PROP_INT: 
+            slot = intSnapshot.add(prop, (int)dflt); 
+            intSnapshot.values[slot] = getPropi(prop, (int)dflt);
+            return slot;
+        case PROP_FLOAT: 
+            slot = floatSnapshot.add(prop, (float)dflt); 
+            floatSnapshot.values[slot] = getPropf(prop, (float)dflt);
+            return slot;
+        case PROP_DOUBLE: 
+            slot = doubleSnapshot.add(prop, dflt); 
+            doubleSnapshot.values[slot] = getPropd(prop, dflt);
+            return slot;
+    }
+    return -1;
+}
+
+
+void Properties::updateSnapshot()
+{
+    if (! (propsCallbacks && props))
+        return;
+
+    double startTime = timer.getSeconds();
+    int err;
+
+    // reads go through getters, so they are recorded too
+    int count = intSnapshot.props.size();
+    for (int i = 0; i < count; i++)
+        intSnapshot.values[i] = getPropi(intSnapshot.props[i], 
+                intSnapshot.defaults[i], &err);
+
+    count = floatSnapshot.props.size();
+    for (int i = 0; i < count; i++)
+        floatSnapshot.values[i] = getPropf(floatSnapshot.props[i], 
+                floatSnapshot.defaults[i], &err);
+
+    count = doubleSnapshot.props.size();
+    for (int i = 0; i < count; i++)
+        doubleSnapshot.values[i] = getPropd(doubleSnapshot.props[i], 
+                doubleSnapshot.defaults[i], &err);
+
+    snapshotTime = timer.getSeconds() - startTime;
+}
+
+
+int Properties::addWatch(SaslPropRef prop, int type, int callback, 
+        double epsilon)
+{
+    size_t id = 0;
+    while ((id < watches.size()) && watches[id].prop)
+        id++;
+    if (id == watches.size())
+        watches.push_back(PropWatch());
+
+    PropWatch &watch = watches[id];
+    watch.prop = prop;
+    watch.type = type;
+    watch.callback = callback;
+    watch.epsilon = epsilon;
+    if (PROP_STRING == type)
+        watch.string = getProps(prop);
+    else
+        watch.number = getPropd(prop);
+    watchesCount++;
+    return id;
+}
+
+
+void Properties::removeWatch(int id)
+{
+    if (((unsigned)id >= watches.size()) || (! watches[id].prop))
+        return;
+
+    lua.unRef(watches[id].callback);
+    watches[id].prop = NULL;
+    watches[id].string.clear();
+    watchesCount--;
+}
+
+
+/// Push value of property to Lua stack
+static void pushValue(lua_State *L, int type, double number, 
+        const std::string &string)
+{
+    if (PROP_STRING == type)
+        lua_pushstring(L, string.c_str());
+    else
+        lua_pushnumber(L, number);
+}
+
+
+void Properties::checkWatches()
+{
+    watchesFired = 0;
+    if (! watchesCount)
+        return;
+
+    double startTime = timer.getSeconds();
+    lua_State *L = lua.getLua();
+
+    // callbacks and getters of functional properties may add new 
+    // watches, so check only existing ones and don't keep references 
+    // to elements while reading properties
+    size_t count = watches.size();
+    for (size_t i = 0; i < count; i++) {
+        SaslPropRef prop = watches[i].prop;
+        if (! prop)
+            continue;
+
+        int type = watches[i].type;
+        double oldNumber = watches[i].number;
+        double number = oldNumber;
+        std::string string;
+        bool changed;
+        switch (type) {
+            case PROP_INT:
+                number = getPropi(prop, (int)oldNumber);
+                changed = number != oldNumber;
+                break;
+            case PROP_STRING:
+                string = getProps(prop, watches[i].string);
+                changed = string != watches[i].string;
+                break;
+            default:
+                if (PROP_FLOAT == type)
+                    number = getPropf(prop, (float)oldNumber);
+                else
+                    number = getPropd(prop, oldNumber);
+                if (watches[i].epsilon > 0)
+                    changed = fabs(number - oldNumber) >= watches[i].epsilon;
+                else
+                    changed = number != oldNumber;
+        }
+
+        if (! changed)
+            continue;
+
+        watchesFired++;
+        PropWatch &watch = watches[i];
+        watch.number = number;
+        watch.string.swap(string);
+        lua.getRef(watch.callback);
+        pushValue(L, type, number, watch.string);
+        pushValue(L, type, oldNumber, string);
+        if (LUA_PCALL(L, 2, 0, 0)) {
+            findAvionics(L)->getLog().error(
+                    "Error calling property change callback: %s", 
+                    lua_tostring(L, -1));
+            lua_pop(L, 1);
+        }
+    }
+
+    watchesTime = timer.getSeconds() - startTime;
+}
+
+
+void Properties::setSnapshoti(int slot, int value)
+{
+    if ((unsigned)slot >= intSnapshot.values.size())
+        return;
+    intSnapshot.values[slot] = value;
+    setProp(intSnapshot.props[slot], value);
+}
+
+
+void Properties::setSnapshotf(int slot, float value)
+{
+    if ((unsigned)slot >= floatSnapshot.values.size())
+        return;
+    floatSnapshot.values[slot] = value;
+    setProp(floatSnapshot.props[slot], value);
+}
+
+
+void Properties::setSnapshotd(int slot, double value)
+{
+    if ((unsigned)slot >= doubleSnapshot.values.size())
+        return;
+    doubleSnapshot.values[slot] = value;
+    setProp(doubleSnapshot.props[slot], value);
+}
+
+
+int Properties::startRecording(const std::string &fileName)
+{
+    if (recorder.open(fileName))
+        return -1;
+
+    // handles created before recording are used by scripts too
+    for (std::map<SaslPropRef, HandleInfo>::iterator i = handles.begin();
+            i != handles.end(); ++i)
+        recorder.addProp((*i).first, (*i).second.name, (*i).second.type);
+    return 0;
+}
+
+
+void Properties::stopRecording()
+{
+    recorder.close();
+}
+
+
+void Properties::reportStats(sasl_stat_callback report, void *ref)
+{
+    report(ref, "snapshot.size", intSnapshot.slots.size() + 
+            floatSnapshot.slots.size() + doubleSnapshot.slots.size());
+    report(ref, "snapshot.bytes", 
+            intSnapshot.values.size() * sizeof(int) + 
+            floatSnapshot.values.size() * sizeof(float) + 
+            doubleSnapshot.values.size() * sizeof(double));
+    report(ref, "snapshot.time", snapshotTime);
+
+    int calls = 0, hits = 0;
+    for (std::list<FuncPropHandler>::iterator i = funcProps.begin();
+            i != funcProps.end(); i++) 
+    {
+        calls += (*i).calls;
+        hits += (*i).hits;
+    }
+    report(ref, "funcProps.calls", calls);
+    report(ref, "funcProps.hits", hits);
+
+    report(ref, "watches.count", watchesCount);
+    report(ref, "watches.fired", watchesFired);
+    report(ref, "watches.time", watchesTime);
+
+    if (recorder.isOpen())
+        recorder.reportStats(report, ref);
+
+    if (propsCallbacks && props && propsCallbacks->props_stats)
+        propsCallbacks->props_stats(props, report, ref);
+}
+
+
 static int propGetterCallback(int type, void *buf, int maxSize, void *ref)
 {
     Properties::FuncPropHandler *handler = (Properties::FuncPropHandler*)ref;
     if (! handler)
         return 0;
 
-    Luna &lua = handler->properties->getLua();
-    lua_State *L = lua.getLua();
-    
-    lua.getRef(handler->getter);
-    
-    if (LUA_PCALL(L, 0, 1, 0))
-        getAvionics(L)->getLog().error(
-                "Error calling property getter: %s\n", lua_tostring(L, -1));
+    if (handler->cached && handler->properties->isCacheValid(*handler))
+        handler->hits++;
+    else if (handler->properties->isLuaBlocked())
+        return 0;
     else {
-        switch (type) {
-            case PROP_INT: {
-                    int v = lua_tointeger(L, -1);
-                    if (buf && (maxSize >= (int)sizeof(v)))
-                        memcpy(buf, &v, sizeof(v));
-                    return sizeof(v);
-                }
-            case PROP_FLOAT: {
-                    float v = (float)lua_tonumber(L, -1);
-                    if (buf && (maxSize >= (int)sizeof(v)))
-                        memcpy(buf, &v, sizeof(v));
-                    return sizeof(v);
-                }
-            case PROP_DOUBLE: {
-                    double v = lua_tonumber(L, -1);
-                    if (buf && (maxSize >= (int)sizeof(v)))
-                        memcpy(buf, &v, sizeof(v));
-                    return sizeof(v);
-                }
-            case PROP_STRING: {
-                    const char *v = lua_tostring(L, -1);
-                    int len = strlen(v);
-                    if (buf && (maxSize >= (int)len))
-                        memcpy(buf, v, len + 1);
-                    return len + 1;
-                }
+        Luna &lua = handler->properties->getLua();
+        lua_State *L = lua.getLua();
+        
+        lua.getRef(handler->getter);
+        handler->calls++;
+        
+        if (LUA_PCALL(L, 0, 1, 0)) {
+            findAvionics(L)->getLog().error(
+                    "Error calling property getter: %s\n", lua_tostring(L, -1));
+            lua_pop(L, 1);
+            handler->valid = false;
+            return 0;
         }
+
+        if (PROP_STRING == type) {
+            const char *v = lua_tostring(L, -1);
+            handler->string = v ? v : "";
+        } else
+            handler->number = lua_tonumber(L, -1);
         lua_pop(L, 1);
+
+        handler->valid = true;
+        handler->frame = handler->properties->getFrameCounter();
+        if (0 < handler->maxAge)
+            handler->time = handler->properties->getTime();
+    }
+
+    switch (type) {
+        case PROP_INT: {
+                int v = (int)handler->number;
+                if (buf && (maxSize >= (int)sizeof(v)))
+                    memcpy(buf, &v, sizeof(v));
+                return sizeof(v);
+            }
+        case PROP_FLOAT: {
+                float v = (float)handler->number;
+                if (buf && (maxSize >= (int)sizeof(v)))
+                    memcpy(buf, &v, sizeof(v));
+                return sizeof(v);
+            }
+        case PROP_DOUBLE: {
+                double v = handler->number;
+                if (buf && (maxSize >= (int)sizeof(v)))
+                    memcpy(buf, &v, sizeof(v));
+                return sizeof(v);
+            }
+        case PROP_STRING: {
+                int len = handler->string.length();
+                if (buf && (0 < maxSize))
+                    memcpy(buf, handler->string.c_str(), 
+                            len + 1 > maxSize ? maxSize : len + 1);
+                return len + 1;
+            }
     }
 
     return 0;
@@ -542,9 +1242,11 @@ static int propGetterCallback(int type, void *buf, int maxSize, void *ref)
 static void propSetterCallback(int type, void *buf, int size, void *ref)
 {
     Properties::FuncPropHandler *handler = (Properties::FuncPropHandler*)ref;
-    if ((! handler) || (! buf))
+    if ((! handler) || (! buf) || handler->properties->isLuaBlocked())
         return;
 
+    handler->valid = false;
+
     Luna &lua = handler->properties->getLua();
     lua_State *L = lua.getLua();
     lua.getRef(handler->setter);
@@ -565,12 +1267,12 @@ static void propSetterCallback(int type, void *buf, int size, void *ref)
     }
     
     if (LUA_PCALL(lua.getLua(), 1, 0, 0))
-        getAvionics(L)->getLog().error(
+        findAvionics(L)->getLog().error(
                 "Error calling property setter: %s\n", lua_tostring(L, -1));
 }
 
 SaslPropRef Properties::registerFuncProp(const std::string &name, int type, 
-        int maxSize, int getter, int setter)
+        int maxSize, int getter, int setter, double cacheAge)
 {
     if (! (propsCallbacks && props))
         return 0;
@@ -579,12 +1281,34 @@ SaslPropRef Properties::registerFuncProp(const std::string &name, int type,
     handler.properties = this;
     handler.getter = getter;
     handler.setter = setter;
+    handler.cached = 0 <= cacheAge;
+    handler.maxAge = cacheAge;
+    handler.valid = false;
+    handler.frame = 0;
+    handler.time = 0;
+    handler.number = 0;
+    handler.calls = 0;
+    handler.hits = 0;
 
     funcProps.push_back(handler);
 
-    return propsCallbacks->create_func_prop(props, name.c_str(),
+    SaslPropRef prop = propsCallbacks->create_func_prop(props, name.c_str(),
             type, maxSize, propGetterCallback, propSetterCallback, 
             &(funcProps.back()));
+    addHandle(prop, name, type);
+    return prop;
+}
+
+
+bool Properties::isCacheValid(const FuncPropHandler &handler)
+{
+    if (! handler.valid)
+        return false;
+
+    if (0 < handler.maxAge)
+        return timer.getSeconds() - handler.time < handler.maxAge;
+    else
+        return handler.frame == frameCounter;
 }
 
 
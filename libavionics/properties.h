@@ -5,8 +5,12 @@
 #include "libavcallbacks.h"
 #include <string>
 #include <list>
+#include <map>
+#include <vector>
 #include "luna.h"
 #include "log.h"
+#include "rttimer.h"
+#include "propsrecorder.h"
 
 
 namespace xa {
@@ -36,12 +40,175 @@ class Properties
 
             /// Lua reference to setter func
             int setter;
+
+            /// true if result of getter is cached
+            bool cached;
+
+            /// max age of cached value in seconds, zero means one frame
+            double maxAge;
+
+            /// true if cached value can be used
+            bool valid;
+
+            /// frame when value was cached
+            int frame;
+
+            /// time when value was cached
+            double time;
+
+            /// cached value of numeric property
+            double number;
+
+            /// cached value of string property
+            std::string string;
+
+            /// number of getter calls
+            int calls;
+
+            /// number of reads served from cache
+            int hits;
         };
 
     private:
         /// list of registered func props
         std::list<FuncPropHandler> funcProps;
 
+        /// buffer reused by array operations
+        std::vector<double> arrayBuf;
+
+        /// Values of properties of single type read once per frame
+        template <typename T>
+        struct SnapshotValues {
+            /// properties to read
+            std::vector<SaslPropRef> props;
+
+            /// values read at start of frame
+            std::vector<T> values;
+
+            /// values used if property can't be read
+            std::vector<T> defaults;
+
+            /// slots indexed by property
+            std::map<SaslPropRef, int> slots;
+
+            /// slots of released properties
+            std::vector<int> freeSlots;
+
+            /// Add property to snapshot.  Returns slot of property.
+            /// Property already in snapshot keeps its slot and default
+            int add(SaslPropRef prop, T dflt) {
+                std::map<SaslPropRef, int>::iterator i = slots.find(prop);
+                if (i != slots.end())
+                    return (*i).second;
+
+                int slot;
+                if (freeSlots.empty()) {
+                    slot = props.size();
+                    props.push_back(prop);
+                    values.push_back(dflt);
+                    defaults.push_back(dflt);
+                } else {
+                    slot = freeSlots.back();
+                    freeSlots.pop_back();
+                    props[slot] = prop;
+                    values[slot] = defaults[slot] = dflt;
+                }
+                slots[prop] = slot;
+                return slot;
+            }
+
+            /// Release slot of property
+            void remove(SaslPropRef prop) {
+                std::map<SaslPropRef, int>::iterator i = slots.find(prop);
+                if (i == slots.end())
+                    return;
+                int slot = (*i).second;
+                props[slot] = NULL;
+                values[slot] = defaults[slot];
+                freeSlots.push_back(slot);
+                slots.erase(i);
+            }
+        };
+
+        /// snapshot of int properties
+        SnapshotValues<int> intSnapshot;
+
+        /// snapshot of float properties
+        SnapshotValues<float> floatSnapshot;
+
+        /// snapshot of double properties
+        SnapshotValues<double> doubleSnapshot;
+
+        /// timer used to measure snapshot time
+        RtTimer timer;
+
+        /// time spent by last snapshot update in seconds
+        double snapshotTime;
+
+        /// number of current frame
+        int frameCounter;
+
+        /// Property checked for changes once per frame
+        struct PropWatch {
+            /// watched property or NULL if watch slot is free
+            SaslPropRef prop;
+
+            /// type of property
+            int type;
+
+            /// min change of numeric value
+            double epsilon;
+
+            /// Lua reference to callback
+            int callback;
+
+            /// last seen numeric value
+            double number;
+
+            /// last seen string value
+            std::string string;
+        };
+
+        /// registered watches
+        std::vector<PropWatch> watches;
+
+        /// number of active watches
+        int watchesCount;
+
+        /// number of callbacks called during last check
+        int watchesFired;
+
+        /// time spent checking watches in seconds
+        double watchesTime;
+
+        /// log of property reads and writes
+        PropsRecorder recorder;
+
+        /// Property handle given to scripts
+        struct HandleInfo {
+            /// name of property
+            std::string name;
+
+            /// type of property
+            int type;
+
+            /// number of references to handle
+            int refs;
+        };
+
+        /// live handles, registered in recorder when recording starts
+        std::map<SaslPropRef, HandleInfo> handles;
+
+        /// true while functional properties must not call Lua
+        bool luaBlocked;
+
+        /// true if functional property was accessed while Lua was blocked
+        bool blockedCall;
+
+    private:
+        /// Remember reference to handle and register it in recorder
+        void addHandle(SaslPropRef prop, const std::string &name, int type);
+
     public:
         Properties(Luna &lua);
 
@@ -78,7 +245,7 @@ class Properties
         
         /// Returns value of property as double
         /// On errors returns dflt
-        float getPropd(SaslPropRef prop, double dflt=0, int *err=NULL);
+        double getPropd(SaslPropRef prop, double dflt=0, int *err=NULL);
         
         /// Set value of double property.
         int setProp(SaslPropRef prop, double value);
@@ -90,24 +257,151 @@ class Properties
         /// Set value of string property.
         int setProp(SaslPropRef prop, const std::string &value);
 
+        /// Copy range of array property to values.
+        /// \param type type of values, PROP_INT or PROP_FLOAT
+        /// \param values buffer for count values or NULL to get size
+        /// Returns number of values copied or number of elements available
+        /// after offset if values is NULL
+        int getPropArray(SaslPropRef prop, int type, void *values, 
+                int offset, int count, int *err=NULL);
+
+        /// Set range of array property.
+        /// \param type type of values, PROP_INT or PROP_FLOAT
+        int setPropArray(SaslPropRef prop, int type, const void *values, 
+                int offset, int count);
+
+        /// Read property once per frame at start of update.
+        /// \param type PROP_INT, PROP_FLOAT or PROP_DOUBLE
+        /// \param dflt value used if property can't be read
+        /// Returns slot of property in snapshot of specified type or -1.
+        /// Property added again shares slot, slot is released when last
+        /// reference to property is freed
+        int addSnapshotProp(SaslPropRef prop, int type, double dflt);
+
+        /// Read all snapshot properties
+        void updateSnapshot();
+
+        /// Call Lua function when property changes.
+        /// \param type PROP_INT, PROP_FLOAT, PROP_DOUBLE or PROP_STRING
+        /// \param callback Lua reference to function called with new and
+        ///     old values of property
+        /// \param epsilon min change of numeric value to call callback
+        /// Returns ID of watch
+        int addWatch(SaslPropRef prop, int type, int callback, 
+                double epsilon);
+
+        /// Remove watch and release callback
+        void removeWatch(int id);
+
+        /// Check watched properties and call callbacks of changed ones
+        void checkWatches();
+
+        /// Returns value of int property from snapshot
+        int getSnapshoti(int slot) { 
+            return (unsigned)slot < intSnapshot.values.size() ? 
+                intSnapshot.values[slot] : 0;
+        }
+
+        /// Returns value of float property from snapshot
+        float getSnapshotf(int slot) {
+            return (unsigned)slot < floatSnapshot.values.size() ? 
+                floatSnapshot.values[slot] : 0;
+        }
+
+        /// Returns value of double property from snapshot
+        double getSnapshotd(int slot) {
+            return (unsigned)slot < doubleSnapshot.values.size() ? 
+                doubleSnapshot.values[slot] : 0;
+        }
+
+        /// Set value of snapshot property and update snapshot
+        void setSnapshoti(int slot, int value);
+
+        /// Set value of snapshot property and update snapshot
+        void setSnapshotf(int slot, float value);
+
+        /// Set value of snapshot property and update snapshot
+        void setSnapshotd(int slot, double value);
+
+        /// Returns buffer large enough for count values of any type.
+        /// Buffer is valid until next call
+        void* getArrayBuffer(int count);
+
         /// Update properties subsystem
         int update();
 
+        /// Write property values deferred during frame
+        int flush();
+
+        /// Disable or enable deferred writes of property
+        void setPropImmediate(SaslPropRef prop, bool immediate);
+
+        /// Start recording property reads and writes to file.
+        /// Returns non-zero on error
+        int startRecording(const std::string &fileName);
+
+        /// Stop recording properties
+        void stopRecording();
+
+        /// Returns properties callbacks
+        struct SaslPropsCallbacks* getCallbacks() { return propsCallbacks; }
+
+        /// Returns properties subsystem handler
+        SaslProps getPropsHandle() { return props; }
+
+        /// Report statistics of properties backend
+        /// \param report callback called for every value
+        /// \param ref reference passed to callback
+        void reportStats(sasl_stat_callback report, void *ref);
+
         /// register functional property
+        /// \param cacheAge max age of cached getter result in seconds,
+        ///     zero to call getter once per frame, negative disables cache
         SaslPropRef registerFuncProp(const std::string &name, int type, 
-                int maxSize, int getter, int setter);
+                int maxSize, int getter, int setter, double cacheAge = -1);
+
+        /// Returns true if cached value of functional property can be used
+        bool isCacheValid(const FuncPropHandler &handler);
+
+        /// Set number of current frame
+        void setFrameCounter(int counter) { frameCounter = counter; }
+
+        /// Returns number of current frame
+        int getFrameCounter() const { return frameCounter; }
+
+        /// Returns time in seconds for measuring intervals
+        double getTime() { return timer.getSeconds(); }
        
         /// remove property handler from list and unref callbacks
         void destroyFuncProp(FuncPropHandler *handler);
 
         /// Returns Lua wrapper
         Luna& getLua() { return lua; };
+
+        /// Forbid calling Lua from functional properties.  Used by
+        /// functions called via LuaJIT FFI which can't reenter Lua
+        void blockLua() { luaBlocked = true; blockedCall = false; }
+
+        /// Allow calling Lua from functional properties again.
+        /// Returns true if any functional property was skipped meanwhile
+        bool unblockLua() { luaBlocked = false; return blockedCall; }
+
+        /// Returns true if functional property can't call Lua now
+        bool isLuaBlocked() {
+            if (luaBlocked)
+                blockedCall = true;
+            return luaBlocked;
+        }
 };
 
 
 /// Register properties in Lua
 void exportPropsToLua(Luna &lua);
 
+/// Store statistics value in table on top of Lua stack.
+/// Used as sasl_stat_callback with lua_State as reference
+void addStatToTable(void *ref, const char *name, double value);
+
 };
 
 
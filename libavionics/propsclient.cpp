@@ -7,9 +7,15 @@
 #include <stdint.h>
 #endif
 #include <stdio.h>
+#include <math.h>
 #include "lownet.h"
 #include "md5.h"
 #include "utils.h"
+#include "properties.h"
+#include "propsrecorder.h"
+#include "propsmcast.h"
+#include "propsshm.h"
+#include "rttimer.h"
 
 
 using namespace xa;
@@ -18,6 +24,14 @@ using namespace xa;
 struct NetProps;
 
 
+/// Number of received values used for smoothing
+#define SMOOTH_SAMPLES 4
+
+/// Max time between received values in seconds.  Smoothing starts from
+/// scratch after longer pause
+#define SMOOTH_MAX_GAP 1.0
+
+
 /// Value of property
 class PropValue
 {
@@ -47,6 +61,37 @@ class PropValue
         /// Do not update till this revision
         int notUpdateTill;
 
+        /// encoding of values sent by server
+        int encoding;
+
+        /// scale of fixed point values
+        float scale;
+
+        /// offset of fixed point values
+        float offset;
+
+        /// bits of last decoded value, base of delta code
+        uint64_t lastBits;
+
+        /// true if float and double values are smoothed
+        bool smoothing;
+
+        /// delay of returned values after received ones in seconds
+        double smoothDelay;
+
+        /// max difference of received and returned value, larger
+        /// changes are returned immediately.  Zero if not checked
+        double snapThreshold;
+
+        /// times when values were received, oldest first
+        double sampleTimes[SMOOTH_SAMPLES];
+
+        /// received values
+        double sampleValues[SMOOTH_SAMPLES];
+
+        /// number of received values
+        int samplesCount;
+
     public:
         /// Create new property value
         PropValue(NetProps *props, int id, int type, const char *name);
@@ -66,6 +111,12 @@ class PropValue
         /// Returns reference to properties storage
         NetProps* getProps() { return props; }
 
+        /// Returns encoding of values sent by server
+        int getEncoding() const { return encoding; }
+
+        /// Change encoding of values when server acknowledged it
+        void setEncoding(int encoding, float scale, float offset);
+
         /// Returns property value as integer
         int getInt(int *err);
 
@@ -90,35 +141,112 @@ class PropValue
         /// Sets value of property.  returns non-zero on errors
         int setString(const char *newValue);
         
-        /// Load property value from raw data
-        void parse(const unsigned char *data, int revision);
+        /// Load property value from raw data.
+        /// \param size length of string value, data points to characters
+        void parse(const unsigned char *data, int size, int revision);
+
+        /// Load property value from fixed point or delta code
+        void parseCode(uint64_t code, int revision);
+
+        /// Load property value from shared memory segment
+        void loadShared();
+
+        /// Interpolate float and double values between received ones
+        /// \param delay delay of returned values in seconds, zero to
+        ///     extrapolate from last values
+        /// \param snap max change of value which is smoothed
+        void setSmoothing(bool enable, double delay, double snap);
 
     private:
+        /// Remember received value for smoothing
+        void addSample(double value);
+
+        /// Returns value interpolated for time
+        double getSmoothed(double now) const;
+
+        /// Copy value of string property
+        void storeString(const char *data, std::size_t len);
+
+        /// Returns true if value of revision overrides local changes
+        bool isActual(int revision);
+
         /// Send set property value command to server
         int sendPropUpdate();
 };
 
 
+/// Subscription waiting to be sent in batch
+struct PendingSub
+{
+    /// property ID
+    int id;
+
+    /// max size of string property
+    int maxSize;
+};
+
+
 /// Storage of networked properties handles
-struct NetProps
+struct NetProps: public McastHandler
 {
     Log &log;
     AsyncCon con;
     std::vector<PropValue*> values;
+
+    /// protocol version, 2 or 3
+    int version;
+
+    /// NP3 subscriptions of existing properties to send
+    std::vector<PendingSub> toSubscribe;
+
+    /// NP3 subscriptions of created properties to send
+    std::vector<PendingSub> toCreate;
+
+    /// clock of received values
+    RtTimer timer;
+
     int propsToGo;
     uint16_t lastSetSerial;
     uint16_t curSetSerial;
 
-    NetProps(Log &log): log(log), con(log) { };
+    /// rate of pushed updates per second or 0 to request updates
+    int pushRate;
+
+    /// default min change of pushed numeric values
+    float pushDeadband;
+
+    /// true if values are received from multicast group
+    bool multicast;
+
+    /// receiver of multicast frames
+    McastReceiver receiver;
+
+    /// properties by slot in multicast frames
+    std::vector<PropValue*> slotValues;
+
+    /// segment shared with server on the same host
+    ShmSegment segment;
+
+    NetProps(Log &log): log(log), con(log) { 
+        version = 2;
+        pushRate = 0;
+        pushDeadband = 0;
+        multicast = false;
+    };
 
     ~NetProps() {
         for (std::vector<PropValue*>::iterator i = values.begin();
                 i != values.end(); ++i)
             delete *i;
     }
+
+    /// Load value received from multicast group
+    virtual void onMcastValue(int slot, int type, const unsigned char *data,
+            int size);
 };
 
 
+static void flushSubscriptions(NetProps *p);
 
 
 PropValue::PropValue(NetProps *props, int id, int type, const char *name): 
@@ -126,6 +254,13 @@ PropValue::PropValue(NetProps *props, int id, int type, const char *name):
 {
     memset(&lastValue, 0, sizeof(lastValue));
     notUpdateTill = 0;
+    encoding = NETPROP_RAW;
+    scale = 1;
+    offset = 0;
+    lastBits = 0;
+    smoothing = false;
+    smoothDelay = snapThreshold = 0;
+    samplesCount = 0;
 }
 
 
@@ -157,11 +292,48 @@ int PropValue::getInt(int *err)
 
 int PropValue::sendPropUpdate()
 {
+    // server must know property before it is set
+    flushSubscriptions(props);
+
     props->lastSetSerial++;
     notUpdateTill = props->lastSetSerial;
+    // local value is returned as is
+    samplesCount = 0;
+
+    if (props->segment.isOpen()) {
+        // set request goes by ring, subscription must reach server first
+        if (props->con.getSendBuffer().getFilled() && props->con.sendAll())
+            return -1;
+
+        double number = 0;
+        const char *string = NULL;
+        std::size_t len = 0;
+        switch (type) {
+            case PROP_INT: number = lastValue.intValue;  break;
+            case PROP_FLOAT: number = lastValue.floatValue;  break;
+            case PROP_DOUBLE: number = lastValue.doubleValue;  break;
+            case PROP_STRING: 
+                string = lastValue.buf;
+                len = string ? strlen(string) : 0;
+                break;
+        }
+        if (! props->segment.pushRequest(id, type, props->lastSetSerial, 
+                    number, string, len))
+        {
+            props->log.error("too many set requests, property %s not set",
+                    name.c_str());
+            return -1;
+        }
+        return 0;
+    }
+
     NetBuf &buf = props->con.getSendBuffer();
+    bool np3 = 3 == props->version;
     buf.addUint8(2);
-    buf.addUint8(id);
+    if (np3)
+        buf.addVarint(id);
+    else
+        buf.addUint8(id);
     buf.addUint8(type);
     buf.addUint16(props->lastSetSerial);
     switch (type) {
@@ -172,7 +344,10 @@ int PropValue::sendPropUpdate()
             std::size_t len = 0;
             if (lastValue.buf)
                 len = strlen(lastValue.buf);
-            buf.addUint16(len);
+            if (np3)
+                buf.addVarint(len);
+            else
+                buf.addUint16(len);
             if (len)
                 buf.add((unsigned char*)lastValue.buf, len);
             return 0;
@@ -202,8 +377,12 @@ float PropValue::getFloat(int *err)
         case PROP_INT: 
             return lastValue.intValue;
         case PROP_FLOAT: 
+            if (smoothing)
+                return (float)getSmoothed(props->timer.getSeconds());
             return lastValue.floatValue;
         case PROP_DOUBLE: 
+            if (smoothing)
+                return (float)getSmoothed(props->timer.getSeconds());
             return (float)lastValue.doubleValue;
         case PROP_STRING: return strToFloat(lastValue.buf ? lastValue.buf : "0");
     }
@@ -233,8 +412,14 @@ double PropValue::getDouble(int *err)
 
     switch (type) {
         case PROP_INT: return lastValue.intValue;
-        case PROP_FLOAT: return lastValue.floatValue;
-        case PROP_DOUBLE: return lastValue.doubleValue;
+        case PROP_FLOAT: 
+            if (smoothing)
+                return getSmoothed(props->timer.getSeconds());
+            return lastValue.floatValue;
+        case PROP_DOUBLE: 
+            if (smoothing)
+                return getSmoothed(props->timer.getSeconds());
+            return lastValue.doubleValue;
         case PROP_STRING: return strToDouble(lastValue.buf ? lastValue.buf : "0");
     }
 
@@ -321,39 +506,255 @@ int PropValue::setString(const char *newValue)
 
         
         
-void PropValue::parse(const unsigned char *data, int revision)
+bool PropValue::isActual(int revision)
 {
     if (! ((revision >= notUpdateTill) || 
             ((65530 < notUpdateTill) && (10 > revision))))
     {
-        return;
+        return false;
     }
 
     notUpdateTill = revision;
+    return true;
+}
+
+
+void PropValue::parse(const unsigned char *data, int size, int revision)
+{
+    if (! isActual(revision))
+        return;
+
     switch (type) {
         case PROP_INT: 
             lastValue.intValue = netToInt32(data); 
             break;
         case PROP_FLOAT: 
             lastValue.floatValue = netToFloat(data); 
+            if (smoothing)
+                addSample(lastValue.floatValue);
             break;
         case PROP_DOUBLE: 
             lastValue.doubleValue = netToDouble(data); 
+            if (smoothing)
+                addSample(lastValue.doubleValue);
             break;
         case PROP_STRING: 
-            std::size_t len = (std::size_t)netToInt16(data);
-            if ((! lastValue.buf) || (len + 1 > lastValue.maxBufSize)) {
-                lastValue.maxBufSize = len + 20;
-                free(lastValue.buf);
-                lastValue.buf = (char*)malloc(lastValue.maxBufSize);
-            }
-            memcpy(lastValue.buf, data + 2, len);
-            lastValue.buf[len] = 0;
+            storeString((const char*)data, (std::size_t)size);
             break;
     }
 }
 
 
+void PropValue::storeString(const char *data, std::size_t len)
+{
+    if ((! lastValue.buf) || ((int)len + 1 > lastValue.maxBufSize)) {
+        lastValue.maxBufSize = len + 20;
+        free(lastValue.buf);
+        lastValue.buf = (char*)malloc(lastValue.maxBufSize);
+    }
+    memcpy(lastValue.buf, data, len);
+    lastValue.buf[len] = 0;
+}
+
+
+void PropValue::loadShared()
+{
+    ShmValue value;
+    unsigned acked;
+    if (! props->segment.readValue(id - 1, value, acked))
+        return;
+    if ((value.type != type) || (! isActual(acked)))
+        return;
+
+    switch (type) {
+        case PROP_INT: lastValue.intValue = (int)value.number; break;
+        case PROP_FLOAT: lastValue.floatValue = (float)value.number; break;
+        case PROP_DOUBLE: lastValue.doubleValue = value.number; break;
+        case PROP_STRING: storeString(value.string, value.size); break;
+    }
+}
+
+
+
+void PropValue::setEncoding(int newEncoding, float newScale, float newOffset)
+{
+    encoding = newEncoding;
+    scale = newScale;
+    offset = newOffset;
+    lastBits = 0;
+}
+
+
+void PropValue::parseCode(uint64_t code, int revision)
+{
+    // delta state must follow server even if value is ignored
+    double value;
+    if (NETPROP_FIXED16 == encoding)
+        value = offset + (double)code * scale;
+    else
+        value = elementValue(type, decodeElement(type, code, lastBits));
+
+    if (! isActual(revision))
+        return;
+
+    switch (type) {
+        case PROP_INT: lastValue.intValue = (int)value; break;
+        case PROP_FLOAT: lastValue.floatValue = (float)value; break;
+        case PROP_DOUBLE: lastValue.doubleValue = value; break;
+    }
+    if (smoothing)
+        addSample(PROP_FLOAT == type ? lastValue.floatValue : value);
+}
+
+
+void PropValue::setSmoothing(bool enable, double delay, double snap)
+{
+    smoothing = enable && ((PROP_FLOAT == type) || (PROP_DOUBLE == type));
+    smoothDelay = 0 < delay ? delay : 0;
+    snapThreshold = 0 < snap ? snap : 0;
+    samplesCount = 0;
+}
+
+
+void PropValue::addSample(double value)
+{
+    double now = props->timer.getSeconds();
+
+    if (samplesCount) {
+        double last = sampleTimes[samplesCount - 1];
+        double shown = getSmoothed(now);
+        if ((0 < snapThreshold) && (fabs(value - shown) > snapThreshold))
+            samplesCount = 0;
+        else if (now - last > SMOOTH_MAX_GAP) {
+            // value changed after pause, move from shown value
+            samplesCount = 0;
+            if (0 < smoothDelay) {
+                sampleTimes[0] = now - smoothDelay;
+                sampleValues[0] = shown;
+                samplesCount = 1;
+            }
+        } else if (now <= last) {
+            // several values received during the same update
+            sampleValues[samplesCount - 1] = value;
+            return;
+        }
+    }
+
+    if (SMOOTH_SAMPLES == samplesCount) {
+        for (int i = 1; i < SMOOTH_SAMPLES; i++) {
+            sampleTimes[i - 1] = sampleTimes[i];
+            sampleValues[i - 1] = sampleValues[i];
+        }
+        samplesCount--;
+    }
+    sampleTimes[samplesCount] = now;
+    sampleValues[samplesCount] = value;
+    samplesCount++;
+}
+
+
+double PropValue::getSmoothed(double now) const
+{
+    if (! samplesCount)
+        return PROP_FLOAT == type ? lastValue.floatValue : 
+            lastValue.doubleValue;
+
+    double t = now - smoothDelay;
+    if (t <= sampleTimes[0])
+        return sampleValues[0];
+
+    // interpolate between values received around t
+    int last = samplesCount - 1;
+    for (int i = 1; i <= last; i++)
+        if (t <= sampleTimes[i]) {
+            double k = (t - sampleTimes[i - 1]) / 
+                (sampleTimes[i] - sampleTimes[i - 1]);
+            return sampleValues[i - 1] + 
+                k * (sampleValues[i] - sampleValues[i - 1]);
+        }
+
+    // delayed values never pass last received one
+    if ((! last) || (0 < smoothDelay))
+        return sampleValues[last];
+
+    // dead reckoning after last value for one interval.  Server doesn't
+    // send unchanged values, so estimate returns back to last value 
+    // during next interval
+    double interval = sampleTimes[last] - sampleTimes[last - 1];
+    double ahead = t - sampleTimes[last];
+    if (ahead > 2 * interval)
+        return sampleValues[last];
+    if (ahead > interval)
+        ahead = 2 * interval - ahead;
+    return sampleValues[last] + (sampleValues[last] - 
+            sampleValues[last - 1]) * ahead / interval;
+}
+
+
+void NetProps::onMcastValue(int slot, int type, const unsigned char *data,
+        int size)
+{
+    // group carries values of properties subscribed by other clients too
+    if ((slot >= (int)slotValues.size()) || (! slotValues[slot]) ||
+            (slotValues[slot]->getType() != type))
+        return;
+    slotValues[slot]->parse(data, size, curSetSerial);
+}
+
+
+/// Ask server to push property value
+static void sendPushRate(NetProps *p, int id, int rate, float deadband)
+{
+    NetBuf &buf = p->con.getSendBuffer();
+    buf.addUint8(6);
+    if (3 == p->version) {
+        buf.addVarint(id);
+        buf.addVarint(rate);
+    } else {
+        buf.addUint8(id);
+        buf.addUint16(rate);
+    }
+    buf.addFloat(deadband);
+}
+
+
+/// Send batch of NP3 subscriptions
+static void sendSubscriptions(NetProps *p, int cmd, 
+        std::vector<PendingSub> &subs)
+{
+    if (subs.empty())
+        return;
+
+    NetBuf &buf = p->con.getSendBuffer();
+    buf.addUint8(cmd);
+    buf.addVarint(subs.size());
+    for (std::vector<PendingSub>::iterator i = subs.begin(); 
+            i != subs.end(); ++i)
+    {
+        PropValue *v = p->values[(*i).id - 1];
+        buf.addUint8(v->getType());
+        buf.addVarint((*i).id);
+        buf.addVarint((*i).maxSize);
+        buf.addVarint(v->getName().length());
+        buf.add((const unsigned char*)v->getName().c_str(), 
+                v->getName().length());
+    }
+
+    if (p->pushRate)
+        for (std::vector<PendingSub>::iterator i = subs.begin(); 
+                i != subs.end(); ++i)
+            sendPushRate(p, (*i).id, p->pushRate, p->pushDeadband);
+    subs.clear();
+}
+
+
+/// Send subscriptions made since last update
+static void flushSubscriptions(NetProps *p)
+{
+    sendSubscriptions(p, 1, p->toSubscribe);
+    sendSubscriptions(p, 5, p->toCreate);
+}
+
 
 /// Returns reference to property
 static SaslPropRef createSaslPropRef(SaslProps props, const char *name, int type, 
@@ -364,7 +765,7 @@ static SaslPropRef createSaslPropRef(SaslProps props, const char *name, int type
         return NULL;
 
     int id = p->values.size() + 1;
-    if ((255 < id) || (PROP_INT > type) || (PROP_STRING < type)) {
+    if ((PROP_INT > type) || (PROP_STRING < type)) {
         p->log.error("invalid property type %i\n", type);
         return NULL;
     }
@@ -375,7 +776,26 @@ static SaslPropRef createSaslPropRef(SaslProps props, const char *name, int type
             return v;
     }
 
+    if ((2 == p->version) && (255 < id)) {
+        p->log.error("too many networked properties\n");
+        return NULL;
+    }
+
+    if (p->segment.isOpen() && (id > p->segment.getCapacity())) {
+        p->log.error("too many properties in shared memory\n");
+        return NULL;
+    }
+
     p->values.push_back(new PropValue(p, id, type, name));
+
+    if (3 == p->version) {
+        PendingSub sub;
+        sub.id = id;
+        sub.maxSize = maxSize;
+        (1 == cmd ? p->toSubscribe : p->toCreate).push_back(sub);
+        return p->values[id - 1];
+    }
+
     int len = strlen(name);
 
     NetBuf &buf = p->con.getSendBuffer();
@@ -386,6 +806,9 @@ static SaslPropRef createSaslPropRef(SaslProps props, const char *name, int type
     buf.addUint16(maxSize);
     buf.add((unsigned char*)name, len);
 
+    if (p->pushRate)
+        sendPushRate(p, id, p->pushRate, p->pushDeadband);
+
     return p->values[id - 1];
 }
 
@@ -531,21 +954,16 @@ static int setPropString(SaslPropRef prop, const char *newValue)
 static void doneProps(SaslProps props)
 {
     NetProps *p = (NetProps*)props;
+    if (p && p->multicast)
+        p->log.info("received %.0f multicast datagrams, %.0f frames lost",
+                p->receiver.getDatagrams(), p->receiver.getLost());
     delete p;
 }
 
 
-// do networked job
-static int updateProps(SaslProps props)
+/// Parse values of properties.  Returns non-zero on error
+static int parseValues(NetProps *p)
 {
-    NetProps *p = (NetProps*)props;
-    if (! p)
-        return -1;
-
-    if (p->con.update()) {
-        return -1;
-    }
-
     NetBuf &buf = p->con.getRecvBuffer();
     if ((! p->propsToGo) && (4 <= buf.getFilled())) {
         int id = buf.getData()[0];
@@ -570,20 +988,178 @@ static int updateProps(SaslProps props)
         int sz = getPropTypeSize(v->getType());
         if (buf.getFilled() < (unsigned)sz + 1)
             break;
+        int len = 0;
         if (PROP_STRING == v->getType()) {
             if (buf.getFilled() < 3)
                 break;
-            sz += netToInt16(buf.getData() + 1);
+            len = netToInt16(buf.getData() + 1);
+            sz += len;
         }
         if (buf.getFilled() < (unsigned)sz + 1)
             break;
-        v->parse(buf.getData() + 1, p->curSetSerial);
+        v->parse(buf.getData() + 1 + sz - len, len, p->curSetSerial);
         buf.remove(1 + sz);
         p->propsToGo--;
     }
 
-    if (! p->propsToGo) {
-        p->con.getSendBuffer().addUint8(3);
+    return 0;
+}
+
+
+/// Parse encoding acknowledge.  Returns 1 if message was parsed,
+/// 0 if it is incomplete or -1 on error
+static int parseEncoding(NetProps *p, NetReader &reader)
+{
+    unsigned propId;
+    int encoding;
+    const unsigned char *params;
+    if (! (reader.getVarint(propId) && reader.getUint8(encoding) && 
+                (params = reader.getBytes(8))))
+        return reader.isInvalid() ? -1 : 0;
+    if ((! propId) || (propId > p->values.size())) {
+        p->log.error("invalid property id %i\n", propId);
+        p->con.close();
+        return -1;
+    }
+    p->values[propId - 1]->setEncoding(encoding, netToFloat(params),
+            netToFloat(params + 4));
+    return 1;
+}
+
+
+/// Parse slot of property in multicast frames.  Returns 1 if message
+/// was parsed, 0 if it is incomplete or -1 on error
+static int parseSlot(NetProps *p, NetReader &reader)
+{
+    unsigned propId, slot;
+    if (! (reader.getVarint(propId) && reader.getVarint(slot)))
+        return reader.isInvalid() ? -1 : 0;
+    if ((! propId) || (propId > p->values.size())) {
+        p->log.error("invalid property id %i\n", propId);
+        p->con.close();
+        return -1;
+    }
+    if (slot >= p->slotValues.size())
+        p->slotValues.resize(slot + 1, NULL);
+    p->slotValues[slot] = p->values[propId - 1];
+    return 1;
+}
+
+
+/// Parse values of properties sent by NP3 server.
+/// Returns non-zero on error
+static int parseValuesNp3(NetProps *p)
+{
+    NetBuf &buf = p->con.getRecvBuffer();
+    while (! p->propsToGo) {
+        NetReader reader(buf.getData(), buf.getFilled());
+        int command, serial;
+        unsigned count;
+        if (! reader.getUint8(command))
+            return 0;
+        if ((7 == command) || (9 == command)) {
+            int res = 7 == command ? parseEncoding(p, reader) : 
+                parseSlot(p, reader);
+            if (0 >= res)
+                return res;
+            buf.remove(reader.getPos());
+            continue;
+        }
+        if (! (reader.getVarint(count) && reader.getUint16(serial)))
+            return reader.isInvalid() ? -1 : 0;
+        if (4 != command) {
+            p->log.error("Invalid command %i\n", command);
+            p->con.close();
+            return -1;
+        }
+        p->propsToGo = count;
+        p->curSetSerial = serial;
+        buf.remove(reader.getPos());
+        if (! count)
+            return 0;
+    }
+
+    while (p->propsToGo && buf.getFilled()) {
+        NetReader reader(buf.getData(), buf.getFilled());
+        unsigned propId, len = 0;
+        if (! reader.getVarint(propId))
+            return reader.isInvalid() ? -1 : 0;
+        if ((! propId) || (propId > p->values.size())) {
+            p->log.error("invalid property id %i\n", propId);
+            p->con.close();
+            return -1;
+        }
+        PropValue *v = p->values[propId - 1];
+        if (NETPROP_DELTA == v->getEncoding()) {
+            uint64_t code;
+            if (! reader.getVarint64(code))
+                return reader.isInvalid() ? -1 : 0;
+            v->parseCode(code, p->curSetSerial);
+            buf.remove(reader.getPos());
+            p->propsToGo--;
+            continue;
+        }
+        if (NETPROP_FIXED16 == v->getEncoding()) {
+            int code;
+            if (! reader.getUint16(code))
+                break;
+            v->parseCode(code, p->curSetSerial);
+            buf.remove(reader.getPos());
+            p->propsToGo--;
+            continue;
+        }
+        if (PROP_STRING == v->getType()) {
+            if (! reader.getVarint(len))
+                return reader.isInvalid() ? -1 : 0;
+        } else
+            len = getPropTypeSize(v->getType());
+        const unsigned char *data = reader.getBytes(len);
+        if (! data)
+            break;
+        v->parse(data, len, p->curSetSerial);
+        buf.remove(reader.getPos());
+        p->propsToGo--;
+    }
+
+    return 0;
+}
+
+
+// do networked job
+static int updateProps(SaslProps props)
+{
+    NetProps *p = (NetProps*)props;
+    if (! p)
+        return -1;
+
+    flushSubscriptions(p);
+
+    if (p->con.update()) {
+        return -1;
+    }
+
+    int (*parse)(NetProps*) = 3 == p->version ? parseValuesNp3 : parseValues;
+
+    if (! (p->pushRate || p->multicast)) {
+        if (parse(p))
+            return -1;
+        if (! p->propsToGo)
+            p->con.getSendBuffer().addUint8(3);
+        return 0;
+    }
+
+    // server may push several batches between updates
+    NetBuf &buf = p->con.getRecvBuffer();
+    size_t lastFilled;
+    do {
+        lastFilled = buf.getFilled();
+        if (parse(p))
+            return -1;
+    } while (buf.getFilled() && (buf.getFilled() != lastFilled));
+
+    if (p->multicast && p->receiver.update(*p)) {
+        p->log.error("error receiving multicast datagrams");
+        return -1;
     }
 
     return 0;
@@ -597,33 +1173,103 @@ static SaslPropsCallbacks callbacks = { getSaslPropRef, freeSaslPropRef, createP
         updateProps, doneProps };
 
 
-int xa::connectToServer(SASL sasl, Log &log, const char *host, int port, 
-        const char *secret)
+/// Returns property value read from shared memory as integer
+static int getSharedPropInt(SaslPropRef prop, int *err)
+{
+    if (prop)
+        ((PropValue*)prop)->loadShared();
+    return getPropInt(prop, err);
+}
+
+
+/// Returns property value read from shared memory as float
+static float getSharedPropFloat(SaslPropRef prop, int *err)
+{
+    if (prop)
+        ((PropValue*)prop)->loadShared();
+    return getPropFloat(prop, err);
+}
+
+
+/// Returns property value read from shared memory as double
+static double getSharedPropDouble(SaslPropRef prop, int *err)
+{
+    if (prop)
+        ((PropValue*)prop)->loadShared();
+    return getPropDouble(prop, err);
+}
+
+
+/// Returns property value read from shared memory as string
+static int getSharedPropString(SaslPropRef prop, char *buf, int maxSize, 
+        int *err)
+{
+    if (prop)
+        ((PropValue*)prop)->loadShared();
+    return getPropString(prop, buf, maxSize, err);
+}
+
+
+/// Values are read from shared memory, connection carries subscriptions
+/// only, so nothing is done unless there are new properties
+static int updateSharedProps(SaslProps props)
+{
+    NetProps *p = (NetProps*)props;
+    if (! p)
+        return -1;
+
+    if (p->segment.isClosed()) {
+        p->log.error("server closed shared memory");
+        return -1;
+    }
+
+    flushSubscriptions(p);
+    if (p->con.getSendBuffer().getFilled() && p->con.update())
+        return -1;
+
+    return 0;
+}
+
+
+static SaslPropsCallbacks sharedCallbacks = { getSaslPropRef, 
+        freeSaslPropRef, createProp, createFuncProp, 
+        getSharedPropInt, setPropInt, getSharedPropFloat, setPropFloat, 
+        getSharedPropDouble, setPropDouble, 
+        getSharedPropString, setPropString,
+        updateSharedProps, doneProps };
+
+
+/// Connect to server and pass authentication.
+/// \param version protocol version to request, 2 or 3
+/// Returns connected properties or NULL on error
+static NetProps* login(Log &log, const char *host, int port, 
+        const char *secret, int version)
 {
     int sock = establishConnection(host, port);
     log.debug("connecting...");
     if (1 > sock)
-        return -1;
+        return NULL;
 
     NetProps *np = new NetProps(log);
     np->con.setSocket(sock);
+    np->version = version;
     AsyncCon &con = np->con;
 
-    con.send((unsigned char*)"NP2\n", 4);
+    con.send((unsigned char*)(3 == version ? "NP3\n" : "NP2\n"), 4);
     if (con.sendAll()) {
         delete np;
-        return -1;
+        return NULL;
     }
 
     if (con.recvData(20)) {
         delete np;
-        return -1;
+        return NULL;
     }
 
     NetBuf &buf = con.getRecvBuffer();
     if (20 != buf.getFilled()) {
         delete np;
-        return -1;
+        return NULL;
     }
 
     md5_state_t md5;
@@ -637,30 +1283,206 @@ int xa::connectToServer(SASL sasl, Log &log, const char *host, int port,
     con.send(digest, 16);
     if (con.sendAll()) {
         delete np;
-        return -1;
+        return NULL;
     }
     
     if (con.recvData(4) || (4 != buf.getFilled())) {
         log.error("can't receive result");
         delete np;
-        return -1;
+        return NULL;
     }
 
     if (memcmp(buf.getData(), "PASS", 4)) {
         log.error("we are not allowed");
         delete np;
-        return -1;
+        return NULL;
     }
     buf.remove(4);
     log.debug("logged in!");
+    return np;
+}
+
+
+int xa::connectToServer(SASL sasl, Log &log, const char *host, int port, 
+        const char *secret, int pushRate, float deadband)
+{
+    // servers which don't know NP3 close connection after handshake
+    NetProps *np = login(log, host, port, secret, 3);
+    if (! np) {
+        log.debug("NP3 handshake failed, trying NP2");
+        np = login(log, host, port, secret, 2);
+    }
+    if (! np)
+        return -1;
 
     np->propsToGo = 0;
     np->lastSetSerial = 0;
+    np->pushRate = 0 < pushRate ? pushRate : 0;
+    np->pushDeadband = deadband;
 
     sasl_set_props(sasl, &callbacks, np);
         
-    np->con.getSendBuffer().addUint8(3);
+    if (! np->pushRate)
+        np->con.getSendBuffer().addUint8(3);
+
+    return 0;
+}
+
+
+/// Send command without arguments and wait for reply which carries
+/// number and text.  Returns non-zero on error
+static int askServer(NetProps *np, int command, unsigned &number, 
+        std::string &text)
+{
+    AsyncCon &con = np->con;
+    con.getSendBuffer().addUint8(command);
+    if (con.sendAll())
+        return -1;
+
+    NetBuf &buf = con.getRecvBuffer();
+    while (true) {
+        NetReader reader(buf.getData(), buf.getFilled());
+        int reply = 0;
+        unsigned len;
+        const unsigned char *data;
+        if (reader.getUint8(reply) && reader.getVarint(number) && 
+                reader.getVarint(len) && (data = reader.getBytes(len)) &&
+                (command == reply))
+        {
+            text.assign((const char*)data, len);
+            buf.remove(reader.getPos());
+            return 0;
+        }
+        if (reader.isInvalid() || (reply && (command != reply)) || 
+                con.recvData(buf.getFilled() + 1))
+            return -1;
+    }
+}
+
+
+int xa::connectToServerMulticast(SASL sasl, Log &log, const char *host, 
+        int port, const char *secret)
+{
+    NetProps *np = login(log, host, port, secret, 3);
+    if (! np)
+        return -1;
+
+    // server replies with address of group, port 0 if it doesn't publish
+    std::string group;
+    unsigned groupPort;
+    if (askServer(np, 8, groupPort, group)) {
+        log.error("can't receive multicast group");
+        delete np;
+        return -1;
+    }
+
+    if (! groupPort) {
+        log.error("server doesn't publish properties to multicast group");
+        delete np;
+        return -1;
+    }
+    if (np->receiver.open(group.c_str(), groupPort)) {
+        log.error("can't join multicast group %s:%i", group.c_str(), 
+                groupPort);
+        delete np;
+        return -1;
+    }
+    log.debug("joined multicast group %s:%i", group.c_str(), groupPort);
+
+    np->propsToGo = 0;
+    np->lastSetSerial = 0;
+    np->multicast = true;
+
+    sasl_set_props(sasl, &callbacks, np);
+    return 0;
+}
+
+
+int xa::connectToServerShared(SASL sasl, Log &log, const char *host, 
+        int port, const char *secret)
+{
+    NetProps *np = login(log, host, port, secret, 3);
+    if (! np)
+        return -1;
+
+    // server replies with name of segment, empty if it can't create it
+    std::string name;
+    unsigned capacity;
+    if (askServer(np, 10, capacity, name) || name.empty()) {
+        log.error("server doesn't share properties memory");
+        delete np;
+        return -1;
+    }
+    if (np->segment.open(name, capacity)) {
+        log.error("can't open shared memory %s, is server on the same "
+                "host?", name.c_str());
+        delete np;
+        return -1;
+    }
+    // segment lives while both sides keep it mapped
+    np->segment.unlink();
+    log.debug("opened shared memory %s", name.c_str());
+
+    np->propsToGo = 0;
+    np->lastSetSerial = 0;
+
+    sasl_set_props(sasl, &sharedCallbacks, np);
+    return 0;
+}
+
+
+int xa::setNetPropEncoding(Properties &properties, SaslPropRef prop, 
+        int encoding, float epsilon, float scale, float offset)
+{
+    if ((&callbacks != properties.getCallbacks()) || (! prop))
+        return -1;
+
+    NetProps *p = (NetProps*)properties.getPropsHandle();
+    if (3 != p->version)
+        return -1;
+
+    // values are decoded the old way till server acknowledges encoding
+    flushSubscriptions(p);
+    NetBuf &buf = p->con.getSendBuffer();
+    buf.addUint8(7);
+    buf.addVarint(((PropValue*)prop)->getId());
+    buf.addUint8(encoding);
+    buf.addFloat(epsilon);
+    buf.addFloat(scale);
+    buf.addFloat(offset);
+    return 0;
+}
+
+
+int xa::setNetPropSmoothing(Properties &properties, SaslPropRef prop, 
+        bool enable, float delay, float snap)
+{
+    if ((&callbacks != properties.getCallbacks()) || (! prop))
+        return -1;
+
+    PropValue *value = (PropValue*)prop;
+    if ((PROP_FLOAT != value->getType()) && 
+            (PROP_DOUBLE != value->getType()))
+        return -1;
+
+    value->setSmoothing(enable, delay, snap);
+    return 0;
+}
+
+
+int xa::setNetPropRate(Properties &properties, SaslPropRef prop, int rate,
+        float deadband)
+{
+    if ((&callbacks != properties.getCallbacks()) || (! prop))
+        return -1;
+
+    NetProps *p = (NetProps*)properties.getPropsHandle();
+    if (! p->pushRate || (0 >= rate))
+        return -1;
 
+    // server must know property before its rate
+    flushSubscriptions(p);
+    sendPushRate(p, ((PropValue*)prop)->getId(), rate, deadband);
     return 0;
 }
 
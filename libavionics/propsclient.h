@@ -8,8 +8,49 @@
 
 namespace xa {
 
+class Properties;
+
+/// Connect to properties server.
+/// \param pushRate if positive server pushes changed values at this
+///     rate per second, otherwise client requests values every update
+/// \param deadband default min change of pushed numeric values
 int connectToServer(SASL sasl, Log &log, const char *host, int port, 
-        const char *secret);
+        const char *secret, int pushRate = 0, float deadband = 0);
+
+/// Connect to properties server which publishes values to multicast
+/// group.  Values are received from group, set requests are sent by
+/// TCP connection.  Requires NP3 server
+int connectToServerMulticast(SASL sasl, Log &log, const char *host, 
+        int port, const char *secret);
+
+/// Connect to properties server running on the same host.  Values are
+/// read from memory shared with server, connection carries subscriptions
+/// only.  Requires NP3 server
+int connectToServerShared(SASL sasl, Log &log, const char *host, 
+        int port, const char *secret);
+
+/// Change push rate and deadband of networked property.
+/// Returns non-zero if properties are not pushed by server
+int setNetPropRate(Properties &properties, SaslPropRef prop, int rate,
+        float deadband);
+
+/// Change encoding of networked property values.
+/// Returns non-zero if server doesn't support encodings
+/// \param encoding NETPROP_RAW, NETPROP_FIXED16 or NETPROP_DELTA
+/// \param epsilon min change of numeric value to send it
+/// \param scale, offset fixed point value is offset + code * scale
+int setNetPropEncoding(Properties &properties, SaslPropRef prop, 
+        int encoding, float epsilon, float scale, float offset);
+
+/// Smooth float or double networked property.  Values returned between
+/// updates are interpolated between received values or extrapolated
+/// from last ones.  Returns non-zero if property can't be smoothed
+/// \param delay delay of returned values after received ones in
+///     seconds, zero to extrapolate from last values
+/// \param snap max change of value which is smoothed, larger changes
+///     are returned immediately.  Zero to smooth any change
+int setNetPropSmoothing(Properties &properties, SaslPropRef prop, 
+        bool enable, float delay, float snap);
 
 };
 
@@ -0,0 +1,208 @@
+#include "propsmcast.h"
+
+#include <string.h>
+
+
+using namespace xa;
+
+
+/// Size of datagram header: signature, sequence, flags and count
+#define MCAST_HEADER_SIZE 11
+
+
+McastPublisher::McastPublisher()
+{
+    port = 0;
+    seq = 0;
+    keyframeInterval = 1;
+    sinceKeyframe = 0;
+    count = 0;
+    datagrams = bytes = 0;
+}
+
+
+int McastPublisher::start(const char *groupAddr, int groupPort,
+        int interval)
+{
+    if (socket.openSender(groupAddr, groupPort, 1))
+        return -1;
+
+    group = groupAddr;
+    port = groupPort;
+    keyframeInterval = 0 < interval ? interval : 1;
+    sinceKeyframe = 0;
+    sent.clear();
+    datagrams = bytes = 0;
+    return 0;
+}
+
+
+void McastPublisher::stop()
+{
+    socket.close();
+    port = 0;
+    group.clear();
+}
+
+
+void McastPublisher::beginDatagram(bool keyframe)
+{
+    datagram.remove(datagram.getFilled());
+    datagram.add((const unsigned char*)MCAST_SIGNATURE, 4);
+    datagram.addInt32(seq);
+    datagram.addUint8(keyframe ? MCAST_KEYFRAME : 0);
+    datagram.addUint16(0);
+    count = 0;
+}
+
+
+void McastPublisher::sendDatagram()
+{
+    // count is patched when all values are added
+    unsigned char *data = datagram.getData();
+    data[MCAST_HEADER_SIZE - 2] = (unsigned char)(count >> 8);
+    data[MCAST_HEADER_SIZE - 1] = (unsigned char)count;
+    socket.send(data, datagram.getFilled());
+    datagrams++;
+    bytes += datagram.getFilled();
+}
+
+
+void McastPublisher::publish(const PropsSnapshot &snapshot)
+{
+    if (! socket.isOpen())
+        return;
+
+    seq++;
+    bool keyframe = ! sinceKeyframe;
+    sinceKeyframe = (sinceKeyframe + 1) % keyframeInterval;
+    if (sent.size() < snapshot.values.size())
+        sent.resize(snapshot.values.size(), 0);
+
+    // frame without changes is sent anyway to let receivers detect losses
+    beginDatagram(keyframe);
+    for (size_t i = 0; i < snapshot.values.size(); i++) {
+        const SnapshotValue &value = snapshot.values[i];
+        if ((! value.valid) || ((! keyframe) && (sent[i] == value.version)))
+            continue;
+        sent[i] = value.version;
+
+        entry.remove(entry.getFilled());
+        entry.addVarint(i);
+        entry.addUint8(value.type);
+        switch (value.type) {
+            case PROP_INT: entry.addInt32((int)value.number); break;
+            case PROP_FLOAT: entry.addFloat((float)value.number); break;
+            case PROP_DOUBLE: entry.addDouble(value.number); break;
+            case PROP_STRING:
+                entry.addVarint(value.string.length());
+                entry.add((const unsigned char*)value.string.c_str(),
+                        value.string.length());
+                break;
+        }
+
+        // start next datagram of frame if value doesn't fit
+        if (count && (MCAST_MAX_DATAGRAM <
+                    datagram.getFilled() + entry.getFilled()))
+        {
+            sendDatagram();
+            beginDatagram(keyframe);
+        }
+        datagram.add(entry.getData(), entry.getFilled());
+        count++;
+    }
+    sendDatagram();
+}
+
+
+void McastPublisher::reportStats(sasl_stat_callback report, void *ref)
+{
+    report(ref, "multicast.frames", seq);
+    report(ref, "multicast.datagrams", datagrams);
+    report(ref, "multicast.bytes", bytes);
+}
+
+
+
+
+McastReceiver::McastReceiver(): datagram(65536)
+{
+    started = false;
+    lastSeq = 0;
+    datagrams = lost = 0;
+}
+
+
+int McastReceiver::open(const char *group, int port)
+{
+    started = false;
+    slotSeqs.clear();
+    datagrams = lost = 0;
+    return socket.openReceiver(group, port);
+}
+
+
+void McastReceiver::close()
+{
+    socket.close();
+}
+
+
+int McastReceiver::update(McastHandler &handler)
+{
+    while (true) {
+        int size = socket.receive(&datagram[0], datagram.size());
+        if (0 > size)
+            return -1;
+        if (! size)
+            return 0;
+        datagrams++;
+        // malformed datagrams of other senders are ignored
+        parse(&datagram[0], size, handler);
+    }
+}
+
+
+int McastReceiver::parse(const unsigned char *data, size_t size,
+        McastHandler &handler)
+{
+    if ((MCAST_HEADER_SIZE > size) || memcmp(data, MCAST_SIGNATURE, 4))
+        return -1;
+
+    unsigned seq = (unsigned)netToInt32(data + 4);
+    NetReader reader(data + MCAST_HEADER_SIZE, size - MCAST_HEADER_SIZE);
+    int count = netToInt16(data + MCAST_HEADER_SIZE - 2);
+
+    if (! started) {
+        started = true;
+        lastSeq = seq;
+    } else if (0 < (int)(seq - lastSeq)) {
+        lost += seq - lastSeq - 1;
+        lastSeq = seq;
+    }
+
+    for (int i = 0; i < count; i++) {
+        unsigned slot, len;
+        int type;
+        if (! (reader.getVarint(slot) && reader.getUint8(type)))
+            return -1;
+        if (PROP_STRING == type) {
+            if (! reader.getVarint(len))
+                return -1;
+        } else
+            len = getPropTypeSize(type);
+        const unsigned char *value = reader.getBytes(len);
+        if ((! value) || (! len && (PROP_STRING != type)))
+            return -1;
+
+        if (slot >= slotSeqs.size())
+            slotSeqs.resize(slot + 1, seq - 1);
+        if (0 > (int)(seq - slotSeqs[slot]))
+            continue;
+        slotSeqs[slot] = seq;
+        handler.onMcastValue(slot, type, value, len);
+    }
+
+    return 0;
+}
+
@@ -0,0 +1,173 @@
+#ifndef __PROPS_MCAST_H__
+#define __PROPS_MCAST_H__
+
+
+#include <string>
+#include <vector>
+#include "lownet.h"
+#include "propssnapshot.h"
+#include "libavionics.h"
+
+
+namespace xa {
+
+
+/// Signature at start of multicast datagram
+#define MCAST_SIGNATURE "SPM1"
+
+/// Flag of datagram which belongs to keyframe
+#define MCAST_KEYFRAME 1
+
+/// Max size of multicast datagram, fits into Ethernet frame
+#define MCAST_MAX_DATAGRAM 1400
+
+
+/// Sends values of all subscribed properties to multicast group once
+/// per frame.  Every keyframeInterval frames all values are sent, other
+/// frames contain changed values only.  Large frames are split to
+/// several datagrams with the same sequence number.
+class McastPublisher
+{
+    private:
+        /// socket sending datagrams
+        UdpSocket socket;
+
+        /// address of multicast group
+        std::string group;
+
+        /// UDP port of multicast group
+        int port;
+
+        /// sequence number of last frame
+        unsigned seq;
+
+        /// number of frames between keyframes
+        int keyframeInterval;
+
+        /// number of frames since last keyframe
+        int sinceKeyframe;
+
+        /// versions of sent values by slot
+        std::vector<unsigned> sent;
+
+        /// datagram being built
+        NetBuf datagram;
+
+        /// encoded value
+        NetBuf entry;
+
+        /// number of values in datagram
+        int count;
+
+        /// number of sent datagrams
+        double datagrams;
+
+        /// number of sent bytes
+        double bytes;
+
+    public:
+        McastPublisher();
+
+    public:
+        /// Start sending frames to group.  Returns non-zero on error
+        /// \param keyframeInterval number of frames between keyframes
+        int start(const char *group, int port, int keyframeInterval);
+
+        /// Stop sending frames
+        void stop();
+
+        /// Returns true if publisher is started
+        bool isRunning() const { return socket.isOpen(); }
+
+        /// Returns address of multicast group
+        const std::string& getGroup() const { return group; }
+
+        /// Returns UDP port of multicast group
+        int getPort() const { return port; }
+
+        /// Send frame of values changed since last snapshot
+        void publish(const PropsSnapshot &snapshot);
+
+        /// Report traffic statistics
+        void reportStats(sasl_stat_callback report, void *ref);
+
+    private:
+        /// Start new datagram of frame
+        void beginDatagram(bool keyframe);
+
+        /// Send datagram to group
+        void sendDatagram();
+};
+
+
+/// Receiver of values from multicast frames
+class McastHandler
+{
+    public:
+        virtual ~McastHandler() { };
+
+        /// Called on every received value
+        /// \param size length of string value or size of numeric value
+        virtual void onMcastValue(int slot, int type,
+                const unsigned char *data, int size) = 0;
+};
+
+
+/// Receives frames sent by McastPublisher.  Values are passed to handler
+/// as soon as datagram arrives.  Values of older frames which came
+/// after newer ones are ignored.
+class McastReceiver
+{
+    private:
+        /// socket receiving datagrams
+        UdpSocket socket;
+
+        /// true if some frame was received
+        bool started;
+
+        /// sequence number of newest received frame
+        unsigned lastSeq;
+
+        /// sequence numbers of last received values by slot
+        std::vector<unsigned> slotSeqs;
+
+        /// buffer for received datagram
+        std::vector<unsigned char> datagram;
+
+        /// number of received datagrams
+        double datagrams;
+
+        /// number of frames lost
+        double lost;
+
+    public:
+        McastReceiver();
+
+    public:
+        /// Join multicast group.  Returns non-zero on error
+        int open(const char *group, int port);
+
+        /// Leave multicast group
+        void close();
+
+        /// Receive all waiting datagrams.  Returns non-zero on error
+        int update(McastHandler &handler);
+
+        /// Returns number of received datagrams
+        double getDatagrams() const { return datagrams; }
+
+        /// Returns number of frames lost
+        double getLost() const { return lost; }
+
+    private:
+        /// Parse single datagram.  Returns non-zero if it is malformed
+        int parse(const unsigned char *data, size_t size,
+                McastHandler &handler);
+};
+
+
+};
+
+
+#endif
+
@@ -0,0 +1,320 @@
+#include "propsrecorder.h"
+
+#include <string.h>
+
+
+using namespace xa;
+
+
+void xa::putVarint(std::vector<unsigned char> &buf, uint64_t value)
+{
+    while (0x80 <= value) {
+        buf.push_back((unsigned char)(value | 0x80));
+        value >>= 7;
+    }
+    buf.push_back((unsigned char)value);
+}
+
+
+bool xa::getVarint(const unsigned char *&data, const unsigned char *end,
+        uint64_t &value)
+{
+    value = 0;
+    for (int shift = 0; (data < end) && (64 > shift); shift += 7) {
+        unsigned char c = *data++;
+        value |= (uint64_t)(c & 0x7f) << shift;
+        if (! (c & 0x80))
+            return true;
+    }
+    return false;
+}
+
+
+uint64_t xa::encodeElement(int type, uint64_t bits, uint64_t &last)
+{
+    uint64_t code;
+    if (PROP_INT == type) {
+        int64_t delta = (int64_t)(int32_t)(uint32_t)bits -
+            (int64_t)(int32_t)(uint32_t)last;
+        code = ((uint64_t)delta << 1) ^ (uint64_t)(delta >> 63);
+    } else
+        code = bits ^ last;
+    last = bits;
+    return code;
+}
+
+
+uint64_t xa::decodeElement(int type, uint64_t code, uint64_t &last)
+{
+    if (PROP_INT == type) {
+        int64_t delta = (int64_t)(code >> 1) ^ -(int64_t)(code & 1);
+        last = (uint32_t)(int32_t)((int32_t)(uint32_t)last + delta);
+    } else
+        last ^= code;
+    return last;
+}
+
+
+double xa::elementValue(int type, uint64_t bits)
+{
+    switch (type) {
+        case PROP_INT:
+            return (int32_t)(uint32_t)bits;
+        case PROP_FLOAT: {
+                uint32_t v = (uint32_t)bits;
+                float f;
+                memcpy(&f, &v, sizeof(f));
+                return f;
+            }
+        case PROP_DOUBLE: {
+                double d;
+                memcpy(&d, &bits, sizeof(d));
+                return d;
+            }
+    }
+    return 0;
+}
+
+
+PropsRecorder::PropsRecorder()
+{
+    file = NULL;
+    lastFrame = 0;
+    frames = reads = skipped = writes = 0;
+    bytes = 0;
+}
+
+
+PropsRecorder::~PropsRecorder()
+{
+    close();
+}
+
+
+int PropsRecorder::open(const std::string &fileName)
+{
+    close();
+
+    file = fopen(fileName.c_str(), "wb");
+    if (! file)
+        return -1;
+
+    ids.clear();
+    props.clear();
+    buf.clear();
+    frames = reads = skipped = writes = 0;
+    bytes = 0;
+
+    buf.insert(buf.end(), PROPS_LOG_SIGNATURE, PROPS_LOG_SIGNATURE + 4);
+    return 0;
+}
+
+
+void PropsRecorder::close()
+{
+    if (! file)
+        return;
+
+    if (! buf.empty())
+        bytes += fwrite(&buf[0], 1, buf.size(), file);
+    buf.clear();
+    fclose(file);
+    file = NULL;
+}
+
+
+void PropsRecorder::addProp(SaslPropRef prop, const std::string &name,
+        int type)
+{
+    if (! (file && prop))
+        return;
+
+    // backend may reuse freed reference for another property
+    std::map<SaslPropRef, int>::iterator i = ids.find(prop);
+    if ((i != ids.end()) && (props[(*i).second].type == type) &&
+            (props[(*i).second].name == name))
+        return;
+
+    int id = props.size();
+    props.push_back(RecordedProp());
+    props.back().name = name;
+    props.back().type = type;
+    ids[prop] = id;
+
+    buf.push_back(RECORD_PROP);
+    putVarint(buf, id);
+    buf.push_back((unsigned char)type);
+    putVarint(buf, name.length());
+    buf.insert(buf.end(), name.begin(), name.end());
+}
+
+
+void PropsRecorder::frame()
+{
+    if (! file)
+        return;
+
+    double now = timer.getSeconds();
+    if (! buf.empty()) {
+        bytes += fwrite(&buf[0], 1, buf.size(), file);
+        buf.clear();
+    }
+
+    buf.push_back(RECORD_FRAME);
+    putVarint(buf, frames ? (uint64_t)((now - lastFrame) * 1000000.0) : 0);
+    lastFrame = now;
+    frames++;
+}
+
+
+void PropsRecorder::record(int record, SaslPropRef prop, int type,
+        int offset, int count, bool array)
+{
+    std::map<SaslPropRef, int>::iterator i = ids.find(prop);
+    if ((i == ids.end()) || (0 > offset) || (0 >= count))
+        return;
+
+    RecordedProp &p = props[(*i).second];
+    if ((int)p.last.size() < offset + count)
+        p.last.resize(offset + count, 0);
+
+    // unchanged elements are coded as zero
+    bool changed = false;
+    for (int j = 0; j < count; j++) {
+        bits[j] = encodeElement(type, bits[j], p.last[offset + j]);
+        if (bits[j])
+            changed = true;
+    }
+
+    if (RECORD_READ == record) {
+        if (! changed) {
+            skipped++;
+            return;
+        }
+        reads++;
+    } else
+        writes++;
+
+    buf.push_back((unsigned char)(record | (type << 3) |
+                (array ? RECORD_ARRAY : 0)));
+    putVarint(buf, (*i).second);
+    if (array) {
+        putVarint(buf, offset);
+        putVarint(buf, count);
+    }
+    for (int j = 0; j < count; j++)
+        putVarint(buf, bits[j]);
+}
+
+
+void PropsRecorder::recordInt(int record, SaslPropRef prop, int value)
+{
+    if (! file)
+        return;
+    bits.resize(1);
+    bits[0] = (uint32_t)value;
+    this->record(record, prop, PROP_INT, 0, 1, false);
+}
+
+
+void PropsRecorder::recordFloat(int record, SaslPropRef prop, float value)
+{
+    if (! file)
+        return;
+    uint32_t v;
+    memcpy(&v, &value, sizeof(v));
+    bits.resize(1);
+    bits[0] = v;
+    this->record(record, prop, PROP_FLOAT, 0, 1, false);
+}
+
+
+void PropsRecorder::recordDouble(int record, SaslPropRef prop, double value)
+{
+    if (! file)
+        return;
+    bits.resize(1);
+    memcpy(&bits[0], &value, sizeof(value));
+    this->record(record, prop, PROP_DOUBLE, 0, 1, false);
+}
+
+
+void PropsRecorder::recordString(int record, SaslPropRef prop,
+        const std::string &value)
+{
+    if (! file)
+        return;
+
+    std::map<SaslPropRef, int>::iterator i = ids.find(prop);
+    if (i == ids.end())
+        return;
+
+    RecordedProp &p = props[(*i).second];
+    if (RECORD_READ == record) {
+        if (p.lastString == value) {
+            skipped++;
+            return;
+        }
+        reads++;
+    } else
+        writes++;
+    p.lastString = value;
+
+    buf.push_back((unsigned char)(record | (PROP_STRING << 3)));
+    putVarint(buf, (*i).second);
+    putVarint(buf, value.length());
+    buf.insert(buf.end(), value.begin(), value.end());
+}
+
+
+void PropsRecorder::recordArray(int record, SaslPropRef prop, int type,
+        const void *values, int offset, int count)
+{
+    if (! (file && values) || (0 >= count))
+        return;
+
+    bits.resize(count);
+    if (PROP_INT == type) {
+        const int *v = (const int*)values;
+        for (int i = 0; i < count; i++)
+            bits[i] = (uint32_t)v[i];
+    } else if (PROP_FLOAT == type) {
+        const float *v = (const float*)values;
+        for (int i = 0; i < count; i++) {
+            uint32_t b;
+            memcpy(&b, &v[i], sizeof(b));
+            bits[i] = b;
+        }
+    } else
+        return;
+
+    this->record(record, prop, type, offset, count, true);
+}
+
+
+void PropsRecorder::recordSize(SaslPropRef prop, int size)
+{
+    if (! file)
+        return;
+
+    std::map<SaslPropRef, int>::iterator i = ids.find(prop);
+    if ((i == ids.end()) || (0 > size) ||
+            ((int)props[(*i).second].last.size() == size))
+        return;
+
+    props[(*i).second].last.resize(size, 0);
+    buf.push_back(RECORD_SIZE);
+    putVarint(buf, (*i).second);
+    putVarint(buf, size);
+}
+
+
+void PropsRecorder::reportStats(sasl_stat_callback report, void *ref)
+{
+    report(ref, "record.frames", frames);
+    report(ref, "record.reads", reads);
+    report(ref, "record.skipped", skipped);
+    report(ref, "record.writes", writes);
+    report(ref, "record.bytes", bytes + buf.size());
+}
+
@@ -0,0 +1,180 @@
+#ifndef __PROPS_RECORDER_H__
+#define __PROPS_RECORDER_H__
+
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <map>
+#include "libavcallbacks.h"
+#include "rttimer.h"
+
+
+namespace xa {
+
+
+/// Signature at start of properties log
+#define PROPS_LOG_SIGNATURE "SPL1"
+
+/// Types of records in properties log.
+/// Record starts with byte containing record type in low 3 bits,
+/// type of value in next 3 bits and flag of array range in high bit.
+enum PropsRecordType {
+    /// new property: varint ID, type byte, varint length and name
+    RECORD_PROP = 1,
+
+    /// start of frame: varint microseconds since previous frame
+    RECORD_FRAME = 2,
+
+    /// value read from simulator: varint ID and coded value
+    RECORD_READ = 3,
+
+    /// value written by avionics: varint ID and coded value
+    RECORD_WRITE = 4,
+
+    /// size of array property: varint ID and varint size
+    RECORD_SIZE = 5
+};
+
+/// Flag of array range in record byte
+#define RECORD_ARRAY 0x80
+
+
+/// Delta coding state of recorded property.
+/// Same state is kept by recorder and replayer, so numbers are stored
+/// as differences to previous value of property: zigzag encoded
+/// difference for integers and XOR of bits for floating point values.
+struct RecordedProp {
+    /// name of property
+    std::string name;
+
+    /// type of property
+    int type;
+
+    /// bits of last coded elements
+    std::vector<uint64_t> last;
+
+    /// last coded string value
+    std::string lastString;
+};
+
+
+/// Append variable length integer to buffer
+void putVarint(std::vector<unsigned char> &buf, uint64_t value);
+
+/// Read variable length integer.  Returns false if data is truncated
+bool getVarint(const unsigned char *&data, const unsigned char *end,
+        uint64_t &value);
+
+/// Returns delta code of element value.  Updates last value.
+/// \param type PROP_INT, PROP_FLOAT or PROP_DOUBLE
+/// \param bits bit pattern of int, float or double value
+uint64_t encodeElement(int type, uint64_t bits, uint64_t &last);
+
+/// Restore element value from delta code.  Updates last value
+uint64_t decodeElement(int type, uint64_t code, uint64_t &last);
+
+/// Convert bit pattern of element to number
+double elementValue(int type, uint64_t bits);
+
+
+/// Writes every property read and write to binary log frame by frame.
+/// Reads which return same value as last recorded are skipped.
+class PropsRecorder
+{
+    private:
+        /// log file or NULL if not recording
+        FILE *file;
+
+        /// records of current frame
+        std::vector<unsigned char> buf;
+
+        /// IDs of recorded properties
+        std::map<SaslPropRef, int> ids;
+
+        /// delta coding state of properties
+        std::vector<RecordedProp> props;
+
+        /// buffer for element bits
+        std::vector<uint64_t> bits;
+
+        /// timer used to measure frame times
+        RtTimer timer;
+
+        /// time of last frame
+        double lastFrame;
+
+        /// number of recorded frames
+        int frames;
+
+        /// number of recorded reads
+        int reads;
+
+        /// number of skipped reads
+        int skipped;
+
+        /// number of recorded writes
+        int writes;
+
+        /// bytes written to file
+        double bytes;
+
+    public:
+        PropsRecorder();
+
+        ~PropsRecorder();
+
+    public:
+        /// Start recording to file.  Returns non-zero on error
+        int open(const std::string &fileName);
+
+        /// Write pending records and close file
+        void close();
+
+        /// Returns true if recording is active
+        bool isOpen() const { return NULL != file; }
+
+        /// Assign ID to property reference
+        void addProp(SaslPropRef prop, const std::string &name, int type);
+
+        /// Start new frame writing records of previous one
+        void frame();
+
+        /// Record int value
+        /// \param record RECORD_READ or RECORD_WRITE
+        void recordInt(int record, SaslPropRef prop, int value);
+
+        /// Record float value
+        void recordFloat(int record, SaslPropRef prop, float value);
+
+        /// Record double value
+        void recordDouble(int record, SaslPropRef prop, double value);
+
+        /// Record string value
+        void recordString(int record, SaslPropRef prop,
+                const std::string &value);
+
+        /// Record range of array property
+        /// \param type type of values, PROP_INT or PROP_FLOAT
+        void recordArray(int record, SaslPropRef prop, int type,
+                const void *values, int offset, int count);
+
+        /// Record size of array property
+        void recordSize(SaslPropRef prop, int size);
+
+        /// Report recording statistics
+        void reportStats(sasl_stat_callback report, void *ref);
+
+    private:
+        /// Append numeric record.  Elements are taken from bits buffer
+        void record(int record, SaslPropRef prop, int type, int offset,
+                int count, bool array);
+};
+
+
+};
+
+
+#endif
+
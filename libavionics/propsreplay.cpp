@@ -0,0 +1,605 @@
+#include "propsreplay.h"
+
+#include <string>
+#include <vector>
+#include <map>
+#include <deque>
+#include <string.h>
+#include <stdio.h>
+#include "propsrecorder.h"
+#include "properties.h"
+#include "utils.h"
+
+
+using namespace xa;
+
+
+struct ReplayProps;
+
+
+/// Property with recorded value
+struct ReplayProp
+{
+    /// Reference to properties storage
+    ReplayProps *props;
+
+    /// Name of property
+    std::string name;
+
+    /// Type of property
+    int type;
+
+    /// Numeric value or elements of array property
+    std::vector<double> values;
+
+    /// Value of string property
+    std::string string;
+
+    /// Getter of functional property or NULL
+    sasl_prop_getter_callback getter;
+
+    /// Setter of functional property or NULL
+    sasl_prop_setter_callback setter;
+
+    /// Reference passed to getter and setter
+    void *ref;
+
+    /// Recorded writes of current frame not made by avionics yet
+    std::deque<double> expected;
+};
+
+
+/// Replayed properties and recorded log
+struct ReplayProps
+{
+    Log &log;
+
+    /// content of log file
+    std::vector<unsigned char> data;
+
+    /// position of next record in data
+    size_t pos;
+
+    /// delta coding state of recorded properties
+    std::vector<RecordedProp> recorded;
+
+    /// properties by recorded ID
+    std::vector<ReplayProp*> byId;
+
+    /// properties by name
+    std::map<std::string, ReplayProp*> byName;
+
+    /// number of replayed frames
+    int frame;
+
+    /// recorded time of replayed frames in seconds
+    double recordedTime;
+
+    /// number of writes made by avionics
+    int writes;
+
+    /// number of writes which differ from recorded ones
+    int mismatches;
+
+    /// number of recorded writes waiting for avionics
+    int expected;
+
+    /// true if all records were replayed
+    bool finished;
+
+    ReplayProps(Log &log): log(log) {
+        pos = 0;
+        frame = 0;
+        recordedTime = 0;
+        writes = mismatches = expected = 0;
+        finished = false;
+    }
+
+    ~ReplayProps() {
+        for (std::map<std::string, ReplayProp*>::iterator i =
+                byName.begin(); i != byName.end(); ++i)
+            delete (*i).second;
+    }
+};
+
+
+/// Returns property with specified name creating it if needed
+static ReplayProp* findProp(ReplayProps *props, const std::string &name,
+        int type)
+{
+    std::map<std::string, ReplayProp*>::iterator i = props->byName.find(name);
+    if (i != props->byName.end())
+        return (*i).second;
+
+    ReplayProp *prop = new ReplayProp();
+    prop->props = props;
+    prop->name = name;
+    prop->type = type;
+    prop->values.resize(1, 0);
+    prop->getter = NULL;
+    prop->setter = NULL;
+    prop->ref = NULL;
+    props->byName[name] = prop;
+    return prop;
+}
+
+
+/// Round value to precision of property type
+static double roundToType(int type, double value)
+{
+    switch (type) {
+        case PROP_INT:
+        case PROP_INT_ARRAY:
+            return (int)value;
+        case PROP_FLOAT:
+        case PROP_FLOAT_ARRAY:
+            return (float)value;
+    }
+    return value;
+}
+
+
+/// Store numeric value written by avionics and compare it with recorded one
+static int writeNumber(ReplayProp *prop, double value)
+{
+    ReplayProps *p = prop->props;
+    p->writes++;
+    if (! prop->expected.empty()) {
+        if (prop->expected.front() != value)
+            p->mismatches++;
+        prop->expected.pop_front();
+        p->expected--;
+    }
+
+    if (PROP_STRING == prop->type)
+        prop->string = toString(value);
+    else {
+        if (prop->values.empty())
+            prop->values.resize(1);
+        prop->values[0] = roundToType(prop->type, value);
+    }
+    return 0;
+}
+
+
+/// Returns numeric value of property
+static double readNumber(ReplayProp *prop)
+{
+    if (PROP_STRING == prop->type)
+        return strToDouble(prop->string);
+    return prop->values.empty() ? 0 : prop->values[0];
+}
+
+
+/// Read range of recorded numeric values
+static bool readValues(ReplayProps *p, const unsigned char *&data,
+        const unsigned char *end, int record, int type, int id, bool array)
+{
+    uint64_t offset = 0, count = 1;
+    if (array && ! (getVarint(data, end, offset) &&
+                getVarint(data, end, count)))
+        return false;
+
+    RecordedProp &rec = p->recorded[id];
+    ReplayProp *prop = p->byId[id];
+    if (rec.last.size() < offset + count)
+        rec.last.resize(offset + count, 0);
+    if ((RECORD_READ == record) && (prop->values.size() < offset + count))
+        prop->values.resize(offset + count, 0);
+
+    for (uint64_t i = 0; i < count; i++) {
+        uint64_t code;
+        if (! getVarint(data, end, code))
+            return false;
+        double value = elementValue(type,
+                decodeElement(type, code, rec.last[offset + i]));
+        if (RECORD_READ == record)
+            prop->values[offset + i] = value;
+        else if (! array) {
+            prop->expected.push_back(value);
+            p->expected++;
+        }
+    }
+    return true;
+}
+
+
+/// Apply single record.
+/// Returns 1 at start of frame, 0 on success or -1 if log is corrupted
+static int replayRecord(ReplayProps *p, const unsigned char *&data,
+        const unsigned char *end)
+{
+    int header = *data++;
+    int record = header & 0x07;
+    int type = (header >> 3) & 0x07;
+    bool array = 0 != (header & RECORD_ARRAY);
+
+    if (RECORD_FRAME == record) {
+        uint64_t time;
+        if (! getVarint(data, end, time))
+            return -1;
+        p->recordedTime += time / 1000000.0;
+        return 1;
+    }
+
+    uint64_t id, len;
+    if (! getVarint(data, end, id))
+        return -1;
+
+    if (RECORD_PROP == record) {
+        if ((data >= end) || (id > p->recorded.size()))
+            return -1;
+        int propType = *data++;
+        if (! getVarint(data, end, len) || (len > (uint64_t)(end - data)))
+            return -1;
+        if (id == p->recorded.size()) {
+            p->recorded.push_back(RecordedProp());
+            p->byId.push_back(NULL);
+        }
+        RecordedProp &rec = p->recorded[id];
+        rec.name = std::string((const char*)data, len);
+        rec.type = propType;
+        rec.last.clear();
+        rec.lastString.clear();
+        p->byId[id] = findProp(p, rec.name, propType);
+        data += len;
+        return 0;
+    }
+
+    if (id >= p->recorded.size())
+        return -1;
+
+    if (RECORD_SIZE == record) {
+        uint64_t size;
+        if (! getVarint(data, end, size))
+            return -1;
+        p->recorded[id].last.resize(size, 0);
+        p->byId[id]->values.resize(size, 0);
+        return 0;
+    }
+
+    if ((RECORD_READ != record) && (RECORD_WRITE != record))
+        return -1;
+
+    if (PROP_STRING == type) {
+        if (! getVarint(data, end, len) || (len > (uint64_t)(end - data)))
+            return -1;
+        std::string value((const char*)data, len);
+        data += len;
+        p->recorded[id].lastString = value;
+        if (RECORD_READ == record)
+            p->byId[id]->string = value;
+        return 0;
+    }
+
+    return readValues(p, data, end, record, type, id, array) ? 0 : -1;
+}
+
+
+/// Apply records till start of next frame.
+/// Returns non-zero if log is corrupted
+static int replayFrame(ReplayProps *p)
+{
+    const unsigned char *start = p->data.empty() ? NULL : &p->data[0];
+    const unsigned char *end = start + p->data.size();
+    const unsigned char *data = start + p->pos;
+
+    while (data < end) {
+        int res = replayRecord(p, data, end);
+        if (-1 == res) {
+            p->log.error("Properties log is corrupted at offset %i",
+                    (int)(data - start));
+            break;
+        }
+        if (1 == res) {
+            p->pos = data - start;
+            return 0;
+        }
+    }
+
+    p->pos = p->data.size();
+    p->finished = true;
+    return data < end ? -1 : 0;
+}
+
+
+/// Returns reference to property
+static SaslPropRef getPropRef(SaslProps props, const char *name, int type)
+{
+    ReplayProps *p = (ReplayProps*)props;
+    if (! (p && name))
+        return NULL;
+    return findProp(p, name, type);
+}
+
+
+/// Properties are owned by storage, nothing to free
+static void freePropRef(SaslPropRef prop)
+{
+}
+
+
+/// Create property or return reference to existing one
+static SaslPropRef createProp(SaslProps props, const char *name, int type,
+        int maxSize, bool notPublish)
+{
+    ReplayProps *p = (ReplayProps*)props;
+    if (! (p && name))
+        return NULL;
+
+    ReplayProp *prop = findProp(p, name, type);
+    if (((PROP_INT_ARRAY == type) || (PROP_FLOAT_ARRAY == type)) &&
+            ((int)prop->values.size() < maxSize))
+        prop->values.resize(maxSize, 0);
+    return prop;
+}
+
+
+/// Create functional property
+static SaslPropRef createFuncProp(SaslProps props, const char *name,
+        int type, int maxSize, sasl_prop_getter_callback getter,
+        sasl_prop_setter_callback setter, void *ref)
+{
+    ReplayProps *p = (ReplayProps*)props;
+    if (! (p && name))
+        return NULL;
+
+    ReplayProp *prop = findProp(p, name, type);
+    prop->getter = getter;
+    prop->setter = setter;
+    prop->ref = ref;
+    return prop;
+}
+
+
+static int getPropInt(SaslPropRef ref, int *err)
+{
+    if (err)
+        *err = 0;
+    ReplayProp *prop = (ReplayProp*)ref;
+    if (prop->getter) {
+        int v = 0;
+        prop->getter(PROP_INT, &v, sizeof(v), prop->ref);
+        return v;
+    }
+    return (int)readNumber(prop);
+}
+
+
+static int setPropInt(SaslPropRef ref, int value)
+{
+    ReplayProp *prop = (ReplayProp*)ref;
+    if (prop->setter) {
+        prop->setter(PROP_INT, &value, sizeof(value), prop->ref);
+        return 0;
+    }
+    return writeNumber(prop, value);
+}
+
+
+static float getPropFloat(SaslPropRef ref, int *err)
+{
+    if (err)
+        *err = 0;
+    ReplayProp *prop = (ReplayProp*)ref;
+    if (prop->getter) {
+        float v = 0;
+        prop->getter(PROP_FLOAT, &v, sizeof(v), prop->ref);
+        return v;
+    }
+    return (float)readNumber(prop);
+}
+
+
+static int setPropFloat(SaslPropRef ref, float value)
+{
+    ReplayProp *prop = (ReplayProp*)ref;
+    if (prop->setter) {
+        prop->setter(PROP_FLOAT, &value, sizeof(value), prop->ref);
+        return 0;
+    }
+    return writeNumber(prop, value);
+}
+
+
+static double getPropDouble(SaslPropRef ref, int *err)
+{
+    if (err)
+        *err = 0;
+    ReplayProp *prop = (ReplayProp*)ref;
+    if (prop->getter) {
+        double v = 0;
+        prop->getter(PROP_DOUBLE, &v, sizeof(v), prop->ref);
+        return v;
+    }
+    return readNumber(prop);
+}
+
+
+static int setPropDouble(SaslPropRef ref, double value)
+{
+    ReplayProp *prop = (ReplayProp*)ref;
+    if (prop->setter) {
+        prop->setter(PROP_DOUBLE, &value, sizeof(value), prop->ref);
+        return 0;
+    }
+    return writeNumber(prop, value);
+}
+
+
+/// Copy string value of property to buffer.  Returns length of string
+static int getPropString(SaslPropRef ref, char *buf, int maxSize, int *err)
+{
+    if (err)
+        *err = 0;
+    ReplayProp *prop = (ReplayProp*)ref;
+    if (prop->getter)
+        return prop->getter(PROP_STRING, buf, maxSize, prop->ref);
+
+    std::string s = PROP_STRING == prop->type ? prop->string :
+        toString(readNumber(prop));
+    int len = s.length();
+    if (buf && maxSize) {
+        int toCopy = len + 1 < maxSize ? len + 1 : maxSize;
+        memcpy(buf, s.c_str(), toCopy);
+        buf[toCopy - 1] = 0;
+        if ((len + 1 > maxSize) && err)
+            *err = 1;
+    }
+    return len;
+}
+
+
+static int setPropString(SaslPropRef ref, const char *value)
+{
+    ReplayProp *prop = (ReplayProp*)ref;
+    if (! value)
+        return -1;
+    if (prop->setter) {
+        prop->setter(PROP_STRING, (void*)value, strlen(value) + 1, prop->ref);
+        return 0;
+    }
+    if (PROP_STRING != prop->type)
+        return writeNumber(prop, strToDouble(value));
+    prop->props->writes++;
+    prop->string = value;
+    return 0;
+}
+
+
+static int getPropArray(SaslPropRef ref, int type, void *values,
+        int offset, int count, int *err)
+{
+    if (err)
+        *err = 0;
+    ReplayProp *prop = (ReplayProp*)ref;
+    int size = prop->values.size();
+    if ((0 > offset) || (offset >= size))
+        return 0;
+    if (count > size - offset)
+        count = size - offset;
+    if (! values)
+        return size - offset;
+
+    for (int i = 0; i < count; i++) {
+        if (PROP_INT == type)
+            ((int*)values)[i] = (int)prop->values[offset + i];
+        else
+            ((float*)values)[i] = (float)prop->values[offset + i];
+    }
+    return count;
+}
+
+
+static int setPropArray(SaslPropRef ref, int type, const void *values,
+        int offset, int count)
+{
+    ReplayProp *prop = (ReplayProp*)ref;
+    if ((! values) || (0 > offset) || (0 >= count))
+        return -1;
+
+    if ((int)prop->values.size() < offset + count)
+        prop->values.resize(offset + count, 0);
+    for (int i = 0; i < count; i++) {
+        double v = PROP_INT == type ? ((const int*)values)[i] :
+            ((const float*)values)[i];
+        prop->values[offset + i] = roundToType(prop->type, v);
+    }
+    prop->props->writes++;
+    return 0;
+}
+
+
+/// Advance replay by one frame
+static int updateProps(SaslProps props)
+{
+    ReplayProps *p = (ReplayProps*)props;
+    if (p->finished)
+        return 0;
+
+    // recorded writes which were not repeated by avionics
+    if (p->expected) {
+        for (std::map<std::string, ReplayProp*>::iterator i =
+                p->byName.begin(); i != p->byName.end(); ++i)
+            (*i).second->expected.clear();
+        p->mismatches += p->expected;
+        p->expected = 0;
+    }
+
+    p->frame++;
+    return replayFrame(p);
+}
+
+
+static void doneProps(SaslProps props)
+{
+    delete (ReplayProps*)props;
+}
+
+
+/// Report progress of replay
+static void propsStats(SaslProps props, sasl_stat_callback report, void *ref)
+{
+    ReplayProps *p = (ReplayProps*)props;
+    if (! (p && report))
+        return;
+
+    report(ref, "replay.frame", p->frame);
+    report(ref, "replay.time", p->recordedTime);
+    report(ref, "replay.writes", p->writes);
+    report(ref, "replay.mismatches", p->mismatches);
+    report(ref, "replay.finished", p->finished);
+}
+
+
+static SaslPropsCallbacks callbacks = { getPropRef, freePropRef, createProp,
+        createFuncProp, getPropInt, setPropInt, getPropFloat,
+        setPropFloat, getPropDouble, setPropDouble,
+        getPropString, setPropString,
+        updateProps, doneProps, propsStats, getPropArray, setPropArray,
+        NULL, NULL };
+
+
+int xa::replayProps(SASL sasl, Log &log, const char *fileName)
+{
+    FILE *f = fopen(fileName, "rb");
+    if (! f) {
+        log.error("Can't open properties log %s", fileName);
+        return -1;
+    }
+
+    ReplayProps *p = new ReplayProps(log);
+    unsigned char buf[4096];
+    size_t len;
+    while (0 < (len = fread(buf, 1, sizeof(buf), f)))
+        p->data.insert(p->data.end(), buf, buf + len);
+    fclose(f);
+
+    if ((4 > p->data.size()) ||
+            memcmp(&p->data[0], PROPS_LOG_SIGNATURE, 4))
+    {
+        log.error("%s is not properties log", fileName);
+        delete p;
+        return -1;
+    }
+    p->pos = 4;
+
+    // records made before first frame
+    if (replayFrame(p)) {
+        delete p;
+        return -1;
+    }
+
+    sasl_set_props(sasl, &callbacks, p);
+    return 0;
+}
+
+
+int xa::isReplayFinished(Properties &properties)
+{
+    if (&callbacks != properties.getCallbacks())
+        return 1;
+    ReplayProps *p = (ReplayProps*)properties.getPropsHandle();
+    return (! p) || p->finished;
+}
+
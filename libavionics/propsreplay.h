@@ -0,0 +1,24 @@
+#ifndef __PROPS_REPLAY_H__
+#define __PROPS_REPLAY_H__
+
+
+#include "libavionics.h"
+#include "log.h"
+
+
+namespace xa {
+
+class Properties;
+
+/// Replace properties by values recorded to file by PropsRecorder.
+/// Every update of properties advances replay by one frame.
+/// Returns zero on success
+int replayProps(SASL sasl, Log &log, const char *fileName);
+
+/// Returns non-zero if all recorded frames were replayed
+int isReplayFinished(Properties &properties);
+
+};
+
+#endif
+
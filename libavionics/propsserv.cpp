@@ -1,24 +1,345 @@
 #include "propsserv.h"
 
 #include <string.h>
+#include <math.h>
 #include "md5.h"
-#include "libavcallbacks.h"
+#include "utils.h"
+#include "propsrecorder.h"
+#include "avionics.h"
 
 
 using namespace xa;
 
+
+/// Max number of requests waiting for simulator thread
+#define MAX_REQUESTS 16384
+
+/// Number of snapshots shared by threads
+#define SNAPSHOTS 3
+
+/// Max number of messages logged by network thread between frames
+#define MAX_LOG_MESSAGES 1024
+
+/// Max time network thread waits for sockets or new snapshot in
+/// milliseconds
+#define NET_THREAD_TIMEOUT 5
+
+/// Max number of frames set request from shared memory waits for
+/// subscription of its property
+#define SHM_MAX_WAITS 100
+
+
+PropsExchange::PropsExchange(Properties &properties, Log &log): 
+    properties(properties), log(log), requests(MAX_REQUESTS), 
+    published(SNAPSHOTS), released(SNAPSHOTS), snapshots(SNAPSHOTS)
+{
+    direct = true;
+    reset();
+}
+
+
+void PropsExchange::reset()
+{
+    requests.clear();
+    published.clear();
+    released.clear();
+    for (size_t i = 0; i < snapshots.size(); i++) {
+        snapshots[i].applied = 0;
+        snapshots[i].values.clear();
+        released.push(&snapshots[i]);
+    }
+    slots.clear();
+    users.clear();
+    releasing.clear();
+    freeSlots.clear();
+    current = NULL;
+    lastRequest = applied = 0;
+    count = 0;
+    for (size_t i = 0; i < refs.size(); i++)
+        properties.freeProp(refs[i]);
+    refs.clear();
+    types.clear();
+    latest.clear();
+    frame = 0;
+    changed = dropped = 0;
+}
+
+
+int PropsExchange::subscribe(int command, int type, int maxSize, 
+        const std::string &name)
+{
+    std::pair<std::string, int> key(name, type);
+    std::map<std::pair<std::string, int>, int>::iterator i = slots.find(key);
+
+    // property may be created after it was referenced as missing
+    if ((i != slots.end()) && (5 != command)) {
+        users[(*i).second]++;
+        return (*i).second;
+    }
+
+    // slot of released property is reused when no snapshot refers to it
+    while ((! releasing.empty()) && isApplied(releasing.front().first)) {
+        freeSlots.push_back(releasing.front().second);
+        releasing.pop_front();
+    }
+
+    PropsRequest request;
+    request.kind = 5 == command ? PropsRequest::CREATE : PropsRequest::GET;
+    request.seq = lastRequest + 1;
+    if (i != slots.end())
+        request.slot = (*i).second;
+    else if (! freeSlots.empty())
+        request.slot = freeSlots.back();
+    else
+        request.slot = users.size();
+    request.type = type;
+    request.maxSize = maxSize;
+    request.number = 0;
+    request.string = name;
+    if (! this->request(request))
+        return -1;
+
+    lastRequest++;
+    if (i == slots.end()) {
+        if (request.slot == (int)users.size())
+            users.push_back(0);
+        else
+            freeSlots.pop_back();
+        slots[key] = request.slot;
+    }
+    users[request.slot]++;
+    return request.slot;
+}
+
+
+void PropsExchange::unsubscribe(int slot)
+{
+    if ((0 > slot) || (slot >= (int)users.size()) || (0 >= users[slot]) ||
+            --users[slot])
+        return;
+
+    PropsRequest request;
+    request.kind = PropsRequest::RELEASE;
+    request.seq = lastRequest + 1;
+    request.slot = slot;
+    request.type = 0;
+    request.maxSize = 0;
+    request.number = 0;
+    // slot stays used if request can't be passed
+    if (! this->request(request)) {
+        users[slot]++;
+        return;
+    }
+    lastRequest++;
+
+    for (std::map<std::pair<std::string, int>, int>::iterator i = 
+            slots.begin(); i != slots.end(); ++i)
+        if ((*i).second == slot) {
+            slots.erase(i);
+            break;
+        }
+    releasing.push_back(std::make_pair(request.seq, slot));
+}
+
+
+bool PropsExchange::set(int slot, int type, double number, 
+        const std::string &string, unsigned &seq)
+{
+    PropsRequest request;
+    request.kind = PropsRequest::SET;
+    request.seq = lastRequest + 1;
+    request.slot = slot;
+    request.type = type;
+    request.maxSize = 0;
+    request.number = number;
+    request.string = string;
+    if (! this->request(request))
+        return false;
+
+    seq = ++lastRequest;
+    return true;
+}
+
+
+bool PropsExchange::receive()
+{
+    bool received = false;
+    PropsSnapshot *snapshot;
+    while (published.pop(snapshot)) {
+        if (current)
+            released.push(current);
+        current = snapshot;
+        received = true;
+    }
+    return received;
+}
+
+
+const SnapshotValue* PropsExchange::getValue(int slot) const
+{
+    if ((! current) || (0 > slot) || (slot >= (int)current->values.size()) ||
+            (! current->values[slot].valid))
+        return NULL;
+    return &current->values[slot];
+}
+
+
+bool PropsExchange::isApplied(unsigned seq) const
+{
+    return current && (0 <= (int)(current->applied - seq));
+}
+
+
+bool PropsExchange::request(const PropsRequest &request)
+{
+    if (! direct)
+        return requests.push(request);
+    applyRequest(request);
+    return true;
+}
+
+
+void PropsExchange::apply()
+{
+    PropsRequest request;
+    while (requests.pop(request))
+        applyRequest(request);
+}
+
+
+void PropsExchange::applyRequest(const PropsRequest &request)
+{
+    applied = request.seq;
+    int slot = request.slot;
+    if (PropsRequest::SET == request.kind) {
+        if ((slot >= (int)refs.size()) || (! refs[slot]))
+            return;
+        switch (request.type) {
+            case PROP_INT: 
+                properties.setProp(refs[slot], (int)request.number); 
+                break;
+            case PROP_FLOAT: 
+                properties.setProp(refs[slot], (float)request.number); 
+                break;
+            case PROP_DOUBLE: 
+                properties.setProp(refs[slot], request.number); 
+                break;
+            case PROP_STRING: 
+                properties.setProp(refs[slot], request.string); 
+                break;
+        }
+        return;
+    }
+
+    if (PropsRequest::RELEASE == request.kind) {
+        if ((slot >= (int)refs.size()) || (! refs[slot]))
+            return;
+        properties.freeProp(refs[slot]);
+        refs[slot] = NULL;
+        types[slot] = 0;
+        count--;
+        // new version makes snapshots forget old value
+        latest[slot] = SnapshotValue();
+        latest[slot].version = frame + 1;
+        return;
+    }
+
+    if (slot >= (int)refs.size()) {
+        refs.resize(slot + 1, NULL);
+        types.resize(slot + 1, 0);
+        latest.resize(slot + 1);
+    }
+    if (refs[slot])
+        return;
+    types[slot] = request.type;
+    latest[slot].type = request.type;
+    if (PropsRequest::CREATE == request.kind)
+        refs[slot] = properties.createProp(request.string, request.type, 
+                request.maxSize);
+    else
+        refs[slot] = properties.getProp(request.string, request.type);
+    if (refs[slot])
+        count++;
+    else
+        log.error("Can't reference property '%s'", request.string.c_str());
+}
+
+
+void PropsExchange::publish()
+{
+    PropsSnapshot *snapshot;
+    if (! released.pop(snapshot)) {
+        dropped++;
+        return;
+    }
+
+    // every property is read once per frame for all clients
+    frame++;
+    changed = 0;
+    for (size_t i = 0; i < refs.size(); i++) {
+        if (! refs[i])
+            continue;
+        SnapshotValue &value = latest[i];
+        if (PROP_STRING == types[i]) {
+            std::string s = properties.getProps(refs[i]);
+            if (value.valid && (s == value.string))
+                continue;
+            value.string = s;
+        } else {
+            double number;
+            switch (types[i]) {
+                case PROP_INT: number = properties.getPropi(refs[i]); break;
+                case PROP_FLOAT: number = properties.getPropf(refs[i]); break;
+                default: number = properties.getPropd(refs[i]);
+            }
+            if (value.valid && (number == value.number))
+                continue;
+            value.number = number;
+        }
+        value.valid = true;
+        value.version = frame;
+        changed++;
+    }
+
+    // snapshot keeps values of older frame, copy changed ones only
+    snapshot->applied = applied;
+    snapshot->values.resize(latest.size());
+    for (size_t i = 0; i < latest.size(); i++)
+        if (snapshot->values[i].version != latest[i].version)
+            snapshot->values[i] = latest[i];
+
+    published.push(snapshot);
+}
+
+
+
+
 ClientProp::ClientProp()
 {
+    exchange = NULL;
+    slot = -1;
+    checkedVersion = sharedVersion = 0;
     memset(&lastValue, 0, sizeof(lastValue));
+    interval = deadband = nextPush = 0;
+    encoding = NETPROP_RAW;
+    epsilon = offset = 0;
+    scale = 1;
+    lastBits = 0;
 }
 
 
 ClientProp::ClientProp(int id, int type, const std::string &name, 
-        Properties *properties, SaslPropRef ref):
-       id(id), type(type), name(name), properties(properties), ref(ref)
+        PropsExchange *exchange, int slot):
+       id(id), type(type), name(name), exchange(exchange), slot(slot)
 {
+    checkedVersion = sharedVersion = 0;
     sendNext = true;
     memset(&lastValue, 0, sizeof(lastValue));
+    interval = deadband = nextPush = 0;
+    encoding = NETPROP_RAW;
+    epsilon = offset = 0;
+    scale = 1;
+    lastBits = 0;
 }
 
 ClientProp::~ClientProp()
@@ -28,50 +349,155 @@ ClientProp::~ClientProp()
 }
 
 
-bool ClientProp::isChanged()
+bool ClientProp::isChanged(double deadband)
 {
+    // property is not read by simulator thread yet
+    const SnapshotValue *value = exchange->getValue(slot);
+    if (! value)
+        return false;
+
     if (sendNext)
         return true;
 
+    // result of check changes only with value
+    if (value->version == checkedVersion)
+        return false;
+    checkedVersion = value->version;
+
+    if (deadband < epsilon)
+        deadband = epsilon;
+
     switch (type) {
         case PROP_INT:
-            return properties->getPropi(ref) != lastValue.intValue;
+            return fabs(value->number - lastValue.intValue) > deadband;
         case PROP_FLOAT:
-            return properties->getPropf(ref) != lastValue.floatValue;
+            {
+                float v = (float)value->number;
+                if (! (fabs(v - lastValue.floatValue) > deadband))
+                    return false;
+                return (NETPROP_FIXED16 != encoding) || 
+                    (quantize(v) != lastBits);
+            }
         case PROP_DOUBLE:
-            return properties->getPropd(ref) != lastValue.doubleValue;
-        case PROP_STRING:
             {
-                std::string s = properties->getProps(ref);
-                return (! lastValue.buf) || (strcmp(s.c_str(), lastValue.buf));
+                double v = value->number;
+                if (! (fabs(v - lastValue.doubleValue) > deadband))
+                    return false;
+                return (NETPROP_FIXED16 != encoding) || 
+                    (quantize(v) != lastBits);
             }
+        case PROP_STRING:
+            return (! lastValue.buf) || 
+                strcmp(value->string.c_str(), lastValue.buf);
         default:
             return false;
     }
 }
 
 
-void ClientProp::send(NetBuf &buffer)
+const SnapshotValue* ClientProp::getNewValue()
+{
+    const SnapshotValue *value = exchange->getValue(slot);
+    if ((! value) || (value->version == sharedVersion))
+        return NULL;
+    sharedVersion = value->version;
+    return value;
+}
+
+
+unsigned ClientProp::quantize(double value) const
+{
+    double code = floor((value - offset) / scale + 0.5);
+    if (! (0 < code))
+        return 0;
+    if (65535 < code)
+        return 65535;
+    return (unsigned)code;
+}
+
+
+bool ClientProp::setEncoding(int newEncoding, double newEpsilon, 
+        double newScale, double newOffset)
+{
+    switch (newEncoding) {
+        case NETPROP_RAW:
+            break;
+        case NETPROP_FIXED16:
+            if (((PROP_FLOAT != type) && (PROP_DOUBLE != type)) || 
+                    (! (0 < newScale)))
+                return false;
+            break;
+        case NETPROP_DELTA:
+            if (PROP_STRING == type)
+                return false;
+            break;
+        default:
+            return false;
+    }
+
+    encoding = newEncoding;
+    epsilon = 0 < newEpsilon ? newEpsilon : 0;
+    scale = newScale;
+    offset = newOffset;
+
+    // delta code starts from zero after encoding change
+    lastBits = 0;
+    sendNext = true;
+    return true;
+}
+
+
+int ClientProp::send(NetBuf &buffer, int version)
 {
     sendNext = false;
 
-    buffer.addUint8(id);
+    // value exists because only changed properties are sent
+    const SnapshotValue *value = exchange->getValue(slot);
+    checkedVersion = value->version;
+
+    if (3 == version)
+        buffer.addVarint(id);
+    else
+        buffer.addUint8(id);
+
+    int mode = 3 == version ? encoding : NETPROP_RAW;
+    size_t start = buffer.getFilled();
     switch (type) {
         case PROP_INT: 
-            lastValue.intValue = properties->getPropi(ref);
-            buffer.addInt32(lastValue.intValue);
+            lastValue.intValue = (int)value->number;
+            if (NETPROP_DELTA == mode)
+                buffer.addVarint64(encodeElement(PROP_INT, 
+                            (uint32_t)lastValue.intValue, lastBits));
+            else
+                buffer.addInt32(lastValue.intValue);
             break;
         case PROP_FLOAT:
-            lastValue.floatValue = properties->getPropf(ref);
-            buffer.addFloat(lastValue.floatValue);
+            lastValue.floatValue = (float)value->number;
+            if (NETPROP_FIXED16 == mode) {
+                lastBits = quantize(lastValue.floatValue);
+                buffer.addUint16(lastBits);
+            } else if (NETPROP_DELTA == mode) {
+                uint32_t bits;
+                memcpy(&bits, &lastValue.floatValue, sizeof(bits));
+                buffer.addVarint64(encodeElement(PROP_FLOAT, bits, lastBits));
+            } else
+                buffer.addFloat(lastValue.floatValue);
             break;
         case PROP_DOUBLE:
-            lastValue.doubleValue = properties->getPropf(ref);
-            buffer.addDouble(lastValue.doubleValue);
+            lastValue.doubleValue = value->number;
+            if (NETPROP_FIXED16 == mode) {
+                lastBits = quantize(lastValue.doubleValue);
+                buffer.addUint16(lastBits);
+            } else if (NETPROP_DELTA == mode) {
+                uint64_t bits;
+                memcpy(&bits, &lastValue.doubleValue, sizeof(bits));
+                buffer.addVarint64(encodeElement(PROP_DOUBLE, bits, lastBits));
+            } else
+                buffer.addDouble(lastValue.doubleValue);
             break;
         case PROP_STRING:
             {
-                std::string s = properties->getProps(ref);
+                const std::string &s = value->string;
                 int len = s.length();
                 if ((! lastValue.buf) || (len + 1 > lastValue.maxBufSize)) {
                     lastValue.maxBufSize = len + 20;
@@ -79,73 +505,131 @@ void ClientProp::send(NetBuf &buffer)
                     lastValue.buf = (char*)malloc(lastValue.maxBufSize);
                 }
                 strcpy(lastValue.buf, s.c_str());
-                buffer.addUint16(len);
+                if (3 == version)
+                    buffer.addVarint(len);
+                else
+                    buffer.addUint16(len);
                 buffer.add((const unsigned char*)s.c_str(), len);
             }
-            break;
+            return 0;
     }
+    return getPropTypeSize(type) - (int)(buffer.getFilled() - start);
 }
 
 
-void ClientProp::setInt(int value)
+void ClientProp::setPushRate(int rate, double band)
 {
-    properties->setProp(ref, value);
+    interval = 0 < rate ? 1.0 / rate : 0;
+    deadband = 0 < band ? band : 0;
+    nextPush = 0;
 }
 
 
-void ClientProp::setFloat(float value)
+bool ClientProp::needsPush(double now)
 {
-    properties->setProp(ref, value);
+    return (0 < interval) && (now >= nextPush) && isChanged(deadband);
 }
 
 
-void ClientProp::setDouble(double value)
+PropsServer::PropsServer(Log &log, Properties &properties): 
+        log(log), logQueue(MAX_LOG_MESSAGES), exchange(properties, log),
+        poller(netLog), server(netLog), properties(properties)
 {
-    properties->setProp(ref, value);
+    threaded = false;
+    stopping = false;
+    server.setCallback(this);
+    server.setPoller(&poller);
 }
 
-void ClientProp::setString(const std::string &value)
+
+PropsServer::~PropsServer()
 {
-    properties->setProp(ref, value);
+    stop();
 }
 
 
-
-
-PropsServer::PropsServer(Log &log, Properties &properties): 
-        log(log), server(log), properties(properties)
+int PropsServer::start(const char *password, int port, bool threaded)
 {
-    server.setCallback(this);
+    void *ref;
+    sasl_log_callback logger = log.getLogger(&ref);
+    netLog.setLogger(logger, ref);
+    netLog.setQueue(NULL);
+
+    secret = password;
+    if (server.start(port))
+        return -1;
+    if (! threaded)
+        return 0;
+
+    // new snapshot wakes network thread
+    if (poller.enableWakeup())
+        log.warning("network thread will wait for snapshots with timeout");
+
+    exchange.setDirect(false);
+    logQueue.clear();
+    netLog.setQueue(&logQueue);
+    stopping = false;
+    this->threaded = true;
+    memoryBarrier();
+    if (thread.start(run, this)) {
+        log.warning("can't start network thread, serving properties "
+                "in simulator thread");
+        this->threaded = false;
+        exchange.setDirect(true);
+        netLog.setQueue(NULL);
+    }
+    return 0;
 }
 
 
-PropsServer::~PropsServer()
+void PropsServer::run(void *server)
 {
-    server.stop();
+    PropsServer *self = (PropsServer*)server;
+    while (! self->stopping) {
+        self->serve(NET_THREAD_TIMEOUT);
+        memoryBarrier();
+    }
 }
 
 
-int PropsServer::start(const char *password, int port)
+int PropsServer::update()
 {
-    secret = password;
-    return server.start(port);
+    exchange.apply();
+    exchange.publish();
+    if (! threaded)
+        return serve(0);
+
+    poller.wakeup();
+    log.flush(logQueue);
+    return 0;
 }
 
 
-int PropsServer::update()
+int PropsServer::serve(int timeout)
 {
     int err = 0;
 
+    // values are pushed only when simulator published new frame
+    bool fresh = exchange.receive();
+    if (fresh && mcast.isRunning())
+        mcast.publish(*exchange.getSnapshot());
+
+    if (0 > poller.poll(timeout)) {
+        netLog.error("error polling sockets");
+        err = -1;
+    }
+
     if (server.update()) {
-        log.error("tcp server error");
+        netLog.error("tcp server error");
         err = -1;
     }
 
+    double now = timer.getSeconds();
     for (std::list<PropsClient>::iterator i = clients.begin(); 
             i != clients.end(); )
     {
-        if ((*i).update()) {
-            log.debug("closing client connection");
+        if ((*i).update(now, fresh)) {
+            netLog.debug("closing client connection");
             i = clients.erase(i);
 		} else {
 			++i;
@@ -158,15 +642,26 @@ int PropsServer::update()
 
 void PropsServer::stop()
 {
+    if (thread.isRunning()) {
+        stopping = true;
+        memoryBarrier();
+        thread.join();
+    }
+    threaded = false;
+    netLog.setQueue(NULL);
+    log.flush(logQueue);
+
     server.stop();
     clients.clear();
+    exchange.reset();
+    exchange.setDirect(true);
 }
 
 
 void PropsServer::onConnectionReceived(int sock)
 {
-    clients.push_back(PropsClient(log, secret, properties));
-    clients.back().start(sock);
+    clients.push_back(PropsClient(netLog, secret, exchange, &mcast));
+    clients.back().start(sock, &poller);
 }
 
 bool PropsServer::isRunning()
@@ -175,22 +670,70 @@ bool PropsServer::isRunning()
 }
 
 
+void PropsServer::reportStats(sasl_stat_callback report, void *ref)
+{
+    report(ref, "server.props", exchange.getCount());
+    report(ref, "server.changed", exchange.getChanged());
+    if (mcast.isRunning() && ! threaded)
+        mcast.reportStats(report, ref);
+
+    // clients belong to network thread
+    if (threaded) {
+        report(ref, "server.dropped", exchange.getDropped());
+        return;
+    }
+
+    report(ref, "server.clients", clients.size());
+    int n = 0;
+    for (std::list<PropsClient>::iterator i = clients.begin(); 
+            i != clients.end(); ++i)
+        (*i).reportStats("server.client" + toString(++n) + ".", report, ref);
+}
 
 
-PropsClient::PropsClient(Log &log, const std::string &secret, Properties &properties): 
-    log(log), con(log), secret(secret), properties(properties)
+int PropsServer::setMulticast(const char *group, int port, 
+        int keyframeInterval)
 {
+    // publisher is used by network thread
+    if (threaded)
+        return -1;
+
+    mcast.stop();
+    if ((! group) || (! *group))
+        return 0;
+    if (mcast.start(group, port, keyframeInterval)) {
+        log.error("can't publish properties to multicast group %s:%i", 
+                group, port);
+        return -1;
+    }
+    log.info("publishing properties to multicast group %s:%i", group, port);
+    return 0;
+}
+
+
+
+
+PropsClient::PropsClient(Log &log, const std::string &secret, 
+        PropsExchange &exchange, McastPublisher *mcast): 
+    log(log), con(log), secret(secret), exchange(exchange), mcast(mcast)
+{
+    shm = NULL;
+    shmWaits = 0;
+    state = CLOSED;
+    sentBytes = savedBytes = 0;
 }
 
 
 PropsClient::~PropsClient()
 {
+    delete shm;
 }
 
 
-void PropsClient::start(int sock)
+void PropsClient::start(int sock, NetPoller *poller)
 {
     log.debug("starting connection");
+    con.setPoller(poller);
     if (con.setSocket(sock)) {
         log.error("error witching client to non-blockng mode");
         stop();
@@ -198,22 +741,45 @@ void PropsClient::start(int sock)
     }
     con.setCallback(this);
     state = AUTH_HANDSHAKE;
+    version = 2;
     lastSetSerial = 0;
+    lastAckedSerial = 0;
+    pushing = false;
+    multicast = false;
+    shmRequests.clear();
+    shmWaits = 0;
+    sentBytes = savedBytes = 0;
 }
 
 
-int PropsClient::update()
+int PropsClient::update(double now, bool fresh)
 {
     if (CLOSED == state) {
         log.debug("client closed");
         return -1;
     }
+
+    if (fresh) {
+        // acknowledge set requests applied by simulator thread
+        while ((! pendingSets.empty()) && 
+                exchange.isApplied(pendingSets.front().seq))
+        {
+            lastSetSerial = pendingSets.front().serial;
+            pendingSets.pop_front();
+        }
+        if (pushing && (COMMAND == state))
+            pushChanges(now);
+    }
+    // subscriptions are received before set requests from shared memory
     int res = con.update();
     if (res) {
         log.error("error updaing client connection");
         stop();
+        return res;
     }
-    return res;
+    if (fresh && shm && (COMMAND == state))
+        updateSharedMemory();
+    return 0;
 }
 
 
@@ -233,7 +799,11 @@ void PropsClient::doHandshake(NetBuf &buffer)
     if (4 > buffer.getFilled())
         return;
 
-    if (memcmp(buffer.getData(), "NP2\n", 4)) {
+    if (! memcmp(buffer.getData(), "NP3\n", 4))
+        version = 3;
+    else if (! memcmp(buffer.getData(), "NP2\n", 4))
+        version = 2;
+    else {
         log.error("invalid protocol!");
         stop();
         return;
@@ -241,7 +811,7 @@ void PropsClient::doHandshake(NetBuf &buffer)
 
     buffer.remove(4);
 
-    con.send((unsigned char*)"NP2\n", 4);
+    con.send((unsigned char*)(3 == version ? "NP3\n" : "NP2\n"), 4);
 
     for (int i = 0; i < 16; i++)
         seed[i] = (unsigned char)rand();
@@ -259,7 +829,8 @@ void PropsClient::doVerify(NetBuf &buffer)
 
     md5_state_t md5;
     md5_init(&md5);
-    md5_append(&md5, (const md5_byte_t*)"NP2\n", 4);
+    md5_append(&md5, (const md5_byte_t*)(3 == version ? "NP3\n" : "NP2\n"), 
+            4);
     md5_append(&md5, seed, 16);
     md5_append(&md5, (const md5_byte_t*)secret.c_str(), secret.length());
     unsigned char digest[16];
@@ -296,25 +867,99 @@ void PropsClient::handleSubscription(NetBuf &buffer)
     std::string name((char*)buffer.getData() + 6, nameSize);
     buffer.remove(nameSize + 6);
 
+    subscribe(command, type, id, maxSize, name);
+}
+
+
+void PropsClient::handleSubscriptionNp3(NetBuf &buffer)
+{
+    NetReader reader(buffer.getData(), buffer.getFilled());
+    int command;
+    unsigned count;
+    if (! (reader.getUint8(command) && reader.getVarint(count)))
+        return;
+
+    // process batch only when it is received completely
+    for (unsigned i = 0; i < count; i++) {
+        int type;
+        unsigned id, maxSize, nameSize;
+        if (! (reader.getUint8(type) && reader.getVarint(id) && 
+                    reader.getVarint(maxSize) && reader.getVarint(nameSize) &&
+                    reader.getBytes(nameSize)))
+        {
+            if (reader.isInvalid()) {
+                log.error("Invalid subscription message");
+                stop();
+            }
+            return;
+        }
+    }
+
+    NetReader batch(buffer.getData(), buffer.getFilled());
+    batch.getUint8(command);
+    batch.getVarint(count);
+    for (unsigned i = 0; (i < count) && (COMMAND == state); i++) {
+        int type;
+        unsigned id, maxSize, nameSize;
+        batch.getUint8(type);
+        batch.getVarint(id);
+        batch.getVarint(maxSize);
+        batch.getVarint(nameSize);
+        std::string name((const char*)batch.getBytes(nameSize), nameSize);
+        subscribe(command, type, id, maxSize, name);
+    }
+    buffer.remove(reader.getPos());
+}
+
+
+void PropsClient::subscribe(int command, int type, int id, int maxSize,
+        const std::string &name)
+{
     if ((1 > type) || (4 < type)) {
         log.error("Invalid property type %i", type);
         stop();
         return;
     }
 
-    SaslPropRef prop;
-
-    if (5 == command)
-        prop = properties.createProp(name, type, maxSize);
-    else
-        prop = properties.getProp(name, type);
-
-    if (! prop) {
-        log.error("Can't reference property '%s'", name.c_str());
+    // clients subscribed to the same property share its slot
+    int slot = exchange.subscribe(command, type, maxSize, name);
+    if (0 > slot) {
+        log.error("Too many requests, can't reference property '%s'", 
+                name.c_str());
         return;
     }
 
-    propRefs[id] = ClientProp(id, type, name, &properties, prop);
+    // client may reuse ID for another property
+    std::map<int, ClientProp>::iterator i = propRefs.find(id);
+    if (i != propRefs.end())
+        exchange.unsubscribe((*i).second.getSlot());
+
+    propRefs[id] = ClientProp(id, type, name, &exchange, slot);
+    if (multicast)
+        sendSlot(propRefs[id]);
+}
+
+
+void PropsClient::sendValues(const std::vector<ClientProp*> &props)
+{
+	NetBuf& sendBuffer = con.getSendBuffer();
+    size_t start = sendBuffer.getFilled();
+    size_t i = 0;
+    do {
+        size_t count = props.size() - i;
+        if ((3 != version) && (255 < count))
+            count = 255;
+        sendBuffer.addUint8(4);
+        if (3 == version)
+            sendBuffer.addVarint(count);
+        else
+            sendBuffer.addUint8(count);
+        sendBuffer.addUint16(lastSetSerial);
+        for (; count; count--, i++)
+            savedBytes += props[i]->send(sendBuffer, version);
+    } while (i < props.size());
+    sentBytes += sendBuffer.getFilled() - start;
+    lastAckedSerial = lastSetSerial;
 }
 
 
@@ -322,7 +967,7 @@ void PropsClient::handleGetProps(NetBuf &buffer)
 {
     buffer.remove(1);
 
-    std::list<ClientProp*> propsToSend;
+    std::vector<ClientProp*> propsToSend;
 
     for (std::map<int, ClientProp>::iterator i = propRefs.begin();
             i != propRefs.end(); ++i)
@@ -331,16 +976,230 @@ void PropsClient::handleGetProps(NetBuf &buffer)
         if (p.isChanged()) 
             propsToSend.push_back(&p);
     }
-	NetBuf& sendBuffer = con.getSendBuffer();
-	sendBuffer.addUint8(4);
-	sendBuffer.addUint8(propsToSend.size());
-	sendBuffer.addUint16(lastSetSerial);
 
-    for (std::list<ClientProp*>::iterator i = propsToSend.begin(); 
-            i != propsToSend.end(); ++i)
+    sendValues(propsToSend);
+}
+
+
+void PropsClient::pushChanges(double now)
+{
+    std::vector<ClientProp*> propsToSend;
+
+    for (std::map<int, ClientProp>::iterator i = propRefs.begin();
+            i != propRefs.end(); ++i)
     {
-        ClientProp *p = *i;
-		p->send(sendBuffer);
+        ClientProp &p = (*i).second;
+        if (p.needsPush(now)) {
+            p.pushed(now);
+            propsToSend.push_back(&p);
+        }
+    }
+
+    // empty batch acknowledges set requests
+    if (propsToSend.size() || (lastAckedSerial != lastSetSerial))
+        sendValues(propsToSend);
+}
+
+
+void PropsClient::handlePushRate(NetBuf &buffer)
+{
+    int id, rate;
+    float deadband;
+    if (3 == version) {
+        NetReader reader(buffer.getData(), buffer.getFilled());
+        unsigned propId, propRate;
+        const unsigned char *band;
+        if (! (reader.getUint8(id) && reader.getVarint(propId) && 
+                    reader.getVarint(propRate) && (band = reader.getBytes(4))))
+        {
+            if (reader.isInvalid()) {
+                log.error("Invalid push rate message");
+                stop();
+            }
+            return;
+        }
+        id = propId;
+        rate = propRate;
+        deadband = netToFloat(band);
+        buffer.remove(reader.getPos());
+    } else {
+        if (8 > buffer.getFilled())
+            return;
+        const unsigned char *command = buffer.getData();
+        id = command[1];
+        rate = netToInt16(command + 2);
+        deadband = netToFloat(command + 4);
+        buffer.remove(8);
+    }
+
+    std::map<int, ClientProp>::iterator i = propRefs.find(id);
+    if (i == propRefs.end()) {
+        log.warning("property %i doesn't exists", id);
+        return;
+    }
+
+    (*i).second.setPushRate(rate, deadband);
+    if (rate)
+        pushing = true;
+}
+
+
+void PropsClient::handleEncoding(NetBuf &buffer)
+{
+    NetReader reader(buffer.getData(), buffer.getFilled());
+    int command, encoding;
+    unsigned id;
+    const unsigned char *params;
+    if (! (reader.getUint8(command) && reader.getVarint(id) && 
+                reader.getUint8(encoding) && (params = reader.getBytes(12))))
+    {
+        if (reader.isInvalid()) {
+            log.error("Invalid encoding message");
+            stop();
+        }
+        return;
+    }
+    buffer.remove(reader.getPos());
+
+    std::map<int, ClientProp>::iterator i = propRefs.find(id);
+    if (i == propRefs.end()) {
+        log.warning("property %i doesn't exists", id);
+        return;
+    }
+
+    float epsilon = netToFloat(params);
+    float scale = netToFloat(params + 4);
+    float offset = netToFloat(params + 8);
+    if (! (*i).second.setEncoding(encoding, epsilon, scale, offset)) {
+        log.warning("invalid encoding %i of property %i", encoding, id);
+        return;
+    }
+
+    // values sent after acknowledge use new encoding
+    NetBuf &sendBuffer = con.getSendBuffer();
+    sendBuffer.addUint8(7);
+    sendBuffer.addVarint(id);
+    sendBuffer.addUint8(encoding);
+    sendBuffer.addFloat(scale);
+    sendBuffer.addFloat(offset);
+}
+
+
+void PropsClient::handleMulticast(NetBuf &buffer)
+{
+    buffer.remove(1);
+
+    NetBuf &sendBuffer = con.getSendBuffer();
+    sendBuffer.addUint8(8);
+    if (! (mcast && mcast->isRunning())) {
+        log.warning("client asked for multicast, but server doesn't "
+                "publish values");
+        sendBuffer.addVarint(0);
+        sendBuffer.addVarint(0);
+        return;
+    }
+
+    const std::string &group = mcast->getGroup();
+    sendBuffer.addVarint(mcast->getPort());
+    sendBuffer.addVarint(group.length());
+    sendBuffer.add((const unsigned char*)group.c_str(), group.length());
+
+    // values come by multicast, TCP connection carries slots and
+    // acknowledges of set requests only
+    multicast = true;
+    pushing = true;
+    for (std::map<int, ClientProp>::iterator i = propRefs.begin();
+            i != propRefs.end(); ++i)
+        sendSlot((*i).second);
+}
+
+
+void PropsClient::sendSlot(const ClientProp &prop)
+{
+    NetBuf &sendBuffer = con.getSendBuffer();
+    sendBuffer.addUint8(9);
+    sendBuffer.addVarint(prop.getId());
+    sendBuffer.addVarint(prop.getSlot());
+}
+
+
+void PropsClient::handleSharedMemory(NetBuf &buffer)
+{
+    buffer.remove(1);
+
+    if (! shm) {
+        shm = new ShmSegment;
+        if (shm->create(SHM_MAX_PROPS)) {
+            log.warning("can't create shared memory segment");
+            delete shm;
+            shm = NULL;
+        }
+    }
+
+    // values are written to segment since next update
+    NetBuf &sendBuffer = con.getSendBuffer();
+    sendBuffer.addUint8(10);
+    if (! shm) {
+        sendBuffer.addVarint(0);
+        sendBuffer.addVarint(0);
+        return;
+    }
+    const std::string &name = shm->getName();
+    sendBuffer.addVarint(shm->getCapacity());
+    sendBuffer.addVarint(name.length());
+    sendBuffer.add((const unsigned char*)name.c_str(), name.length());
+}
+
+
+void PropsClient::updateSharedMemory()
+{
+    ShmRequest request;
+    while ((SHM_RING_SIZE > (int)shmRequests.size()) && 
+            shm->popRequest(request)) 
+    {
+        if ((PROP_INT > request.type) || (PROP_STRING < request.type)) {
+            log.error("invalid property type %i", request.type);
+            stop();
+            return;
+        }
+        shmRequests.push_back(request);
+    }
+
+    // subscription may still travel by TCP, requests wait for it in order
+    while ((COMMAND == state) && (! shmRequests.empty())) {
+        const ShmRequest &r = shmRequests.front();
+        if ((propRefs.end() == propRefs.find(r.id)) && 
+                (SHM_MAX_WAITS > ++shmWaits))
+            break;
+        setValue(r.id, r.type, r.number, std::string(r.string, r.size), 
+                r.serial & 0xffff);
+        shmRequests.pop_front();
+        shmWaits = 0;
+    }
+    if (COMMAND != state)
+        return;
+
+    // sequence changes only if there is something new for client
+    bool writing = false;
+    for (std::map<int, ClientProp>::iterator i = propRefs.begin();
+            i != propRefs.end(); ++i)
+    {
+        ClientProp &p = (*i).second;
+        const SnapshotValue *value = p.getNewValue();
+        if (! value)
+            continue;
+        if (! writing) {
+            shm->beginWrite();
+            writing = true;
+        }
+        shm->writeValue(p.getId() - 1, value->type, value->number, 
+                value->string);
+    }
+    if (writing || (lastAckedSerial != lastSetSerial)) {
+        if (! writing)
+            shm->beginWrite();
+        shm->endWrite(lastSetSerial);
+        lastAckedSerial = lastSetSerial;
     }
 }
 
@@ -371,30 +1230,93 @@ void PropsClient::handleSetProp(NetBuf &buffer)
     if (buffer.getFilled() < sz)
         return;
 
-    lastSetSerial = netToInt16(command + 3);
+    setProp(command[1], command[2], 
+            PROP_STRING == command[2] ? command + 7 : command + 5, dataSz,
+            netToInt16(command + 3));
+    buffer.remove(sz);
+}
+
+
+void PropsClient::handleSetPropNp3(NetBuf &buffer)
+{
+    NetReader reader(buffer.getData(), buffer.getFilled());
+    int command, type, serial;
+    unsigned id, size = 0;
+    if (! (reader.getUint8(command) && reader.getVarint(id) && 
+                reader.getUint8(type) && reader.getUint16(serial)))
+    {
+        if (reader.isInvalid()) {
+            log.error("Invalid set property message");
+            stop();
+        }
+        return;
+    }
+
+    if (PROP_STRING == type) {
+        if (! reader.getVarint(size)) {
+            if (reader.isInvalid()) {
+                log.error("Invalid set property message");
+                stop();
+            }
+            return;
+        }
+    } else {
+        size = getPropTypeSize(type);
+        if (! size) {
+            log.error("Invalid property type %i", type);
+            stop();
+            return;
+        }
+    }
+
+    const unsigned char *data = reader.getBytes(size);
+    if (! data)
+        return;
+
+    setProp(id, type, data, size, serial);
+    buffer.remove(reader.getPos());
+}
+
+
+void PropsClient::setProp(int id, int type, const unsigned char *data, 
+        int size, int serial)
+{
+    double number = 0;
+    std::string string;
+    switch (type) {
+        case PROP_INT: number = netToInt32(data); break;
+        case PROP_FLOAT: number = netToFloat(data); break;
+        case PROP_DOUBLE: number = netToDouble(data); break;
+        case PROP_STRING: string.assign((const char*)data, size); break;
+        default:
+            log.error("invalid property type %i", type);
+            stop();
+            return;
+    }
+
+    setValue(id, type, number, string, serial);
+}
+
 
-    std::map<int, ClientProp>::iterator i = propRefs.find(command[1]);
+void PropsClient::setValue(int id, int type, double number, 
+        const std::string &string, int serial)
+{
+    std::map<int, ClientProp>::iterator i = propRefs.find(id);
     if (i == propRefs.end()) {
-        log.warning("property %i doesn't exists", command[1]);
-        buffer.remove(sz);
+        log.warning("property %i doesn't exists", id);
         stop();
         return;
     }
     ClientProp &prop = (*i).second;
 
-    switch (command[2]) {
-        case PROP_INT: prop.setInt(netToInt32(command + 5)); break;
-        case PROP_FLOAT: prop.setFloat(netToFloat(command + 5)); break;
-        case PROP_DOUBLE: prop.setDouble(netToDouble(command + 5)); break;
-        case PROP_STRING:
-            prop.setString(std::string((const char*)command + 7, dataSz));
-            break;
-        default:
-            log.error("invalid property type %i", command[2]);
-            stop();
+    // serial is acknowledged when snapshot contains new value
+    PendingSet pending;
+    pending.serial = serial;
+    if (! exchange.set(prop.getSlot(), type, number, string, pending.seq)) {
+        log.error("Too many requests, set of property %i ignored", id);
+        return;
     }
-        
-    buffer.remove(sz);
+    pendingSets.push_back(pending);
 }
 
 
@@ -409,9 +1331,38 @@ void PropsClient::doCommand(NetBuf &buffer)
         int command = buffer.getData()[0];
         switch (command) {
             case 1:
-            case 5: handleSubscription(buffer);  break;
-            case 2: handleSetProp(buffer);  break;
+            case 5: 
+                if (3 == version)
+                    handleSubscriptionNp3(buffer);
+                else
+                    handleSubscription(buffer);
+                break;
+            case 2: 
+                if (3 == version)
+                    handleSetPropNp3(buffer);
+                else
+                    handleSetProp(buffer);
+                break;
             case 3: handleGetProps(buffer);  break;
+            case 6: handlePushRate(buffer);  break;
+            case 7:
+                if (3 == version) {
+                    handleEncoding(buffer);
+                    break;
+                }
+                // fall through, NP2 has no encodings
+            case 8:
+                if (3 == version) {
+                    handleMulticast(buffer);
+                    break;
+                }
+                // fall through, NP2 has no multicast
+            case 10:
+                if (3 == version) {
+                    handleSharedMemory(buffer);
+                    break;
+                }
+                // fall through, NP2 has no shared memory
             default:
                 log.error("Invalid command %i", command);
                 stop();
@@ -423,7 +1374,45 @@ void PropsClient::doCommand(NetBuf &buffer)
 
 void PropsClient::stop()
 {
+    if ((CLOSED != state) && sentBytes)
+        log.info("client received %.0f bytes of values, %.0f bytes saved "
+                "by encoding", sentBytes, savedBytes);
     state = CLOSED;
     con.close();
+    if (shm)
+        shm->close();
+    unsubscribeAll();
+}
+
+
+void PropsClient::unsubscribeAll()
+{
+    for (std::map<int, ClientProp>::iterator i = propRefs.begin();
+            i != propRefs.end(); ++i)
+        exchange.unsubscribe((*i).second.getSlot());
+    propRefs.clear();
+}
+
+
+void PropsClient::reportStats(const std::string &prefix, 
+        sasl_stat_callback report, void *ref)
+{
+    report(ref, (prefix + "sent").c_str(), sentBytes);
+    report(ref, (prefix + "saved").c_str(), savedBytes);
+}
+
+
+/// Returns table of props server traffic statistics
+static int luaGetPropsServerStats(lua_State *L)
+{
+    lua_newtable(L);
+    getAvionics(L)->getPropsServer().reportStats(addStatToTable, L);
+    return 1;
+}
+
+
+void xa::exportPropsServerToLua(Luna &lua)
+{
+    lua.registerFunction("getPropsServerStats", luaGetPropsServerStats);
 }
 
@@ -5,14 +5,211 @@
 #include <string>
 #include <list>
 #include <map>
+#include <deque>
+#include <vector>
 #include "lownet.h"
+#include "netthread.h"
+#include "propsmcast.h"
+#include "propsshm.h"
+#include "propssnapshot.h"
+#include "rttimer.h"
 #include "properties.h"
 #include "log.h"
+#include "libavionics.h"
 
 
 namespace xa {
 
 
+/// Request of network thread to simulator thread
+struct PropsRequest
+{
+    enum Kind {
+        /// reference existing property
+        GET,
+
+        /// create property
+        CREATE,
+
+        /// set value of property
+        SET,
+
+        /// release property unsubscribed by all clients
+        RELEASE
+    };
+
+    /// kind of request
+    int kind;
+
+    /// number of request
+    unsigned seq;
+
+    /// slot of property
+    int slot;
+
+    /// type of property or value
+    int type;
+
+    /// max size of created string property
+    int maxSize;
+
+    /// value of numeric property
+    double number;
+
+    /// name of property or value of string property
+    std::string string;
+};
+
+
+/// Registry of properties subscribed by all clients of server.
+/// Every distinct property gets slot which is index of its value in
+/// snapshot.  Values are read once per frame and marked by version
+/// number when changed, so clients compare versions instead of values.
+/// Passes requests of network thread to simulator thread and snapshots 
+/// of properties values back.  Properties are accessed only by simulator
+/// thread.
+class PropsExchange
+{
+    private:
+        /// Properties subsystem
+        Properties &properties;
+
+        /// Logger of simulator thread
+        Log &log;
+
+        /// true if requests are applied immediately
+        bool direct;
+
+        /// requests to simulator thread
+        SpscQueue<PropsRequest> requests;
+
+        /// snapshots published by simulator thread
+        SpscQueue<PropsSnapshot*> published;
+
+        /// snapshots released by network thread
+        SpscQueue<PropsSnapshot*> released;
+
+        /// storage of snapshots
+        std::vector<PropsSnapshot> snapshots;
+
+        /// slots of properties by name and type.  Network thread only
+        std::map<std::pair<std::string, int>, int> slots;
+
+        /// number of client properties using slot.  Network thread only
+        std::vector<int> users;
+
+        /// released slots with numbers of release requests.  Slot can
+        /// be reused when current snapshot doesn't contain old property.
+        /// Network thread only
+        std::deque<std::pair<unsigned, int> > releasing;
+
+        /// slots free for reuse.  Network thread only
+        std::vector<int> freeSlots;
+
+        /// snapshot used by network thread or NULL
+        PropsSnapshot *current;
+
+        /// number of last sent request.  Network thread only
+        unsigned lastRequest;
+
+        /// references to properties by slot.  Simulator thread only
+        std::vector<SaslPropRef> refs;
+
+        /// types of properties by slot.  Simulator thread only
+        std::vector<int> types;
+
+        /// last read values by slot.  Simulator thread only
+        std::vector<SnapshotValue> latest;
+
+        /// number of last read frame.  Simulator thread only
+        unsigned frame;
+
+        /// number of values changed in last frame
+        int changed;
+
+        /// number of last applied request.  Simulator thread only
+        unsigned applied;
+
+        /// number of referenced properties.  Simulator thread only
+        int count;
+
+        /// number of frames without free snapshot
+        int dropped;
+
+    public:
+        PropsExchange(Properties &properties, Log &log);
+
+    private:
+        PropsExchange(const PropsExchange&);
+        PropsExchange& operator=(const PropsExchange&);
+
+    public:
+        /// Forget all properties.  Called when no thread uses exchange
+        void reset();
+
+        /// Apply requests immediately if connections are served by 
+        /// simulator thread
+        void setDirect(bool direct) { this->direct = direct; }
+
+        /// Returns slot of property or -1 if request queue is full.
+        /// Every successful call must be paired with unsubscribe.
+        /// Called by network thread
+        /// \param command 1 to reference existing property, 5 to create it
+        int subscribe(int command, int type, int maxSize, 
+                const std::string &name);
+
+        /// Release property when last client unsubscribed it.
+        /// Called by network thread
+        void unsubscribe(int slot);
+
+        /// Request to set property value.  Called by network thread.
+        /// Returns false if request queue is full
+        /// \param seq number of request
+        bool set(int slot, int type, double number, const std::string &string,
+                unsigned &seq);
+
+        /// Take latest published snapshot.  Called by network thread.
+        /// Returns true if new snapshot was taken
+        bool receive();
+
+        /// Returns current snapshot or NULL.  Called by network thread
+        const PropsSnapshot* getSnapshot() const { return current; }
+
+        /// Returns value of property in current snapshot or NULL.
+        /// Called by network thread
+        const SnapshotValue* getValue(int slot) const;
+
+        /// Returns true if request was applied before current snapshot.
+        /// Called by network thread
+        bool isApplied(unsigned seq) const;
+
+        /// Apply requests of network thread.  Called by simulator thread
+        void apply();
+
+        /// Read values of properties and publish snapshot.
+        /// Called by simulator thread
+        void publish();
+
+        /// Returns number of distinct subscribed properties
+        int getCount() const { return count; }
+
+        /// Returns number of values changed in last frame
+        int getChanged() const { return changed; }
+
+        /// Returns number of frames skipped because network thread
+        /// didn't release snapshots
+        int getDropped() const { return dropped; }
+
+    private:
+        /// Pass request to simulator thread or apply it immediately.
+        /// Returns false if request queue is full
+        bool request(const PropsRequest &request);
+
+        /// Apply request to properties
+        void applyRequest(const PropsRequest &request);
+};
+
+
 /// Property requested by client
 class ClientProp
 {
@@ -39,39 +236,94 @@ class ClientProp
             int maxBufSize;
         } lastValue;
 
-        /// Properties subsystem
-        Properties *properties;
+        /// Snapshots of values
+        PropsExchange *exchange;
+
+        /// slot of property in snapshots
+        int slot;
+
+        /// version of value checked last time
+        unsigned checkedVersion;
+
+        /// version of value written to shared memory
+        unsigned sharedVersion;
 
-        /// Reference to property
-        SaslPropRef ref;
+        /// min interval between pushed values in seconds, 0 if not pushed
+        double interval;
+
+        /// min change of numeric value to push it
+        double deadband;
+
+        /// time when value can be pushed again
+        double nextPush;
+
+        /// encoding of value in NP3 protocol
+        int encoding;
+
+        /// min change of numeric value to send it
+        double epsilon;
+
+        /// scale of fixed point value
+        double scale;
+
+        /// offset of fixed point value
+        double offset;
+
+        /// bits of last encoded value, base of delta code
+        uint64_t lastBits;
 
     public:
         ClientProp();
 
         /// Create new reference to property
+        /// \param slot slot of property in snapshots
         ClientProp(int id, int type, const std::string &name, 
-                Properties *properties, SaslPropRef ref);
+                PropsExchange *exchange, int slot);
         
         ~ClientProp();
 
     public:
         /// Returns true if property needed to send
-        bool isChanged();
+        /// \param deadband min change of numeric value
+        bool isChanged(double deadband = 0);
+
+        /// Push value to client at rate updates per second if it changes
+        /// more than deadband.  Zero rate disables pushing
+        void setPushRate(int rate, double deadband);
+
+        /// Returns true if property is pushed
+        bool isPushed() const { return 0 < interval; }
+
+        /// Returns true if value should be pushed now
+        bool needsPush(double now);
+
+        /// Remember time of pushed value
+        void pushed(double now) { nextPush = now + interval; }
+
+        /// Change encoding of value.  Returns false if encoding can't be
+        /// used for property type
+        /// \param epsilon min change of numeric value to send it
+        /// \param scale, offset parameters of fixed point encoding
+        bool setEncoding(int encoding, double epsilon, double scale,
+                double offset);
 
         /// Write property to buffer
-        void send(NetBuf &buffer);
+        /// \param version protocol version, 2 or 3
+        /// Returns number of bytes saved by encoding
+        int send(NetBuf &buffer, int version);
 
-        /// Set property value as integer
-        void setInt(int value);
-        
-        /// Set property value as float
-        void setFloat(float value);
-        
-        /// Set property value as double
-        void setDouble(double value);
-        
-        /// Set property value as string
-        void setString(const std::string &value);
+        /// Returns value changed since last call or NULL
+        const SnapshotValue* getNewValue();
+
+        /// Returns slot of property in snapshots
+        int getSlot() const { return slot; }
+
+        /// Returns property ID at client side
+        int getId() const { return id; }
+
+    private:
+        /// Returns fixed point code of value
+        unsigned quantize(double value) const;
 };
 
 
@@ -79,6 +331,16 @@ class ClientProp
 /// Properties client connection
 class PropsClient: private NetReceiver
 {
+    private:
+        /// Set request waiting for simulator thread
+        struct PendingSet {
+            /// serial number of request sent by client
+            int serial;
+
+            /// number of request passed to simulator thread
+            unsigned seq;
+        };
+
     private:
         /// Logger to use
         Log log;
@@ -102,32 +364,76 @@ class PropsClient: private NetReceiver
         /// random sequence
         unsigned char seed[16];
 
-        /// Properties subsystem
-        Properties &properties;
-
         /// Properties names.
         std::map<int, ClientProp> propRefs;
 
+        /// Registry of properties values
+        PropsExchange &exchange;
+
+        /// Publisher of values to multicast group or NULL
+        McastPublisher *mcast;
+
+        /// set requests not applied yet
+        std::deque<PendingSet> pendingSets;
+
+        /// protocol version, 2 or 3
+        int version;
+
         /// last seen set property serial
         int lastSetSerial;
 
+        /// last set serial reported to client
+        int lastAckedSerial;
+
+        /// true if client subscribed for pushed values
+        bool pushing;
+
+        /// true if client receives values from multicast group
+        bool multicast;
+
+        /// segment shared with client on the same host or NULL
+        ShmSegment *shm;
+
+        /// set requests from segment waiting for subscription
+        std::deque<ShmRequest> shmRequests;
+
+        /// number of updates first of shmRequests waits for subscription
+        int shmWaits;
+
+        /// bytes of values messages sent to client
+        double sentBytes;
+
+        /// bytes saved by values encoding
+        double savedBytes;
+
     public:
         /// Create new connection to client
-        PropsClient(Log &log, const std::string &secret, Properties &properties);
+        /// \param exchange registry of properties values
+        /// \param mcast publisher of values to multicast group or NULL
+        PropsClient(Log &log, const std::string &secret, 
+                PropsExchange &exchange, McastPublisher *mcast);
 
         /// Destroy connection to client
         ~PropsClient();
 
     public:
         /// move client to working state
-        void start(int sock);
+        /// \param poller poller checking state of client socket
+        void start(int sock, NetPoller *poller);
 
         /// proceed connection operations
-        int update();
+        /// \param now current time in seconds
+        /// \param fresh true if new snapshot of values was received
+        int update(double now, bool fresh);
 
         /// shutdown connection
         void stop();
 
+        /// Report traffic statistics
+        /// \param prefix prefix of statistics names
+        void reportStats(const std::string &prefix, 
+                sasl_stat_callback report, void *ref);
+
     private:
         /// called on data received
         virtual void onDataReceived(NetBuf &buffer);
@@ -143,12 +449,61 @@ class PropsClient: private NetReceiver
 
         /// Handle subscription message
         void handleSubscription(NetBuf &buffer);
+
+        /// Handle batch of subscriptions of NP3 protocol
+        void handleSubscriptionNp3(NetBuf &buffer);
+
+        /// Release properties referenced by client
+        void unsubscribeAll();
+
+        /// Reference property requested by client
+        /// \param command 1 to reference existing property, 5 to create it
+        void subscribe(int command, int type, int id, int maxSize, 
+                const std::string &name);
         
         /// Handle set property value message
         void handleSetProp(NetBuf &buffer);
+
+        /// Handle set property value message of NP3 protocol
+        void handleSetPropNp3(NetBuf &buffer);
+
+        /// Set value of property.  size is length of string values
+        /// \param serial serial number of request
+        void setProp(int id, int type, const unsigned char *data, int size,
+                int serial);
+
+        /// Pass decoded value of property to simulator thread
+        /// \param serial serial number of request
+        void setValue(int id, int type, double number, 
+                const std::string &string, int serial);
         
         /// Handle get properties values message
         void handleGetProps(NetBuf &buffer);
+
+        /// Handle push rate message
+        void handlePushRate(NetBuf &buffer);
+
+        /// Handle encoding message of NP3 protocol
+        void handleEncoding(NetBuf &buffer);
+
+        /// Handle join multicast group message of NP3 protocol
+        void handleMulticast(NetBuf &buffer);
+
+        /// Tell client slot of property in multicast frames
+        void sendSlot(const ClientProp &prop);
+
+        /// Handle shared memory message of NP3 protocol
+        void handleSharedMemory(NetBuf &buffer);
+
+        /// Apply set requests of shared memory client and write
+        /// changed values to segment
+        void updateSharedMemory();
+
+        /// Send changed pushed properties
+        void pushChanges(double now);
+
+        /// Send properties values in batches of up to 255 properties
+        void sendValues(const std::vector<ClientProp*> &props);
 };
 
 
@@ -159,9 +514,30 @@ class PropsServer: private ConnectionAcceptor
         /// logger to use
         Log &log;
 
+        /// logger of network connections
+        Log netLog;
+
+        /// messages logged by network thread
+        LogQueue logQueue;
+
+        /// requests and snapshots passed between threads
+        PropsExchange exchange;
+
+        /// thread serving connections in threaded mode
+        NetThread thread;
+
+        /// true if connections are served by network thread
+        bool threaded;
+
+        /// set to ask network thread to exit
+        volatile bool stopping;
+
         /// secret word
         std::string secret;
 
+        /// Checks state of all sockets at once
+        NetPoller poller;
+
         /// TCP server object
         TcpServer server;
 
@@ -171,6 +547,12 @@ class PropsServer: private ConnectionAcceptor
         /// Properties subsystem
         Properties &properties;
 
+        /// Timer for pushing properties
+        RtTimer timer;
+
+        /// Publisher of values to multicast group
+        McastPublisher mcast;
+
     public:
         /// create props server
         PropsServer(Log &log, Properties &properties);
@@ -180,7 +562,8 @@ class PropsServer: private ConnectionAcceptor
 
     public:
         /// Start properties server
-        int start(const char *secret, int port);
+        /// \param threaded serve connections by separate thread if true
+        int start(const char *secret, int port, bool threaded = false);
 
         /// Do networking communications
         int update();
@@ -191,12 +574,33 @@ class PropsServer: private ConnectionAcceptor
         /// Returns true if server is running
         bool isRunning();
 
+        /// Report traffic statistics of connected clients
+        void reportStats(sasl_stat_callback report, void *ref);
+
+        /// Publish values to multicast group.  NULL group stops publishing.
+        /// Can't be changed while network thread is running.
+        /// Returns non-zero on error
+        /// \param keyframeInterval number of frames between frames with
+        ///                         all values
+        int setMulticast(const char *group, int port, int keyframeInterval);
+
     private:
         /// create new connection
         virtual void onConnectionReceived(int sock);
+
+        /// Serve network connections
+        /// \param timeout max time to wait for sockets or new snapshot
+        ///     in milliseconds
+        int serve(int timeout);
+
+        /// Body of network thread
+        static void run(void *server);
 };
 
 
+/// Register props server functions in Lua
+void exportPropsServerToLua(Luna &lua);
+
 };
 
 
@@ -0,0 +1,286 @@
+#include "propsshm.h"
+
+#include <string.h>
+#include <stdio.h>
+#ifdef WINDOWS
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#include "netthread.h"
+#include "libavionics.h"
+
+
+using namespace xa;
+
+
+/// Max attempts to read value while server writes values
+#define SHM_READ_RETRIES 1000
+
+
+ShmSegment::ShmSegment()
+{
+    header = NULL;
+    values = NULL;
+    size = 0;
+    owner = false;
+#ifdef WINDOWS
+    handle = NULL;
+#endif
+}
+
+
+ShmSegment::~ShmSegment()
+{
+    close();
+}
+
+
+int ShmSegment::map(bool create, int capacity)
+{
+    size = sizeof(ShmHeader) + capacity * sizeof(ShmValue);
+    void *data;
+
+#ifdef WINDOWS
+    if (create) {
+        handle = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL,
+                PAGE_READWRITE, 0, (DWORD)size, name.c_str());
+        if (handle && (ERROR_ALREADY_EXISTS == GetLastError())) {
+            CloseHandle(handle);
+            handle = NULL;
+        }
+    } else
+        handle = OpenFileMappingA(FILE_MAP_ALL_ACCESS, FALSE, name.c_str());
+    if (! handle)
+        return -1;
+    data = MapViewOfFile(handle, FILE_MAP_ALL_ACCESS, 0, 0, size);
+    if (! data) {
+        CloseHandle(handle);
+        handle = NULL;
+        return -1;
+    }
+#else
+    int fd = shm_open(name.c_str(), create ? O_RDWR | O_CREAT | O_EXCL :
+            O_RDWR, 0600);
+    if (0 > fd)
+        return -1;
+
+    struct stat st;
+    if (create ? ftruncate(fd, size) :
+            (fstat(fd, &st) || ((size_t)st.st_size < size)))
+    {
+        ::close(fd);
+        if (create)
+            shm_unlink(name.c_str());
+        return -1;
+    }
+
+    // mapping stays valid after descriptor is closed
+    data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (MAP_FAILED == data) {
+        if (create)
+            shm_unlink(name.c_str());
+        return -1;
+    }
+#endif
+
+    header = (ShmHeader*)data;
+    values = (ShmValue*)(header + 1);
+    owner = create;
+    return 0;
+}
+
+
+int ShmSegment::create(int capacity)
+{
+    close();
+
+    static int counter = 0;
+    char buf[64];
+#ifdef WINDOWS
+    sprintf(buf, "Local\\sasl-props-%lu-%i", GetCurrentProcessId(),
+            ++counter);
+#else
+    sprintf(buf, "/sasl-props-%i-%i", (int)getpid(), ++counter);
+#endif
+    name = buf;
+
+    if (map(true, capacity))
+        return -1;
+
+    // fresh segment is zero filled, so no value is written yet
+    memset(header, 0, sizeof(ShmHeader));
+    memcpy(header->signature, SHM_SIGNATURE, 4);
+    header->capacity = capacity;
+    memoryBarrier();
+    return 0;
+}
+
+
+int ShmSegment::open(const std::string &segmentName, int capacity)
+{
+    close();
+
+    name = segmentName;
+    if (map(false, capacity))
+        return -1;
+
+    if (memcmp(header->signature, SHM_SIGNATURE, 4) ||
+            ((int)header->capacity != capacity))
+    {
+        close();
+        return -1;
+    }
+    return 0;
+}
+
+
+void ShmSegment::unlink()
+{
+#ifndef WINDOWS
+    if (! name.empty())
+        shm_unlink(name.c_str());
+#endif
+    name.clear();
+}
+
+
+void ShmSegment::close()
+{
+    if (! header)
+        return;
+
+    if (owner) {
+        header->closed = 1;
+        unlink();
+    }
+
+#ifdef WINDOWS
+    UnmapViewOfFile(header);
+    CloseHandle(handle);
+    handle = NULL;
+#else
+    munmap(header, size);
+#endif
+    header = NULL;
+    values = NULL;
+    name.clear();
+}
+
+
+void ShmSegment::beginWrite()
+{
+    header->seq++;
+    memoryBarrier();
+}
+
+
+void ShmSegment::writeValue(int index, int type, double number,
+        const std::string &string)
+{
+    if ((0 > index) || (index >= (int)header->capacity))
+        return;
+
+    ShmValue &value = values[index];
+    value.type = type;
+    value.number = number;
+    value.size = string.length() < SHM_STRING_SIZE ? string.length() :
+        SHM_STRING_SIZE;
+    memcpy(value.string, string.c_str(), value.size);
+}
+
+
+void ShmSegment::endWrite(unsigned acked)
+{
+    header->acked = acked;
+    // values must be written before readers see even sequence
+    memoryBarrier();
+    header->seq++;
+}
+
+
+bool ShmSegment::readValue(int index, ShmValue &value, unsigned &acked) const
+{
+    if ((! header) || (0 > index) || (index >= (int)header->capacity))
+        return false;
+
+    const ShmValue &shared = values[index];
+    for (int i = 0; i < SHM_READ_RETRIES; i++) {
+        uint32_t seq = header->seq;
+        if (seq & 1)
+            continue;
+        memoryBarrier();
+
+        value.type = shared.type;
+        value.number = shared.number;
+        value.size = shared.size < SHM_STRING_SIZE ? shared.size :
+            SHM_STRING_SIZE;
+        if (PROP_STRING == value.type)
+            memcpy(value.string, shared.string, value.size);
+        acked = header->acked;
+
+        // value is torn if server started writing meanwhile
+        memoryBarrier();
+        if (seq == header->seq)
+            return 0 != value.type;
+    }
+
+    return false;
+}
+
+
+bool ShmSegment::pushRequest(int id, int type, unsigned serial,
+        double number, const char *string, size_t length)
+{
+    if (! header)
+        return false;
+
+    uint32_t tail = header->tail;
+    uint32_t next = (tail + 1) % SHM_RING_SIZE;
+    if (next == header->head)
+        return false;
+    memoryBarrier();
+
+    ShmRequest &request = header->requests[tail];
+    request.id = id;
+    request.type = type;
+    request.serial = serial;
+    request.number = number;
+    request.size = length < SHM_STRING_SIZE ? length : SHM_STRING_SIZE;
+    if (string)
+        memcpy(request.string, string, request.size);
+
+    // request must be written before server can see it
+    memoryBarrier();
+    header->tail = next;
+    return true;
+}
+
+
+bool ShmSegment::popRequest(ShmRequest &request)
+{
+    if (! header)
+        return false;
+
+    // client may corrupt indexes, they are never trusted
+    uint32_t head = header->head;
+    uint32_t tail = header->tail;
+    if ((head == tail) || (SHM_RING_SIZE <= head) ||
+            (SHM_RING_SIZE <= tail))
+        return false;
+    memoryBarrier();
+
+    request = header->requests[head];
+    if (SHM_STRING_SIZE < request.size)
+        request.size = SHM_STRING_SIZE;
+
+    // request must be read before client can reuse slot
+    memoryBarrier();
+    header->head = (head + 1) % SHM_RING_SIZE;
+    return true;
+}
+
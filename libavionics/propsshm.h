@@ -0,0 +1,197 @@
+#ifndef __PROPS_SHM_H__
+#define __PROPS_SHM_H__
+
+
+#include <string>
+#include <stdlib.h>
+#include <stdint.h>
+
+
+namespace xa {
+
+
+/// Signature at start of shared memory segment
+#define SHM_SIGNATURE "SPS1"
+
+/// Max size of string value in segment, longer strings are truncated
+#define SHM_STRING_SIZE 256
+
+/// Number of values in segment
+#define SHM_MAX_PROPS 4096
+
+/// Number of set requests in ring of segment
+#define SHM_RING_SIZE 64
+
+
+/// Value of property in segment
+struct ShmValue
+{
+    /// type of property, 0 if value wasn't written yet
+    int32_t type;
+
+    /// length of string value
+    uint32_t size;
+
+    /// value of numeric property
+    double number;
+
+    /// value of string property
+    char string[SHM_STRING_SIZE];
+};
+
+
+/// Request to set value of property
+struct ShmRequest
+{
+    /// property ID at client side
+    uint32_t id;
+
+    /// type of value
+    int32_t type;
+
+    /// serial number of request
+    uint32_t serial;
+
+    /// length of string value
+    uint32_t size;
+
+    /// value of numeric property
+    double number;
+
+    /// value of string property
+    char string[SHM_STRING_SIZE];
+};
+
+
+/// Start of segment.  Values follow header
+struct ShmHeader
+{
+    /// equals to SHM_SIGNATURE
+    char signature[4];
+
+    /// number of values in segment
+    uint32_t capacity;
+
+    /// seqlock of values, odd while values are written
+    volatile uint32_t seq;
+
+    /// serial of last applied set request
+    volatile uint32_t acked;
+
+    /// non-zero if server closed segment
+    volatile uint32_t closed;
+
+    /// index of first request, changed by server only
+    volatile uint32_t head;
+
+    /// index after last request, changed by client only
+    volatile uint32_t tail;
+
+    /// ring of set requests
+    ShmRequest requests[SHM_RING_SIZE];
+};
+
+
+/// Shared memory segment passing properties values between server and
+/// client running on the same host.  Server writes values indexed by
+/// property ID of client, client reads them under seqlock without any
+/// system calls.  Set requests go back through single producer, single
+/// consumer ring.
+class ShmSegment
+{
+    private:
+        /// name of segment
+        std::string name;
+
+        /// mapped segment or NULL
+        ShmHeader *header;
+
+        /// values following header
+        ShmValue *values;
+
+        /// size of mapping
+        size_t size;
+
+        /// true if segment was created by this side
+        bool owner;
+
+#ifdef WINDOWS
+        /// handle of file mapping
+        void *handle;
+#endif
+
+    public:
+        ShmSegment();
+
+        /// Unmap segment
+        ~ShmSegment();
+
+    private:
+        ShmSegment(const ShmSegment&);
+        ShmSegment& operator=(const ShmSegment&);
+
+    public:
+        /// Create new segment with unique name.  Returns non-zero on error
+        /// \param capacity number of values in segment
+        int create(int capacity);
+
+        /// Map segment created by server.  Returns non-zero on error
+        int open(const std::string &name, int capacity);
+
+        /// Remove name of segment, mapping stays valid
+        void unlink();
+
+        /// Unmap segment.  Server marks it closed first
+        void close();
+
+        /// Returns true if segment is mapped
+        bool isOpen() const { return NULL != header; }
+
+        /// Returns name of segment
+        const std::string& getName() const { return name; }
+
+        /// Returns number of values in segment
+        int getCapacity() const { return header ? header->capacity : 0; }
+
+        /// Returns true if server closed segment
+        bool isClosed() const { return (! header) || header->closed; }
+
+        /// Start writing values.  Called by server
+        void beginWrite();
+
+        /// Write value of property.  Called by server between beginWrite
+        /// and endWrite
+        /// \param index property ID minus one
+        void writeValue(int index, int type, double number,
+                const std::string &string);
+
+        /// Finish writing values.  Called by server
+        /// \param acked serial of last applied set request
+        void endWrite(unsigned acked);
+
+        /// Read value of property.  Called by client.
+        /// Returns false if value wasn't written yet
+        /// \param index property ID minus one
+        /// \param acked serial of last applied set request
+        bool readValue(int index, ShmValue &value, unsigned &acked) const;
+
+        /// Append set request.  Called by client.
+        /// Returns false if ring is full
+        bool pushRequest(int id, int type, unsigned serial, double number,
+                const char *string, size_t size);
+
+        /// Remove first set request.  Called by server.
+        /// Returns false if ring is empty
+        bool popRequest(ShmRequest &request);
+
+    private:
+        /// Map segment.  Returns non-zero on error
+        int map(bool create, int capacity);
+};
+
+
+};
+
+
+#endif
+
@@ -0,0 +1,48 @@
+#ifndef __PROPS_SNAPSHOT_H__
+#define __PROPS_SNAPSHOT_H__
+
+
+#include <string>
+#include <vector>
+
+
+namespace xa {
+
+
+/// Value of property in snapshot
+struct SnapshotValue
+{
+    /// true if property is referenced
+    bool valid;
+
+    /// type of property
+    int type;
+
+    /// value of numeric property
+    double number;
+
+    /// value of string property
+    std::string string;
+
+    /// number of frame when value changed last time
+    unsigned version;
+
+    SnapshotValue(): valid(false), type(0), number(0), version(0) { }
+};
+
+
+/// Values of subscribed properties read during single frame
+struct PropsSnapshot
+{
+    /// number of last request applied before values were read
+    unsigned applied;
+
+    /// values of properties indexed by slot
+    std::vector<SnapshotValue> values;
+};
+
+
+};
+
+
+#endif
@@ -18,6 +18,15 @@ long RtTimer::getTime()
 {
     return GetTickCount() - startSeconds;
 }
+
+double RtTimer::getSeconds()
+{
+    LARGE_INTEGER freq, counter;
+    if (! (QueryPerformanceFrequency(&freq) && 
+                QueryPerformanceCounter(&counter)))
+        return getTime() / 1000.0;
+    return (double)counter.QuadPart / (double)freq.QuadPart;
+}
 #else
 RtTimer::RtTimer()
 {
@@ -33,5 +42,12 @@ long RtTimer::getTime()
     int seconds = tv.tv_sec - startSeconds;
     return seconds * 1000 + tv.tv_usec / 1000;
 }
+
+double RtTimer::getSeconds()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (double)(tv.tv_sec - startSeconds) + tv.tv_usec / 1000000.0;
+}
 #endif
 
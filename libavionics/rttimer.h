@@ -23,6 +23,10 @@ class RtTimer
     public:
         /// Returns number of milliseconds passed from timer creation
         long getTime();
+
+        /// Returns time in seconds with best available precision.
+        /// Suitable for measuring intervals only
+        double getSeconds();
 };
 
 
@@ -526,37 +526,35 @@ static int luaGetContextsState(lua_State *L)
 
 void Sound::exportSoundToLua(Luna &lua)
 {
-    lua_State *L = lua.getLua();
-
-    LUA_REGISTER(L, "loadSampleFromFile", luaLoadSample);
-	LUA_REGISTER(L, "loadSampleInReverse", luaLoadSampleInReverse);
-    LUA_REGISTER(L, "unloadSample", luaUnloadSample);
-    LUA_REGISTER(L, "playSample", luaSamplePlay);
-    LUA_REGISTER(L, "stopSample", luaSampleStop);
-    LUA_REGISTER(L, "setSampleGain", luaSampleSetGain);
-    LUA_REGISTER(L, "setSamplePitch", luaSampleSetPitch);
-    LUA_REGISTER(L, "rewindSample", luaSampleRewind);
-    LUA_REGISTER(L, "isSamplePlaying", luaIsSamplePlaying);
-	LUA_REGISTER(L, "getSamplePlayingRemaining", luaGetSamplePlayingLeft);
-    LUA_REGISTER(L, "setMasterGain", luaSetMasterGain);
-    LUA_REGISTER(L, "setSampleEnv", luaSetSampleEnv);
-    LUA_REGISTER(L, "getSampleEnv", luaGetSampleEnv);
-    LUA_REGISTER(L, "setSamplePosition", luaSetSamplePosition);
-    LUA_REGISTER(L, "getSamplePosition", luaGetSamplePosition);
-    LUA_REGISTER(L, "setSampleDirection", luaSetSampleDirection);
-    LUA_REGISTER(L, "getSampleDirection", luaGetSampleDirection);
-    LUA_REGISTER(L, "setSampleMaxDistance", luaSetSampleMaxDistance);
-    LUA_REGISTER(L, "setSampleRolloff", luaSetSampleRolloff);
-    LUA_REGISTER(L, "setSampleRefDistance", luaSetSampleRefDistance);
-    LUA_REGISTER(L, "setSampleCone", luaSetSampleCone);
-    LUA_REGISTER(L, "getSampleCone", luaGetSampleCone);
-    LUA_REGISTER(L, "setSampleRelative", luaSetSampleRelative);
-    LUA_REGISTER(L, "getSampleRelative", luaGetSampleRelative);
-    LUA_REGISTER(L, "setListenerEnv", luaSetListenerEnv);
-    LUA_REGISTER(L, "setListenerPosition", luaSetListenerPosition);
-    LUA_REGISTER(L, "getListenerPosition", luaGetListenerPosition);
-    LUA_REGISTER(L, "setListenerOrientation", luaSetListenerOrientation);
-    LUA_REGISTER(L, "getListenerOrientation", luaGetListenerOrientation);
-	LUA_REGISTER(L, "getSoundContextsState", luaGetContextsState);
+    lua.registerFunction("loadSampleFromFile", luaLoadSample);
+	lua.registerFunction("loadSampleInReverse", luaLoadSampleInReverse);
+    lua.registerFunction("unloadSample", luaUnloadSample);
+    lua.registerFunction("playSample", luaSamplePlay);
+    lua.registerFunction("stopSample", luaSampleStop);
+    lua.registerFunction("setSampleGain", luaSampleSetGain);
+    lua.registerFunction("setSamplePitch", luaSampleSetPitch);
+    lua.registerFunction("rewindSample", luaSampleRewind);
+    lua.registerFunction("isSamplePlaying", luaIsSamplePlaying);
+	lua.registerFunction("getSamplePlayingRemaining", luaGetSamplePlayingLeft);
+    lua.registerFunction("setMasterGain", luaSetMasterGain);
+    lua.registerFunction("setSampleEnv", luaSetSampleEnv);
+    lua.registerFunction("getSampleEnv", luaGetSampleEnv);
+    lua.registerFunction("setSamplePosition", luaSetSamplePosition);
+    lua.registerFunction("getSamplePosition", luaGetSamplePosition);
+    lua.registerFunction("setSampleDirection", luaSetSampleDirection);
+    lua.registerFunction("getSampleDirection", luaGetSampleDirection);
+    lua.registerFunction("setSampleMaxDistance", luaSetSampleMaxDistance);
+    lua.registerFunction("setSampleRolloff", luaSetSampleRolloff);
+    lua.registerFunction("setSampleRefDistance", luaSetSampleRefDistance);
+    lua.registerFunction("setSampleCone", luaSetSampleCone);
+    lua.registerFunction("getSampleCone", luaGetSampleCone);
+    lua.registerFunction("setSampleRelative", luaSetSampleRelative);
+    lua.registerFunction("getSampleRelative", luaGetSampleRelative);
+    lua.registerFunction("setListenerEnv", luaSetListenerEnv);
+    lua.registerFunction("setListenerPosition", luaSetListenerPosition);
+    lua.registerFunction("getListenerPosition", luaGetListenerPosition);
+    lua.registerFunction("setListenerOrientation", luaSetListenerOrientation);
+    lua.registerFunction("getListenerOrientation", luaGetListenerOrientation);
+	lua.registerFunction("getSoundContextsState", luaGetContextsState);
 }
 
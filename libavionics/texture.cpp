@@ -52,6 +52,7 @@ TextureManager::TextureManager()
 {
 	buffer = NULL;
 	bufLength = 0;
+	tracking = 0;
 }
 
 TextureManager::~TextureManager()
@@ -295,6 +296,8 @@ void TextureManager::unload(TexturePart *texturePart)
 
 	Texture *texture = texturePart->getTexture();
 	delete texturePart;
+	if (texture)
+		touch(texture->getId());
 
 	if (texture) {
 		for (PartsList::iterator i = partsLoaded.begin();
@@ -339,6 +342,43 @@ void TextureManager::setGraphicsCallbacks(struct SaslGraphicsCallbacks *callback
 }
 
 
+unsigned TextureManager::getVersion(int texId) const
+{
+	std::map<int, unsigned>::const_iterator i = versions.find(texId);
+	return i == versions.end() ? 0 : (*i).second;
+}
+
+
+int TextureManager::beginTracking()
+{
+	tracking++;
+	return (int)drawn.size();
+}
+
+
+void TextureManager::endTracking(int mark, std::vector<int> &ids)
+{
+	ids.clear();
+	if ((0 <= mark) && (mark < (int)drawn.size()))
+		ids.assign(drawn.begin() + mark, drawn.end());
+	std::sort(ids.begin(), ids.end());
+	ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+
+	// enclosing component still collects textures drawn by nested one
+	if (0 < tracking)
+		tracking--;
+	if (! tracking)
+		drawn.clear();
+}
+
+
+void TextureManager::resetTracking()
+{
+	tracking = 0;
+	drawn.clear();
+}
+
+
 /// Lua wrapper for texture manager
 static int luaLoadImage(lua_State *L)
 {
@@ -433,10 +473,12 @@ static int luaRecreateImage(lua_State *L)
 	SaslGraphicsCallbacks *graphics = avionics->getGraphics();
 	assert(graphics);
 
-	if (lua_isnumber(L, 1))
-		graphics->recreate_texture(graphics, (int)lua_tonumber(L, 1),
+	if (lua_isnumber(L, 1)) {
+		int texId = (int)lua_tonumber(L, 1);
+		graphics->recreate_texture(graphics, texId,
 		(int)lua_tonumber(L, 2), (int)lua_tonumber(L, 3));
-	else {
+		avionics->getTextureManager()->touch(texId);
+	} else {
 		if (lua_islightuserdata(L, 1)) {
 			TexturePart *part = (TexturePart*)lua_touserdata(L, 1);
 			if (!part)
@@ -446,6 +488,8 @@ static int luaRecreateImage(lua_State *L)
 			graphics->recreate_texture(graphics, part->getTexture()->getId(),
 				width, height);
 			part->getTexture()->setSize(width, height);
+			avionics->getTextureManager()->touch(
+				part->getTexture()->getId());
 		}
 	}
 
@@ -514,6 +558,9 @@ static int luaSetRenderTarget(lua_State *L)
 		clear = (bool)lua_tonumber(L, 1);
 	}
 
+	// content of render target is going to be replaced
+	avionics->getTextureManager()->touch(texId);
+
 	lua_pushboolean(L, 0 == graphics->set_render_target(graphics, texId, clear));
 	return 1;
 }
@@ -560,17 +607,63 @@ static int luaRestoreRenderTarget(lua_State *L)
 	return 0;
 }
 
+/// Start collecting textures drawn by component rendered with damage
+/// tracking.  Returns mark for endTextureTracking
+static int luaBeginTextureTracking(lua_State *L)
+{
+	TextureManager *textureManager = getAvionics(L)->getTextureManager();
+	lua_pushnumber(L, textureManager->beginTracking());
+	return 1;
+}
+
+
+/// Stop collecting textures.  Returns array of IDs of textures drawn
+/// since mark
+static int luaEndTextureTracking(lua_State *L)
+{
+	TextureManager *textureManager = getAvionics(L)->getTextureManager();
+	std::vector<int> ids;
+	textureManager->endTracking((int)lua_tonumber(L, 1), ids);
+
+	lua_createtable(L, (int)ids.size(), 0);
+	for (std::size_t i = 0; i < ids.size(); i++) {
+		lua_pushnumber(L, ids[i]);
+		lua_rawseti(L, -2, (int)i + 1);
+	}
+	return 1;
+}
+
+
+/// Drop textures tracking left by errors
+static int luaResetTextureTracking(lua_State *L)
+{
+	getAvionics(L)->getTextureManager()->resetTracking();
+	return 0;
+}
+
+
+/// Returns version of texture content by texture ID
+static int luaGetTextureVersion(lua_State *L)
+{
+	TextureManager *textureManager = getAvionics(L)->getTextureManager();
+	lua_pushnumber(L, textureManager->getVersion((int)lua_tonumber(L, 1)));
+	return 1;
+}
+
+
 void xa::exportTextureToLua(Luna &lua)
 {
-	lua_State *L = lua.getLua();
-
-	LUA_REGISTER(L, "getGLTexture", luaLoadImage);
-	LUA_REGISTER(L, "getTextureSize", luaGetTextureSize);
-	LUA_REGISTER(L, "loadImageFromMemory", luaLoadImageFromMemory);
-	LUA_REGISTER(L, "unloadImage", luaUnloadImage);
-	LUA_REGISTER(L, "recreateImage", luaRecreateImage);
-	LUA_REGISTER(L, "findImage", luaFindImage);
-	LUA_REGISTER(L, "setRenderTarget", luaSetRenderTarget);
-	LUA_REGISTER(L, "getNewRenderTargetID", luaGetNewRenderTargetID);
-	LUA_REGISTER(L, "restoreRenderTarget", luaRestoreRenderTarget);
+	lua.registerFunction("getGLTexture", luaLoadImage);
+	lua.registerFunction("getTextureSize", luaGetTextureSize);
+	lua.registerFunction("loadImageFromMemory", luaLoadImageFromMemory);
+	lua.registerFunction("unloadImage", luaUnloadImage);
+	lua.registerFunction("recreateImage", luaRecreateImage);
+	lua.registerFunction("findImage", luaFindImage);
+	lua.registerFunction("setRenderTarget", luaSetRenderTarget);
+	lua.registerFunction("getNewRenderTargetID", luaGetNewRenderTargetID);
+	lua.registerFunction("restoreRenderTarget", luaRestoreRenderTarget);
+	lua.registerFunction("beginTextureTracking", luaBeginTextureTracking);
+	lua.registerFunction("endTextureTracking", luaEndTextureTracking);
+	lua.registerFunction("resetTextureTracking", luaResetTextureTracking);
+	lua.registerFunction("getTextureVersion", luaGetTextureVersion);
 }
\ No newline at end of file
@@ -4,6 +4,7 @@
 #include <list>
 #include <map>
 #include <string>
+#include <vector>
 #include "luna.h"
 #include "libavcallbacks.h"
 
@@ -130,6 +131,15 @@ class TexturePart
 		/// list of texture parts loaded
 		PartsList partsLoaded;
 
+		/// Versions of textures content by texture ID
+		std::map<int, unsigned> versions;
+
+		/// IDs of textures drawn while tracking is enabled
+		std::vector<int> drawn;
+
+		/// Number of components collecting drawn textures
+		int tracking;
+
 	public:
 		/// Create texture manager
 		TextureManager();
@@ -176,6 +186,28 @@ class TexturePart
 		/// Returns graphics API
 		SaslGraphicsCallbacks* getGraphics() { return graphics; }
 
+		/// Mark content of texture changed
+		void touch(int texId) { versions[texId]++; }
+
+		/// Returns version of texture content
+		unsigned getVersion(int texId) const;
+
+		/// Remember texture drawn while tracking is enabled
+		void trackDrawn(int texId) {
+			if (tracking)
+				drawn.push_back(texId);
+		}
+
+		/// Start collecting drawn textures.  Returns mark for endTracking
+		int beginTracking();
+
+		/// Stop collecting textures started by beginTracking.
+		/// Returns IDs of textures drawn since mark, every ID once
+		void endTracking(int mark, std::vector<int> &ids);
+
+		/// Drop all tracking started by beginTracking
+		void resetTracking();
+
 	private:
 		/// Load image from memory.
 		Texture* loadImage(const unsigned char *buffer, std::size_t length);
@@ -0,0 +1,113 @@
+-- Benchmark panel of LuaJIT FFI fast path.
+--
+-- Every frame reads dataref and draws rectangles in loops, once through
+-- FFI wrappers bound by init.lua and once through classic C functions,
+-- and counts traces started and aborted by JIT compiler in each loop.
+-- Results are written to X-Plane log every few seconds.
+--
+-- usage: copy this file to aircraft directory as avionics.lua
+
+size = { 512, 256 }
+
+panel2d = true
+panelWidth2d = 512
+panelHeight2d = 256
+
+-- number of calls per loop and frame
+local CALLS = 2000
+
+-- number of frames between reports
+local REPORT_FRAMES = 300
+
+
+local elevation = findProp("sim/flightmodel/position/elevation", "double")
+
+-- every variant has its own loop, so JIT compiler records separate traces
+-- for them
+local ffiGetPropd = getPropd
+local classicGetPropd = classicFunctions.getPropd or getPropd
+local ffiDrawRectangle = drawRectangle
+local classicDrawRectangle = classicFunctions.drawRectangle or drawRectangle
+
+local variants = {
+    { name = "getPropd ffi", loop = function()
+        local sum = 0
+        for i = 1, CALLS do
+            sum = sum + ffiGetPropd(elevation, 0)
+        end
+        return sum
+    end },
+    { name = "getPropd C", loop = function()
+        local sum = 0
+        for i = 1, CALLS do
+            sum = sum + classicGetPropd(elevation, 0)
+        end
+        return sum
+    end },
+    { name = "drawRect ffi", loop = function()
+        for i = 1, CALLS do
+            ffiDrawRectangle(i % 500, 10, 2, 2, 0, 1, 0, 1)
+        end
+    end },
+    { name = "drawRect C", loop = function()
+        for i = 1, CALLS do
+            classicDrawRectangle(i % 500, 10, 2, 2, 0, 1, 0, 1)
+        end
+    end },
+}
+
+for _, v in ipairs(variants) do
+    v.time = 0
+    v.traces = 0
+    v.aborts = 0
+end
+
+
+-- variant running now, trace events are counted for it
+local current = nil
+
+if jit then
+    jit.attach(function(what)
+        if current then
+            if 'start' == what then
+                current.traces = current.traces + 1
+            elseif 'abort' == what then
+                current.aborts = current.aborts + 1
+            end
+        end
+    end, 'trace')
+end
+
+if not classicFunctions.getPropd then
+    logWarning("FFI functions aren't bound, both variants are classic")
+end
+
+
+local frames = 0
+
+local function report()
+    for _, v in ipairs(variants) do
+        logInfo(string.format("%-14s %7.1f ns/call, %i traces, %i aborts",
+                v.name, v.time * 1e9 / (frames * CALLS), v.traces, v.aborts))
+        v.time = 0
+        v.traces = 0
+        v.aborts = 0
+    end
+    frames = 0
+end
+
+
+function draw(self)
+    for _, v in ipairs(variants) do
+        current = v
+        local start = os.clock()
+        v.loop()
+        v.time = v.time + os.clock() - start
+        current = nil
+    end
+
+    frames = frames + 1
+    if REPORT_FRAMES <= frames then
+        report()
+    end
+end
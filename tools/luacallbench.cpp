@@ -0,0 +1,114 @@
+// Benchmark of Lua to C function call cost.
+//
+// Compares C functions finding avionics in registry table, as all
+// exported functions did before, with C closures reading it from
+// upvalue, as functions registered by Luna::registerFunction do.
+// Needs LuaJIT only, not simulator.
+//
+// usage: luacallbench [calls]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "luna.h"
+#include "rttimer.h"
+
+
+using namespace xa;
+
+
+/// Number of calls which found avionics
+static unsigned found = 0;
+
+
+/// Same lookup as findAvionics
+static Avionics* getRegistryAvionics(lua_State *lua)
+{
+    lua_getfield(lua, LUA_REGISTRYINDEX, "avionics");
+    Avionics *v = (Avionics*)lua_touserdata(lua, -1);
+    lua_pop(lua, 1);
+    return v;
+}
+
+
+static int luaRegistryCall(lua_State *L)
+{
+    if (getRegistryAvionics(L))
+        found++;
+    lua_pushnumber(L, lua_tonumber(L, 1));
+    return 1;
+}
+
+
+static int luaClosureCall(lua_State *L)
+{
+    if (getAvionics(L))
+        found++;
+    lua_pushnumber(L, lua_tonumber(L, 1));
+    return 1;
+}
+
+
+static int luaPlainCall(lua_State *L)
+{
+    lua_pushnumber(L, lua_tonumber(L, 1));
+    return 1;
+}
+
+
+/// Call function by name from Lua loop and print time per call
+static void benchCall(RtTimer &timer, lua_State *L, const char *name,
+        int calls)
+{
+    char script[256];
+    sprintf(script, "local f, s = %s, 0 "
+            "for i = 1, %i do s = s + f(i) end "
+            "return s", name, calls);
+    if (luaL_loadstring(L, script)) {
+        printf("%s: %s\n", name, lua_tostring(L, -1));
+        lua_pop(L, 1);
+        return;
+    }
+
+    found = 0;
+    double start = timer.getSeconds();
+    if (lua_pcall(L, 0, 1, 0)) {
+        printf("%s: %s\n", name, lua_tostring(L, -1));
+        lua_pop(L, 1);
+        return;
+    }
+    double time = timer.getSeconds() - start;
+    lua_pop(L, 1);
+
+    printf("%-8s %6.1f ns/call (%u of %i found avionics)\n", name,
+            time * 1e9 / calls, found, calls);
+}
+
+
+int main(int argc, char *argv[])
+{
+    int calls = 1 < argc ? atoi(argv[1]) : 10000000;
+    if (0 >= calls) {
+        printf("usage: luacallbench [calls]\n");
+        return 1;
+    }
+
+    lua_State *L = luaL_newstate();
+    luaL_openlibs(L);
+
+    // any non-NULL pointer will do, avionics is never dereferenced
+    Avionics *avionics = (Avionics*)&found;
+    lua_pushlightuserdata(L, avionics);
+    lua_setfield(L, LUA_REGISTRYINDEX, "avionics");
+
+    lua_register(L, "plain", luaPlainCall);
+    lua_register(L, "registry", luaRegistryCall);
+    lua_register_closure(L, "closure", luaClosureCall, avionics);
+
+    RtTimer timer;
+    benchCall(timer, L, "plain", calls);
+    benchCall(timer, L, "registry", calls);
+    benchCall(timer, L, "closure", calls);
+
+    lua_close(L);
+    return 0;
+}
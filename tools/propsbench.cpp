@@ -0,0 +1,339 @@
+// Benchmark of network properties transport.
+//
+// Measures encoding and parsing of NP3 values messages, consuming of
+// small messages from receive buffer, multicast frames over loopback
+// and shared memory segment.  Doesn't need simulator or Lua, only
+// networking code of libavionics is linked.
+//
+// usage: propsbench [properties] [frames]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#ifdef WINDOWS
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+#include "lownet.h"
+#include "libavcallbacks.h"
+#include "propsmcast.h"
+#include "propsshm.h"
+#include "rttimer.h"
+
+
+using namespace xa;
+
+
+/// Multicast group used for loopback test
+#define BENCH_MCAST_GROUP "239.255.42.99"
+
+/// UDP port of multicast group
+#define BENCH_MCAST_PORT 47199
+
+/// Number of frames between multicast keyframes
+#define BENCH_KEYFRAME_INTERVAL 60
+
+/// Size of datagram used to split stream for parser test
+#define BENCH_CHUNK_SIZE 1400
+
+
+// Only networking objects are linked, so log messages go to stderr
+// without logger of avionics.
+Log::Log()
+{
+    callback = NULL;
+    ref = NULL;
+    queue = NULL;
+}
+
+void Log::debug(const char*, ...) { }
+void Log::info(const char*, ...) { }
+void Log::warning(const char *message, ...)
+{
+    fprintf(stderr, "WARNING: %s\n", message);
+}
+void Log::error(const char *message, ...)
+{
+    fprintf(stderr, "ERROR: %s\n", message);
+}
+
+
+static void sleepMs(int ms)
+{
+#ifdef WINDOWS
+    Sleep(ms);
+#else
+    usleep(ms * 1000);
+#endif
+}
+
+
+/// Value of simulated property at frame.  Every tenth property changes
+/// each frame, others stay still like most of cockpit state
+static double getValue(int prop, int frame)
+{
+    if (prop % 10)
+        return prop * 0.25;
+    return prop * 0.25 + frame * 0.001;
+}
+
+
+static uint64_t getBits(double v)
+{
+    uint64_t bits;
+    memcpy(&bits, &v, sizeof(bits));
+    return bits;
+}
+
+
+/// Encode NP3 values message of all properties.
+/// \param delta send XOR of IEEE bits instead of raw values
+static void encodeValues(NetBuf &buf, int count, int frame, bool delta,
+        std::vector<uint64_t> &last)
+{
+    buf.addUint8(4);
+    buf.addVarint(count);
+    buf.addUint16(frame & 0xffff);
+    for (int i = 0; i < count; i++) {
+        double v = getValue(i, frame);
+        buf.addVarint(i + 1);
+        if (delta) {
+            uint64_t bits = getBits(v);
+            buf.addVarint64(bits ^ last[i]);
+            last[i] = bits;
+        } else
+            buf.addDouble(v);
+    }
+}
+
+
+/// Parse NP3 values message the same way client does, removing every
+/// value from buffer once parsed.  Returns checksum of values
+static double parseValues(NetBuf &buf, bool delta,
+        std::vector<uint64_t> &last)
+{
+    NetReader header(buf.getData(), buf.getFilled());
+    int command, serial;
+    unsigned count;
+    if (! (header.getUint8(command) && header.getVarint(count) &&
+                header.getUint16(serial)))
+        return 0;
+    buf.remove(header.getPos());
+
+    double sum = 0;
+    while (count && buf.getFilled()) {
+        NetReader reader(buf.getData(), buf.getFilled());
+        unsigned id;
+        if (! reader.getVarint(id))
+            break;
+        double v;
+        if (delta) {
+            uint64_t code;
+            if (! reader.getVarint64(code))
+                break;
+            last[id - 1] ^= code;
+            memcpy(&v, &last[id - 1], sizeof(v));
+        } else {
+            const unsigned char *data = reader.getBytes(8);
+            if (! data)
+                break;
+            v = netToDouble(data);
+        }
+        sum += v;
+        buf.remove(reader.getPos());
+        count--;
+    }
+    return sum;
+}
+
+
+static void benchCodec(RtTimer &timer, int props, int frames, bool delta)
+{
+    std::vector<uint64_t> sentLast(props, 0);
+    std::vector<uint64_t> recvLast(props, 0);
+    NetBuf buf;
+    double encodeTime = 0, parseTime = 0, bytes = 0, sum = 0;
+
+    for (int frame = 0; frame < frames; frame++) {
+        double start = timer.getSeconds();
+        encodeValues(buf, props, frame, delta, sentLast);
+        double encoded = timer.getSeconds();
+        bytes += buf.getFilled();
+        sum += parseValues(buf, delta, recvLast);
+        double parsed = timer.getSeconds();
+        encodeTime += encoded - start;
+        parseTime += parsed - encoded;
+    }
+
+    printf("np3 %-5s %5i props: %8.0f bytes/frame, encode %7.1f us, "
+            "parse %7.1f us (checksum %g)\n", delta ? "delta" : "raw",
+            props, bytes / frames, encodeTime * 1e6 / frames,
+            parseTime * 1e6 / frames, sum);
+}
+
+
+/// Receive stream of set requests in datagram sized chunks and consume
+/// them one message at a time
+static void benchParser(RtTimer &timer, int messages)
+{
+    NetBuf stream;
+    for (int i = 0; i < messages; i++) {
+        stream.addUint8(2);
+        stream.addVarint(i % 2000 + 1);
+        stream.addUint8(PROP_DOUBLE);
+        stream.addUint16(i & 0xffff);
+        stream.addDouble(i);
+    }
+
+    NetBuf buf;
+    size_t size = stream.getFilled();
+    int parsed = 0;
+    double start = timer.getSeconds();
+    for (size_t offset = 0; offset < size; offset += BENCH_CHUNK_SIZE) {
+        size_t len = offset + BENCH_CHUNK_SIZE < size ? BENCH_CHUNK_SIZE :
+            size - offset;
+        buf.add(stream.getData() + offset, len);
+        while (buf.getFilled()) {
+            NetReader reader(buf.getData(), buf.getFilled());
+            int command, type, serial;
+            unsigned id;
+            if (! (reader.getUint8(command) && reader.getVarint(id) &&
+                        reader.getUint8(type) && reader.getUint16(serial) &&
+                        reader.getBytes(getPropTypeSize(type))))
+                break;
+            buf.remove(reader.getPos());
+            parsed++;
+        }
+    }
+    double time = timer.getSeconds() - start;
+
+    printf("parser: %i messages, %.0f bytes, %.1f ms, %.1f MB/s, "
+            "%.0f ns/message\n", parsed, (double)size, time * 1e3,
+            size / time / 1e6, time * 1e9 / parsed);
+}
+
+
+/// Counts values received from multicast group
+class BenchHandler: public McastHandler
+{
+    public:
+        int values;
+
+        BenchHandler(): values(0) { }
+
+        virtual void onMcastValue(int, int, const unsigned char*, int) {
+            values++;
+        }
+};
+
+
+static void benchMcast(RtTimer &timer, int props, int frames)
+{
+    McastReceiver receiver;
+    McastPublisher publisher;
+    if (receiver.open(BENCH_MCAST_GROUP, BENCH_MCAST_PORT) ||
+            publisher.start(BENCH_MCAST_GROUP, BENCH_MCAST_PORT,
+                BENCH_KEYFRAME_INTERVAL))
+    {
+        printf("mcast: can't join group %s:%i, skipped\n",
+                BENCH_MCAST_GROUP, BENCH_MCAST_PORT);
+        return;
+    }
+
+    PropsSnapshot snapshot;
+    snapshot.applied = 0;
+    snapshot.values.resize(props);
+    for (int i = 0; i < props; i++) {
+        SnapshotValue &v = snapshot.values[i];
+        v.valid = true;
+        v.type = PROP_DOUBLE;
+        v.number = getValue(i, 0);
+        v.version = 1;
+    }
+
+    BenchHandler handler;
+    double publishTime = 0, receiveTime = 0;
+    for (int frame = 1; frame <= frames; frame++) {
+        for (int i = 0; i < props; i += 10) {
+            snapshot.values[i].number = getValue(i, frame);
+            snapshot.values[i].version = frame + 1;
+        }
+        double start = timer.getSeconds();
+        publisher.publish(snapshot);
+        double published = timer.getSeconds();
+        receiver.update(handler);
+        receiveTime += timer.getSeconds() - published;
+        publishTime += published - start;
+    }
+    // pick up datagrams still in flight
+    sleepMs(50);
+    receiver.update(handler);
+
+    printf("mcast %5i props: publish %7.1f us, receive %7.1f us, "
+            "%.1f datagrams/frame, %i of %i frames lost, %.0f values/frame\n",
+            props, publishTime * 1e6 / frames, receiveTime * 1e6 / frames,
+            receiver.getDatagrams() / frames, (int)receiver.getLost(),
+            frames, (double)handler.values / frames);
+}
+
+
+static void benchShm(RtTimer &timer, int props, int frames)
+{
+    ShmSegment server, client;
+    if (server.create(props) || client.open(server.getName(), props)) {
+        printf("shm: can't create segment, skipped\n");
+        return;
+    }
+
+    std::string empty;
+    ShmValue value;
+    unsigned acked;
+    double writeTime = 0, readTime = 0, sum = 0;
+    for (int frame = 0; frame < frames; frame++) {
+        double start = timer.getSeconds();
+        server.beginWrite();
+        for (int i = 0; i < props; i++)
+            server.writeValue(i, PROP_DOUBLE, getValue(i, frame), empty);
+        server.endWrite(frame);
+        double written = timer.getSeconds();
+        for (int i = 0; i < props; i++)
+            if (client.readValue(i, value, acked))
+                sum += value.number;
+        readTime += timer.getSeconds() - written;
+        writeTime += written - start;
+    }
+
+    printf("shm   %5i props: write %7.1f us, read %7.1f us "
+            "(checksum %g)\n", props, writeTime * 1e6 / frames,
+            readTime * 1e6 / frames, sum);
+}
+
+
+int main(int argc, char *argv[])
+{
+    int props = 1 < argc ? atoi(argv[1]) : 2000;
+    int frames = 2 < argc ? atoi(argv[2]) : 1000;
+    if ((0 >= props) || (0 >= frames)) {
+        printf("usage: propsbench [properties] [frames]\n");
+        return 1;
+    }
+
+#ifdef WINDOWS
+    WSADATA wsaData;
+    WSAStartup(MAKEWORD(2, 2), &wsaData);
+#endif
+
+    RtTimer timer;
+    benchCodec(timer, props, frames, false);
+    benchCodec(timer, props, frames, true);
+    benchParser(timer, props * frames);
+    benchMcast(timer, props, frames);
+    benchShm(timer, props, frames);
+
+#ifdef WINDOWS
+    WSACleanup();
+#endif
+    return 0;
+}
@@ -0,0 +1,237 @@
+// Benchmark of X-Plane properties backend.
+//
+// Measures cost of single property access through SaslPropsCallbacks
+// table of xap.  X-Plane data access API is replaced by stub below which
+// keeps values in memory, so measured time is overhead of properties
+// backend itself.  Doesn't need simulator or Lua.
+//
+// usage: xpropsbench [properties] [frames]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include "xpsdk.h"
+#include "props.h"
+#include "rttimer.h"
+
+
+using namespace xa;
+using namespace xap;
+
+
+/// Dataref of stub data access API
+struct StubDataRef
+{
+    /// X-Plane types of dataref
+    XPLMDataTypeID types;
+
+    /// value of dataref
+    double value;
+};
+
+
+/// Datarefs available to backend
+static std::vector<StubDataRef> dataRefs;
+
+/// Number of XPLMGetDataRefTypes calls
+static unsigned typeQueries = 0;
+
+
+/// Name of benchmark dataref
+static std::string getDataRefName(int index)
+{
+    char buf[64];
+    sprintf(buf, "sasl/bench/prop%i", index);
+    return buf;
+}
+
+
+/// Types of datarefs cycle the same way as in cockpit: mostly floats,
+/// then ints and doubles, some of them exported as several types
+static XPLMDataTypeID getDataRefTypes(int index)
+{
+    switch (index % 5) {
+        case 0: return xplmType_Int;
+        case 1: return xplmType_Double;
+        case 2: return xplmType_Float | xplmType_Double;
+        default: return xplmType_Float;
+    }
+}
+
+
+//
+// Stub X-Plane data access API
+//
+
+XPLMDataRef XPLMFindDataRef(const char *name)
+{
+    const char *prefix = "sasl/bench/prop";
+    size_t len = strlen(prefix);
+    if (strncmp(name, prefix, len))
+        return NULL;
+    int index = atoi(name + len);
+    if ((0 > index) || ((int)dataRefs.size() <= index))
+        return NULL;
+    return &dataRefs[index];
+}
+
+int XPLMCanWriteDataRef(XPLMDataRef)
+{
+    return 1;
+}
+
+int XPLMIsDataRefGood(XPLMDataRef ref)
+{
+    return NULL != ref;
+}
+
+XPLMDataTypeID XPLMGetDataRefTypes(XPLMDataRef ref)
+{
+    typeQueries++;
+    return ((StubDataRef*)ref)->types;
+}
+
+int XPLMGetDatai(XPLMDataRef ref)
+{
+    return (int)((StubDataRef*)ref)->value;
+}
+
+void XPLMSetDatai(XPLMDataRef ref, int value)
+{
+    ((StubDataRef*)ref)->value = value;
+}
+
+float XPLMGetDataf(XPLMDataRef ref)
+{
+    return (float)((StubDataRef*)ref)->value;
+}
+
+void XPLMSetDataf(XPLMDataRef ref, float value)
+{
+    ((StubDataRef*)ref)->value = value;
+}
+
+double XPLMGetDatad(XPLMDataRef ref)
+{
+    return ((StubDataRef*)ref)->value;
+}
+
+void XPLMSetDatad(XPLMDataRef ref, double value)
+{
+    ((StubDataRef*)ref)->value = value;
+}
+
+int XPLMGetDatavi(XPLMDataRef, int*, int, int)
+{
+    return 0;
+}
+
+void XPLMSetDatavi(XPLMDataRef, int*, int, int)
+{
+}
+
+int XPLMGetDatavf(XPLMDataRef, float*, int, int)
+{
+    return 0;
+}
+
+void XPLMSetDatavf(XPLMDataRef, float*, int, int)
+{
+}
+
+int XPLMGetDatab(XPLMDataRef, void*, int, int)
+{
+    return 0;
+}
+
+void XPLMSetDatab(XPLMDataRef, void*, int, int)
+{
+}
+
+XPLMDataRef XPLMRegisterDataAccessor(const char*, XPLMDataTypeID, int,
+        XPLMGetDatai_f, XPLMSetDatai_f, XPLMGetDataf_f, XPLMSetDataf_f,
+        XPLMGetDatad_f, XPLMSetDatad_f, XPLMGetDatavi_f, XPLMSetDatavi_f,
+        XPLMGetDatavf_f, XPLMSetDatavf_f, XPLMGetDatab_f, XPLMSetDatab_f,
+        void*, void*)
+{
+    return NULL;
+}
+
+void XPLMUnregisterDataAccessor(XPLMDataRef)
+{
+}
+
+XPLMPluginID XPLMFindPluginBySignature(const char*)
+{
+    return XPLM_NO_PLUGIN_ID;
+}
+
+void XPLMSendMessageToPlugin(XPLMPluginID, int, void*)
+{
+}
+
+
+/// Read all properties as type each frame
+static void benchGetters(RtTimer &timer, SaslProps props, int count,
+        int frames, int type)
+{
+    SaslPropsCallbacks *callbacks = getPropsCallbacks();
+    std::vector<SaslPropRef> refs(count);
+    for (int i = 0; i < count; i++)
+        refs[i] = callbacks->get_prop_ref(props,
+                getDataRefName(i).c_str(), type);
+
+    unsigned queries = typeQueries;
+    double sum = 0;
+    int err;
+    double start = timer.getSeconds();
+    for (int frame = 0; frame < frames; frame++)
+        for (int i = 0; i < count; i++)
+            switch (type) {
+                case PROP_INT:
+                    sum += callbacks->get_prop_int(refs[i], &err);
+                    break;
+                case PROP_FLOAT:
+                    sum += callbacks->get_prop_float(refs[i], &err);
+                    break;
+                default:
+                    sum += callbacks->get_prop_double(refs[i], &err);
+            }
+    double time = timer.getSeconds() - start;
+    double accesses = (double)count * frames;
+
+    printf("get %-6s %5i props: %6.1f ns/access, %.2f type queries/access "
+            "(checksum %g)\n", PROP_INT == type ? "int" :
+            (PROP_FLOAT == type ? "float" : "double"), count,
+            time * 1e9 / accesses, (typeQueries - queries) / accesses, sum);
+
+    for (int i = 0; i < count; i++)
+        callbacks->free_prop_ref(refs[i]);
+}
+
+
+int main(int argc, char *argv[])
+{
+    int props = 1 < argc ? atoi(argv[1]) : 5000;
+    int frames = 2 < argc ? atoi(argv[2]) : 1000;
+    if ((0 >= props) || (0 >= frames)) {
+        printf("usage: xpropsbench [properties] [frames]\n");
+        return 1;
+    }
+
+    dataRefs.resize(props);
+    for (int i = 0; i < props; i++) {
+        dataRefs[i].types = getDataRefTypes(i);
+        dataRefs[i].value = i * 0.25;
+    }
+
+    RtTimer timer;
+    SaslProps p = propsInit();
+    benchGetters(timer, p, props, frames, PROP_INT);
+    benchGetters(timer, p, props, frames, PROP_FLOAT);
+    benchGetters(timer, p, props, frames, PROP_DOUBLE);
+    propsDone(p);
+    return 0;
+}
@@ -1,5 +1,7 @@
 #include <list>
 #include <map>
+#include <deque>
+#include <vector>
 #include <string>
 #include <stdlib.h>
 #include <string.h>
@@ -18,8 +20,31 @@ using namespace xap;
 
 #define MSG_ADD_DATAREF 0x01000000
 
+/// Number of property handles allocated at once
+#define PROPS_SLAB_SIZE 256
+
+/// Initial number of buckets in property handles table
+#define PROPS_INITIAL_BUCKETS 64
+
 
 struct XPlaneProps;
+struct Property;
+
+
+/// Functions to access dataref of specific X-Plane type
+struct PropAccessors {
+    /// X-Plane type handled by accessors
+    XPLMDataTypeID type;
+
+    int (*getInt)(Property *prop, int *err);
+    void (*setInt)(Property *prop, int value);
+    float (*getFloat)(Property *prop, int *err);
+    void (*setFloat)(Property *prop, float value);
+    double (*getDouble)(Property *prop, int *err);
+    void (*setDouble)(Property *prop, double value);
+    int (*getString)(Property *prop, char *buf, int maxSize, int *err);
+    void (*setString)(Property *prop, const char *value);
+};
 
 
 /// Reference to X-Plane property 
@@ -32,6 +57,50 @@ struct Property {
 
     /// Link to properties structure
     XPlaneProps *parent;
+
+    /// true if property is writable
+    bool writable;
+
+    /// X-Plane types of dataref
+    XPLMDataTypeID types;
+
+    /// Accessors used to get and set property as int
+    const PropAccessors *intAccess;
+
+    /// Accessors used to get and set property as float
+    const PropAccessors *floatAccess;
+
+    /// Accessors used to get and set property as double
+    const PropAccessors *doubleAccess;
+
+    /// Accessors used to get and set property as string
+    const PropAccessors *stringAccess;
+
+    /// Name of property as requested by avionics including array index
+    std::string name;
+
+    /// Type of property requested by avionics
+    int type;
+
+    /// Hash of name and type
+    unsigned hash;
+
+    /// Number of references to this handle
+    int refs;
+
+    /// Index of last pending write of dataref in write queue or -1.
+    /// Shared by all handles of the same dataref
+    int pending;
+
+    /// Next handle of the same dataref requested with another type
+    /// or this handle.  Handles of dataref form ring
+    Property *sibling;
+
+    /// true if writes shouldn't be deferred till end of frame
+    bool immediate;
+
+    /// Next property in hash bucket or in list of free handles
+    Property *next;
 };
 
 
@@ -48,17 +117,36 @@ struct Value {
 
     /// property as string
     std::string stringValue;
+
+    /// property as array of ints
+    std::vector<int> intArrayValue;
+
+    /// property as array of floats
+    std::vector<float> floatArrayValue;
 };
 
 
-/// Self-created property
+/// Self-created property.  Value is stored in arena of property type
 struct CustomProperty
 {
     /// Reference to property for unregistering
     XPLMDataRef ref;
 
-    /// property value
-    Value data;
+    /// Name of property
+    std::string name;
+
+    /// Type of property
+    int type;
+
+    /// Index of value in arena of property type.
+    /// Index of first element for array properties
+    int index;
+
+    /// Number of elements of array property
+    int size;
+
+    /// Link to properties structure
+    XPlaneProps *parent;
 	
 	/// published in DRE
 	bool published;
@@ -82,66 +170,108 @@ struct FuncProperty
 };
 
 
-/// List of referneces to properties
-typedef std::list<Property*> PropsList;
+/// Property handles shared by all requests of the same name and type.
+/// Handles are allocated in slabs and reused via free list.
+struct PropsTable {
+    /// Hash buckets
+    std::vector<Property*> buckets;
+
+    /// Allocated slabs of handles
+    std::vector<Property*> slabs;
+
+    /// Unused handles
+    Property *freeList;
+
+    /// Number of handles in use
+    int live;
+
+    /// Max number of handles in use
+    int peak;
+};
+
+
+/// Self-created properties and their values.  Values of every type
+/// are stored in separate arrays, properties are never removed so
+/// indices are stable.
+struct CustomProps
+{
+    /// Properties.  Deque keeps addresses passed to X-Plane stable
+    std::deque<CustomProperty> props;
+
+    /// Hash index of props by name, -1 marks empty bucket
+    std::vector<int> index;
+
+    /// Values of int properties
+    std::vector<int> ints;
+
+    /// Values of float properties
+    std::vector<float> floats;
 
+    /// Values of double properties
+    std::vector<double> doubles;
 
-/// List of self-created properties
-typedef std::map<std::string, CustomProperty*> CustomPropsMap;
+    /// Values of string properties
+    std::vector<std::string> strings;
+
+    /// Elements of int array properties
+    std::vector<int> intArrays;
+
+    /// Elements of float array properties
+    std::vector<float> floatArrays;
+};
 
 /// List of functional properties
 typedef std::list<FuncProperty*> FuncPropsList;
 
 
 
-/// delayed set property value command
-struct SetPropCmd
+/// Value waiting to be written to property
+struct PendingWrite
 {
-    /// property reference
+    /// property reference or NULL if write was already done
     Property *property;
 
-    /// type of value
+    /// type of value.  PROP_INT_ARRAY and PROP_FLOAT_ARRAY means
+    /// range of array
     int type;
 
     /// value to set
     Value data;
-    
-    SetPropCmd(Property *prop, int value) {
-        property = prop;
-        type = PROP_INT;
-        data.intValue = value;
-    };
-
-    SetPropCmd(Property *prop, float value) {
-        property = prop;
-        type = PROP_FLOAT;
-        data.floatValue = value;
-    };
-    
-    SetPropCmd(Property *prop, double value) {
-        property = prop;
-        type = PROP_DOUBLE;
-        data.doubleValue = value;
-    };
-    
-    SetPropCmd(Property *prop, const std::string &value) {
-        property = prop;
-        type = PROP_STRING;
-        data.stringValue = value;
-    };
+
+    /// index of first element for array values
+    int offset;
 };
 
-/// List of set prop commands
-typedef std::list<struct SetPropCmd> PropsToSet;
+
+/// Property writes combined by property and done once per frame.
+/// Elements are reused between frames to keep memory allocated by
+/// strings and arrays
+struct WriteQueue
+{
+    /// pending writes, only first count elements are used
+    std::vector<PendingWrite> writes;
+
+    /// number of pending writes
+    int count;
+
+    /// number of set requests since last flush
+    int requested;
+
+    /// number of set requests before last flush
+    int lastRequested;
+
+    /// number of writes done by last flush
+    int lastFlushed;
+};
 
 
 /// X-Plane properties info
 struct XPlaneProps {
     /// References to properties
-    PropsList props;
+    PropsTable props;
 
     /// user created properties
-    CustomPropsMap customProps;
+    CustomProps customProps;
 
     /// user created callback properties
     FuncPropsList funcProps;
@@ -149,18 +279,37 @@ struct XPlaneProps {
     /// true if properties system was initialized
     bool initialized;
 
-    /// list of properties to set
-    PropsToSet propsToSet;
+    /// properties to set at end of frame
+    WriteQueue writes;
+
+    /// buffer for conversion of int arrays
+    std::vector<int> intBuf;
+
+    /// buffer for conversion of float arrays
+    std::vector<float> floatBuf;
 
     // ID of dataref editor plugin
     XPLMPluginID dataRefPlugin; 
 };
 
 
+static void bindProperty(Property *prop);
+static void unbindProperties(XPlaneProps *props);
+static void applyWrite(PendingWrite &write);
+
+
 /// Initialize properties structure
 SaslProps xap::propsInit()
 {
     XPlaneProps *props = new XPlaneProps;
+    props->props.buckets.resize(PROPS_INITIAL_BUCKETS, NULL);
+    props->props.freeList = NULL;
+    props->props.live = 0;
+    props->props.peak = 0;
+    props->writes.count = 0;
+    props->writes.requested = 0;
+    props->writes.lastRequested = 0;
+    props->writes.lastFlushed = 0;
     props->initialized = false;
     props->dataRefPlugin = XPLM_NO_PLUGIN_ID;
     return props;
@@ -174,8 +323,9 @@ void xap::propsDone(SaslProps props)
     if (! p)
         return;
 
-    for (PropsList::iterator i = p->props.begin(); i != p->props.end(); ++i)
-        delete *i;
+    for (std::vector<Property*>::iterator i = p->props.slabs.begin(); 
+            i != p->props.slabs.end(); ++i)
+        delete[] *i;
     
     for (FuncPropsList::iterator i = p->funcProps.begin(); 
             i != p->funcProps.end(); ++i)
@@ -184,12 +334,9 @@ void xap::propsDone(SaslProps props)
         delete *i;
     }
     
-    for (CustomPropsMap::iterator i = p->customProps.begin(); 
-            i != p->customProps.end(); ++i)
-    {
-        XPLMUnregisterDataAccessor((*i).second->ref);
-        delete (*i).second;
-    }
+    for (std::deque<CustomProperty>::iterator i = 
+            p->customProps.props.begin(); i != p->customProps.props.end(); ++i)
+        XPLMUnregisterDataAccessor((*i).ref);
 
     if (p)
         delete p;
@@ -208,6 +355,11 @@ void xap::funcPropsDone(SaslProps props)
         delete *i;
     }
     p->funcProps.clear();
+
+    // handles of functional properties stay interned but their datarefs
+    // have no accessors now.  createFuncProp registers them again, may be
+    // with another types
+    unbindProperties(p);
 }
 
 
@@ -230,6 +382,140 @@ static void cutArrayIndex(std::string &name, int &index)
 }
 
 
+/// FNV-1a hash of property name and type
+static unsigned hashProp(const char *name, int type)
+{
+    unsigned h = 2166136261u;
+    for (const unsigned char *c = (const unsigned char*)name; *c; c++)
+        h = (h ^ *c) * 16777619u;
+    return (h ^ (unsigned)type) * 16777619u;
+}
+
+
+/// Returns bucket of property handle with specified hash
+static Property** propsBucket(PropsTable &table, unsigned hash)
+{
+    return &table.buckets[hash & (table.buckets.size() - 1)];
+}
+
+
+/// Returns handle with same name and type or NULL if not found
+static Property* findHandle(PropsTable &table, const char *name, int type, 
+        unsigned hash)
+{
+    for (Property *prop = *propsBucket(table, hash); prop; prop = prop->next)
+        if ((prop->hash == hash) && (prop->type == type) && 
+                (prop->name == name))
+            return prop;
+    return NULL;
+}
+
+
+/// Double number of buckets if table is too loaded
+static void growTable(PropsTable &table)
+{
+    if (table.live < (int)table.buckets.size())
+        return;
+
+    std::vector<Property*> old;
+    old.swap(table.buckets);
+    table.buckets.resize(old.size() * 2, NULL);
+    for (std::vector<Property*>::iterator i = old.begin(); 
+            i != old.end(); ++i)
+    {
+        Property *prop = *i;
+        while (prop) {
+            Property *next = prop->next;
+            Property **bucket = propsBucket(table, prop->hash);
+            prop->next = *bucket;
+            *bucket = prop;
+            prop = next;
+        }
+    }
+}
+
+
+/// Take handle from free list.  Allocate new slab if free list is empty
+static Property* allocHandle(PropsTable &table)
+{
+    if (! table.freeList) {
+        Property *slab = new Property[PROPS_SLAB_SIZE];
+        table.slabs.push_back(slab);
+        for (int i = PROPS_SLAB_SIZE - 1; i >= 0; i--) {
+            slab[i].next = table.freeList;
+            table.freeList = slab + i;
+        }
+    }
+    Property *prop = table.freeList;
+    table.freeList = prop->next;
+    table.live++;
+    if (table.live > table.peak)
+        table.peak = table.live;
+    return prop;
+}
+
+
+/// Join ring of handles of the same dataref requested with other types,
+/// so writes through any handle are visible through others
+static void linkSibling(PropsTable &table, Property *prop)
+{
+    for (int type = PROP_INT; type <= PROP_FLOAT_ARRAY; type++) {
+        if (type == prop->type)
+            continue;
+        Property *other = findHandle(table, prop->name.c_str(), type, 
+                hashProp(prop->name.c_str(), type));
+        if (other && (other->ref == prop->ref) && 
+                (other->index == prop->index))
+        {
+            prop->sibling = other->sibling;
+            other->sibling = prop;
+            prop->pending = other->pending;
+            return;
+        }
+    }
+}
+
+
+/// Leave ring of handles of the same dataref.  Returns another handle
+/// of dataref or NULL
+static Property* unlinkSibling(Property *prop)
+{
+    if (prop->sibling == prop)
+        return NULL;
+
+    Property *before = prop->sibling;
+    while (before->sibling != prop)
+        before = before->sibling;
+    before->sibling = prop->sibling;
+    prop->sibling = prop;
+    return before;
+}
+
+
+/// Returns true if handles belong to the same dataref
+static bool isSibling(Property *prop, Property *other)
+{
+    Property *i = prop;
+    do {
+        if (i == other)
+            return true;
+        i = i->sibling;
+    } while (i != prop);
+    return false;
+}
+
+
+/// Set index of last pending write of all handles of dataref
+static void setPending(Property *prop, int pending)
+{
+    Property *i = prop;
+    do {
+        i->pending = pending;
+        i = i->sibling;
+    } while (i != prop);
+}
+
+
 /// Finds reference to property
 static SaslPropRef getPropRef(SaslProps props, const char *name, int type)
 {
@@ -237,6 +523,13 @@ static SaslPropRef getPropRef(SaslProps props, const char *name, int type)
     if (! (p && name))
         return NULL;
 
+    unsigned hash = hashProp(name, type);
+    Property *prop = findHandle(p->props, name, type, hash);
+    if (prop) {
+        prop->refs++;
+        return prop;
+    }
+
     int index = 0;
     XPLMDataRef ref = XPLMFindDataRef(name);
 
@@ -249,11 +542,24 @@ static SaslPropRef getPropRef(SaslProps props, const char *name, int type)
             return NULL;
     }
 
-    Property *prop = new Property;
+    growTable(p->props);
+    prop = allocHandle(p->props);
     prop->ref = ref;
     prop->index = index;
     prop->parent = p;
-    p->props.push_back(prop);
+    prop->name = name;
+    prop->type = type;
+    prop->hash = hash;
+    prop->refs = 1;
+    prop->pending = -1;
+    prop->immediate = false;
+    prop->sibling = prop;
+    bindProperty(prop);
+    linkSibling(p->props, prop);
+
+    Property **bucket = propsBucket(p->props, hash);
+    prop->next = *bucket;
+    *bucket = prop;
     return prop;
 }
 
@@ -269,522 +575,1121 @@ static void freePropRef(SaslPropRef property)
     if (! p)
         return;
 
-    for (PropsList::iterator i = p->props.begin(); i != p->props.end(); ++i)
-        if ((*i) == (Property*)prop) {
-            p->props.erase(i);
-            delete prop;
+    if (0 < --prop->refs)
+        return;
+
+    // property may have several queued writes of different array ranges.
+    // Freed property can be reused, so no write may refer to it.
+    // Writes are passed to another handle of dataref if there is one
+    Property *sibling = unlinkSibling(prop);
+    if (0 <= prop->pending) {
+        WriteQueue &queue = p->writes;
+        int last = prop->pending;
+        for (int i = 0; i <= last; i++)
+            if (queue.writes[i].property == prop) {
+                if (sibling)
+                    queue.writes[i].property = sibling;
+                else
+                    applyWrite(queue.writes[i]);
+            }
+        prop->pending = -1;
+    }
+
+    for (Property **i = propsBucket(p->props, prop->hash); *i; 
+            i = &(*i)->next)
+        if (*i == prop) {
+            *i = prop->next;
+            prop->name.clear();
+            prop->next = p->props.freeList;
+            p->props.freeList = prop;
+            p->props.live--;
             return;
         }
 }
 
 
-/// Returne value of property as integer
-static int getPropInt(SaslPropRef property, int *err)
+static int copyStr(char *dest, int maxSize, const std::string &src, int *err)
 {
-    if (err)
-        *err = 0;
-
-    Property *prop = (Property*)property;
-    if (! prop) {
-        if (err)
+    int len = src.length();
+    if (dest && maxSize) {
+        int flen = len + 1;
+        int toCopy = flen < maxSize ? flen : maxSize;
+        memcpy(dest, src.c_str(), toCopy);
+        dest[toCopy - 1] = 0;
+        if ((flen > maxSize) && (err))
             *err = 1;
-        return 0;
     }
+    return src.length();
+}
 
-    XPLMDataTypeID type = XPLMGetDataRefTypes(prop->ref);
-
-    if (xplmType_Int & type)
-        return XPLMGetDatai(prop->ref);
-    
-    if (xplmType_Float & type)
-        return (int)XPLMGetDataf(prop->ref);
-    
-    if (xplmType_Double & type)
-        return (int)XPLMGetDatad(prop->ref);
-
-    if (xplmType_IntArray & type) {
-        int val = 0;
-        XPLMGetDatavi(prop->ref, &val, prop->index, 1);
-        return val;
-    }
-    
-    if (xplmType_FloatArray & type) {
-        float val = 0;
-        XPLMGetDatavf(prop->ref, &val, prop->index, 1);
-        return (int)val;
-    }
 
-    if (xplmType_Data & type) {
-        int len = XPLMGetDatab(prop->ref, NULL, 0, 0);
-        if (0 < len) {
+/// Returns content of byte array dataref as string
+static std::string getDataString(Property *prop)
+{
+    int len = XPLMGetDatab(prop->ref, NULL, 0, 0);
+    if (0 >= len)
+        return std::string();
 #ifdef WINDOWS
-            char *buf = (char*)alloca(len + 1);
+    char *buf = (char*)alloca(len + 1);
 #else
-            char buf[len + 1];
+    char buf[len + 1];
 #endif
-            XPLMGetDatab(prop->ref, buf, 0, len);
-            buf[len] = 0;
-            return strToInt(buf);
-        } else
-            return 0;
-    }
-
-    if (err)
-        *err = 1;
-
-    return 0;
+    XPLMGetDatab(prop->ref, buf, 0, len);
+    buf[len] = 0;
+    return buf;
 }
 
 
-/// Sets value of property as integer
-/// Returns zero on cuccess or non-zero on error
-static int setPropInt(SaslPropRef property, int value)
-{
-    Property *prop = (Property*)property;
-    if (! prop)
-        return -1;
-    
-    XPlaneProps *props = prop->parent;
-    if (! props->initialized) 
-        props->propsToSet.push_back(SetPropCmd(prop, value));
+// Accessors of int datarefs
 
-    if (! XPLMCanWriteDataRef(prop->ref))
-        return -1;
+static int intGetInt(Property *prop, int *err) 
+{ 
+    return XPLMGetDatai(prop->ref); 
+}
 
-    XPLMDataTypeID type = XPLMGetDataRefTypes(prop->ref);
+static void intSetInt(Property *prop, int value) 
+{ 
+    XPLMSetDatai(prop->ref, value); 
+}
 
-    if (xplmType_Int & type) {
-        XPLMSetDatai(prop->ref, value);
-        return 0;
-    }
-    
-    if (xplmType_Float & type) {
-        XPLMSetDataf(prop->ref, (float)value);
-        return 0;
-    }
-    
-    if (xplmType_Double & type) {
-        XPLMSetDatad(prop->ref, (double)value);
-        return 0;
-    }
+static float intGetFloat(Property *prop, int *err) 
+{ 
+    return XPLMGetDatai(prop->ref); 
+}
 
-    if (xplmType_IntArray & type) {
-        XPLMSetDatavi(prop->ref, &value, prop->index, 1);
-        return 0;
-    }
-    
-    if (xplmType_FloatArray & type) {
-        float val = value;
-        XPLMSetDatavf(prop->ref, &val, prop->index, 1);
-        return 0;
-    }
+static void intSetFloat(Property *prop, float value) 
+{ 
+    XPLMSetDatai(prop->ref, (int)value); 
+}
 
-    if (xplmType_Data & type) {
-        std::string s = toString(value);
-        XPLMSetDatab(prop->ref, (void*)s.c_str(), 0, s.length() + 1);
-        return 0;
-    }
+static double intGetDouble(Property *prop, int *err) 
+{ 
+    return XPLMGetDatai(prop->ref); 
+}
 
-    return -2;
+static void intSetDouble(Property *prop, double value) 
+{ 
+    XPLMSetDatai(prop->ref, (int)value); 
 }
 
+static int intGetString(Property *prop, char *buf, int maxSize, int *err)
+{
+    return copyStr(buf, maxSize, toString(XPLMGetDatai(prop->ref)), err);
+}
 
-/// Returne value of property as float
-static float getPropFloat(SaslPropRef property, int *err)
+static void intSetString(Property *prop, const char *value)
 {
-    if (err)
-        *err = 0;
+    XPLMSetDatai(prop->ref, strToInt(value));
+}
 
-    Property *prop = (Property*)property;
-    if (! prop) {
-        if (err)
-            *err = 1;
-        return 0;
-    }
+static const PropAccessors intAccessors = { xplmType_Int, 
+    intGetInt, intSetInt, intGetFloat, intSetFloat, 
+    intGetDouble, intSetDouble, intGetString, intSetString };
 
-    XPLMDataTypeID type = XPLMGetDataRefTypes(prop->ref);
 
-    if (xplmType_Float & type)
-        return XPLMGetDataf(prop->ref);
-    
-    if (xplmType_Int & type)
-        return XPLMGetDatai(prop->ref);
-    
-    if (xplmType_Double & type)
-        return (float)XPLMGetDatad(prop->ref);
+// Accessors of float datarefs
 
-    if (xplmType_FloatArray & type) {
-        float val = 0;
-        XPLMGetDatavf(prop->ref, &val, prop->index, 1);
-        return val;
-    }
+static int floatGetInt(Property *prop, int *err) 
+{ 
+    return (int)XPLMGetDataf(prop->ref); 
+}
 
-    if (xplmType_IntArray & type) {
-        int val = 0;
-        XPLMGetDatavi(prop->ref, &val, prop->index, 1);
-        return val;
-    }
-    
-    if (xplmType_Data & type) {
-        int len = XPLMGetDatab(prop->ref, NULL, 0, 0);
-        if (0 < len) {
-#ifdef WINDOWS
-            char *buf = (char*)alloca(len + 1);
-#else
-            char buf[len + 1];
-#endif
-            XPLMGetDatab(prop->ref, buf, 0, len);
-            buf[len] = 0;
-            return strToFloat(buf);
-        } else
-            return 0;
-    }
-    
-    if (err)
-        *err = 1;
+static void floatSetInt(Property *prop, int value) 
+{ 
+    XPLMSetDataf(prop->ref, (float)value); 
+}
 
-    return 0;
+static float floatGetFloat(Property *prop, int *err) 
+{ 
+    return XPLMGetDataf(prop->ref); 
 }
 
+static void floatSetFloat(Property *prop, float value) 
+{ 
+    XPLMSetDataf(prop->ref, value); 
+}
 
-/// Sets value of property as float
-/// Returns zero on cuccess or non-zero on error
-static int setPropFloat(SaslPropRef property, float value)
+static double floatGetDouble(Property *prop, int *err) 
+{ 
+    return XPLMGetDataf(prop->ref); 
+}
+
+static void floatSetDouble(Property *prop, double value) 
+{ 
+    XPLMSetDataf(prop->ref, (float)value); 
+}
+
+static int floatGetString(Property *prop, char *buf, int maxSize, int *err)
 {
-    Property *prop = (Property*)property;
-    if (! prop)
-        return -1;
+    return copyStr(buf, maxSize, toString(XPLMGetDataf(prop->ref)), err);
+}
 
-    XPlaneProps *props = prop->parent;
-    if (! props->initialized) 
-        props->propsToSet.push_back(SetPropCmd(prop, value));
+static void floatSetString(Property *prop, const char *value)
+{
+    XPLMSetDataf(prop->ref, strToFloat(value));
+}
 
-    if (! XPLMCanWriteDataRef(prop->ref))
-        return -1;
+static const PropAccessors floatAccessors = { xplmType_Float,
+    floatGetInt, floatSetInt, floatGetFloat, floatSetFloat, 
+    floatGetDouble, floatSetDouble, floatGetString, floatSetString };
 
-    XPLMDataTypeID type = XPLMGetDataRefTypes(prop->ref);
 
-    if (xplmType_Float & type) {
-        XPLMSetDataf(prop->ref, value);
-        return 0;
-    }
-    
-    if (xplmType_Int & type) {
-        XPLMSetDatai(prop->ref, (int)value);
-        return 0;
-    }
-    
-    if (xplmType_Double & type) {
-        XPLMSetDatad(prop->ref, (double)value);
-        return 0;
-    }
+// Accessors of double datarefs
 
-    if (xplmType_FloatArray & type) {
-        XPLMSetDatavf(prop->ref, &value, prop->index, 1);
-        return 0;
-    }
+static int doubleGetInt(Property *prop, int *err) 
+{ 
+    return (int)XPLMGetDatad(prop->ref); 
+}
 
-    if (xplmType_IntArray & type) {
-        int val = (int)value;
-        XPLMSetDatavi(prop->ref, &val, prop->index, 1);
-        return 0;
-    }
+static void doubleSetInt(Property *prop, int value) 
+{ 
+    XPLMSetDatad(prop->ref, (double)value); 
+}
 
-    if (xplmType_Data & type) {
-        std::string s = toString(value);
-        XPLMSetDatab(prop->ref, (void*)s.c_str(), 0, s.length() + 1);
-        return 0;
-    }
-    
-    return -2;
+static float doubleGetFloat(Property *prop, int *err) 
+{ 
+    return (float)XPLMGetDatad(prop->ref); 
 }
 
-/// Returne value of property as double
-static double getPropDouble(SaslPropRef property, int *err)
-{
-    if (err)
-        *err = 0;
+static void doubleSetFloat(Property *prop, float value) 
+{ 
+    XPLMSetDatad(prop->ref, (double)value); 
+}
 
-    Property *prop = (Property*)property;
-    if (! prop) {
-        if (err)
-            *err = 1;
-        return 0;
+static double doubleGetDouble(Property *prop, int *err) 
+{ 
+    return XPLMGetDatad(prop->ref); 
+}
+
+static void doubleSetDouble(Property *prop, double value) 
+{ 
+    XPLMSetDatad(prop->ref, value); 
+}
+
+static int doubleGetString(Property *prop, char *buf, int maxSize, int *err)
+{
+    return copyStr(buf, maxSize, toString(XPLMGetDatad(prop->ref)), err);
+}
+
+static void doubleSetString(Property *prop, const char *value)
+{
+    XPLMSetDatad(prop->ref, strToDouble(value));
+}
+
+static const PropAccessors doubleAccessors = { xplmType_Double,
+    doubleGetInt, doubleSetInt, doubleGetFloat, doubleSetFloat, 
+    doubleGetDouble, doubleSetDouble, doubleGetString, doubleSetString };
+
+
+// Accessors of int array datarefs element
+
+static int intArrayGet(Property *prop)
+{
+    int val = 0;
+    XPLMGetDatavi(prop->ref, &val, prop->index, 1);
+    return val;
+}
+
+static void intArraySet(Property *prop, int value)
+{
+    XPLMSetDatavi(prop->ref, &value, prop->index, 1);
+}
+
+static int intArrayGetInt(Property *prop, int *err) 
+{ 
+    return intArrayGet(prop); 
+}
+
+static void intArraySetInt(Property *prop, int value) 
+{ 
+    intArraySet(prop, value); 
+}
+
+static float intArrayGetFloat(Property *prop, int *err) 
+{ 
+    return intArrayGet(prop); 
+}
+
+static void intArraySetFloat(Property *prop, float value) 
+{ 
+    intArraySet(prop, (int)value); 
+}
+
+static double intArrayGetDouble(Property *prop, int *err) 
+{ 
+    return intArrayGet(prop); 
+}
+
+static void intArraySetDouble(Property *prop, double value) 
+{ 
+    intArraySet(prop, (int)value); 
+}
+
+static int intArrayGetString(Property *prop, char *buf, int maxSize, int *err)
+{
+    return copyStr(buf, maxSize, toString(intArrayGet(prop)), err);
+}
+
+static void intArraySetString(Property *prop, const char *value)
+{
+    intArraySet(prop, strToInt(value));
+}
+
+static const PropAccessors intArrayAccessors = { xplmType_IntArray,
+    intArrayGetInt, intArraySetInt, intArrayGetFloat, intArraySetFloat, 
+    intArrayGetDouble, intArraySetDouble, intArrayGetString, 
+    intArraySetString };
+
+
+// Accessors of float array datarefs element
+
+static float floatArrayGet(Property *prop)
+{
+    float val = 0;
+    XPLMGetDatavf(prop->ref, &val, prop->index, 1);
+    return val;
+}
+
+static void floatArraySet(Property *prop, float value)
+{
+    XPLMSetDatavf(prop->ref, &value, prop->index, 1);
+}
+
+static int floatArrayGetInt(Property *prop, int *err) 
+{ 
+    return (int)floatArrayGet(prop); 
+}
+
+static void floatArraySetInt(Property *prop, int value) 
+{ 
+    floatArraySet(prop, (float)value); 
+}
+
+static float floatArrayGetFloat(Property *prop, int *err) 
+{ 
+    return floatArrayGet(prop); 
+}
+
+static void floatArraySetFloat(Property *prop, float value) 
+{ 
+    floatArraySet(prop, value); 
+}
+
+static double floatArrayGetDouble(Property *prop, int *err) 
+{ 
+    return floatArrayGet(prop); 
+}
+
+static void floatArraySetDouble(Property *prop, double value) 
+{ 
+    floatArraySet(prop, (float)value); 
+}
+
+static int floatArrayGetString(Property *prop, char *buf, int maxSize, 
+        int *err)
+{
+    return copyStr(buf, maxSize, toString(floatArrayGet(prop)), err);
+}
+
+static void floatArraySetString(Property *prop, const char *value)
+{
+    floatArraySet(prop, strToFloat(value));
+}
+
+static const PropAccessors floatArrayAccessors = { xplmType_FloatArray,
+    floatArrayGetInt, floatArraySetInt, floatArrayGetFloat, 
+    floatArraySetFloat, floatArrayGetDouble, floatArraySetDouble, 
+    floatArrayGetString, floatArraySetString };
+
+
+// Accessors of byte array datarefs
+
+static void dataSet(Property *prop, const std::string &value)
+{
+    XPLMSetDatab(prop->ref, (void*)value.c_str(), 0, value.length() + 1);
+}
+
+static int dataGetInt(Property *prop, int *err) 
+{ 
+    return strToInt(getDataString(prop)); 
+}
+
+static void dataSetInt(Property *prop, int value) 
+{ 
+    dataSet(prop, toString(value));
+}
+
+static float dataGetFloat(Property *prop, int *err) 
+{ 
+    return strToFloat(getDataString(prop)); 
+}
+
+static void dataSetFloat(Property *prop, float value) 
+{ 
+    dataSet(prop, toString(value));
+}
+
+static double dataGetDouble(Property *prop, int *err) 
+{ 
+    return strToDouble(getDataString(prop)); 
+}
+
+static void dataSetDouble(Property *prop, double value) 
+{ 
+    dataSet(prop, toString(value));
+}
+
+static int dataGetString(Property *prop, char *buf, int maxSize, int *err)
+{
+    int sz = XPLMGetDatab(prop->ref, NULL, 0, 0);
+    if (buf) {
+        int res = XPLMGetDatab(prop->ref, buf, 0, maxSize);
+        if (res < maxSize)
+            buf[res] = 0;
+        else
+            buf[maxSize - 1] = 0;
     }
+    return sz;
+}
+
+static void dataSetString(Property *prop, const char *value)
+{
+    XPLMSetDatab(prop->ref, (void*)value, 0, strlen(value) + 1);
+}
+
+static const PropAccessors dataAccessors = { xplmType_Data,
+    dataGetInt, dataSetInt, dataGetFloat, dataSetFloat, 
+    dataGetDouble, dataSetDouble, dataGetString, dataSetString };
+
+
+// Accessors of datarefs of unknown type.  They try to resolve type
+// and forward call to real accessors
+
+static int unboundGetInt(Property *prop, int *err) 
+{ 
+    bindProperty(prop);
+    if (prop->intAccess->type)
+        return prop->intAccess->getInt(prop, err);
+    if (err)
+        *err = 1;
+    return 0;
+}
+
+static void unboundSetInt(Property *prop, int value) 
+{ 
+    bindProperty(prop);
+    if (prop->intAccess->type)
+        prop->intAccess->setInt(prop, value);
+}
+
+static float unboundGetFloat(Property *prop, int *err) 
+{ 
+    bindProperty(prop);
+    if (prop->floatAccess->type)
+        return prop->floatAccess->getFloat(prop, err);
+    if (err)
+        *err = 1;
+    return 0;
+}
+
+static void unboundSetFloat(Property *prop, float value) 
+{ 
+    bindProperty(prop);
+    if (prop->floatAccess->type)
+        prop->floatAccess->setFloat(prop, value);
+}
+
+static double unboundGetDouble(Property *prop, int *err) 
+{ 
+    bindProperty(prop);
+    if (prop->doubleAccess->type)
+        return prop->doubleAccess->getDouble(prop, err);
+    if (err)
+        *err = 1;
+    return 0;
+}
+
+static void unboundSetDouble(Property *prop, double value) 
+{ 
+    bindProperty(prop);
+    if (prop->doubleAccess->type)
+        prop->doubleAccess->setDouble(prop, value);
+}
+
+static int unboundGetString(Property *prop, char *buf, int maxSize, int *err)
+{
+    bindProperty(prop);
+    if (prop->stringAccess->type)
+        return prop->stringAccess->getString(prop, buf, maxSize, err);
+    if (err)
+        *err = 1;
+    return 0;
+}
+
+static void unboundSetString(Property *prop, const char *value)
+{
+    bindProperty(prop);
+    if (prop->stringAccess->type)
+        prop->stringAccess->setString(prop, value);
+}
+
+static const PropAccessors unboundAccessors = { xplmType_Unknown,
+    unboundGetInt, unboundSetInt, unboundGetFloat, unboundSetFloat, 
+    unboundGetDouble, unboundSetDouble, unboundGetString, unboundSetString };
+
 
+/// Returns first accessors matching dataref type in order of preference
+static const PropAccessors* selectAccessors(XPLMDataTypeID type, 
+        const PropAccessors *a1, const PropAccessors *a2, 
+        const PropAccessors *a3, const PropAccessors *a4, 
+        const PropAccessors *a5, const PropAccessors *a6)
+{
+    const PropAccessors *order[] = { a1, a2, a3, a4, a5, a6 };
+    for (int i = 0; i < 6; i++)
+        if (type & order[i]->type)
+            return order[i];
+    return &unboundAccessors;
+}
+
+
+/// Query type of dataref and select accessors for every value type.
+/// Native accessor is preferred if dataref has several types.
+static void bindProperty(Property *prop)
+{
     XPLMDataTypeID type = XPLMGetDataRefTypes(prop->ref);
+    prop->writable = XPLMCanWriteDataRef(prop->ref);
+    prop->types = type;
+
+    prop->intAccess = selectAccessors(type, &intAccessors, &floatAccessors,
+            &doubleAccessors, &intArrayAccessors, &floatArrayAccessors,
+            &dataAccessors);
+    prop->floatAccess = selectAccessors(type, &floatAccessors, 
+            &intAccessors, &doubleAccessors, &floatArrayAccessors, 
+            &intArrayAccessors, &dataAccessors);
+    prop->doubleAccess = selectAccessors(type, &doubleAccessors, 
+            &floatAccessors, &intAccessors, &floatArrayAccessors, 
+            &intArrayAccessors, &dataAccessors);
+    prop->stringAccess = selectAccessors(type, &dataAccessors, 
+            &doubleAccessors, &floatAccessors, &intAccessors, 
+            &floatArrayAccessors, &intArrayAccessors);
+}
 
-    if (xplmType_Double & type)
-        return (float)XPLMGetDatad(prop->ref);
 
-    if (xplmType_Float & type)
-        return XPLMGetDataf(prop->ref);
-    
-    if (xplmType_Int & type)
-        return XPLMGetDatai(prop->ref);
-    
-    if (xplmType_FloatArray & type) {
-        float val = 0;
-        XPLMGetDatavf(prop->ref, &val, prop->index, 1);
-        return val;
+/// Forget types of all properties.  Types will be resolved again
+/// on next access
+static void unbindProperties(XPlaneProps *props)
+{
+    for (std::vector<Property*>::iterator i = props->props.buckets.begin(); 
+            i != props->props.buckets.end(); ++i)
+        for (Property *prop = *i; prop; prop = prop->next)
+            prop->intAccess = prop->floatAccess = prop->doubleAccess = 
+                prop->stringAccess = &unboundAccessors;
+}
+
+
+/// Write value to property without delay
+static int writeNow(Property *prop, int value)
+{
+    if (! prop->intAccess->type)
+        return -2;
+
+    prop->intAccess->setInt(prop, value);
+    return 0;
+}
+
+
+/// Write value to property without delay
+static int writeNow(Property *prop, float value)
+{
+    if (! prop->floatAccess->type)
+        return -2;
+
+    prop->floatAccess->setFloat(prop, value);
+    return 0;
+}
+
+
+/// Write value to property without delay
+static int writeNow(Property *prop, double value)
+{
+    if (! prop->doubleAccess->type)
+        return -2;
+
+    prop->doubleAccess->setDouble(prop, value);
+    return 0;
+}
+
+
+/// Write value to property without delay
+static int writeNow(Property *prop, const char *value)
+{
+    if (! prop->stringAccess->type)
+        return -2;
+
+    prop->stringAccess->setString(prop, value);
+    return 0;
+}
+
+
+/// Returns true if property can be written now or later.
+/// Properties are not checked until initialization because datarefs 
+/// may be registered by other plugins later.
+static bool canWrite(Property *prop)
+{
+    if (! prop->parent->initialized)
+        return true;
+
+    if (&unboundAccessors == prop->intAccess)
+        bindProperty(prop);
+
+    return prop->writable;
+}
+
+
+/// Returns queued write of property replacing previous write of same 
+/// kind.  Writes are combined by dataref, so last write wins whichever
+/// handle it was done through.  Writes of different array ranges are
+/// not combined.
+static PendingWrite& queueWrite(Property *prop, int type, int offset, 
+        int count)
+{
+    WriteQueue &queue = prop->parent->writes;
+    queue.requested++;
+
+    bool isArray = (PROP_INT_ARRAY == type) || (PROP_FLOAT_ARRAY == type);
+    if (0 <= prop->pending) {
+        PendingWrite &write = queue.writes[prop->pending];
+        if (! isArray) {
+            if ((PROP_INT_ARRAY != write.type) && 
+                    (PROP_FLOAT_ARRAY != write.type))
+            {
+                write.property = prop;
+                return write;
+            }
+        } else if ((write.type == type) && (write.offset == offset)) {
+            int size = (PROP_INT_ARRAY == type) ? 
+                write.data.intArrayValue.size() : 
+                write.data.floatArrayValue.size();
+            if (size == count) {
+                write.property = prop;
+                return write;
+            }
+        }
     }
 
-    if (xplmType_IntArray & type) {
-        int val = 0;
-        XPLMGetDatavi(prop->ref, &val, prop->index, 1);
-        return val;
+    if (queue.count == (int)queue.writes.size())
+        queue.writes.push_back(PendingWrite());
+    setPending(prop, queue.count);
+    PendingWrite &write = queue.writes[queue.count++];
+    write.property = prop;
+    write.offset = offset;
+    return write;
+}
+
+
+/// Returns true if writes to property are deferred till end of frame
+static bool deferWrite(Property *prop)
+{
+    return (! prop->parent->initialized) || (! prop->immediate);
+}
+
+
+/// Returns value of pending write.  Returns false if there is no
+/// pending scalar value
+template <typename T>
+static bool pendingValue(Property *prop, T &value)
+{
+    if (0 > prop->pending)
+        return false;
+
+    const PendingWrite &write = prop->parent->writes.writes[prop->pending];
+    switch (write.type) {
+        case PROP_INT: value = (T)write.data.intValue; return true;
+        case PROP_FLOAT: value = (T)write.data.floatValue; return true;
+        case PROP_DOUBLE: value = (T)write.data.doubleValue; return true;
     }
-    
-    if (xplmType_Data & type) {
-        int len = XPLMGetDatab(prop->ref, NULL, 0, 0);
-        if (0 < len) {
-#ifdef WINDOWS
-            char *buf = (char*)alloca(len + 1);
-#else
-            char buf[len + 1];
-#endif
-            XPLMGetDatab(prop->ref, buf, 0, len);
-            buf[len] = 0;
-            return strToDouble(buf);
-        } else
-            return 0;
+    return false;
+}
+
+
+/// Returne value of property as integer
+static int getPropInt(SaslPropRef property, int *err)
+{
+    if (err)
+        *err = 0;
+
+    Property *prop = (Property*)property;
+    if (! prop) {
+        if (err)
+            *err = 1;
+        return 0;
     }
+
+    int value;
+    if (pendingValue(prop, value))
+        return value;
+
+    return prop->intAccess->getInt(prop, err);
+}
+
+
+/// Sets value of property as integer
+/// Returns zero on cuccess or non-zero on error
+static int setPropInt(SaslPropRef property, int value)
+{
+    Property *prop = (Property*)property;
+    if (! prop)
+        return -1;
     
-    if (err)
-        *err = 1;
+    if (! canWrite(prop))
+        return -1;
 
+    if (! deferWrite(prop))
+        return writeNow(prop, value);
+
+    PendingWrite &write = queueWrite(prop, PROP_INT, 0, 1);
+    write.type = PROP_INT;
+    write.data.intValue = value;
     return 0;
 }
 
 
+/// Returne value of property as float
+static float getPropFloat(SaslPropRef property, int *err)
+{
+    if (err)
+        *err = 0;
+
+    Property *prop = (Property*)property;
+    if (! prop) {
+        if (err)
+            *err = 1;
+        return 0;
+    }
+
+    float value;
+    if (pendingValue(prop, value))
+        return value;
+
+    return prop->floatAccess->getFloat(prop, err);
+}
+
+
 /// Sets value of property as float
 /// Returns zero on cuccess or non-zero on error
-static int setPropDouble(SaslPropRef property, double value)
+static int setPropFloat(SaslPropRef property, float value)
 {
     Property *prop = (Property*)property;
     if (! prop)
         return -1;
-    
-    XPlaneProps *props = prop->parent;
-    if (! props->initialized) 
-        props->propsToSet.push_back(SetPropCmd(prop, value));
 
-    if (! XPLMCanWriteDataRef(prop->ref))
+    if (! canWrite(prop))
         return -1;
 
-    XPLMDataTypeID type = XPLMGetDataRefTypes(prop->ref);
+    if (! deferWrite(prop))
+        return writeNow(prop, value);
 
-    if (xplmType_Double & type) {
-        XPLMSetDatad(prop->ref, value);
-        return 0;
-    }
+    PendingWrite &write = queueWrite(prop, PROP_FLOAT, 0, 1);
+    write.type = PROP_FLOAT;
+    write.data.floatValue = value;
+    return 0;
+}
+
+/// Returne value of property as double
+static double getPropDouble(SaslPropRef property, int *err)
+{
+    if (err)
+        *err = 0;
 
-    if (xplmType_Float & type) {
-        XPLMSetDataf(prop->ref, (float)value);
+    Property *prop = (Property*)property;
+    if (! prop) {
+        if (err)
+            *err = 1;
         return 0;
     }
+
+    double value;
+    if (pendingValue(prop, value))
+        return value;
+
+    return prop->doubleAccess->getDouble(prop, err);
+}
+
+
+/// Sets value of property as float
+/// Returns zero on cuccess or non-zero on error
+static int setPropDouble(SaslPropRef property, double value)
+{
+    Property *prop = (Property*)property;
+    if (! prop)
+        return -1;
     
-    if (xplmType_Int & type) {
-        XPLMSetDatai(prop->ref, (int)value);
+    if (! canWrite(prop))
+        return -1;
+
+    if (! deferWrite(prop))
+        return writeNow(prop, value);
+
+    PendingWrite &write = queueWrite(prop, PROP_DOUBLE, 0, 1);
+    write.type = PROP_DOUBLE;
+    write.data.doubleValue = value;
+    return 0;
+}
+
+
+/// Returne value of property as string
+/// returns length of string
+static int getPropString(SaslPropRef property, char *buf, int maxSize, int *err)
+{
+    if (err)
+        *err = 0;
+
+    Property *prop = (Property*)property;
+    if (! prop) {
+        if (err)
+            *err = 1;
         return 0;
     }
+
+    if ((0 <= prop->pending) && 
+            (PROP_STRING == prop->parent->writes.writes[prop->pending].type))
+        return copyStr(buf, maxSize, 
+                prop->parent->writes.writes[prop->pending].data.stringValue, 
+                err);
+
+    return prop->stringAccess->getString(prop, buf, maxSize, err);
+}
+
+
+/// Sets value of property as string
+/// Returns zero on cuccess or non-zero on error
+static int setPropString(SaslPropRef property, const char *value)
+{
+    Property *prop = (Property*)property;
+    if ((! prop) || (! value))
+        return -1;
     
-    if (xplmType_FloatArray & type) {
-        float val = (float)value;
-        XPLMSetDatavf(prop->ref, &val, prop->index, 1);
-        return 0;
-    }
+    if (! canWrite(prop))
+        return -1;
+
+    if (! deferWrite(prop))
+        return writeNow(prop, value);
+
+    PendingWrite &write = queueWrite(prop, PROP_STRING, 0, 1);
+    write.type = PROP_STRING;
+    write.data.stringValue = value;
+    return 0;
+}
+
+
+/// Convert array of values to another type
+template <typename From, typename To>
+static void convertArray(const From *src, To *dest, int count)
+{
+    for (int i = 0; i < count; i++)
+        dest[i] = (To)src[i];
+}
 
-    if (xplmType_IntArray & type) {
-        int val = (int)value;
-        XPLMSetDatavi(prop->ref, &val, prop->index, 1);
-        return 0;
-    }
 
-    if (xplmType_Data & type) {
-        std::string s = toString(value);
-        XPLMSetDatab(prop->ref, (void*)s.c_str(), 0, s.length() + 1);
-        return 0;
-    }
-    
-    return -2;
+/// Copy elements of source array overlapping range of destination
+template <typename From, typename To>
+static void overlayRange(const std::vector<From> &src, int srcOffset, 
+        To *dest, int offset, int count)
+{
+    int from = srcOffset > offset ? srcOffset : offset;
+    int to = srcOffset + (int)src.size();
+    if (to > offset + count)
+        to = offset + count;
+    for (int i = from; i < to; i++)
+        dest[i - offset] = (To)src[i - srcOffset];
 }
 
 
-static int copyStr(char *dest, int maxSize, const std::string &src, int *err)
+/// Replace elements read from property by queued values in order of
+/// writes.  Scalar values look like array of single element
+template <typename T>
+static void pendingArray(Property *prop, T *values, int offset, int count)
 {
-    int len = src.length();
-    if (dest && maxSize) {
-        int flen = len + 1;
-        int toCopy = flen < maxSize ? flen : maxSize;
-        memcpy(dest, src.c_str(), toCopy);
-        dest[toCopy - 1] = 0;
-        if ((flen < maxSize) && (err))
-            *err = 1;
+    if (0 > prop->pending)
+        return;
+
+    WriteQueue &queue = prop->parent->writes;
+    for (int i = 0; i <= prop->pending; i++) {
+        const PendingWrite &write = queue.writes[i];
+        if (! (write.property && isSibling(write.property, prop)))
+            continue;
+        if ((PROP_INT_ARRAY == write.type) || 
+                (PROP_FLOAT_ARRAY == write.type))
+        {
+            if (PROP_INT_ARRAY == write.type)
+                overlayRange(write.data.intArrayValue, write.offset, 
+                        values, offset, count);
+            else
+                overlayRange(write.data.floatArrayValue, write.offset, 
+                        values, offset, count);
+        } else if ((! offset) && count) {
+            switch (write.type) {
+                case PROP_INT: values[0] = (T)write.data.intValue; break;
+                case PROP_FLOAT: values[0] = (T)write.data.floatValue; break;
+                case PROP_DOUBLE: values[0] = (T)write.data.doubleValue; break;
+            }
+        }
     }
-    return src.length();
 }
 
 
-/// Returne value of property as string
-/// returns length of string
-static int getPropString(SaslPropRef property, char *buf, int maxSize, int *err)
+/// Copy queued values over elements read from property
+static int withPending(Property *prop, int type, void *values, int offset,
+        int read)
+{
+    if (PROP_FLOAT == type)
+        pendingArray(prop, (float*)values, offset, read);
+    else
+        pendingArray(prop, (int*)values, offset, read);
+    return read;
+}
+
+
+/// Read range of array dataref.  Returns number of elements read
+/// or number of available elements if values is NULL.  Values written
+/// during frame are returned before they are flushed
+static int getPropArray(SaslPropRef property, int type, void *values, 
+        int offset, int count, int *err)
 {
     if (err)
         *err = 0;
 
     Property *prop = (Property*)property;
-    if (! prop) {
+    if ((! prop) || (0 > offset) || (0 > count) || 
+            ((PROP_INT != type) && (PROP_FLOAT != type))) 
+    {
         if (err)
             *err = 1;
         return 0;
     }
 
-    XPLMDataTypeID type = XPLMGetDataRefTypes(prop->ref);
-    
-    if (xplmType_Data & type) {
-        int sz = XPLMGetDatab(prop->ref, NULL, 0, 0);
-        if (buf) {
-            int res = XPLMGetDatab(prop->ref, buf, 0, maxSize);
-            if (res < maxSize)
-                buf[res] = 0;
-            else
-                buf[maxSize - 1] = 0;
+    if (&unboundAccessors == prop->intAccess)
+        bindProperty(prop);
+
+    XPlaneProps *p = prop->parent;
+    int first = prop->index + offset;
+
+    if (prop->types & (xplmType_FloatArray | xplmType_IntArray)) {
+        bool isFloat = prop->types & xplmType_FloatArray;
+        if (! values) {
+            int size = isFloat ? XPLMGetDatavf(prop->ref, NULL, 0, 0) :
+                XPLMGetDatavi(prop->ref, NULL, 0, 0);
+            return size > first ? size - first : 0;
+        }
+        int read;
+        if (isFloat && (PROP_FLOAT == type))
+            read = XPLMGetDatavf(prop->ref, (float*)values, first, count);
+        else if ((! isFloat) && (PROP_INT == type))
+            read = XPLMGetDatavi(prop->ref, (int*)values, first, count);
+        else if (isFloat) {
+            if ((int)p->floatBuf.size() < count)
+                p->floatBuf.resize(count);
+            read = XPLMGetDatavf(prop->ref, &p->floatBuf[0], first, count);
+            convertArray(&p->floatBuf[0], (int*)values, read);
+        } else {
+            if ((int)p->intBuf.size() < count)
+                p->intBuf.resize(count);
+            read = XPLMGetDatavi(prop->ref, &p->intBuf[0], first, count);
+            convertArray(&p->intBuf[0], (float*)values, read);
         }
-        return sz;
+        return withPending(prop, type, values, offset, read);
     }
-    
-    if (xplmType_Double & type)
-        return copyStr(buf, maxSize, toString(XPLMGetDatad(prop->ref)), err);
 
-    if (xplmType_Float & type)
-        return copyStr(buf, maxSize, toString(XPLMGetDataf(prop->ref)), err);
-    
-    if (xplmType_Int & type)
-        return copyStr(buf, maxSize, toString(XPLMGetDatai(prop->ref)), err);
-    
-    if (xplmType_FloatArray & type) {
-        float val = 0;
-        XPLMGetDatavf(prop->ref, &val, prop->index, 1);
-        return copyStr(buf, maxSize, toString(val), err);
-    }
+    // scalar property looks like array of single element
+    if (offset)
+        return 0;
+    if (! values)
+        return 1;
+    if (! count)
+        return 0;
+    if (PROP_FLOAT == type)
+        *(float*)values = prop->floatAccess->getFloat(prop, err);
+    else
+        *(int*)values = prop->intAccess->getInt(prop, err);
+    return withPending(prop, type, values, offset, 1);
+}
+
+
+/// Write range of array dataref without delay
+static int writeArrayNow(Property *prop, int type, const void *values, 
+        int offset, int count)
+{
+    if (&unboundAccessors == prop->intAccess)
+        bindProperty(prop);
+    if (! prop->writable)
+        return -1;
 
-    if (xplmType_IntArray & type) {
-        int val = 0;
-        XPLMGetDatavi(prop->ref, &val, prop->index, 1);
-        return copyStr(buf, maxSize, toString(val), err);
+    XPlaneProps *p = prop->parent;
+    int first = prop->index + offset;
+
+    if (prop->types & (xplmType_FloatArray | xplmType_IntArray)) {
+        bool isFloat = prop->types & xplmType_FloatArray;
+        if (isFloat && (PROP_FLOAT == type))
+            XPLMSetDatavf(prop->ref, (float*)values, first, count);
+        else if ((! isFloat) && (PROP_INT == type))
+            XPLMSetDatavi(prop->ref, (int*)values, first, count);
+        else if (isFloat && (PROP_INT == type)) {
+            if ((int)p->floatBuf.size() < count)
+                p->floatBuf.resize(count);
+            convertArray((const int*)values, &p->floatBuf[0], count);
+            XPLMSetDatavf(prop->ref, &p->floatBuf[0], first, count);
+        } else if ((! isFloat) && (PROP_FLOAT == type)) {
+            if ((int)p->intBuf.size() < count)
+                p->intBuf.resize(count);
+            convertArray((const float*)values, &p->intBuf[0], count);
+            XPLMSetDatavi(prop->ref, &p->intBuf[0], first, count);
+        } else
+            return -1;
+        return 0;
     }
-    
-    if (err)
-        *err = 1;
 
+    if (offset)
+        return -1;
+    if (PROP_FLOAT == type)
+        prop->floatAccess->setFloat(prop, *(const float*)values);
+    else if (PROP_INT == type)
+        prop->intAccess->setInt(prop, *(const int*)values);
+    else
+        return -1;
     return 0;
 }
 
 
-/// Sets value of property as string
+/// Write range of array dataref
 /// Returns zero on cuccess or non-zero on error
-static int setPropString(SaslPropRef property, const char *value)
+static int setPropArray(SaslPropRef property, int type, const void *values, 
+        int offset, int count)
 {
     Property *prop = (Property*)property;
-    if ((! prop) || (! value))
+    if ((! prop) || (! values) || (0 > offset) || (0 >= count) ||
+            ((PROP_INT != type) && (PROP_FLOAT != type)))
         return -1;
-    
-    XPlaneProps *props = prop->parent;
-    if (! props->initialized) 
-        props->propsToSet.push_back(SetPropCmd(prop, value));
 
-    if (! XPLMCanWriteDataRef(prop->ref))
+    if (! canWrite(prop))
         return -1;
 
-    XPLMDataTypeID type = XPLMGetDataRefTypes(prop->ref);
-
-    if (xplmType_Data & type) {
-        XPLMSetDatab(prop->ref, (void*)value, 0, strlen(value) + 1);
-        return 0;
+    if (! deferWrite(prop))
+        return writeArrayNow(prop, type, values, offset, count);
+
+    if (PROP_INT == type) {
+        PendingWrite &write = queueWrite(prop, PROP_INT_ARRAY, offset, count);
+        write.type = PROP_INT_ARRAY;
+        write.data.intArrayValue.assign((const int*)values, 
+                (const int*)values + count);
+    } else {
+        PendingWrite &write = queueWrite(prop, PROP_FLOAT_ARRAY, offset, 
+                count);
+        write.type = PROP_FLOAT_ARRAY;
+        write.data.floatArrayValue.assign((const float*)values, 
+                (const float*)values + count);
     }
+    return 0;
+}
 
-    if (xplmType_Double & type) {
-        XPLMSetDatad(prop->ref, strToDouble(value));
-        return 0;
-    }
 
-    if (xplmType_Float & type) {
-        XPLMSetDataf(prop->ref, strToFloat(value));
-        return 0;
-    }
-    
-    if (xplmType_Int & type) {
-        XPLMSetDatai(prop->ref, strToInt(value));
-        return 0;
-    }
-    
-    if (xplmType_FloatArray & type) {
-        float val = strToFloat(value);
-        XPLMSetDatavf(prop->ref, &val, prop->index, 1);
-        return 0;
-    }
+/// Write pending value to property
+static void applyWrite(PendingWrite &write)
+{
+    Property *prop = write.property;
+    if (! prop)
+        return;
+    write.property = NULL;
+    setPending(prop, -1);
 
-    if (xplmType_IntArray & type) {
-        int val = strToInt(value);
-        XPLMSetDatavi(prop->ref, &val, prop->index, 1);
-        return 0;
+    if (&unboundAccessors == prop->intAccess)
+        bindProperty(prop);
+    if (! prop->writable)
+        return;
+
+    switch (write.type) {
+        case PROP_INT: writeNow(prop, write.data.intValue); break;
+        case PROP_FLOAT: writeNow(prop, write.data.floatValue); break;
+        case PROP_DOUBLE: writeNow(prop, write.data.doubleValue); break;
+        case PROP_STRING: 
+            writeNow(prop, write.data.stringValue.c_str()); 
+            break;
+        case PROP_INT_ARRAY: 
+            writeArrayNow(prop, PROP_INT, &write.data.intArrayValue[0],
+                    write.offset, write.data.intArrayValue.size());
+            break;
+        case PROP_FLOAT_ARRAY: 
+            writeArrayNow(prop, PROP_FLOAT, &write.data.floatArrayValue[0],
+                    write.offset, write.data.floatArrayValue.size());
+            break;
     }
-    
-    return -2;
 }
 
 
-/// Returns value of custom int property
-static int readInt(void *refcon)
+/// Write all pending values in order of first write in frame.
+/// Values set by accessors called during flush are written too.
+static void flushWrites(XPlaneProps *props)
 {
-    CustomProperty *p = (CustomProperty*)refcon;
-    if (p) 
-        return p->data.intValue;
-    else
-        return 0;
+    WriteQueue &queue = props->writes;
+    int flushed = 0;
+    for (int i = 0; i < queue.count; i++) {
+        if (queue.writes[i].property)
+            flushed++;
+        applyWrite(queue.writes[i]);
+    }
+    queue.count = 0;
+    queue.lastRequested = queue.requested;
+    queue.lastFlushed = flushed;
+    queue.requested = 0;
 }
 
-/// Set value of custom int property
-static void writeInt(void *refcon, int value)
+
+/// Returns index of custom property with specified name or -1
+static int findCustomProp(CustomProps &custom, const char *name)
 {
-    CustomProperty *p = (CustomProperty*)refcon;
-    if (p) 
-        p->data.intValue = value;
+    if (custom.index.empty())
+        return -1;
+
+    size_t mask = custom.index.size() - 1;
+    for (size_t i = hashProp(name, 0) & mask; -1 != custom.index[i]; 
+            i = (i + 1) & mask)
+        if (custom.props[custom.index[i]].name == name)
+            return custom.index[i];
+    return -1;
 }
 
 
-// register property in dataref editor plugin
-static void registerProp(XPlaneProps *props, const char *name)
+/// Add property to hash index.  Index is kept less than half full
+static void indexCustomProp(CustomProps &custom, int prop)
 {
-    if (XPLM_NO_PLUGIN_ID != props->dataRefPlugin) {
-        CustomPropsMap::iterator i = props->customProps.find(name);
-        if (i != props->customProps.end())
-            XPLMSendMessageToPlugin(props->dataRefPlugin, MSG_ADD_DATAREF, 
-                    (void*)((*i).first.c_str()));
+    if (custom.index.size() < custom.props.size() * 2) {
+        custom.index.assign(custom.index.size() ? 
+                custom.index.size() * 2 : PROPS_INITIAL_BUCKETS, -1);
+        for (int i = 0; i < (int)custom.props.size(); i++)
+            if (i != prop)
+                indexCustomProp(custom, i);
     }
+
+    size_t mask = custom.index.size() - 1;
+    size_t i = hashProp(custom.props[prop].name.c_str(), 0) & mask;
+    while (-1 != custom.index[i])
+        i = (i + 1) & mask;
+    custom.index[i] = prop;
 }
 
 
-/// Create integer property
-static SaslPropRef createIntProp(XPlaneProps *props, const char *name, bool notPublish)
+/// Returns value of custom int property
+static int readInt(void *refcon)
 {
-    CustomProperty *prop = new CustomProperty;
-    prop->data.intValue = 0;
-	prop->published = !notPublish;
-    prop->ref = XPLMRegisterDataAccessor(name, xplmType_Int, 1, 
-            readInt, writeInt,
-            NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-            prop, prop);
-    if (! prop->ref) {
-        delete prop;
-        return NULL;
-    }
-    props->customProps[name] = prop;
-	if (!notPublish) {
-		registerProp(props, name);
-	}
-    return getPropRef(props, name, PROP_INT);
+    CustomProperty *p = (CustomProperty*)refcon;
+    return p ? p->parent->customProps.ints[p->index] : 0;
+}
+
+/// Set value of custom int property
+static void writeInt(void *refcon, int value)
+{
+    CustomProperty *p = (CustomProperty*)refcon;
+    if (p) 
+        p->parent->customProps.ints[p->index] = value;
 }
 
 
@@ -792,40 +1697,16 @@ static SaslPropRef createIntProp(XPlaneProps *props, const char *name, bool notP
 static float readFloat(void *refcon)
 {
     CustomProperty *p = (CustomProperty*)refcon;
-    if (p) 
-        return p->data.floatValue;
-    else
-        return 0;
+    return p ? p->parent->customProps.floats[p->index] : 0;
 }
 
 
-/// Set value of custom int property
+/// Set value of custom float property
 static void writeFloat(void *refcon, float value)
 {
     CustomProperty *p = (CustomProperty*)refcon;
     if (p) 
-        p->data.floatValue = value;
-}
-
-/// Create float property
-static SaslPropRef createFloatProp(XPlaneProps *props, const char *name, bool notPublish)
-{
-    CustomProperty *prop = new CustomProperty;
-    prop->data.floatValue = 0;
-	prop->published = !notPublish;
-    prop->ref = XPLMRegisterDataAccessor(name, xplmType_Float, 1, 
-            NULL, NULL, readFloat, writeFloat,
-            NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-            prop, prop);
-    if (! prop->ref) {
-        delete prop;
-        return NULL;
-    }
-    props->customProps[name] = prop;
-	if (!notPublish) {
-		registerProp(props, name);
-	}
-    return getPropRef(props, name, PROP_FLOAT);
+        p->parent->customProps.floats[p->index] = value;
 }
 
 
@@ -833,41 +1714,16 @@ static SaslPropRef createFloatProp(XPlaneProps *props, const char *name, bool no
 static double readDouble(void *refcon)
 {
     CustomProperty *p = (CustomProperty*)refcon;
-    if (p) 
-        return p->data.doubleValue;
-    else
-        return 0;
+    return p ? p->parent->customProps.doubles[p->index] : 0;
 }
 
 
-/// Set value of custom int property
+/// Set value of custom double property
 static void writeDouble(void *refcon, double value)
 {
     CustomProperty *p = (CustomProperty*)refcon;
     if (p) 
-        p->data.doubleValue = value;
-}
-
-
-/// Create double property
-static SaslPropRef createDoubleProp(XPlaneProps *props, const char *name, bool notPublish)
-{
-    CustomProperty *prop = new CustomProperty;
-    prop->data.doubleValue = 0;
-	prop->published = !notPublish;
-    prop->ref = XPLMRegisterDataAccessor(name, xplmType_Double, 1, 
-            NULL, NULL, NULL, NULL, readDouble, writeDouble,
-            NULL, NULL, NULL, NULL, NULL, NULL,
-            prop, prop);
-    if (! prop->ref) {
-        delete prop;
-        return NULL;
-    }
-    props->customProps[name] = prop;
-	if (!notPublish) {
-		registerProp(props, name);
-	}
-    return getPropRef(props, name, PROP_DOUBLE);
+        p->parent->customProps.doubles[p->index] = value;
 }
 
 
@@ -876,11 +1732,12 @@ static int readString(void *refcon, void *value, int offset, int maxSize)
 {
     CustomProperty *p = (CustomProperty*)refcon;
     if (p) {
-        int len = p->data.stringValue.length();
+        const std::string &str = p->parent->customProps.strings[p->index];
+        int len = str.length();
         if (value) {
             int sz = len + 1 - offset;
             int realSz = sz > maxSize ? maxSize : sz;
-            memcpy(value, p->data.stringValue.c_str() + offset, realSz);
+            memcpy(value, str.c_str() + offset, realSz);
             return realSz;
         } else
             return len + 1;
@@ -894,55 +1751,214 @@ static void writeString(void *refcon, void *value, int offset, int size)
 {
     CustomProperty *p = (CustomProperty*)refcon;
     if (p) {
+        std::string &str = p->parent->customProps.strings[p->index];
         if (! offset)
-            p->data.stringValue = std::string((const char*)value, size - 1);
+            str = std::string((const char*)value, size - 1);
         else 
-            p->data.stringValue = p->data.stringValue.substr(0, offset) + 
+            str = str.substr(0, offset) + 
                 std::string((const char*)value, size - 1);
     }
 }
 
-/// Create string property
-static SaslPropRef createStringProp(XPlaneProps *props, const char *name, 
-        int maxSize, bool notPublish)
+
+/// Copy elements of custom array property
+template <typename T>
+static int readArray(const T *data, int size, T *values, int offset, 
+        int max)
+{
+    if (! values)
+        return size;
+    if ((0 > offset) || (offset >= size) || (0 >= max))
+        return 0;
+    int count = size - offset < max ? size - offset : max;
+    memcpy(values, data + offset, count * sizeof(T));
+    return count;
+}
+
+
+/// Update elements of custom array property
+template <typename T>
+static void writeArray(T *data, int size, const T *values, int offset, 
+        int count)
+{
+    if ((! values) || (0 > offset) || (offset >= size) || (0 >= count))
+        return;
+    if (count > size - offset)
+        count = size - offset;
+    memcpy(data + offset, values, count * sizeof(T));
+}
+
+
+/// Returns values of custom int array property
+static int readIntArray(void *refcon, int *values, int offset, int max)
+{
+    CustomProperty *p = (CustomProperty*)refcon;
+    return p ? readArray(&p->parent->customProps.intArrays[p->index], 
+            p->size, values, offset, max) : 0;
+}
+
+
+/// Set values of custom int array property
+static void writeIntArray(void *refcon, int *values, int offset, int count)
+{
+    CustomProperty *p = (CustomProperty*)refcon;
+    if (p)
+        writeArray(&p->parent->customProps.intArrays[p->index], p->size, 
+                values, offset, count);
+}
+
+
+/// Returns values of custom float array property
+static int readFloatArray(void *refcon, float *values, int offset, int max)
+{
+    CustomProperty *p = (CustomProperty*)refcon;
+    return p ? readArray(&p->parent->customProps.floatArrays[p->index], 
+            p->size, values, offset, max) : 0;
+}
+
+
+/// Set values of custom float array property
+static void writeFloatArray(void *refcon, float *values, int offset, 
+        int count)
+{
+    CustomProperty *p = (CustomProperty*)refcon;
+    if (p)
+        writeArray(&p->parent->customProps.floatArrays[p->index], p->size, 
+                values, offset, count);
+}
+
+
+// register property in dataref editor plugin
+static void registerProp(XPlaneProps *props, const char *name)
+{
+    if (XPLM_NO_PLUGIN_ID != props->dataRefPlugin) {
+        int i = findCustomProp(props->customProps, name);
+        if (-1 != i)
+            XPLMSendMessageToPlugin(props->dataRefPlugin, MSG_ADD_DATAREF, 
+                    (void*)props->customProps.props[i].name.c_str());
+    }
+}
+
+
+/// Allocate value of custom property in arena of its type.
+/// Returns index of value or -1 if type is unknown
+static int allocCustomValue(CustomProps &custom, int type, int size)
+{
+    int index;
+    switch (type) {
+        case PROP_INT: 
+            custom.ints.push_back(0); 
+            return custom.ints.size() - 1;
+        case PROP_FLOAT: 
+            custom.floats.push_back(0); 
+            return custom.floats.size() - 1;
+        case PROP_DOUBLE: 
+            custom.doubles.push_back(0); 
+            return custom.doubles.size() - 1;
+        case PROP_STRING: 
+            custom.strings.push_back(std::string()); 
+            return custom.strings.size() - 1;
+        case PROP_INT_ARRAY: 
+            index = custom.intArrays.size();
+            custom.intArrays.resize(index + size, 0);
+            return index;
+        case PROP_FLOAT_ARRAY: 
+            index = custom.floatArrays.size();
+            custom.floatArrays.resize(index + size, 0);
+            return index;
+    }
+    return -1;
+}
+
+
+/// Create custom property of specified type.
+/// size is number of elements of array properties
+static SaslPropRef createCustomProp(XPlaneProps *props, const char *name, 
+        int type, int size, bool notPublish)
 {
-    CustomProperty *prop = new CustomProperty;
+    if (((PROP_INT_ARRAY == type) || (PROP_FLOAT_ARRAY == type)) && 
+            (0 >= size))
+        return NULL;
+
+    CustomProps &custom = props->customProps;
+    int index = allocCustomValue(custom, type, size);
+    if (-1 == index)
+        return NULL;
+
+    custom.props.push_back(CustomProperty());
+    CustomProperty *prop = &custom.props.back();
+    prop->name = name;
+    prop->type = type;
+    prop->index = index;
+    prop->size = size;
+    prop->parent = props;
 	prop->published = !notPublish;
-    prop->ref = XPLMRegisterDataAccessor(name, xplmType_Data, 1, 
-            NULL, NULL, NULL, NULL, NULL, NULL,
-            NULL, NULL, NULL, NULL, readString, writeString,
-            prop, prop);
+
+    switch (type) {
+        case PROP_INT:
+            prop->ref = XPLMRegisterDataAccessor(name, xplmType_Int, 1, 
+                    readInt, writeInt,
+                    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
+                    prop, prop);
+            break;
+        case PROP_FLOAT:
+            prop->ref = XPLMRegisterDataAccessor(name, xplmType_Float, 1, 
+                    NULL, NULL, readFloat, writeFloat,
+                    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
+                    prop, prop);
+            break;
+        case PROP_DOUBLE:
+            prop->ref = XPLMRegisterDataAccessor(name, xplmType_Double, 1, 
+                    NULL, NULL, NULL, NULL, readDouble, writeDouble,
+                    NULL, NULL, NULL, NULL, NULL, NULL,
+                    prop, prop);
+            break;
+        case PROP_STRING:
+            prop->ref = XPLMRegisterDataAccessor(name, xplmType_Data, 1, 
+                    NULL, NULL, NULL, NULL, NULL, NULL,
+                    NULL, NULL, NULL, NULL, readString, writeString,
+                    prop, prop);
+            break;
+        case PROP_INT_ARRAY:
+            prop->ref = XPLMRegisterDataAccessor(name, xplmType_IntArray, 1, 
+                    NULL, NULL, NULL, NULL, NULL, NULL,
+                    readIntArray, writeIntArray, NULL, NULL, NULL, NULL,
+                    prop, prop);
+            break;
+        case PROP_FLOAT_ARRAY:
+            prop->ref = XPLMRegisterDataAccessor(name, xplmType_FloatArray, 1,
+                    NULL, NULL, NULL, NULL, NULL, NULL,
+                    NULL, NULL, readFloatArray, writeFloatArray, NULL, NULL,
+                    prop, prop);
+            break;
+    }
+
     if (! prop->ref) {
-        delete prop;
+        // value stays in arena unused, it is small price for stable indices
+        custom.props.pop_back();
         return NULL;
     }
-    props->customProps[name] = prop;
+    indexCustomProp(custom, custom.props.size() - 1);
 	if (!notPublish) {
 		registerProp(props, name);
 	}
-    return getPropRef(props, name, PROP_STRING);
+    return getPropRef(props, name, type);
 }
 
+
 /// Create new property and returns reference to it.
 /// If property already exists just returns reference to it.
+/// maxSize is number of elements for array properties
 static SaslPropRef createProp(SaslProps props, const char *name, int type, int maxSize, bool notPublish)
 {
     XPlaneProps *p = (XPlaneProps*)props;
     if (! (p && name))
         return NULL;
     
-    CustomPropsMap::iterator i = p->customProps.find(name);
-    if (i != p->customProps.end())
+    if (-1 != findCustomProp(p->customProps, name))
         return getPropRef(p, name, type);
 
-    switch (type) {
-        case PROP_INT: return createIntProp(p, name, notPublish);
-        case PROP_FLOAT: return createFloatProp(p, name, notPublish);
-        case PROP_DOUBLE: return createDoubleProp(p, name, notPublish);
-        case PROP_STRING: return createStringProp(p, name, maxSize, notPublish);
-    }
-
-    return NULL;
+    return createCustomProp(p, name, type, maxSize, notPublish);
 }
 
 
@@ -953,26 +1969,16 @@ static int updateProps(SaslProps props)
 
     if (! p->initialized) {
         p->initialized = true;
-        for (PropsToSet::iterator i = p->propsToSet.begin(); 
-                i != p->propsToSet.end(); i++)
-        {
-            SetPropCmd &v = *i;
-            switch (v.type) {
-                case PROP_INT: setPropInt(v.property, v.data.intValue); break;
-                case PROP_FLOAT: setPropFloat(v.property, v.data.floatValue); break;
-                case PROP_DOUBLE: setPropDouble(v.property, v.data.doubleValue); break;
-                case PROP_STRING: setPropString(v.property, v.data.stringValue.c_str()); break;
-            }
-        }
-        p->propsToSet.clear();
+        flushWrites(p);
 
         p->dataRefPlugin = XPLMFindPluginBySignature("xplanesdk.examples.DataRefEditor");
         if (XPLM_NO_PLUGIN_ID != p->dataRefPlugin) {
-            for (CustomPropsMap::iterator i = p->customProps.begin(); 
-                    i != p->customProps.end(); i++) 
+            for (std::deque<CustomProperty>::iterator i = 
+                    p->customProps.props.begin(); 
+                    i != p->customProps.props.end(); i++) 
             {
-				if ((*i).second->published) {
-					registerProp(p, (*i).first.c_str());
+				if ((*i).published) {
+					registerProp(p, (*i).name.c_str());
 				}
             }
         }
@@ -1102,9 +2108,14 @@ static SaslPropRef createFuncProp(SaslProps props, const char *name,
 {
     XPlaneProps *p = (XPlaneProps*)props;
 
-    SaslPropRef propRef = getPropRef(props, name, type);
-    if (propRef)
-        return propRef;
+    // handle outlives functional property unregistered by funcPropsDone,
+    // so existing handle is reused only if dataref still has accessors
+    Property *prop = (Property*)getPropRef(props, name, type);
+    if (prop) {
+        if (XPLMIsDataRefGood(prop->ref))
+            return prop;
+        freePropRef(prop);
+    }
 
     FuncProperty *funcProp = new FuncProperty;
     funcProp->data = ref;
@@ -1136,14 +2147,74 @@ static SaslPropRef createFuncProp(SaslProps props, const char *name,
 
     p->funcProps.push_back(funcProp);
 
-    return getPropRef(props, name, type);
+    prop = (Property*)getPropRef(props, name, type);
+    if (prop && (prop->ref != funcProp->ref)) {
+        Property *i = prop;
+        do {
+            i->ref = funcProp->ref;
+            i->index = 0;
+            bindProperty(i);
+            i = i->sibling;
+        } while (i != prop);
+    }
+    return prop;
+}
+
+
+/// Write values set during frame
+static int flushProps(SaslProps props)
+{
+    XPlaneProps *p = (XPlaneProps*)props;
+    if (p && p->initialized)
+        flushWrites(p);
+    return 0;
+}
+
+
+/// Disable or enable deferred writes of property
+static void setPropImmediate(SaslPropRef property, int immediate)
+{
+    Property *prop = (Property*)property;
+    if (! prop)
+        return;
+
+    prop->immediate = immediate;
+    if (immediate && prop->parent->initialized && (0 <= prop->pending))
+        applyWrite(prop->parent->writes.writes[prop->pending]);
+}
+
+
+/// Report usage of property handles
+static void propsStats(SaslProps props, sasl_stat_callback report, void *ref)
+{
+    XPlaneProps *p = (XPlaneProps*)props;
+    if (! (p && report))
+        return;
+
+    report(ref, "handles.live", p->props.live);
+    report(ref, "handles.peak", p->props.peak);
+    report(ref, "handles.allocated", 
+            (double)p->props.slabs.size() * PROPS_SLAB_SIZE);
+    report(ref, "handles.buckets", (double)p->props.buckets.size());
+    report(ref, "writes.requested", p->writes.lastRequested);
+    report(ref, "writes.flushed", p->writes.lastFlushed);
+    report(ref, "writes.capacity", (double)p->writes.writes.size());
+
+    const CustomProps &c = p->customProps;
+    report(ref, "custom.count", (double)c.props.size());
+    report(ref, "custom.bytes", (double)(c.ints.size() * sizeof(int) + 
+            c.floats.size() * sizeof(float) + 
+            c.doubles.size() * sizeof(double) + 
+            c.intArrays.size() * sizeof(int) + 
+            c.floatArrays.size() * sizeof(float)));
 }
 
 
 static SaslPropsCallbacks callbacks = { getPropRef, freePropRef, createProp, 
         createFuncProp, getPropInt, setPropInt, getPropFloat, 
         setPropFloat, getPropDouble, setPropDouble, getPropString,
-        setPropString, updateProps, NULL };
+        setPropString, updateProps, NULL, propsStats, getPropArray,
+        setPropArray, flushProps, setPropImmediate };
 
 
 SaslPropsCallbacks* xap::getPropsCallbacks()